@@ -513,10 +513,10 @@ AC_DEFUN([SILK_AC_COMP_SHARED_OBJECT],[
 #
 AC_DEFUN([SILK_AC_FINALIZE],[
     # Add libraries to the default list
-    LIBS=`echo "${SNAPPY_LDFLAGS} ${LZO_LDFLAGS} ${ZLIB_LDFLAGS} ${LIBS}" | sed 's/   */ /g'`
+    LIBS=`echo "${LZ4_LDFLAGS} ${ZSTD_LDFLAGS} ${SNAPPY_LDFLAGS} ${LZO_LDFLAGS} ${ZLIB_LDFLAGS} ${LIBS}" | sed 's/   */ /g'`
 
     # Add include flags
-    SK_CPPFLAGS=`echo "${SK_CPPFLAGS} ${ZLIB_CFLAGS} ${LZO_CFLAGS} ${SNAPPY_CFLAGS} ${PCAP_CFLAGS}" | sed 's/   */ /g'`
+    SK_CPPFLAGS=`echo "${SK_CPPFLAGS} ${ZLIB_CFLAGS} ${LZO_CFLAGS} ${SNAPPY_CFLAGS} ${ZSTD_CFLAGS} ${LZ4_CFLAGS} ${PCAP_CFLAGS}" | sed 's/   */ /g'`
 
     # Define these after all tests have run; some system headers also
     # define these macros
@@ -875,7 +875,7 @@ AC_DEFUN([SILK_AC_ARG_ENABLE_OUTPUT_COMPRESSION],[
 
     AC_ARG_ENABLE([output-compression],
         [AS_HELP_STRING([--enable-output-compression],
-            [enable or set the default compression method for binary SiLK output files. Choices (subject to library availability): none, zlib, lzo1x, snappy. [none]])[]dnl
+            [enable or set the default compression method for binary SiLK output files. Choices (subject to library availability): none, zlib, lzo1x, snappy, zstd, lz4. [none]])[]dnl
         ],[[sk_output_comp="$enableval"]])
 
     case "$sk_output_comp" in
@@ -890,10 +890,18 @@ AC_DEFUN([SILK_AC_ARG_ENABLE_OUTPUT_COMPRESSION],[
             then
                 sk_output_comp=snappy
             fi
+            if test "x$ENABLE_LZ4" = "x1"
+            then
+                sk_output_comp=lz4
+            fi
             if test "x$ENABLE_LZO" = "x1"
             then
                 sk_output_comp=lzo1x
             fi
+            if test "x$ENABLE_ZSTD" = "x1"
+            then
+                sk_output_comp=zstd
+            fi
             ;;
         no|none)
             sk_output_comp=none
@@ -916,6 +924,18 @@ AC_DEFUN([SILK_AC_ARG_ENABLE_OUTPUT_COMPRESSION],[
                 AC_MSG_ERROR([output-compression=$sk_output_comp is not available because snappy was not found])
             fi
             ;;
+        zstd)
+            if test "x$ENABLE_ZSTD" != "x1"
+            then
+                AC_MSG_ERROR([output-compression=$sk_output_comp is not available because zstd was not found])
+            fi
+            ;;
+        lz4)
+            if test "x$ENABLE_LZ4" != "x1"
+            then
+                AC_MSG_ERROR([output-compression=$sk_output_comp is not available because lz4 was not found])
+            fi
+            ;;
         *)
             AC_MSG_ERROR([output-compression=$sk_output_comp is not valid])
             ;;
@@ -1645,6 +1665,34 @@ AC_DEFUN([SILK_AC_WRITE_SUMMARY],[
     * SNAPPY support:               NO"
     fi
 
+    if test "x$ENABLE_ZSTD" = "x1"
+    then
+        sk_msg_ldflags=`echo "$ZSTD_LDFLAGS" | sed 's/^ *//' | sed 's/ *$//' | sed 's/  */ /g'`
+        if test -n "$sk_msg_ldflags"
+        then
+            sk_msg_ldflags=" ($sk_msg_ldflags)"
+        fi
+        SILK_FINAL_MSG="$SILK_FINAL_MSG
+    * ZSTD support:                 YES$sk_msg_ldflags"
+    else
+        SILK_FINAL_MSG="$SILK_FINAL_MSG
+    * ZSTD support:                 NO"
+    fi
+
+    if test "x$ENABLE_LZ4" = "x1"
+    then
+        sk_msg_ldflags=`echo "$LZ4_LDFLAGS" | sed 's/^ *//' | sed 's/ *$//' | sed 's/  */ /g'`
+        if test -n "$sk_msg_ldflags"
+        then
+            sk_msg_ldflags=" ($sk_msg_ldflags)"
+        fi
+        SILK_FINAL_MSG="$SILK_FINAL_MSG
+    * LZ4 support:                  YES$sk_msg_ldflags"
+    else
+        SILK_FINAL_MSG="$SILK_FINAL_MSG
+    * LZ4 support:                  NO"
+    fi
+
     if test "x$ENABLE_PCAP" = "x1"
     then
         sk_msg_ldflags=`echo "$PCAP_LDFLAGS" | sed 's/^ *//' | sed 's/ *$//' | sed 's/  */ /g'`
@@ -1890,6 +1938,22 @@ AC_DEFUN([SILK_RPM_SPEC_SUBST],[
         RPM_SPEC_CONFIGURE="$RPM_SPEC_CONFIGURE --without-snappy"
     fi
 
+    if test "x$ENABLE_ZSTD" = "x1"
+    then
+        RPM_SPEC_REQUIRES="$RPM_SPEC_REQUIRES libzstd,"
+        RPM_SPEC_BUILDREQUIRES="$RPM_SPEC_BUILDREQUIRES libzstd-devel,"
+    else
+        RPM_SPEC_CONFIGURE="$RPM_SPEC_CONFIGURE --without-zstd"
+    fi
+
+    if test "x$ENABLE_LZ4" = "x1"
+    then
+        RPM_SPEC_REQUIRES="$RPM_SPEC_REQUIRES lz4,"
+        RPM_SPEC_BUILDREQUIRES="$RPM_SPEC_BUILDREQUIRES lz4-devel,"
+    else
+        RPM_SPEC_CONFIGURE="$RPM_SPEC_CONFIGURE --without-lz4"
+    fi
+
     if test "x$ENABLE_PCAP" = "x1"
     then
         RPM_SPEC_REQUIRES="$RPM_SPEC_REQUIRES libpcap,"
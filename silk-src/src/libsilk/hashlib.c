@@ -26,6 +26,13 @@ RCSIDENT("$SiLK: hashlib.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 #define TRC_ARG(v_v)    __LINE__, (void *)(v_v)
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HASH_USE_SSE2 1
+#else
+#define HASH_USE_SSE2 0
+#endif
+
 
 /* Configuration */
 
@@ -116,6 +123,26 @@ int32_t SECONDARY_BLOCK_FRACTION = -3;
  */
 #define HASHLIB_ENV_MAXMEM      "SILK_HASH_MAXMEM"
 
+/*
+ *    Environment variable that overrides the type of table requested
+ *    by the caller.  See hashlib_create_table().
+ */
+#define HASHLIB_ENV_GROUPPROBE  "SILK_HASH_GROUPPROBE"
+
+/*
+ *    For a table that uses group probing, the number of entries
+ *    whose tags are compared at once.  Must be a power of 2 that
+ *    evenly divides MIN_BLOCK_ENTRIES.
+ */
+#define HASH_GROUP_WIDTH    16
+
+/*
+ *    For a table that uses group probing, the tag of an empty entry.
+ *    The tag of an occupied entry is the top 7 bits of its hash, so
+ *    only an empty entry has the high bit set.
+ */
+#define HASH_TAG_EMPTY      0x80
+
 /* Distinguished values for block index in the iterator */
 #define HASH_ITER_BEGIN -1
 #define HASH_ITER_END -2
@@ -127,6 +154,9 @@ int32_t SECONDARY_BLOCK_FRACTION = -3;
 struct HashBlock_st {
     /* Pointer to an array of variable-sized entries */
     uint8_t            *data_ptr;
+    /* Pointer to an array holding the tag of each entry when the
+     * table uses group probing; NULL otherwise */
+    uint8_t            *tag_ptr;
     /* The table that owns this block */
     const HashTable    *table;
     /* Total capacity of this block as a number of entries */
@@ -158,6 +188,8 @@ struct HashTable_st {
     uint8_t             is_sorted;
     /**  Non-zero if we can memset new memory to a value */
     uint8_t             can_memset_val;
+    /**  Non-zero if the blocks use group probing (HTT_GROUPPROBE) */
+    uint8_t             group_probe;
     /**  Maximum number of entries the initial block may store */
     uint64_t            max_init_entry;
     /**  Size of key; used as cmp_userdata by hashlib_sort_entries() */
@@ -260,10 +292,15 @@ hashlib_create_block(
 static void
 hashlib_free_block(
     HashBlock          *block_ptr);
+static uint64_t
+hashlib_hash_key(
+    const HashTable    *table_ptr,
+    const uint8_t      *key_ptr);
 static int
 hashlib_block_find_entry(
     const HashBlock    *block_ptr,
     const uint8_t      *key_ptr,
+    uint64_t            hash_value,
     uint8_t           **entry_pptr);
 static int
 hashlib_iterate_sorted(
@@ -374,6 +411,38 @@ hashlib_compute_max_initial_entries(
 #define HASH_VALUE_AT(blk_ptr, hash_index)                              \
     HASHENTRY_GET_VALUE((blk_ptr), HASH_ENTRY_AT((blk_ptr), (hash_index)))
 
+/*
+ *    Return the tag to store for an entry whose hash is 'hash_value'
+ *    in a table that uses group probing.
+ */
+#define HASH_TAG_FROM_HASH(hash_value)          \
+    ((uint8_t)((hash_value) >> 57))
+
+/*
+ *    Record the tag for the entry at 'entry_ptr' in 'blk_ptr', which
+ *    must be a HashBlock, when the block uses group probing.
+ */
+#define HASH_BLOCK_SET_TAG(blk_ptr, entry_ptr, hash_value)              \
+    do {                                                                \
+        if ((blk_ptr)->tag_ptr) {                                       \
+            (blk_ptr)->tag_ptr[(((entry_ptr) - (blk_ptr)->data_ptr)     \
+                                / HASH_GET_ENTRY_LEN(blk_ptr))]         \
+                = HASH_TAG_FROM_HASH(hash_value);                       \
+        }                                                               \
+    } while(0)
+
+/*
+ *    Return the position of the least significant bit that is set
+ *    in 'lb_bits', which must not be 0.
+ */
+#if defined(__GNUC__)
+#define HASH_LOWEST_BIT(lb_bits)                \
+    ((unsigned int)__builtin_ctz(lb_bits))
+#else
+#define HASH_LOWEST_BIT(lb_bits)                \
+    hashlib_lowest_bit(lb_bits)
+#endif
+
 /*
  *    Increment the value of 'member' in the hashlib_stats structure
  *    for 'tbl_blk_ptr', which may be a HashTable or a HashBlock.
@@ -415,6 +484,7 @@ hashlib_create_table(
     HashTable *table_ptr = NULL;
     HashBlock *block_ptr = NULL;
     uint64_t initial_entries;
+    const char *env;
 
     /* Validate arguments */
     if (0 == key_len || 0 == value_len) {
@@ -438,13 +508,24 @@ hashlib_create_table(
     table_ptr->value_len = value_len;
     table_ptr->load_factor = load_factor;
 
+    /* Determine whether to use group probing; the environment
+     * overrides the caller's choice */
+    env = getenv(HASHLIB_ENV_GROUPPROBE);
+    if (env && *env) {
+        table_ptr->group_probe = (0 != strcmp(env, "0"));
+        if (table_ptr->group_probe && DEFAULT_LOAD_FACTOR == load_factor) {
+            table_ptr->load_factor = HASHLIB_GROUPPROBE_LOAD_FACTOR;
+        }
+    } else {
+        table_ptr->group_probe = (HTT_GROUPPROBE == value_type);
+    }
+
     TRACEMSG(3,
              (TRC_FMT "key_len %u, value_len %u, entry_len %u, load_factor %u",
               TRC_ARG(table_ptr), key_len, value_len,
-              key_len + value_len, load_factor));
+              key_len + value_len, table_ptr->load_factor));
 
     /* Application data */
-    SK_UNUSED_PARAM(value_type);
     SK_UNUSED_PARAM(appdata_ptr);
     SK_UNUSED_PARAM(appdata_size);
 
@@ -606,6 +687,19 @@ hashlib_create_block(
                     TRC_ARG(table_ptr)));
         return NULL;
     }
+    if (!table_ptr->group_probe) {
+        block_ptr->tag_ptr = NULL;
+    } else {
+        block_ptr->tag_ptr = (uint8_t*)malloc(block_entries);
+        if (block_ptr->tag_ptr == NULL) {
+            free(block_ptr->data_ptr);
+            free(block_ptr);
+            TRACEMSG(1,(TRC_FMT "Failed to allocate new tag array.",
+                        TRC_ARG(table_ptr)));
+            return NULL;
+        }
+        memset(block_ptr->tag_ptr, HASH_TAG_EMPTY, block_entries);
+    }
 
     block_ptr->table = table_ptr;
     block_ptr->max_entries = block_entries;
@@ -644,6 +738,7 @@ hashlib_free_block(
 {
     /* Free the data and the block itself */
     assert(block_ptr);
+    free(block_ptr->tag_ptr);
     free(block_ptr->data_ptr);
     free(block_ptr);
 }
@@ -665,6 +760,7 @@ hashlib_rehash(
     const uint8_t *val_ref;
     uint8_t *entry_ptr;
     uint8_t *new_entry_ptr;
+    uint64_t hash_value;
     int rv;
     unsigned int k;
     uint64_t i;
@@ -754,8 +850,9 @@ hashlib_rehash(
 
             /* If not empty, then copy the entry into the new block */
             if (!HASH_VALUE_ISEMPTY(block_ptr, val_ref)) {
-                rv = hashlib_block_find_entry(new_block_ptr,
-                                              key_ref, &new_entry_ptr);
+                hash_value = hashlib_hash_key(table_ptr, key_ref);
+                rv = hashlib_block_find_entry(new_block_ptr, key_ref,
+                                              hash_value, &new_entry_ptr);
                 if (rv != ERR_NOTFOUND) {
                     /* value is not-empty, but we cannot find the key
                      * in the hash table. either the hashlib code is
@@ -767,7 +864,7 @@ hashlib_rehash(
                                  " found an existing key in the new block"),
                                 TRC_ARG(table_ptr)));
                     assert(rv == ERR_NOTFOUND);
-                    free(new_block_ptr);
+                    hashlib_free_block(new_block_ptr);
                     table_ptr->num_blocks = 1 + k;
                     return ERR_INTERNALERROR;
                 }
@@ -775,6 +872,7 @@ hashlib_rehash(
                 HASHENTRY_SET_KEY(new_block_ptr, new_entry_ptr, key_ref);
                 memcpy(HASHENTRY_GET_VALUE(new_block_ptr, new_entry_ptr),
                        val_ref, HASH_GET_VALUE_LEN(block_ptr));
+                HASH_BLOCK_SET_TAG(new_block_ptr, new_entry_ptr, hash_value);
                 ++new_block_ptr->num_entries;
                 HASH_STAT_INCR(table_ptr, rehash_inserts);
             }
@@ -939,7 +1037,8 @@ hashlib_compute_max_initial_entries(
      */
     max_init_entry = ((double)max_memory / (double)total_basis
                       * (double)init_basis
-                      / (double)HASH_GET_ENTRY_LEN(table_ptr));
+                      / (double)(HASH_GET_ENTRY_LEN(table_ptr)
+                                 + table_ptr->group_probe));
 
     /*
      *    Get the largest power of two less than max_init_entry.
@@ -1135,12 +1234,14 @@ assert_not_already_there(
 {
     const uint8_t *entry_ptr;
     const HashBlock *block_ptr;
+    const uint64_t hash_value = hashlib_hash_key(table_ptr, key_ptr);
     unsigned int k;
     int rv;
 
     for (k = 0; k < (table_ptr->num_blocks-1); ++k) {
         block_ptr = table_ptr->block_ptrs[k];
-        rv = hashlib_block_find_entry(block_ptr, key_ptr, &entry_ptr);
+        rv = hashlib_block_find_entry(block_ptr, key_ptr, hash_value,
+                                      &entry_ptr);
         if (rv == OK) {
             getc(stdin);
         }
@@ -1157,6 +1258,7 @@ hashlib_insert(
 {
     HashBlock *block_ptr = NULL;
     uint8_t *entry_ptr = NULL;
+    uint64_t hash_value;
     unsigned int k;
     int rv;
 
@@ -1181,10 +1283,15 @@ hashlib_insert(
     }
     assert(table_ptr->num_blocks);
 
+    /* The hash of the key is the same for every block */
+    hash_value = hashlib_hash_key(table_ptr, key_ptr);
+
     /* Look in each block for the key */
     for (k = 0; k < table_ptr->num_blocks; ++k) {
         block_ptr = table_ptr->block_ptrs[k];
-        if (hashlib_block_find_entry(block_ptr, key_ptr, &entry_ptr) == OK) {
+        if (hashlib_block_find_entry(block_ptr, key_ptr, hash_value,
+                                     &entry_ptr) == OK)
+        {
             /* Found entry, use it */
             *value_pptr = HASHENTRY_GET_VALUE(block_ptr, entry_ptr);
             return OK_DUPLICATE;
@@ -1214,6 +1321,7 @@ hashlib_insert(
      */
     *value_pptr = HASHENTRY_GET_VALUE(block_ptr, entry_ptr);
     HASHENTRY_SET_KEY(block_ptr, entry_ptr, key_ptr);
+    HASH_BLOCK_SET_TAG(block_ptr, entry_ptr, hash_value);
     ++block_ptr->num_entries;
 
     return OK;
@@ -1228,6 +1336,7 @@ hashlib_lookup(
 {
     const HashBlock *block_ptr;
     uint8_t *entry_ptr = NULL;
+    uint64_t hash_value;
     unsigned int k;
 
     assert(table_ptr);
@@ -1241,10 +1350,14 @@ hashlib_lookup(
         return ERR_SORTTABLE;
     }
 
+    hash_value = hashlib_hash_key(table_ptr, key_ptr);
+
     /* Look in each block for the key */
     for (k = 0; k < table_ptr->num_blocks; ++k) {
         block_ptr = table_ptr->block_ptrs[k];
-        if (hashlib_block_find_entry(block_ptr, key_ptr, &entry_ptr) == OK) {
+        if (hashlib_block_find_entry(block_ptr, key_ptr, hash_value,
+                                     &entry_ptr) == OK)
+        {
             /* Return pointer to the value in the entry structure */
             *value_pptr = HASHENTRY_GET_VALUE(block_ptr, entry_ptr);
             return OK;
@@ -1255,12 +1368,185 @@ hashlib_lookup(
 
 
 /*
- *    If not found, points to insertion point,
+ *    Compute the 64-bit hash of 'key_ptr', a key in 'table_ptr'.  The
+ *    hash does not depend on the block, so callers compute it once
+ *    and pass it to hashlib_block_find_entry() for each block.
+ */
+static uint64_t
+hashlib_hash_key(
+    const HashTable    *table_ptr,
+    const uint8_t      *key_ptr)
+{
+    /* seeds for the hashing function */
+    uint32_t hash_primary = 0x53694c4b;
+    uint32_t hash_secondary = 0x4361726e;
+
+    hash(key_ptr, HASH_GET_KEY_LEN(table_ptr), &hash_primary, &hash_secondary);
+    return hash_primary + (((uint64_t)hash_secondary) << UINT64_C(32));
+}
+
+
+#if !defined(__GNUC__)
+/*
+ *    Return the position of the least significant bit that is set in
+ *    'bits', which must not be 0.  Used by HASH_LOWEST_BIT() when the
+ *    compiler does not provide a builtin.
+ */
+static unsigned int
+hashlib_lowest_bit(
+    uint32_t            bits)
+{
+    unsigned int pos = 0;
+
+    assert(bits);
+    while (0 == (bits & 1)) {
+        bits >>= 1;
+        ++pos;
+    }
+    return pos;
+}
+#endif  /* !defined(__GNUC__) */
+
+
+/*
+ *    Return a bitmap of the HASH_GROUP_WIDTH tags starting at
+ *    'tag_ptr' where bit N is set when the Nth tag is 'tag'.
+ */
+static uint32_t
+hashlib_group_match(
+    const uint8_t      *tag_ptr,
+    uint8_t             tag)
+{
+#if HASH_USE_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)tag_ptr);
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t bits = 0;
+    unsigned int i;
+
+    for (i = 0; i < HASH_GROUP_WIDTH; ++i) {
+        if (tag_ptr[i] == tag) {
+            bits |= (1u << i);
+        }
+    }
+    return bits;
+#endif  /* HASH_USE_SSE2 */
+}
+
+
+/*
+ *    Return a bitmap of the HASH_GROUP_WIDTH tags starting at
+ *    'tag_ptr' where bit N is set when the Nth entry is empty.
+ */
+static uint32_t
+hashlib_group_match_empty(
+    const uint8_t      *tag_ptr)
+{
+#if HASH_USE_SSE2
+    /* only HASH_TAG_EMPTY has its high bit set */
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i*)tag_ptr));
+#else
+    uint32_t bits = 0;
+    unsigned int i;
+
+    for (i = 0; i < HASH_GROUP_WIDTH; ++i) {
+        if (tag_ptr[i] & HASH_TAG_EMPTY) {
+            bits |= (1u << i);
+        }
+    }
+    return bits;
+#endif  /* HASH_USE_SSE2 */
+}
+
+
+/*
+ *    Find the entry for 'key_ptr' in 'block_ptr', a block in a table
+ *    that uses group probing.  Helper for hashlib_block_find_entry().
+ *
+ *    The entries are divided into groups of HASH_GROUP_WIDTH, and
+ *    the low bits of 'hash_value' select the first group to probe.
+ *    The tags of every entry in the group are compared at once with
+ *    the tag for the key, and only the entries whose tags match have
+ *    their keys compared.  If the key is not found and the group has
+ *    an empty entry, the key is not in the block and the first empty
+ *    entry is the insertion point.  Otherwise, the next group is
+ *    chosen by triangular probing, which visits every group since the
+ *    number of groups is a power of 2.
+ */
+static int
+hashlib_block_find_entry_grouped(
+    const HashBlock    *block_ptr,
+    const uint8_t      *key_ptr,
+    uint64_t            hash_value,
+    uint8_t           **entry_pptr)
+{
+#ifdef HASHLIB_RECORD_STATS
+    int first_check = 1;
+#endif
+    const uint64_t group_mask
+        = (block_ptr->max_entries / HASH_GROUP_WIDTH) - 1;
+    const uint8_t tag = HASH_TAG_FROM_HASH(hash_value);
+    const uint8_t *tag_ptr;
+    uint64_t group;
+    uint64_t hash_index;
+    uint64_t stride;
+    uint32_t bits;
+
+    for (group = hash_value & group_mask, stride = 0; ;
+         group = (group + stride) & group_mask)
+    {
+        tag_ptr = block_ptr->tag_ptr + group * HASH_GROUP_WIDTH;
+
+        /* compare keys of the entries whose tags match */
+        for (bits = hashlib_group_match(tag_ptr, tag);
+             bits != 0;
+             bits &= bits - 1)
+        {
+            hash_index = group * HASH_GROUP_WIDTH + HASH_LOWEST_BIT(bits);
+            HASH_STAT_INCR(block_ptr, key_compares);
+            if (0 == memcmp(HASH_KEY_AT(block_ptr, hash_index),
+                            key_ptr, HASH_GET_KEY_LEN(block_ptr)))
+            {
+                *entry_pptr = HASH_ENTRY_AT(block_ptr, hash_index);
+                return OK;
+            }
+        }
+
+        /* an empty entry in this group ends the search */
+        bits = hashlib_group_match_empty(tag_ptr);
+        if (bits) {
+            hash_index = group * HASH_GROUP_WIDTH + HASH_LOWEST_BIT(bits);
+            *entry_pptr = HASH_ENTRY_AT(block_ptr, hash_index);
+            return ERR_NOTFOUND;
+        }
+
+        ++stride;
+        assert(stride <= group_mask);
+#ifdef HASHLIB_RECORD_STATS
+        if (first_check) {
+            first_check = 0;
+            HASH_STAT_INCR(block_ptr, find_collisions);
+        }
+        HASH_STAT_INCR(block_ptr, collision_hops);
+#endif  /* HASHLIB_RECORD_STATS */
+    }
+}
+
+
+/*
+ *    Find the entry for 'key_ptr' in 'block_ptr', where 'hash_value'
+ *    is the hash of the key as computed by hashlib_hash_key().  If
+ *    found, set 'entry_pptr' to the entry and return OK.  If not
+ *    found, set 'entry_pptr' to the insertion point and return
+ *    ERR_NOTFOUND.
  */
 static int
 hashlib_block_find_entry(
     const HashBlock    *block_ptr,
     const uint8_t      *key_ptr,
+    uint64_t            hash_value,
     uint8_t           **entry_pptr)
 {
 #ifdef HASHLIB_RECORD_STATS
@@ -1270,18 +1556,16 @@ hashlib_block_find_entry(
     uint32_t num_tries = 0;
 #endif
     uint64_t hash_index;
-    uint64_t hash_value;
     uint64_t hash_probe_increment;
-    /* seeds for the hashing function */
-    uint32_t hash_primary = 0x53694c4b;
-    uint32_t hash_secondary = 0x4361726e;
 
     HASH_STAT_INCR(block_ptr, find_entries);
 
+    if (block_ptr->tag_ptr) {
+        return hashlib_block_find_entry_grouped(block_ptr, key_ptr,
+                                                hash_value, entry_pptr);
+    }
+
     /*
-     *  First this code computes the hash for the key, the
-     *  'hash_value'.
-     *
      *  The 'hash_value' is masked by the size of the block to
      *  determine which bucket to check (the 'hash_index').  Since the
      *  block size is a power of 2, masking can be used as a modulo
@@ -1314,8 +1598,6 @@ hashlib_block_find_entry(
      *  update a bucket's value to the no_value_ptr value---though
      *  there is no way for the hashlib code to enforce this.
      */
-    hash(key_ptr, HASH_GET_KEY_LEN(block_ptr), &hash_primary, &hash_secondary);
-    hash_value = hash_primary + (((uint64_t)hash_secondary) << UINT64_C(32));
     hash_probe_increment = hash_value | 0x01; /* must be odd */
     for (;;) {
         hash_index = hash_value & (block_ptr->max_entries - 1);
@@ -1326,6 +1608,7 @@ hashlib_block_find_entry(
             return ERR_NOTFOUND;
         }
         /* compare the keys */
+        HASH_STAT_INCR(block_ptr, key_compares);
         if (0 == memcmp(HASHENTRY_GET_KEY(block_ptr, *entry_pptr),
                         key_ptr, HASH_GET_KEY_LEN(block_ptr)))
         {
@@ -1386,6 +1669,8 @@ hashlib_print_stats(
             hts->find_collisions);
     fprintf(fp, "  %" PRIu64 " total collision hops.\n",
             hts->collision_hops);
+    fprintf(fp, "  %" PRIu64 " total key comparisons.\n",
+            hts->key_compares);
 }
 #endif /* HASHLIB_RECORD_STATS */
 
@@ -1857,6 +2142,8 @@ hashlib_dump_table_header(
     fprintf(fp, "Load factor:\t %d = %2.0f%%\n",
             table_ptr->load_factor,
             100 * (float) table_ptr->load_factor / 255);
+    fprintf(fp, "Probing:\t %s\n",
+            (table_ptr->group_probe ? "group" : "single entry"));
     fprintf(fp, ("Table has %" PRIu8 " blocks:\n"), table_ptr->num_blocks);
     for (k = 0; k < table_ptr->num_blocks; ++k) {
         block_ptr = table_ptr->block_ptrs[k];
@@ -83,6 +83,19 @@ RCSIDENTVAR(rcsID_HASHLIB_H, "$SiLK: hashlib.h ef14e54179be 2020-04-14 21:57:45Z
  */
 #define HTT_BYREFERENCE 1
 
+/**
+ *    Indicates the table keeps a one-byte tag for each entry in a
+ *    separate array and probes a group of entries at a time by
+ *    comparing the tags, using SSE2 instructions when available.
+ *    Only entries whose tags match are compared with the key, which
+ *    allows the table to be filled to a higher load factor than the
+ *    default table.  See HASHLIB_GROUPPROBE_LOAD_FACTOR.
+ *
+ *    Pass as the 'data_type' argument to hashlib_create_table().
+ *    Since SiLK 3.20.0.
+ */
+#define HTT_GROUPPROBE 2
+
 /**
  *    Indicates table allows deletion. Items are only removed from the
  *    table after a rehash.  Deleted items have the value
@@ -98,6 +111,12 @@ RCSIDENTVAR(rcsID_HASHLIB_H, "$SiLK: hashlib.h ef14e54179be 2020-04-14 21:57:45Z
  */
 #define DEFAULT_LOAD_FACTOR 185
 
+/**
+ *    Suggested load for tables created with HTT_GROUPPROBE is 223
+ *    (87.45%).
+ */
+#define HASHLIB_GROUPPROBE_LOAD_FACTOR 223
+
 /**
  *    Maximum number of block-indexes allowed by the hash iterator.
  */
@@ -158,7 +177,15 @@ typedef int
  *
  *    key_width:      The width of a key in bytes.
  *    value_width:    The width of a value in bytes
- *    data_type:      UNUSED.
+ *    data_type:      HTT_GROUPPROBE to create a group-probed table;
+ *                    any other value creates the default table.  When
+ *                    the environment variable SILK_HASH_GROUPPROBE is
+ *                    set to a non-empty value, its value determines
+ *                    the type instead: "0" for the default table and
+ *                    anything else for a group-probed table; in the
+ *                    latter case, a 'load_factor' of
+ *                    DEFAULT_LOAD_FACTOR is replaced by
+ *                    HASHLIB_GROUPPROBE_LOAD_FACTOR.
  *    no_value_ptr:   A sequence of value_width bytes used to represent
  *                    "no value" (i.e., an empty entry).  The hash table
  *                    makes a copy of this value.  If 'no_value_ptr' is
@@ -497,6 +524,9 @@ struct hashlib_stats_st {
     uint64_t find_collisions;
     /* number of steps required to resolve collisions */
     uint64_t collision_hops;
+    /* number of times a key in the table was compared to the key
+     * being found */
+    uint64_t key_compares;
 };
 typedef struct hashlib_stats_st hashlib_stats_t;
 
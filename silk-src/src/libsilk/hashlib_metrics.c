@@ -6,13 +6,30 @@
 ** @OPENSOURCE_LICENSE_END@
 */
 
-/* File: hashlib_metrics.c: program for generating performance metrics */
+/* File: hashlib_metrics.c: program for generating performance metrics
+ *
+ * When run with no arguments, time the insertion of random keys
+ * using various block sizes and counts.
+ *
+ * When run as
+ *
+ *   hashlib_metrics --compare {sip|dip|5tuple} FILE [FILE...]
+ *
+ * read the SiLK Flow records in each FILE, build a key from each
+ * record, and compare the time to insert and then to look up every
+ * key in the default table and in a table that uses group probing
+ * (HTT_GROUPPROBE), both when the table starts small and must grow
+ * and when it is sized for the number of distinct keys.
+ */
 
 #include <silk/silk.h>
 
 RCSIDENT("$SiLK: hashlib_metrics.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
 #include <silk/hashlib.h>
+#include <silk/rwrec.h>
+#include <silk/skstream.h>
+#include <silk/utils.h>
 
 
 /* NOTE: normally these would not be changed by an application.  This
@@ -29,6 +46,18 @@ typedef struct TestDesc_st {
     float    estimate_ratio;
 } TestDesc;
 
+/* Description of a table to use in --compare mode */
+typedef struct CompareDesc_st {
+    const char *name;
+    uint8_t     data_type;
+    uint8_t     load_factor;
+} CompareDesc;
+
+/* The keys that may be built from a record in --compare mode */
+typedef enum {
+    COMPARE_KEY_SIP, COMPARE_KEY_DIP, COMPARE_KEY_5TUPLE
+} compare_key_t;
+
 
 static double
 get_elapsed_secs(
@@ -156,7 +185,247 @@ run_test(
 }
 
 
-int main()
+/*
+ *    Read the SiLK Flow records in the 'num_paths' files in 'paths',
+ *    build a key of type 'key_type' from each, and return an array
+ *    of the keys.  Set 'key_len' to the octet length of a key and
+ *    'num_keys' to the number of keys.  Return NULL on error.
+ */
+static uint8_t *
+compare_read_keys(
+    compare_key_t       key_type,
+    char              **paths,
+    int                 num_paths,
+    size_t             *key_len,
+    size_t             *num_keys)
+{
+    skstream_t *stream;
+    rwRec rwrec;
+    uint8_t *keys = NULL;
+    uint8_t *k;
+    size_t capacity = 0;
+    uint32_t ip;
+    uint16_t port;
+    int i;
+    int rv;
+
+    *key_len = ((COMPARE_KEY_5TUPLE == key_type) ? 13 : sizeof(uint32_t));
+    *num_keys = 0;
+
+    for (i = 0; i < num_paths; ++i) {
+        rv = skStreamOpenSilkFlow(&stream, paths[i], SK_IO_READ);
+        if (rv) {
+            skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+            skStreamDestroy(&stream);
+            free(keys);
+            return NULL;
+        }
+        while ((rv = skStreamReadRecord(stream, &rwrec)) == SKSTREAM_OK) {
+            if (*num_keys == capacity) {
+                capacity = ((capacity) ? (capacity << 1) : (1 << 16));
+                k = (uint8_t*)realloc(keys, capacity * *key_len);
+                if (NULL == k) {
+                    skAppPrintOutOfMemory("keys");
+                    skStreamDestroy(&stream);
+                    free(keys);
+                    return NULL;
+                }
+                keys = k;
+            }
+            k = keys + *num_keys * *key_len;
+            switch (key_type) {
+              case COMPARE_KEY_SIP:
+                ip = rwRecGetSIPv4(&rwrec);
+                memcpy(k, &ip, sizeof(ip));
+                break;
+              case COMPARE_KEY_DIP:
+                ip = rwRecGetDIPv4(&rwrec);
+                memcpy(k, &ip, sizeof(ip));
+                break;
+              case COMPARE_KEY_5TUPLE:
+                ip = rwRecGetSIPv4(&rwrec);
+                memcpy(k, &ip, sizeof(ip));
+                ip = rwRecGetDIPv4(&rwrec);
+                memcpy(k + 4, &ip, sizeof(ip));
+                port = rwRecGetSPort(&rwrec);
+                memcpy(k + 8, &port, sizeof(port));
+                port = rwRecGetDPort(&rwrec);
+                memcpy(k + 10, &port, sizeof(port));
+                k[12] = rwRecGetProto(&rwrec);
+                break;
+            }
+            ++*num_keys;
+        }
+        if (rv != SKSTREAM_ERR_EOF) {
+            skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+            skStreamDestroy(&stream);
+            free(keys);
+            return NULL;
+        }
+        skStreamDestroy(&stream);
+    }
+    return keys;
+}
+
+
+/*
+ *    Insert the 'num_keys' keys in 'keys' into a table described by
+ *    'desc' that is created with an estimated size of 'estimate',
+ *    then look up each key.  Print a line of results to 'out_fp'.
+ *    Return the number of distinct keys.
+ */
+static uint64_t
+compare_run(
+    FILE               *out_fp,
+    const CompareDesc  *desc,
+    uint64_t            estimate,
+    const uint8_t      *keys,
+    size_t              key_len,
+    size_t              num_keys)
+{
+#ifdef HASHLIB_RECORD_STATS
+    hashlib_stats_t hashlib_stats;
+#endif
+    struct timeval tv1, tv2, tv3;
+    HashTable *table_ptr;
+    const uint8_t *k;
+    uint8_t *val_ptr;
+    uint32_t count;
+    uint64_t entries;
+    size_t i;
+
+    table_ptr = hashlib_create_table((uint8_t)key_len, sizeof(uint32_t),
+                                     desc->data_type,
+                                     NULL,         /* all 0 means empty */
+                                     NULL, 0,      /* No user data */
+                                     estimate, desc->load_factor);
+    if (NULL == table_ptr) {
+        skAppPrintErr("Unable to create table");
+        exit(EXIT_FAILURE);
+    }
+
+    /* count the records for each key, as rwuniq does */
+    gettimeofday(&tv1, NULL);
+    for (i = 0, k = keys; i < num_keys; ++i, k += key_len) {
+        if (hashlib_insert(table_ptr, k, &val_ptr) < 0) {
+            skAppPrintErr("Insert failed after %" SK_PRIuZ " keys", i);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&count, val_ptr, sizeof(count));
+        ++count;
+        memcpy(val_ptr, &count, sizeof(count));
+    }
+    gettimeofday(&tv2, NULL);
+    for (i = 0, k = keys; i < num_keys; ++i, k += key_len) {
+        if (hashlib_lookup(table_ptr, k, &val_ptr) != OK) {
+            skAppPrintErr("Lookup failed for key %" SK_PRIuZ, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    gettimeofday(&tv3, NULL);
+
+    entries = hashlib_count_entries(table_ptr);
+#ifdef HASHLIB_RECORD_STATS
+    hashlib_get_stats(table_ptr, &hashlib_stats);
+#endif
+
+    fprintf(out_fp,
+            ("%s\t%u\t%" PRIu64 "\t%" SK_PRIuZ "\t%" PRIu64 "\t%" PRIu64
+             "\t%3.3f\t%3.3f"
+#ifdef HASHLIB_RECORD_STATS
+             "\t%" PRIu32 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+             "\t%" PRIu64
+#endif
+             "\n"),
+            desc->name, desc->load_factor, estimate, num_keys, entries,
+            hashlib_count_buckets(table_ptr),
+            get_elapsed_secs(&tv1, &tv2), get_elapsed_secs(&tv2, &tv3)
+#ifdef HASHLIB_RECORD_STATS
+            , hashlib_stats.rehashes,
+            hashlib_stats.find_entries,
+            hashlib_stats.find_collisions,
+            hashlib_stats.collision_hops,
+            hashlib_stats.key_compares
+#endif
+            );
+    fflush(out_fp);
+
+    hashlib_free_table(table_ptr);
+    return entries;
+}
+
+
+/*
+ *    Run the --compare mode.  'argv' holds the key type followed by
+ *    the input files.
+ */
+static int
+compare_main(
+    int                 argc,
+    char              **argv)
+{
+    const CompareDesc tables[] = {
+        {"single", HTT_INPLACE,    DEFAULT_LOAD_FACTOR},
+        {"group",  HTT_GROUPPROBE, DEFAULT_LOAD_FACTOR},
+        {"group",  HTT_GROUPPROBE, HASHLIB_GROUPPROBE_LOAD_FACTOR}
+    };
+    const size_t num_tables = sizeof(tables)/sizeof(tables[0]);
+    compare_key_t key_type;
+    uint8_t *keys;
+    size_t key_len;
+    size_t num_keys;
+    uint64_t distinct = 0;
+    size_t i;
+
+    if (argc < 2) {
+        skAppPrintErr("Usage: %s --compare {sip|dip|5tuple} FILE [FILE...]",
+                      skAppName());
+        return EXIT_FAILURE;
+    }
+    if (0 == strcmp(argv[0], "sip")) {
+        key_type = COMPARE_KEY_SIP;
+    } else if (0 == strcmp(argv[0], "dip")) {
+        key_type = COMPARE_KEY_DIP;
+    } else if (0 == strcmp(argv[0], "5tuple")) {
+        key_type = COMPARE_KEY_5TUPLE;
+    } else {
+        skAppPrintErr("Unknown key type '%s'", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (getenv("SILK_HASH_GROUPPROBE")) {
+        skAppPrintErr("Warning: SILK_HASH_GROUPPROBE overrides the table type");
+    }
+
+    keys = compare_read_keys(key_type, argv + 1, argc - 1,
+                             &key_len, &num_keys);
+    if (NULL == keys) {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, ("Probe\tLF\tEst\tKeys\tEntries\tBuckets"
+                     "\tInsert\tLookup"
+#ifdef HASHLIB_RECORD_STATS
+                     "\tRehsh\tFinds\tCollns\tHops\tKeyCmp"
+#endif
+                     "\n"));
+
+    /* start with a small table that must grow */
+    for (i = 0; i < num_tables; ++i) {
+        distinct = compare_run(stdout, &tables[i], 0, keys, key_len, num_keys);
+    }
+    /* use a table sized for the number of distinct keys */
+    for (i = 0; i < num_tables; ++i) {
+        compare_run(stdout, &tables[i], distinct, keys, key_len, num_keys);
+    }
+
+    free(keys);
+    return 0;
+}
+
+
+int main(
+    int                 argc,
+    char              **argv)
 {
     TestDesc test;
     int32_t fracs[] = { 3, 2, 1, 0, -1, -2 };
@@ -167,6 +436,11 @@ int main()
     FILE *graph_fp;
     double elapsed_time;
 
+    if (argc > 1 && 0 == strcmp(argv[1], "--compare")) {
+        skAppRegister(argv[0]);
+        return compare_main(argc - 2, argv + 2);
+    }
+
     /* Data suitable for graphing, x is ratio, y is time for each set
      * of params */
     graph_fp = fopen("graph.csv", "w");
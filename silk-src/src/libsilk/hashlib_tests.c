@@ -124,6 +124,94 @@ hashlib_test1(
 
 }
 
+/*
+ *    Test a table that uses group probing.  Start with a small
+ *    estimate so the table must add blocks and rehash.
+ */
+static void
+hashlib_test_groupprobe(
+    void)
+{
+    const uint32_t max_key = 400000;
+    const uint32_t num_missing = 10000;
+    HashTable *test_ptr;
+    HASH_ITER iter;
+    uint32_t *key_ref;
+    uint32_t *val_ref;
+    uint32_t num_found;
+    uint32_t iKey;
+    int rv;
+
+    printf("\n--- Testing group-probed hash table\n");
+
+    test_ptr = hashlib_create_table(sizeof(iKey), sizeof(uint32_t),
+                                    HTT_GROUPPROBE,
+                                    NULL, /* all 0 means empty */
+                                    NULL, 0, /* No user data */
+                                    1000, HASHLIB_GROUPPROBE_LOAD_FACTOR);
+    assert(test_ptr);
+
+    printf("Testing insert\n");
+    for (iKey = 1; iKey <= max_key; ++iKey) {
+        rv = hashlib_insert(test_ptr, (uint8_t*)&iKey, (uint8_t**)&val_ref);
+        if (rv != OK) {
+            printf("****Insert of new key %u returned %d\n", iKey, rv);
+            exit(EXIT_FAILURE);
+        }
+        *val_ref = iKey * 2;
+    }
+    for (iKey = 1; iKey <= max_key; iKey += 7) {
+        rv = hashlib_insert(test_ptr, (uint8_t*)&iKey, (uint8_t**)&val_ref);
+        if (rv != OK_DUPLICATE || *val_ref != iKey * 2) {
+            printf("****Insert of existing key %u returned %d\n", iKey, rv);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (hashlib_count_entries(test_ptr) != max_key
+        || hashlib_count_nonempties(test_ptr) != max_key)
+    {
+        printf("****Incorrect entry count\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Insert test PASSED.\n");
+
+    printf("Testing lookup\n");
+    for (iKey = 1; iKey <= max_key + num_missing; ++iKey) {
+        rv = hashlib_lookup(test_ptr, (uint8_t*)&iKey, (uint8_t**)&val_ref);
+        if (iKey <= max_key
+            ? (rv != OK || *val_ref != iKey * 2)
+            : (rv != ERR_NOTFOUND))
+        {
+            printf("****Lookup of key %u returned %d\n", iKey, rv);
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("Lookup test PASSED.\n");
+
+    printf("Testing iteration\n");
+    num_found = 0;
+    iter = hashlib_create_iterator(test_ptr);
+    while (hashlib_iterate(test_ptr, &iter, (uint8_t**)&key_ref,
+                           (uint8_t**)&val_ref)
+           != ERR_NOMOREENTRIES)
+    {
+        ++num_found;
+        if (*val_ref != *key_ref * 2) {
+            printf("****Incorrect value: %u != %u\n", *val_ref, *key_ref);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_found != max_key) {
+        printf("Iteration failed.  Expected %u entries, found %u\n",
+               max_key, num_found);
+        exit(EXIT_FAILURE);
+    }
+    printf("Iteration test PASSED.\n");
+
+    hashlib_free_table(test_ptr);
+}
+
+
 /* NOTE: remove is not implemented. We may implement it
  * eventually. Remove is intrinsically expensive since it requires a
  * rehash. */
@@ -224,6 +312,7 @@ int main(
     fprintf(stdout, "Starting regression testing\n");
 
     hashlib_test1();
+    hashlib_test_groupprobe();
 
     /* If we reached this point, all tests were successful */
     fprintf(stdout, "\nAll tests completed successfully.\n");
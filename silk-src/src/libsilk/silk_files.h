@@ -58,12 +58,24 @@ RCSIDENTVAR(rcsID_SILK_FILES_H, "$SiLK: silk_files.h ef14e54179be 2020-04-14 21:
  */
 #define SK_COMPMETHOD_SNAPPY    3
 
+/**
+ *    Use Zstandard compression.  Since SiLK 3.20.0.
+ */
+#define SK_COMPMETHOD_ZSTD      4
+
+/**
+ *    Use LZ4 compression.  Since SiLK 3.20.0.
+ */
+#define SK_COMPMETHOD_LZ4       5
+
 #ifdef SKCOMPMETHOD_SOURCE
 static const char *sk_compmethod_names[] = {
     "none",
     "zlib",
     "lzo1x",
     "snappy",
+    "zstd",
+    "lz4",
     ""
 };
 #endif /* SKCOMPMETHOD_SOURCE */
@@ -79,8 +91,9 @@ static const char *sk_compmethod_names[] = {
 #define SK_COMPMETHOD_DEFAULT 255
 
 /**
- *    Use the "best" compression method.  This is lzo1x if available,
- *    else snappy if available, else zlib if available, else none.
+ *    Use the "best" compression method.  This is zstd if available,
+ *    else lzo1x if available, else lz4 if available, else snappy if
+ *    available, else zlib if available, else none.
  */
 #define SK_COMPMETHOD_BEST    254
 
@@ -152,6 +165,17 @@ sk_compmethod_t
 skCompMethodGetBest(
     void);
 
+/**
+ *    Return the available compression method that is expected to
+ *    compress and decompress most quickly, preferring speed over
+ *    compression ratio.  Used for temporary files.
+ *
+ *    Since SiLK 3.20.0.
+ */
+sk_compmethod_t
+skCompMethodGetFastest(
+    void);
+
 /**
  *    Return the default compression method.
  *
@@ -321,6 +345,7 @@ skFileFormatFromName(
 #define FT_RWPRINTSTATS     0x23
 #define FT_PDUFLOWCAP       0x24
 #define FT_PREFIXMAP        0x25
+#define FT_RWTUPLE          0x26
 /* When you add new types here; add the name to the array below. */
 
 /* old identifier names */
@@ -374,6 +399,7 @@ static const char *sk_file_format_names[] = {
     /* 0x23 */  "FT_RWPRINTSTATS",
     /* 0x24 */  "FT_PDUFLOWCAP",
     /* 0x25 */  "FT_PREFIXMAP",
+    /* 0x26 */  "FT_RWTUPLE",
     ""
 };
 #endif /* SKFILEFORMAT_SOURCE */
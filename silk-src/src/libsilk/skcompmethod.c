@@ -173,6 +173,12 @@ skCompMethodCheck(
 #endif
 #if SK_ENABLE_SNAPPY
       case SK_COMPMETHOD_SNAPPY:
+#endif
+#if SK_ENABLE_ZSTD
+      case SK_COMPMETHOD_ZSTD:
+#endif
+#if SK_ENABLE_LZ4
+      case SK_COMPMETHOD_LZ4:
 #endif
         return SK_COMPMETHOD_IS_AVAIL;
     }
@@ -189,10 +195,35 @@ sk_compmethod_t
 skCompMethodGetBest(
     void)
 {
-#if   SK_ENABLE_LZO
+#if   SK_ENABLE_ZSTD
+    return SK_COMPMETHOD_ZSTD;
+#elif SK_ENABLE_LZO
+    return SK_COMPMETHOD_LZO1X;
+#elif SK_ENABLE_LZ4
+    return SK_COMPMETHOD_LZ4;
+#elif SK_ENABLE_SNAPPY
+    return SK_COMPMETHOD_SNAPPY;
+#elif SK_ENABLE_ZLIB
+    return SK_COMPMETHOD_ZLIB;
+#else
+    return SK_COMPMETHOD_NONE;
+#endif
+}
+
+
+/* Return the fastest compression method. */
+sk_compmethod_t
+skCompMethodGetFastest(
+    void)
+{
+#if   SK_ENABLE_LZ4
+    return SK_COMPMETHOD_LZ4;
+#elif SK_ENABLE_LZO
     return SK_COMPMETHOD_LZO1X;
 #elif SK_ENABLE_SNAPPY
     return SK_COMPMETHOD_SNAPPY;
+#elif SK_ENABLE_ZSTD
+    return SK_COMPMETHOD_ZSTD;
 #elif SK_ENABLE_ZLIB
     return SK_COMPMETHOD_ZLIB;
 #else
@@ -24,6 +24,7 @@
 
 RCSIDENT("$SiLK: skheader.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
+#include <silk/rwascii.h>
 #include "skheader_priv.h"
 #include "skstream_priv.h"
 
@@ -133,6 +134,8 @@ static int hentryRegisterInvocation(sk_hentry_type_id_t hentry_id);
 static int hentryRegisterPackedfile(sk_hentry_type_id_t hentry_id);
 static int hentryRegisterProbename(sk_hentry_type_id_t hentry_id);
 static int hentryRegisterTombstone(sk_hentry_type_id_t hentry_id);
+static int hentryRegisterBlockIndex(sk_hentry_type_id_t hentry_id);
+static int hentryRegisterTuple(sk_hentry_type_id_t hentry_id);
 
 
 /* FUNCTION DEFINITIONS */
@@ -754,6 +757,10 @@ skHeaderInitialize(
     rv |= hentryRegisterProbename(SK_HENTRY_PROBENAME_ID);
     /* defined below */
     rv |= hentryRegisterTombstone(SK_HENTRY_TOMBSTONE_ID);
+    /* defined below */
+    rv |= hentryRegisterBlockIndex(SK_HENTRY_BLOCKINDEX_ID);
+
+    rv |= hentryRegisterTuple(SK_HENTRY_TUPLE_ID);
     /* defined in skprefixmap.c */
     rv |= skPrefixMapRegisterHeaderEntry(SK_HENTRY_PREFIXMAP_ID);
     /* defined in skbag.c */
@@ -3007,6 +3014,418 @@ skHentryTombstoneGetCount(
 }
 
 
+/*
+ *    **********************************************************************
+ *
+ *    Block Index
+ *
+ */
+
+/*
+ *    sk_hentry_blockindex_t is the definition of the blockindex
+ *    header.  The layout of the header does not depend on the
+ *    version, which describes the content of the block summaries, so
+ *    that a reader may skip summaries it does not understand.
+ */
+typedef struct sk_hentry_blockindex_st {
+    sk_header_entry_spec_t  he_spec;
+    uint32_t                bi_version;
+    uint32_t                bi_length;
+} sk_hentry_blockindex_t;
+
+/* Forward declaration */
+static sk_header_entry_t *
+blockindexCreate(
+    uint32_t            summary_version,
+    uint32_t            summary_length);
+
+static sk_header_entry_t *
+blockindexCopy(
+    const sk_header_entry_t    *hentry)
+{
+    const sk_hentry_blockindex_t *bi_hdr = (sk_hentry_blockindex_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+    return blockindexCreate(bi_hdr->bi_version, bi_hdr->bi_length);
+}
+
+static sk_header_entry_t *
+blockindexCreate(
+    uint32_t            summary_version,
+    uint32_t            summary_length)
+{
+    sk_hentry_blockindex_t *bi_hdr;
+
+    bi_hdr = ((sk_hentry_blockindex_t*)
+              calloc(1, sizeof(sk_hentry_blockindex_t)));
+    if (NULL == bi_hdr) {
+        return NULL;
+    }
+    bi_hdr->he_spec.hes_id  = SK_HENTRY_BLOCKINDEX_ID;
+    bi_hdr->he_spec.hes_len = sizeof(sk_hentry_blockindex_t);
+    bi_hdr->bi_version = summary_version;
+    bi_hdr->bi_length = summary_length;
+
+    return (sk_header_entry_t *)bi_hdr;
+}
+
+static void
+blockindexFree(
+    sk_header_entry_t  *hentry)
+{
+    sk_hentry_blockindex_t *bi_hdr = (sk_hentry_blockindex_t*)hentry;
+
+    if (bi_hdr) {
+        assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+        bi_hdr->he_spec.hes_id = UINT32_MAX;
+        free(bi_hdr);
+    }
+}
+
+static ssize_t
+blockindexPacker(
+    const sk_header_entry_t    *in_hentry,
+    uint8_t                    *out_packed,
+    size_t                      bufsize)
+{
+    const sk_hentry_blockindex_t *bi_hdr = (sk_hentry_blockindex_t*)in_hentry;
+
+    assert(in_hentry);
+    assert(out_packed);
+    assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+
+    if (bufsize >= sizeof(sk_hentry_blockindex_t)) {
+        sk_hentry_blockindex_t tmp_hdr;
+        SK_HENTRY_SPEC_PACK(&tmp_hdr, &bi_hdr->he_spec);
+        tmp_hdr.bi_version = htonl(bi_hdr->bi_version);
+        tmp_hdr.bi_length = htonl(bi_hdr->bi_length);
+
+        memcpy(out_packed, &tmp_hdr, sizeof(tmp_hdr));
+    }
+
+    return sizeof(sk_hentry_blockindex_t);
+}
+
+static void
+blockindexPrint(
+    const sk_header_entry_t    *hentry,
+    FILE                       *fh)
+{
+    const sk_hentry_blockindex_t *bi_hdr = (sk_hentry_blockindex_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+    fprintf(fh, "v%" PRIu32 ", summary length = %" PRIu32,
+            bi_hdr->bi_version, bi_hdr->bi_length);
+}
+
+static sk_header_entry_t *
+blockindexUnpacker(
+    uint8_t            *in_packed)
+{
+    sk_hentry_blockindex_t *bi_hdr;
+    size_t offset;
+
+    assert(in_packed);
+
+    /* create space for new header */
+    bi_hdr = ((sk_hentry_blockindex_t*)
+              calloc(1, sizeof(sk_hentry_blockindex_t)));
+    if (NULL == bi_hdr) {
+        return NULL;
+    }
+
+    /* copy the spec */
+    SK_HENTRY_SPEC_UNPACK(&(bi_hdr->he_spec), in_packed);
+    assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+
+    if (bi_hdr->he_spec.hes_len != sizeof(sk_hentry_blockindex_t)) {
+        free(bi_hdr);
+        return NULL;
+    }
+    offset = sizeof(sk_header_entry_spec_t);
+
+    /* get the version number and the summary length */
+    memcpy(&bi_hdr->bi_version, &in_packed[offset],sizeof(uint32_t));
+    bi_hdr->bi_version = ntohl(bi_hdr->bi_version);
+    offset += sizeof(uint32_t);
+
+    memcpy(&bi_hdr->bi_length, &in_packed[offset],sizeof(uint32_t));
+    bi_hdr->bi_length = ntohl(bi_hdr->bi_length);
+
+    return (sk_header_entry_t*)bi_hdr;
+}
+
+/*  Called by skHeaderInitialize to register the header type */
+static int
+hentryRegisterBlockIndex(
+    sk_hentry_type_id_t hentry_id)
+{
+    assert(SK_HENTRY_BLOCKINDEX_ID == hentry_id);
+    return skHentryTypeRegister(hentry_id, &blockindexPacker,
+                                &blockindexUnpacker, &blockindexCopy,
+                                &blockindexFree, &blockindexPrint);
+}
+
+int
+skHeaderAddBlockIndex(
+    sk_file_header_t   *hdr,
+    uint32_t            summary_version,
+    uint32_t            summary_length)
+{
+    int rv;
+    sk_header_entry_t *bi_hdr;
+
+    bi_hdr = blockindexCreate(summary_version, summary_length);
+    if (bi_hdr == NULL) {
+        return SKHEADER_ERR_ALLOC;
+    }
+    rv = skHeaderAddEntry(hdr, bi_hdr);
+    if (rv) {
+        blockindexFree(bi_hdr);
+    }
+    return rv;
+}
+
+uint32_t
+skHentryBlockIndexGetVersion(
+    const sk_header_entry_t    *hentry)
+{
+    const sk_hentry_blockindex_t *bi_hdr = (sk_hentry_blockindex_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+    return bi_hdr->bi_version;
+}
+
+uint32_t
+skHentryBlockIndexGetLength(
+    const sk_header_entry_t    *hentry)
+{
+    const sk_hentry_blockindex_t *bi_hdr = (sk_hentry_blockindex_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(bi_hdr) == SK_HENTRY_BLOCKINDEX_ID);
+    return bi_hdr->bi_length;
+}
+
+
+/*
+ *    **********************************************************************
+ *
+ *    Tuple
+ *
+ */
+
+/*
+ *    sk_hentry_tuple_t is the definition of the tuple header.  The
+ *    field identifiers are single octets, so the packed and unpacked
+ *    forms have the same layout apart from the byte order of the
+ *    count.
+ */
+typedef struct sk_hentry_tuple_st {
+    sk_header_entry_spec_t  he_spec;
+    uint32_t                tu_count;
+    uint8_t                 tu_fields[SK_HENTRY_TUPLE_MAX_FIELDS];
+} sk_hentry_tuple_t;
+
+/* Forward declaration */
+static sk_header_entry_t *
+tupleCreate(
+    uint32_t            field_count,
+    const uint8_t      *field_ids);
+
+static sk_header_entry_t *
+tupleCopy(
+    const sk_header_entry_t    *hentry)
+{
+    const sk_hentry_tuple_t *tu_hdr = (sk_hentry_tuple_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+    return tupleCreate(tu_hdr->tu_count, tu_hdr->tu_fields);
+}
+
+static sk_header_entry_t *
+tupleCreate(
+    uint32_t            field_count,
+    const uint8_t      *field_ids)
+{
+    sk_hentry_tuple_t *tu_hdr;
+
+    assert(field_count <= SK_HENTRY_TUPLE_MAX_FIELDS);
+
+    tu_hdr = (sk_hentry_tuple_t*)calloc(1, sizeof(sk_hentry_tuple_t));
+    if (NULL == tu_hdr) {
+        return NULL;
+    }
+    tu_hdr->he_spec.hes_id  = SK_HENTRY_TUPLE_ID;
+    tu_hdr->he_spec.hes_len = sizeof(sk_hentry_tuple_t);
+    tu_hdr->tu_count = field_count;
+    memcpy(tu_hdr->tu_fields, field_ids, field_count);
+
+    return (sk_header_entry_t *)tu_hdr;
+}
+
+static void
+tupleFree(
+    sk_header_entry_t  *hentry)
+{
+    sk_hentry_tuple_t *tu_hdr = (sk_hentry_tuple_t*)hentry;
+
+    if (tu_hdr) {
+        assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+        tu_hdr->he_spec.hes_id = UINT32_MAX;
+        free(tu_hdr);
+    }
+}
+
+static ssize_t
+tuplePacker(
+    const sk_header_entry_t    *in_hentry,
+    uint8_t                    *out_packed,
+    size_t                      bufsize)
+{
+    const sk_hentry_tuple_t *tu_hdr = (sk_hentry_tuple_t*)in_hentry;
+
+    assert(in_hentry);
+    assert(out_packed);
+    assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+
+    if (bufsize >= sizeof(sk_hentry_tuple_t)) {
+        sk_hentry_tuple_t tmp_hdr;
+        SK_HENTRY_SPEC_PACK(&tmp_hdr, &tu_hdr->he_spec);
+        tmp_hdr.tu_count = htonl(tu_hdr->tu_count);
+        memcpy(tmp_hdr.tu_fields, tu_hdr->tu_fields,
+               sizeof(tmp_hdr.tu_fields));
+
+        memcpy(out_packed, &tmp_hdr, sizeof(tmp_hdr));
+    }
+
+    return sizeof(sk_hentry_tuple_t);
+}
+
+static void
+tuplePrint(
+    const sk_header_entry_t    *hentry,
+    FILE                       *fh)
+{
+    const sk_hentry_tuple_t *tu_hdr = (sk_hentry_tuple_t*)hentry;
+    char name[64];
+    uint32_t i;
+
+    assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+    fprintf(fh, "fields = ");
+    for (i = 0; i < tu_hdr->tu_count; ++i) {
+        rwAsciiGetFieldName(name, sizeof(name),
+                            (rwrec_printable_fields_t)tu_hdr->tu_fields[i]);
+        fprintf(fh, "%s%s", ((i > 0) ? "," : ""), name);
+    }
+}
+
+static sk_header_entry_t *
+tupleUnpacker(
+    uint8_t            *in_packed)
+{
+    sk_hentry_tuple_t *tu_hdr;
+    size_t offset;
+
+    assert(in_packed);
+
+    /* create space for new header */
+    tu_hdr = (sk_hentry_tuple_t*)calloc(1, sizeof(sk_hentry_tuple_t));
+    if (NULL == tu_hdr) {
+        return NULL;
+    }
+
+    /* copy the spec */
+    SK_HENTRY_SPEC_UNPACK(&(tu_hdr->he_spec), in_packed);
+    assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+
+    if (tu_hdr->he_spec.hes_len != sizeof(sk_hentry_tuple_t)) {
+        free(tu_hdr);
+        return NULL;
+    }
+    offset = sizeof(sk_header_entry_spec_t);
+
+    /* get the field count and the fields */
+    memcpy(&tu_hdr->tu_count, &in_packed[offset], sizeof(uint32_t));
+    tu_hdr->tu_count = ntohl(tu_hdr->tu_count);
+    offset += sizeof(uint32_t);
+    if (tu_hdr->tu_count > SK_HENTRY_TUPLE_MAX_FIELDS) {
+        free(tu_hdr);
+        return NULL;
+    }
+
+    memcpy(tu_hdr->tu_fields, &in_packed[offset], sizeof(tu_hdr->tu_fields));
+
+    return (sk_header_entry_t*)tu_hdr;
+}
+
+/*  Called by skHeaderInitialize to register the header type */
+static int
+hentryRegisterTuple(
+    sk_hentry_type_id_t hentry_id)
+{
+    assert(SK_HENTRY_TUPLE_ID == hentry_id);
+    return skHentryTypeRegister(hentry_id, &tuplePacker,
+                                &tupleUnpacker, &tupleCopy,
+                                &tupleFree, &tuplePrint);
+}
+
+int
+skHeaderAddTuple(
+    sk_file_header_t   *hdr,
+    uint32_t            field_count,
+    const uint32_t     *field_ids)
+{
+    uint8_t fields[SK_HENTRY_TUPLE_MAX_FIELDS];
+    sk_header_entry_t *tu_hdr;
+    uint32_t i;
+    int rv;
+
+    if (0 == field_count || field_count > SK_HENTRY_TUPLE_MAX_FIELDS) {
+        return SKHEADER_ERR_BAD_FORMAT;
+    }
+    for (i = 0; i < field_count; ++i) {
+        if (field_ids[i] > UINT8_MAX) {
+            return SKHEADER_ERR_BAD_FORMAT;
+        }
+        fields[i] = (uint8_t)field_ids[i];
+    }
+
+    tu_hdr = tupleCreate(field_count, fields);
+    if (tu_hdr == NULL) {
+        return SKHEADER_ERR_ALLOC;
+    }
+    rv = skHeaderAddEntry(hdr, tu_hdr);
+    if (rv) {
+        tupleFree(tu_hdr);
+    }
+    return rv;
+}
+
+uint32_t
+skHentryTupleGetFieldCount(
+    const sk_header_entry_t    *hentry)
+{
+    const sk_hentry_tuple_t *tu_hdr = (sk_hentry_tuple_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+    return tu_hdr->tu_count;
+}
+
+uint32_t
+skHentryTupleGetFieldId(
+    const sk_header_entry_t    *hentry,
+    uint32_t                    position)
+{
+    const sk_hentry_tuple_t *tu_hdr = (sk_hentry_tuple_t*)hentry;
+
+    assert(skHeaderEntryGetTypeId(tu_hdr) == SK_HENTRY_TUPLE_ID);
+    if (position >= tu_hdr->tu_count) {
+        return UINT32_MAX;
+    }
+    return tu_hdr->tu_fields[position];
+}
+
+
 /*
 ** Local Variables:
 ** mode:c
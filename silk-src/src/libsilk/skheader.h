@@ -968,6 +968,104 @@ skHentryTombstoneGetCount(
     const sk_header_entry_t    *hentry);
 
 
+
+/*
+ *    **********************************************************************
+ *
+ *    The 'blockindex' header entry type marks a file where each
+ *    compressed block is preceded by a summary of the records in the
+ *    block.  The entry holds the version of the summary and its
+ *    length in octets.  See skStreamSetBlockPredicate().
+ *
+ *    **********************************************************************
+ */
+
+#define SK_HENTRY_BLOCKINDEX_ID 11
+
+/**
+ *    Append a new blockindex header.
+ *
+ *    Create a new blockindex header where each block summary has
+ *    version 'summary_version' and is 'summary_length' octets long,
+ *    and append it to 'hdr'.
+ */
+int
+skHeaderAddBlockIndex(
+    sk_file_header_t   *hdr,
+    uint32_t            summary_version,
+    uint32_t            summary_length);
+
+/**
+ *    Return the version of the block summaries described by this
+ *    blockindex header.
+ */
+uint32_t
+skHentryBlockIndexGetVersion(
+    const sk_header_entry_t    *hentry);
+
+/**
+ *    Return the length in octets of the block summaries described by
+ *    this blockindex header.
+ */
+uint32_t
+skHentryBlockIndexGetLength(
+    const sk_header_entry_t    *hentry);
+
+
+
+/*
+ *    **********************************************************************
+ *
+ *    The 'tuple' header entry type is used by the tuple files that
+ *    rwfilter writes with --tuple-save.  The entry holds the list of
+ *    fields (sIP, dIP, sPort, dPort, protocol) that make up each
+ *    fixed-length key in the file, in the order they appear in the
+ *    key.  Each field is identified by its rwrec_printable_fields_t
+ *    value.
+ *
+ *    **********************************************************************
+ */
+
+#define SK_HENTRY_TUPLE_ID      12
+
+/**
+ *    The maximum number of fields a tuple header may hold.
+ */
+#define SK_HENTRY_TUPLE_MAX_FIELDS  8
+
+/**
+ *    Append a new tuple header.
+ *
+ *    Create a new tuple header containing the 'field_count' field
+ *    identifiers in 'field_ids' and append it to 'hdr'.  Return
+ *    SKHEADER_ERR_BAD_FORMAT if 'field_count' is 0 or greater than
+ *    SK_HENTRY_TUPLE_MAX_FIELDS or if any identifier is larger than
+ *    UINT8_MAX.
+ */
+int
+skHeaderAddTuple(
+    sk_file_header_t   *hdr,
+    uint32_t            field_count,
+    const uint32_t     *field_ids);
+
+/**
+ *    Return the number of fields in this tuple header.
+ */
+uint32_t
+skHentryTupleGetFieldCount(
+    const sk_header_entry_t    *hentry);
+
+/**
+ *    Return the identifier of the field at position 'position' in
+ *    this tuple header.  Return UINT32_MAX if 'position' is not less
+ *    than the number of fields.
+ */
+uint32_t
+skHentryTupleGetFieldId(
+    const sk_header_entry_t    *hentry,
+    uint32_t                    position);
+
+
 #ifndef SKHEADER_SOURCE
 /* Define aliases required for consistency with previous releases of
  * SiLK. */
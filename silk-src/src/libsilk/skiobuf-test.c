@@ -25,6 +25,38 @@ static int datalen;
 
 #define FAIL do {assert(0); skAbort();} while (0)
 
+/* length of the block summary used by the tests */
+#define SUMMARY_SIZE 8
+
+
+/* write the block's sequence number into the summary */
+static void
+summary_write(
+    uint8_t            *summary,
+    void               *cb_data)
+{
+    uint32_t *count = (uint32_t*)cb_data;
+
+    memset(summary, 0, SUMMARY_SIZE);
+    memcpy(summary, count, sizeof(uint32_t));
+    ++*count;
+}
+
+/* verify the block's sequence number and read every block */
+static int
+summary_check(
+    const uint8_t      *summary,
+    void               *cb_data)
+{
+    uint32_t *count = (uint32_t*)cb_data;
+
+    if (memcmp(summary, count, sizeof(uint32_t))) {
+        FAIL;
+    }
+    ++*count;
+    return 1;
+}
+
 
 static char
 rval(
@@ -100,7 +132,9 @@ test(
     unsigned            numrecs,
     uint32_t            blocksize,
     unsigned            skipafter,
-    unsigned            skipfor)
+    unsigned            skipfor,
+    uint32_t            threads,
+    int                 summary)
 {
     char *name = strdup("/tmp/skiobuf-test.XXXXXX");
     int fd;
@@ -115,6 +149,7 @@ test(
     off_t off;
     char c;
     int skipping;
+    uint32_t summary_count;
 
     fd = mkstemp(name);
     if (fd == -1) {
@@ -141,6 +176,20 @@ test(
         FAIL;
     }
 
+    rv = skIOBufSetCompressionThreads(buf, threads);
+    if (rv == -1) {
+        FAIL;
+    }
+
+    summary_count = 0;
+    if (summary) {
+        rv = skIOBufSetBlockSummary(buf, SUMMARY_SIZE, &summary_write, NULL,
+                                    &summary_count);
+        if (rv == -1) {
+            FAIL;
+        }
+    }
+
     /* accept a max limit of 1MB */
     i32 = skIOBufUpperCompBlockSize(buf);
     fprintf(stderr, "%" PRIu32 "\n", i32);
@@ -184,6 +233,20 @@ test(
         FAIL;
     }
 
+    rv = skIOBufSetReadAhead(buf, threads);
+    if (rv == -1) {
+        FAIL;
+    }
+
+    summary_count = 0;
+    if (summary) {
+        rv = skIOBufSetBlockSummary(buf, SUMMARY_SIZE, NULL, &summary_check,
+                                    &summary_count);
+        if (rv == -1) {
+            FAIL;
+        }
+    }
+
     p = data;
     skip = 1;
     skipping = 0;
@@ -239,17 +302,35 @@ int main()
     testfile = create_test_data(&testfname, 10, 100000);
 
     test(SK_COMPMETHOD_NONE, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
-         0, 0);
-    test(SK_COMPMETHOD_NONE, testfile, 10, 100000, 100, 50, 200);
+         0, 0, 0, 0);
+    test(SK_COMPMETHOD_NONE, testfile, 10, 100000, 100, 50, 200, 0, 0);
 #if SK_ENABLE_ZLIB
     test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
-         0, 0);
-    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, 100, 50, 200);
+         0, 0, 0, 0);
+    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, 100, 50, 200, 0, 0);
+    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
+         0, 0, 1, 0);
+    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, 100, 50, 200, 4, 0);
+    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
+         0, 0, 0, 1);
+    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, 100, 50, 200, 0, 1);
+    test(SK_COMPMETHOD_ZLIB, testfile, 10, 100000, 100, 50, 200, 4, 1);
 #endif
 #if SK_ENABLE_LZO
     test(SK_COMPMETHOD_LZO1X, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
-         0, 0);
-    test(SK_COMPMETHOD_LZO1X, testfile, 10, 100000, 100, 50, 200);
+         0, 0, 0, 0);
+    test(SK_COMPMETHOD_LZO1X, testfile, 10, 100000, 100, 50, 200, 0, 0);
+    test(SK_COMPMETHOD_LZO1X, testfile, 10, 100000, 100, 50, 200, 4, 0);
+#endif
+#if SK_ENABLE_ZSTD
+    test(SK_COMPMETHOD_ZSTD, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
+         0, 0, 0, 0);
+    test(SK_COMPMETHOD_ZSTD, testfile, 10, 100000, 100, 50, 200, 4, 0);
+#endif
+#if SK_ENABLE_LZ4
+    test(SK_COMPMETHOD_LZ4, testfile, 10, 100000, SKIOBUF_DEFAULT_BLOCKSIZE,
+         0, 0, 0, 0);
+    test(SK_COMPMETHOD_LZ4, testfile, 10, 100000, 100, 50, 200, 4, 0);
 #endif
 
     delete_test_data(testfname, testfile, 10, 100000);
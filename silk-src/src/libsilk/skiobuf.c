@@ -23,6 +23,12 @@ SK_DIAGNOSTIC_IGNORE_PUSH("-Wundef")
 #if SK_ENABLE_SNAPPY
 #include <snappy-c.h>
 #endif
+#if SK_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+#if SK_ENABLE_LZ4
+#include <lz4.h>
+#endif
 #if SK_ENABLE_LZO
 #include SK_LZO_HEADER_NAME
 #endif
@@ -94,6 +100,91 @@ typedef struct compr_sizes_st {
 } compr_sizes_t;
 
 
+/*
+ *    When read-ahead is enabled on an IO buffer reader, each
+ *    iobuf_block_t holds one block that a worker thread has read from
+ *    disk and uncompressed.  When compression threads are enabled on
+ *    an IO buffer writer, each iobuf_block_t holds one block the
+ *    caller has filled that a worker thread compresses and writes.
+ *    If the worker could not process the block, the error is stored
+ *    on the block and is copied to the IO buffer when the caller
+ *    reaches that block.
+ */
+typedef struct iobuf_block_st {
+    /* Buffer holding the compressed block */
+    uint8_t        *compr_buf;
+    /* Buffer holding the uncompressed block */
+    uint8_t        *uncompr_buf;
+    /* Sizes of the compressed and uncompressed buffers */
+    uint32_t        compr_buf_size;
+    uint32_t        uncompr_buf_size;
+    /* Number of bytes of compressed data in 'compr_buf' */
+    uint32_t        compr_size;
+    /* Number of bytes of uncompressed data in 'uncompr_buf' */
+    uint32_t        uncompr_size;
+    /* Number of bytes read from disk for this block, including the
+     * compr_sizes_t header and any blocks that were skipped */
+    uint64_t        disk_bytes;
+    /* The errno or internal error code of an error */
+    int             io_errno;
+    /* Source code line of the error */
+    uint32_t        error_line;
+    /* The sequence number of this block in the stream */
+    uint64_t        seq;
+    /* When writing, the summary of the block */
+    uint8_t        *summary;
+    /* Set once the worker has finished with the block */
+    unsigned        is_ready  : 1;
+    /* Set when the block is the end of the stream */
+    unsigned        at_eof    : 1;
+    /* Error flags; see the same members on sk_iobuf_t */
+    unsigned        has_error : 1;
+    unsigned        has_interr: 1;
+    unsigned        has_ioerr : 1;
+} iobuf_block_t;
+
+
+/*
+ *    The iobuf_pool_t holds the worker threads and the ring of blocks
+ *    that are used for read-ahead or for parallel compression.  Block
+ *    number 'seq' of the stream uses blocks[seq % block_count].
+ */
+typedef struct iobuf_pool_st {
+    /* The worker threads */
+    pthread_t      *threads;
+    /* The ring of blocks */
+    iobuf_block_t  *blocks;
+    uint32_t        thread_count;
+    uint32_t        block_count;
+    /* Protects the members below and the 'is_ready' and 'seq'
+     * members of each block */
+    pthread_mutex_t mutex;
+    /* Signaled when a block becomes ready or is released */
+    pthread_cond_t  cond;
+    /* Held by the worker that is reading from the file descriptor,
+     * which ensures the blocks are read in order */
+    pthread_mutex_t io_mutex;
+    /* The sequence number of the next block a worker claims */
+    uint64_t        next_work_seq;
+    /* When reading, the sequence number of the next block to give to
+     * the caller; when writing, the number of blocks the caller has
+     * filled */
+    uint64_t        next_user_seq;
+    /* When reading, the number of blocks the caller has finished
+     * with; when writing, the number of blocks written to disk */
+    uint64_t        released;
+    /* When writing, the block that had an error */
+    iobuf_block_t  *err_block;
+    /* Set when the workers should exit */
+    unsigned        stop      : 1;
+    /* Set once a worker has reached end of file or an error; no more
+     * blocks are read or written */
+    unsigned        io_done   : 1;
+    /* Set while the caller is using block (next_user_seq - 1) */
+    unsigned        holding   : 1;
+} iobuf_pool_t;
+
+
 /*
  *    sk_iobuf_t represents an IO buffer.
  */
@@ -136,6 +227,21 @@ struct sk_iobuf_st {
     /* Function pointers that operate on the file descriptor */
     skio_abstract_t io;
 
+    /* The read-ahead worker threads and blocks, or NULL */
+    iobuf_pool_t   *pool;
+    /* Number of worker threads set by skIOBufSetReadAhead() or
+     * skIOBufSetCompressionThreads() */
+    uint32_t        worker_threads;
+
+    /* The per-block summary set by skIOBufSetBlockSummary().  When
+     * reading, 'summary_buf' holds the summary of the current
+     * block */
+    uint8_t                *summary_buf;
+    skio_summary_fn_t       summary_fn;
+    skio_summary_check_fn_t summary_check_fn;
+    void                   *summary_data;
+    uint32_t                summary_size;
+
     /* Total bytes read from or written to disk */
     off_t           total;
 
@@ -431,6 +537,79 @@ snappy_uncompr_method(
 #endif  /* SK_ENABLE_SNAPPY */
 
 
+#if !SK_ENABLE_ZSTD
+#define ZSTD_METHODS     SKIOBUF_METHOD_PLACEHOLDER
+#else
+#define ZSTD_METHODS                            \
+    {                                           \
+        NULL,                                   \
+        NULL,                                   \
+        zstd_compr_size_method,                 \
+        zstd_compr_method,                      \
+        zstd_uncompr_method,                    \
+        1                                       \
+    }
+
+/* Compression level to use for zstd */
+#define SKIOBUF_ZSTD_LEVEL  3
+
+/* Forward declarations for zstd methods */
+static uint32_t
+zstd_compr_size_method(
+    uint32_t            compr_size,
+    const iobuf_opts_t *opts);
+static int
+zstd_compr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts);
+static int
+zstd_uncompr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts);
+#endif  /* SK_ENABLE_ZSTD */
+
+
+#if !SK_ENABLE_LZ4
+#define LZ4_METHODS      SKIOBUF_METHOD_PLACEHOLDER
+#else
+#define LZ4_METHODS                             \
+    {                                           \
+        NULL,                                   \
+        NULL,                                   \
+        lz4_compr_size_method,                  \
+        lz4_compr_method,                       \
+        lz4_uncompr_method,                     \
+        1                                       \
+    }
+
+/* Forward declarations for lz4 methods */
+static uint32_t
+lz4_compr_size_method(
+    uint32_t            compr_size,
+    const iobuf_opts_t *opts);
+static int
+lz4_compr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts);
+static int
+lz4_uncompr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts);
+#endif  /* SK_ENABLE_LZ4 */
+
+
 /*
  *    Variable to hold the methods for each type of compression that
  *    SiLK supports.
@@ -440,9 +619,16 @@ static const iobuf_methods_t methods[] = {
     { NULL, NULL, NULL, NULL, NULL, 0 },
     ZLIB_METHODS,
     LZO_METHODS,
-    SNAPPY_METHODS
+    SNAPPY_METHODS,
+    ZSTD_METHODS,
+    LZ4_METHODS
 };
 
+/* Forward declaration for read-ahead */
+static void
+iobufPoolStop(
+    sk_iobuf_t         *fd);
+
 
 /* FUNCTION DEFINITIONS */
 
@@ -485,6 +671,7 @@ skIOBufDestroy(
     /* The flush call sets an error on a reader, but that's okay,
        since we are freeing the structure */
     skIOBufFlush(fd);
+    iobufPoolStop(fd);
     if (fd->io.free_fd) {
         fd->io.free_fd(fd->fd);
     }
@@ -495,6 +682,7 @@ skIOBufDestroy(
     if (fd->uncompr_buf) {
         free(fd->uncompr_buf);
     }
+    free(fd->summary_buf);
     method = &methods[fd->compr_method];
     if (method->uninit_method) {
         method->uninit_method(&fd->compr_opts);
@@ -582,6 +770,12 @@ skIOBufBindAbstract(
 #endif
 #if SK_ENABLE_SNAPPY
       case SK_COMPMETHOD_SNAPPY:
+#endif
+#if SK_ENABLE_ZSTD
+      case SK_COMPMETHOD_ZSTD:
+#endif
+#if SK_ENABLE_LZ4
+      case SK_COMPMETHOD_LZ4:
 #endif
         break;
 
@@ -604,6 +798,7 @@ skIOBufBindAbstract(
             SKIOBUF_INTERNAL_ERROR(fd, ESKIO_INITFAIL);
         }
     }
+    iobufPoolStop(fd);
     if (fd->io.free_fd) {
         fd->io.free_fd(fd->fd);
     }
@@ -655,6 +850,53 @@ skIOBufBindAbstract(
 }
 
 
+/*
+ *  count = iobufSkipBytes(fd, len);
+ *
+ *    Move the file descriptor on the IO buffer 'fd' forward 'len'
+ *    bytes, seeking when the file descriptor supports it and reading
+ *    the bytes otherwise.  Used to skip blocks whose summary the
+ *    caller rejected.
+ *
+ *    Return the number of bytes skipped, which is less than 'len' at
+ *    end of file.  Return -1 on error.
+ */
+static ssize_t
+iobufSkipBytes(
+    sk_iobuf_t         *fd,
+    uint32_t            len)
+{
+    uint8_t discard[4096];
+    ssize_t readlen;
+    size_t total = 0;
+
+    if (!fd->no_seek) {
+        errno = 0;
+        if (fd->io.seek(fd->fd, len, SEEK_CUR) != (off_t)(-1)) {
+            return len;
+        }
+        if (errno != ESPIPE) {
+            return -1;
+        }
+        fd->no_seek = 1;
+    }
+
+    while (total < len) {
+        readlen = fd->io.read(fd->fd, discard,
+                              ((len - total < sizeof(discard))
+                               ? (len - total) : sizeof(discard)));
+        if (readlen == -1) {
+            return -1;
+        }
+        if (readlen == 0) {
+            break;
+        }
+        total += readlen;
+    }
+    return (ssize_t)total;
+}
+
+
 /* Handle actual read and decompression of a block */
 static int32_t
 skio_uncompr(
@@ -699,6 +941,7 @@ skio_uncompr(
         new_block_size = fd->max_bytes;
         padded_uncomp_block_size = fd->max_bytes;
     } else {
+      next_block:
         /* Read in the compressed block sizes */
         readlen = fd->io.read(fd->fd, &comp_block_size,
                               sizeof(comp_block_size));
@@ -745,6 +988,34 @@ skio_uncompr(
          *   has this requirement.  Account for that padding here.
          */
         padded_uncomp_block_size = 3 + uncomp_block_size;
+
+        /* Read the summary of the block, and move to the next block
+         * if the caller does not want this one */
+        if (fd->summary_size) {
+            readlen = fd->io.read(fd->fd, fd->summary_buf, fd->summary_size);
+            if (readlen == -1) {
+                SKIOBUF_IO_ERROR(fd);
+            }
+            fd->total += readlen;
+            if ((size_t)readlen < fd->summary_size) {
+                fd->at_eof = 1;
+                SKIOBUF_INTERNAL_ERROR(fd, ESKIO_SHORTREAD);
+            }
+            if (fd->summary_check_fn
+                && !fd->summary_check_fn(fd->summary_buf, fd->summary_data))
+            {
+                readlen = iobufSkipBytes(fd, comp_block_size);
+                if (readlen == -1) {
+                    SKIOBUF_IO_ERROR(fd);
+                }
+                fd->total += readlen;
+                if ((size_t)readlen < comp_block_size) {
+                    fd->at_eof = 1;
+                    SKIOBUF_INTERNAL_ERROR(fd, ESKIO_SHORTREAD);
+                }
+                goto next_block;
+            }
+        }
     }
 
     /* Make sure block sizes aren't too large */
@@ -893,146 +1164,594 @@ skio_uncompr(
 }
 
 
-/* Read data from an IO buffer.  If 'c' is non-null, stop when the
- * char '*c' is encountered. */
-static ssize_t
-iobufRead(
+/*
+ *    Set the error state on the read-ahead block 'blk' and return -1.
+ *    These are similar to SKIOBUF_INTERNAL_ERROR() and
+ *    SKIOBUF_IO_ERROR().
+ */
+#define SKIOBUF_BLOCK_INTERNAL_ERROR(blk, err)  \
+    {                                           \
+        (blk)->io_errno = (int)(err);           \
+        (blk)->has_error = 1;                   \
+        (blk)->has_interr = 1;                  \
+        (blk)->error_line = __LINE__;           \
+        return -1;                              \
+    }
+
+#define SKIOBUF_BLOCK_IO_ERROR(blk)             \
+    {                                           \
+        (blk)->io_errno = errno;                \
+        (blk)->has_error = 1;                   \
+        (blk)->has_ioerr = 1;                   \
+        (blk)->error_line = __LINE__;           \
+        return -1;                              \
+    }
+
+
+/*
+ *  status = iobufReadAheadFill(fd, blk);
+ *
+ *    Read the sizes of the next compressed block and the compressed
+ *    block itself from the file descriptor on the IO buffer 'fd' into
+ *    the read-ahead block 'blk'.  The caller must hold the pool's
+ *    'io_mutex'.
+ *
+ *    Return 1 if a block was read.  Return 0 at end of file and set
+ *    the 'at_eof' member of 'blk'.  Return -1 and set the error state
+ *    of 'blk' on error.
+ */
+static int
+iobufReadAheadFill(
     sk_iobuf_t         *fd,
-    void               *buf,
-    size_t              count,
-    const int          *c)
+    iobuf_block_t      *blk)
 {
-    ssize_t       total   = 0;
-    int           found_c = 0;
-    skio_uncomp_t mode;
-
-    assert(fd);
+    compr_sizes_t sizes;
+    ssize_t readlen;
 
-    /* Take care of boundary conditions */
-    if (fd == NULL) {
-        return -1;
+  next_block:
+    /* Read in the compressed and uncompressed block sizes */
+    readlen = fd->io.read(fd->fd, &sizes.compr_size,
+                          sizeof(sizes.compr_size));
+    if (readlen == -1) {
+        SKIOBUF_BLOCK_IO_ERROR(blk);
     }
-    if (fd->has_error) {
-        return -1;
-    }
-    if (fd->is_writer) {
-        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOREAD);
+    if (readlen == 0) {
+        blk->at_eof = 1;
+        return 0;
     }
-    if (!fd->fd_valid) {
-        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOFD);
+    blk->disk_bytes += readlen;
+    if ((size_t)readlen < sizeof(sizes.compr_size)) {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_SHORTREAD);
     }
-    if (count == 0) {
+    if (sizes.compr_size == 0) {
+        blk->at_eof = 1;
         return 0;
     }
-
-    assert(count <= SSIZE_MAX);
-    if (count > SSIZE_MAX) {
-        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_TOOBIG);
+    readlen = fd->io.read(fd->fd, &sizes.uncompr_size,
+                          sizeof(sizes.uncompr_size));
+    if (readlen == -1) {
+        SKIOBUF_BLOCK_IO_ERROR(blk);
     }
-
-    /* If we don't need the bytes, skip them */
-    if (buf == NULL && c == NULL) {
-        mode = SKIO_UNCOMP_SKIP;
-    } else {
-        mode = SKIO_UNCOMP_NORMAL;
+    blk->disk_bytes += readlen;
+    if ((size_t)readlen < sizeof(sizes.uncompr_size)) {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_SHORTREAD);
     }
+    blk->compr_size = ntohl(sizes.compr_size);
+    blk->uncompr_size = ntohl(sizes.uncompr_size);
 
-    /* Transfer the bytes */
-    while (count && !found_c) {
-        size_t   left = fd->max_bytes - fd->pos;
-        size_t   num;
-        void    *bufpos;
-
-        /* If we have no bytes, we must get some. */
-        if (left == 0) {
-            int32_t uncompr_size;
-
-            if (fd->at_eof) {
-                break;
-            }
-            uncompr_size = skio_uncompr(fd, mode);
-            if (uncompr_size == -1) {
-                /* In an error condition, return those bytes we have
-                 * successfully read.  A subsequent call to
-                 * iobufRead() will return -1 because fd->has_error
-                 * will be set. */
-                return total ? total : -1;
-            }
-            fd->used = 1;
-            left = fd->max_bytes;
-            if (uncompr_size == 0) {
-                assert(fd->at_eof);
-                break;
-            }
-
-        } else if (!fd->is_uncompr && mode == SKIO_UNCOMP_NORMAL) {
-            /* Read and/or uncompress real data, if needed. */
-            int32_t rv = skio_uncompr(fd, SKIO_UNCOMP_REREAD);
-            if (rv == -1) {
-                return total ? total : -1;
+    /* Read the summary; see skio_uncompr() */
+    if (fd->summary_size) {
+        readlen = fd->io.read(fd->fd, fd->summary_buf, fd->summary_size);
+        if (readlen == -1) {
+            SKIOBUF_BLOCK_IO_ERROR(blk);
+        }
+        blk->disk_bytes += readlen;
+        if ((size_t)readlen < fd->summary_size) {
+            SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_SHORTREAD);
+        }
+        if (fd->summary_check_fn
+            && !fd->summary_check_fn(fd->summary_buf, fd->summary_data))
+        {
+            readlen = iobufSkipBytes(fd, blk->compr_size);
+            if (readlen == -1) {
+                SKIOBUF_BLOCK_IO_ERROR(blk);
             }
-            if (rv == 0) {
-                assert(fd->at_eof);
-                break;
+            blk->disk_bytes += readlen;
+            if ((size_t)readlen < blk->compr_size) {
+                SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_SHORTREAD);
             }
+            goto next_block;
         }
+    }
 
-        /* Calculate how many bytes to read from our current buffer */
-        num = (count < left) ? count : left;
+    /* Allow for padding; see skio_uncompr() */
+    if (blk->compr_size > SKIOBUF_MAX_BLOCKSIZE ||
+        3 + blk->uncompr_size > SKIOBUF_MAX_BLOCKSIZE)
+    {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_BLOCKSIZE);
+    }
 
-        /* Copy the bytes, and update the data */
-        bufpos = &fd->uncompr_buf[fd->pos];
-        if (buf != NULL) {
-            if (c != NULL) {
-                void *after = memccpy(buf, bufpos, *c, num);
-                if (after != NULL) {
-                    found_c = 1;
-                    num = ((uint8_t *)after) - ((uint8_t *)buf);
-                }
-            } else {
-                memcpy(buf, bufpos, num);
-            }
-            buf = (uint8_t *)buf + num;
-        } else if (c != NULL) {
-            void *after = memchr(bufpos, *c, num);
-            if (after != NULL) {
-                found_c = 1;
-                num = ((uint8_t *)after) - ((uint8_t *)bufpos) + 1;
-            }
+    /* Reallocate buffers if necessary */
+    if (blk->compr_size > blk->compr_buf_size) {
+        free(blk->compr_buf);
+        blk->compr_buf = (uint8_t*)malloc(blk->compr_size);
+        if (blk->compr_buf == NULL) {
+            blk->compr_buf_size = 0;
+            SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_MALLOC);
         }
-        fd->pos += num;
-        total += num;
-        count -= num;
+        blk->compr_buf_size = blk->compr_size;
+    }
+    if (3 + blk->uncompr_size > blk->uncompr_buf_size) {
+        free(blk->uncompr_buf);
+        blk->uncompr_buf = (uint8_t*)malloc(3 + blk->uncompr_size);
+        if (blk->uncompr_buf == NULL) {
+            blk->uncompr_buf_size = 0;
+            SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_MALLOC);
+        }
+        blk->uncompr_buf_size = 3 + blk->uncompr_size;
     }
 
-    return total;
-}
-
+    /* Read the compressed data */
+    readlen = fd->io.read(fd->fd, blk->compr_buf, blk->compr_size);
+    if (readlen == -1) {
+        SKIOBUF_BLOCK_IO_ERROR(blk);
+    }
+    blk->disk_bytes += readlen;
+    if ((size_t)readlen < blk->compr_size) {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_SHORTREAD);
+    }
 
-/* Standard read function for skiobuf */
-ssize_t
-skIOBufRead(
-    sk_iobuf_t         *fd,
-    void               *buf,
-    size_t              count)
-{
-    return iobufRead(fd, buf, count, NULL);
+    return 1;
 }
 
-/* Read until buffer full or character in 'c' encountered */
-ssize_t
-skIOBufReadToChar(
+
+/*
+ *  status = iobufReadAheadUncompr(fd, blk);
+ *
+ *    Uncompress the data in the read-ahead block 'blk' using the
+ *    compression method of the IO buffer 'fd'.  Return 0 on success.
+ *    Return -1 and set the error state of 'blk' on error.
+ *
+ *    The caller does not hold any lock, so the decompression methods
+ *    must not modify the compression options on 'fd'.
+ */
+static int
+iobufReadAheadUncompr(
     sk_iobuf_t         *fd,
-    void               *buf,
-    size_t              count,
-    int                 c)
+    iobuf_block_t      *blk)
 {
-    return iobufRead(fd, buf, count, &c);
-}
+    const iobuf_methods_t *method;
+    uint32_t new_block_size;
 
+    method = &methods[fd->compr_method];
 
-/* Push 'count' bytes from 'buf' back into the read buffer.  */
-ssize_t
+    new_block_size = blk->uncompr_buf_size;
+    if (method->uncompr_method(blk->uncompr_buf, &new_block_size,
+                               blk->compr_buf, blk->compr_size,
+                               &fd->compr_opts))
+    {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_UNCOMP);
+    }
+    if (new_block_size != blk->uncompr_size) {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_UNCOMP);
+    }
+    return 0;
+}
+
+
+/*
+ *    THREAD ENTRY POINT
+ *
+ *    Entry point for each read-ahead thread.  The thread claims the
+ *    next block of the stream, reads it while holding the pool's
+ *    'io_mutex', and uncompresses it after releasing the lock so
+ *    that other threads may read the blocks that follow.
+ */
+static void *
+iobufReadAheadWorker(
+    void               *v_fd)
+{
+    sk_iobuf_t *fd = (sk_iobuf_t*)v_fd;
+    iobuf_pool_t *pool = fd->pool;
+    iobuf_block_t *blk;
+    int rv;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->io_mutex);
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->stop && !pool->io_done
+               && (pool->next_work_seq >= pool->released + pool->block_count))
+        {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->stop || pool->io_done) {
+            pthread_mutex_unlock(&pool->mutex);
+            pthread_mutex_unlock(&pool->io_mutex);
+            break;
+        }
+        blk = &pool->blocks[pool->next_work_seq % pool->block_count];
+        blk->seq = pool->next_work_seq;
+        ++pool->next_work_seq;
+        blk->is_ready = 0;
+        pthread_mutex_unlock(&pool->mutex);
+
+        blk->disk_bytes = 0;
+        blk->io_errno = 0;
+        blk->at_eof = 0;
+        blk->has_error = 0;
+        blk->has_interr = 0;
+        blk->has_ioerr = 0;
+
+        rv = iobufReadAheadFill(fd, blk);
+        if (rv != 1) {
+            /* no more blocks after this one */
+            pthread_mutex_lock(&pool->mutex);
+            pool->io_done = 1;
+            pthread_mutex_unlock(&pool->mutex);
+        }
+        pthread_mutex_unlock(&pool->io_mutex);
+
+        if (rv == 1) {
+            iobufReadAheadUncompr(fd, blk);
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        blk->is_ready = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+
+/*
+ *    Stop the worker threads on 'fd', if any, and free the blocks.
+ *    When reading, the uncompressed buffer on 'fd' may point into a
+ *    block, and the buffer is reset.  When writing, the caller must
+ *    flush 'fd' first.
+ */
+static void
+iobufPoolStop(
+    sk_iobuf_t         *fd)
+{
+    iobuf_pool_t *pool = fd->pool;
+    uint32_t i;
+
+    if (NULL == pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->thread_count; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    if (pool->holding) {
+        /* fd->uncompr_buf belongs to a block */
+        fd->uncompr_buf = NULL;
+        fd->pos = fd->max_bytes = 0;
+    }
+    for (i = 0; i < pool->block_count; ++i) {
+        free(pool->blocks[i].compr_buf);
+        free(pool->blocks[i].uncompr_buf);
+        free(pool->blocks[i].summary);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->io_mutex);
+    free(pool->blocks);
+    free(pool->threads);
+    free(pool);
+    fd->pool = NULL;
+}
+
+
+/*
+ *  status = iobufPoolStart(fd, worker_fn);
+ *
+ *    Create the blocks and start 'worker_threads' threads running
+ *    'worker_fn' on the IO buffer 'fd'.  Return 0 on success.  Return
+ *    -1 if memory cannot be allocated or no thread can be started; in
+ *    that case, 'fd' continues to read or write synchronously.
+ */
+static int
+iobufPoolStart(
+    sk_iobuf_t         *fd,
+    void             *(*worker_fn)(void *))
+{
+    iobuf_pool_t *pool;
+    uint32_t i;
+
+    assert(NULL == fd->pool);
+
+    pool = (iobuf_pool_t*)calloc(1, sizeof(iobuf_pool_t));
+    if (NULL == pool) {
+        return -1;
+    }
+    /* Allow each thread to work on a block while the caller holds a
+     * block and the same number of blocks wait for the caller or for
+     * their turn to be written */
+    pool->block_count = 1 + 2 * fd->worker_threads;
+    pool->blocks = ((iobuf_block_t*)
+                    calloc(pool->block_count, sizeof(iobuf_block_t)));
+    pool->threads = ((pthread_t*)
+                     calloc(fd->worker_threads, sizeof(pthread_t)));
+    if (NULL == pool->blocks || NULL == pool->threads) {
+        free(pool->blocks);
+        free(pool->threads);
+        free(pool);
+        return -1;
+    }
+    if (fd->is_writer && fd->summary_size) {
+        for (i = 0; i < pool->block_count; ++i) {
+            pool->blocks[i].summary = (uint8_t*)malloc(fd->summary_size);
+            if (NULL == pool->blocks[i].summary) {
+                while (i > 0) {
+                    free(pool->blocks[--i].summary);
+                }
+                free(pool->blocks);
+                free(pool->threads);
+                free(pool);
+                return -1;
+            }
+        }
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_mutex_init(&pool->io_mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    fd->pool = pool;
+    for (i = 0; i < fd->worker_threads; ++i) {
+        if (pthread_create(&pool->threads[pool->thread_count], NULL,
+                           worker_fn, fd))
+        {
+            break;
+        }
+        ++pool->thread_count;
+    }
+    if (0 == pool->thread_count) {
+        iobufPoolStop(fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ *  uncompr_size = iobufReadAheadNext(fd);
+ *
+ *    Wait for the next block of the stream to be ready, release the
+ *    block the caller was using, and make the new block the
+ *    uncompressed buffer of the IO buffer 'fd'.  This is the
+ *    read-ahead replacement for skio_uncompr().
+ *
+ *    Return the number of uncompressed bytes in the block, 0 at end
+ *    of file, or -1 on error.
+ */
+static int32_t
+iobufReadAheadNext(
+    sk_iobuf_t         *fd)
+{
+    iobuf_pool_t *pool = fd->pool;
+    iobuf_block_t *blk;
+
+    /* The block count is large enough that the workers can read the
+     * next block while the caller holds the current one */
+    blk = &pool->blocks[pool->next_user_seq % pool->block_count];
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!(blk->is_ready && blk->seq == pool->next_user_seq)) {
+        pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    fd->total += blk->disk_bytes;
+    blk->disk_bytes = 0;
+
+    if (blk->has_error) {
+        if (!fd->has_error) {
+            fd->io_errno = blk->io_errno;
+            fd->error_line = blk->error_line;
+            fd->has_interr = blk->has_interr;
+            fd->has_ioerr = blk->has_ioerr;
+            fd->has_error = 1;
+            if (blk->has_ioerr) {
+                fd->fd_valid = 0;
+            }
+        }
+        return -1;
+    }
+    if (blk->at_eof) {
+        fd->at_eof = 1;
+        return 0;
+    }
+
+    /* Release the current block */
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->holding) {
+        ++pool->released;
+        pthread_cond_broadcast(&pool->cond);
+    } else if (fd->uncompr_buf) {
+        /* the buffer was allocated by skIOBufUnget() */
+        free(fd->uncompr_buf);
+    }
+    pool->holding = 1;
+    ++pool->next_user_seq;
+    pthread_mutex_unlock(&pool->mutex);
+
+    fd->uncompr_buf = blk->uncompr_buf;
+    fd->uncompr_buf_size = blk->uncompr_buf_size;
+    fd->max_bytes = blk->uncompr_size;
+    fd->pos = 0;
+    fd->in_core = 1;
+    fd->is_uncompr = 1;
+
+    return blk->uncompr_size;
+}
+
+
+/* Read data from an IO buffer.  If 'c' is non-null, stop when the
+ * char '*c' is encountered. */
+static ssize_t
+iobufRead(
+    sk_iobuf_t         *fd,
+    void               *buf,
+    size_t              count,
+    const int          *c)
+{
+    ssize_t       total   = 0;
+    int           found_c = 0;
+    skio_uncomp_t mode;
+
+    assert(fd);
+
+    /* Take care of boundary conditions */
+    if (fd == NULL) {
+        return -1;
+    }
+    if (fd->has_error) {
+        return -1;
+    }
+    if (fd->is_writer) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOREAD);
+    }
+    if (!fd->fd_valid) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOFD);
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    assert(count <= SSIZE_MAX);
+    if (count > SSIZE_MAX) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_TOOBIG);
+    }
+
+    /* Start the read-ahead threads before reading the first block.
+     * They require the block sizes that precede each block. */
+    if (fd->worker_threads && !fd->used && NULL == fd->pool) {
+        const iobuf_methods_t *method = &methods[fd->compr_method];
+        if (!method->uncompr_method || !method->block_numbers
+            || iobufPoolStart(fd, &iobufReadAheadWorker))
+        {
+            fd->worker_threads = 0;
+        }
+    }
+
+    /* If we don't need the bytes, skip them.  When the blocks are
+     * being read ahead, there is no benefit to skipping. */
+    if (buf == NULL && c == NULL && NULL == fd->pool) {
+        mode = SKIO_UNCOMP_SKIP;
+    } else {
+        mode = SKIO_UNCOMP_NORMAL;
+    }
+
+    /* Transfer the bytes */
+    while (count && !found_c) {
+        size_t   left = fd->max_bytes - fd->pos;
+        size_t   num;
+        void    *bufpos;
+
+        /* If we have no bytes, we must get some. */
+        if (left == 0) {
+            int32_t uncompr_size;
+
+            if (fd->at_eof) {
+                break;
+            }
+            if (fd->pool) {
+                uncompr_size = iobufReadAheadNext(fd);
+            } else {
+                uncompr_size = skio_uncompr(fd, mode);
+            }
+            if (uncompr_size == -1) {
+                /* In an error condition, return those bytes we have
+                 * successfully read.  A subsequent call to
+                 * iobufRead() will return -1 because fd->has_error
+                 * will be set. */
+                return total ? total : -1;
+            }
+            fd->used = 1;
+            left = fd->max_bytes;
+            if (uncompr_size == 0) {
+                assert(fd->at_eof);
+                break;
+            }
+
+        } else if (!fd->is_uncompr && mode == SKIO_UNCOMP_NORMAL) {
+            /* Read and/or uncompress real data, if needed. */
+            int32_t rv = skio_uncompr(fd, SKIO_UNCOMP_REREAD);
+            if (rv == -1) {
+                return total ? total : -1;
+            }
+            if (rv == 0) {
+                assert(fd->at_eof);
+                break;
+            }
+        }
+
+        /* Calculate how many bytes to read from our current buffer */
+        num = (count < left) ? count : left;
+
+        /* Copy the bytes, and update the data */
+        bufpos = &fd->uncompr_buf[fd->pos];
+        if (buf != NULL) {
+            if (c != NULL) {
+                void *after = memccpy(buf, bufpos, *c, num);
+                if (after != NULL) {
+                    found_c = 1;
+                    num = ((uint8_t *)after) - ((uint8_t *)buf);
+                }
+            } else {
+                memcpy(buf, bufpos, num);
+            }
+            buf = (uint8_t *)buf + num;
+        } else if (c != NULL) {
+            void *after = memchr(bufpos, *c, num);
+            if (after != NULL) {
+                found_c = 1;
+                num = ((uint8_t *)after) - ((uint8_t *)bufpos) + 1;
+            }
+        }
+        fd->pos += num;
+        total += num;
+        count -= num;
+    }
+
+    return total;
+}
+
+
+/* Standard read function for skiobuf */
+ssize_t
+skIOBufRead(
+    sk_iobuf_t         *fd,
+    void               *buf,
+    size_t              count)
+{
+    return iobufRead(fd, buf, count, NULL);
+}
+
+/* Read until buffer full or character in 'c' encountered */
+ssize_t
+skIOBufReadToChar(
+    sk_iobuf_t         *fd,
+    void               *buf,
+    size_t              count,
+    int                 c)
+{
+    return iobufRead(fd, buf, count, &c);
+}
+
+
+/* Push 'count' bytes from 'buf' back into the read buffer.  */
+ssize_t
 skIOBufUnget(
     sk_iobuf_t         *fd,
     const void         *buf,
@@ -1088,78 +1807,364 @@ static int32_t
 skio_compr(
     sk_iobuf_t         *fd)
 {
-    uint32_t compr_size, uncompr_size;
-    uint32_t size;
-    ssize_t writelen;
-    uint8_t *bufpos;
-    const iobuf_methods_t *method;
+    uint32_t compr_size, uncompr_size;
+    uint32_t size;
+    ssize_t writelen;
+    uint8_t *bufpos;
+    const iobuf_methods_t *method;
+    uint32_t extra;
+    uint32_t offset;
+
+    assert(fd);
+
+    method = &methods[fd->compr_method];
+    uncompr_size = fd->pos;
+
+    extra = fd->pos % fd->block_quantum;
+    /* Programmer's error if we don't have complete records */
+    assert(extra == 0);
+    /* If assertions aren't turned on, at least pad the record */
+    if (extra != 0) {
+        memset(&fd->uncompr_buf[fd->pos], 0, extra);
+        uncompr_size += extra;
+    }
+
+    /* Extra bit added on for block sizes and the block summary */
+    offset = 0;
+    if (method->block_numbers) {
+        offset = sizeof(compr_sizes_t) + fd->summary_size;
+    }
+
+    /* Compress the block */
+    if (method->compr_method) {
+
+        /* Create the compression buffer, if necessary */
+        if (fd->compr_buf == NULL) {
+            fd->compr_buf = (uint8_t*)malloc(fd->compr_buf_size + offset);
+            if (fd->compr_buf == NULL) {
+                SKIOBUF_INTERNAL_ERROR(fd, ESKIO_MALLOC);
+            }
+        }
+
+        compr_size = fd->compr_buf_size;
+        if (method->compr_method(fd->compr_buf + offset, &compr_size,
+                                 fd->uncompr_buf, uncompr_size,
+                                 &fd->compr_opts) != 0)
+        {
+            SKIOBUF_INTERNAL_ERROR(fd, ESKIO_COMP);
+        }
+        bufpos = fd->compr_buf;
+    } else {
+        compr_size = fd->pos;
+        bufpos = fd->uncompr_buf;
+    }
+
+    size = compr_size + offset;
+
+    if (method->block_numbers) {
+        compr_sizes_t *sizes = (compr_sizes_t *)fd->compr_buf;
+
+        /* Write out the block numbers */
+        sizes->compr_size = htonl(compr_size);
+        sizes->uncompr_size = htonl(uncompr_size);
+
+        if (fd->summary_size) {
+            fd->summary_fn(fd->compr_buf + sizeof(compr_sizes_t),
+                           fd->summary_data);
+        }
+    }
+
+    /* Write out compressed data */
+    writelen = fd->io.write(fd->fd, bufpos, size);
+    if (writelen == -1) {
+        SKIOBUF_IO_ERROR(fd);
+    }
+    fd->total += writelen;
+    if ((size_t)writelen < size) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_SHORTWRITE);
+    }
+
+    fd->pos = 0;
+
+    return (int32_t)writelen;
+}
+
+
+/*
+ *  status = iobufWriteBehindCompr(fd, blk, opts);
+ *
+ *    Compress the data in the block 'blk' using the compression
+ *    method of the IO buffer 'fd' and the options 'opts', leaving
+ *    room for the block sizes and the block summary at the front of
+ *    'compr_buf'.  Return 0 on success.  Return -1 and set the error
+ *    state of 'blk' on error.
+ */
+static int
+iobufWriteBehindCompr(
+    sk_iobuf_t         *fd,
+    iobuf_block_t      *blk,
+    const iobuf_opts_t *opts)
+{
+    const iobuf_methods_t *method;
+    compr_sizes_t *sizes;
+    uint32_t compr_size;
+    uint32_t offset;
+
+    method = &methods[fd->compr_method];
+    offset = sizeof(compr_sizes_t) + fd->summary_size;
+
+    /* Create the compression buffer, if necessary */
+    if (blk->compr_buf == NULL) {
+        blk->compr_buf = (uint8_t*)malloc(fd->compr_buf_size + offset);
+        if (blk->compr_buf == NULL) {
+            SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_MALLOC);
+        }
+    }
+
+    compr_size = fd->compr_buf_size;
+    if (method->compr_method(blk->compr_buf + offset,
+                             &compr_size, blk->uncompr_buf,
+                             blk->uncompr_size, opts) != 0)
+    {
+        SKIOBUF_BLOCK_INTERNAL_ERROR(blk, ESKIO_COMP);
+    }
+
+    sizes = (compr_sizes_t *)blk->compr_buf;
+    sizes->compr_size = htonl(compr_size);
+    sizes->uncompr_size = htonl(blk->uncompr_size);
+    if (fd->summary_size) {
+        memcpy(blk->compr_buf + sizeof(compr_sizes_t), blk->summary,
+               fd->summary_size);
+    }
+    blk->compr_size = compr_size + offset;
+
+    return 0;
+}
+
+
+/*
+ *    THREAD ENTRY POINT
+ *
+ *    Entry point for each compression thread.  The thread claims the
+ *    next block the caller has filled, compresses it, waits until all
+ *    earlier blocks have been written, and writes the block.
+ */
+static void *
+iobufWriteBehindWorker(
+    void               *v_fd)
+{
+    sk_iobuf_t *fd = (sk_iobuf_t*)v_fd;
+    iobuf_pool_t *pool = fd->pool;
+    const iobuf_methods_t *method;
+    iobuf_block_t *blk;
+    iobuf_opts_t opts;
+    ssize_t writelen;
+
+    /* Methods that have an uninit_method keep state in their options
+     * that may not be shared across threads */
+    method = &methods[fd->compr_method];
+    opts = fd->compr_opts;
+    if (method->uninit_method) {
+        if (method->init_method(&opts)) {
+            pthread_mutex_lock(&pool->mutex);
+            pool->io_done = 1;
+            pthread_cond_broadcast(&pool->cond);
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->stop && !pool->io_done
+               && pool->next_work_seq >= pool->next_user_seq)
+        {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->stop || pool->io_done) {
+            break;
+        }
+        blk = &pool->blocks[pool->next_work_seq % pool->block_count];
+        ++pool->next_work_seq;
+        pthread_mutex_unlock(&pool->mutex);
+
+        iobufWriteBehindCompr(fd, blk, &opts);
+
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->stop && !pool->io_done && pool->released != blk->seq) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->stop || pool->io_done) {
+            break;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        /* Earlier blocks have been written; write this one */
+        writelen = 0;
+        if (!blk->has_error) {
+            writelen = fd->io.write(fd->fd, blk->compr_buf, blk->compr_size);
+            if (writelen == -1) {
+                blk->io_errno = errno;
+                blk->has_error = 1;
+                blk->has_ioerr = 1;
+                blk->error_line = __LINE__;
+                writelen = 0;
+            } else if ((size_t)writelen < blk->compr_size) {
+                blk->io_errno = ESKIO_SHORTWRITE;
+                blk->has_error = 1;
+                blk->has_interr = 1;
+                blk->error_line = __LINE__;
+            }
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        fd->total += writelen;
+        if (blk->has_error) {
+            pool->err_block = blk;
+            pool->io_done = 1;
+        } else {
+            ++pool->released;
+        }
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (method->uninit_method) {
+        method->uninit_method(&opts);
+    }
+    return NULL;
+}
+
+
+/*
+ *    Copy the error from the block that failed in the pool on the IO
+ *    buffer 'fd' to 'fd'.  If no block failed, a thread could not
+ *    initialize the compression method.  The caller must hold the
+ *    pool's mutex.
+ */
+static void
+iobufWriteBehindError(
+    sk_iobuf_t         *fd)
+{
+    iobuf_block_t *blk = fd->pool->err_block;
+
+    if (fd->has_error) {
+        return;
+    }
+    if (NULL == blk) {
+        fd->io_errno = ESKIO_INITFAIL;
+        fd->has_error = 1;
+        fd->has_interr = 1;
+        fd->error_line = __LINE__;
+    } else {
+        fd->io_errno = blk->io_errno;
+        fd->error_line = blk->error_line;
+        fd->has_interr = blk->has_interr;
+        fd->has_ioerr = blk->has_ioerr;
+        fd->has_error = 1;
+        if (blk->has_ioerr) {
+            fd->fd_valid = 0;
+        }
+    }
+}
+
+
+/*
+ *  status = iobufWriteBehindSubmit(fd);
+ *
+ *    Give the data in the uncompressed buffer of the IO buffer 'fd'
+ *    to the compression threads and replace the buffer with an empty
+ *    one.  This is the parallel replacement for skio_compr().  Return
+ *    0 on success, or -1 if an earlier block failed or memory cannot
+ *    be allocated.
+ */
+static int
+iobufWriteBehindSubmit(
+    sk_iobuf_t         *fd)
+{
+    iobuf_pool_t *pool = fd->pool;
+    iobuf_block_t *blk;
+    uint8_t *buf;
     uint32_t extra;
-    uint32_t offset;
-
-    assert(fd);
-
-    method = &methods[fd->compr_method];
-    uncompr_size = fd->pos;
 
+    /* See skio_compr() */
     extra = fd->pos % fd->block_quantum;
-    /* Programmer's error if we don't have complete records */
     assert(extra == 0);
-    /* If assertions aren't turned on, at least pad the record */
     if (extra != 0) {
         memset(&fd->uncompr_buf[fd->pos], 0, extra);
-        uncompr_size += extra;
+        fd->pos += extra;
     }
 
-    /* Extra bit added on for block sizes */
-    offset = method->block_numbers ? sizeof(compr_sizes_t) : 0;
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->io_done
+           && pool->next_user_seq >= pool->released + pool->block_count)
+    {
+        pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+    if (pool->io_done) {
+        iobufWriteBehindError(fd);
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+    blk = &pool->blocks[pool->next_user_seq % pool->block_count];
+    pthread_mutex_unlock(&pool->mutex);
 
-    /* Compress the block */
-    if (method->compr_method) {
+    /* The block is idle; swap its buffer with the caller's */
+    buf = blk->uncompr_buf;
+    blk->uncompr_buf = fd->uncompr_buf;
+    blk->uncompr_size = fd->pos;
+    blk->io_errno = 0;
+    blk->has_error = 0;
+    blk->has_interr = 0;
+    blk->has_ioerr = 0;
+    if (fd->summary_size) {
+        fd->summary_fn(blk->summary, fd->summary_data);
+    }
 
-        /* Create the compression buffer, if necessary */
-        if (fd->compr_buf == NULL) {
-            fd->compr_buf = (uint8_t*)malloc(fd->compr_buf_size + offset);
-            if (fd->compr_buf == NULL) {
-                SKIOBUF_INTERNAL_ERROR(fd, ESKIO_MALLOC);
-            }
-        }
+    pthread_mutex_lock(&pool->mutex);
+    blk->seq = pool->next_user_seq;
+    ++pool->next_user_seq;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
 
-        compr_size = fd->compr_buf_size;
-        if (method->compr_method(fd->compr_buf + offset, &compr_size,
-                                 fd->uncompr_buf, uncompr_size,
-                                 &fd->compr_opts) != 0)
-        {
-            SKIOBUF_INTERNAL_ERROR(fd, ESKIO_COMP);
+    fd->pos = 0;
+    fd->uncompr_buf = buf;
+    if (NULL == fd->uncompr_buf) {
+        fd->uncompr_buf = (uint8_t*)malloc(fd->uncompr_buf_size);
+        if (NULL == fd->uncompr_buf) {
+            SKIOBUF_INTERNAL_ERROR(fd, ESKIO_MALLOC);
         }
-        bufpos = fd->compr_buf;
-    } else {
-        compr_size = fd->pos;
-        bufpos = fd->uncompr_buf;
     }
 
-    size = compr_size + offset;
+    return 0;
+}
 
-    if (method->block_numbers) {
-        compr_sizes_t *sizes = (compr_sizes_t *)fd->compr_buf;
 
-        /* Write out the block numbers */
-        sizes->compr_size = htonl(compr_size);
-        sizes->uncompr_size = htonl(uncompr_size);
-    }
+/*
+ *  status = iobufWriteBehindWait(fd);
+ *
+ *    Wait for the compression threads on the IO buffer 'fd' to write
+ *    every block the caller has submitted.  Return 0 on success or -1
+ *    if a block failed.
+ */
+static int
+iobufWriteBehindWait(
+    sk_iobuf_t         *fd)
+{
+    iobuf_pool_t *pool = fd->pool;
+    int rv = 0;
 
-    /* Write out compressed data */
-    writelen = fd->io.write(fd->fd, bufpos, size);
-    if (writelen == -1) {
-        SKIOBUF_IO_ERROR(fd);
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->io_done && pool->released < pool->next_user_seq) {
+        pthread_cond_wait(&pool->cond, &pool->mutex);
     }
-    fd->total += writelen;
-    if ((size_t)writelen < size) {
-        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_SHORTWRITE);
+    if (pool->io_done) {
+        iobufWriteBehindError(fd);
+        rv = -1;
     }
+    pthread_mutex_unlock(&pool->mutex);
 
-    fd->pos = 0;
-
-    return (int32_t)writelen;
+    return rv;
 }
 
 
@@ -1192,6 +2197,16 @@ skIOBufWrite(
         SKIOBUF_INTERNAL_ERROR(fd, ESKIO_TOOBIG);
     }
 
+    /* Start the compression threads before writing the first block */
+    if (fd->worker_threads && NULL == fd->pool) {
+        const iobuf_methods_t *method = &methods[fd->compr_method];
+        if (!method->compr_method || !method->block_numbers
+            || iobufPoolStart(fd, &iobufWriteBehindWorker))
+        {
+            fd->worker_threads = 0;
+        }
+    }
+
     fd->used = 1;
 
     /* If the buffer hasn't been created yet, create it. */
@@ -1209,9 +2224,11 @@ skIOBufWrite(
 
         /* If we have filled the buffer, we must write it out. */
         if (left == 0) {
-            int32_t compr_size = skio_compr(fd);
-
-            if (compr_size == -1) {
+            if (fd->pool) {
+                if (iobufWriteBehindSubmit(fd)) {
+                    return -1;
+                }
+            } else if (skio_compr(fd) == -1) {
                 return -1;
             }
 
@@ -1249,7 +2266,14 @@ skIOBufFlush(
         SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOFD);
     }
 
-    if (fd->pos) {
+    if (fd->pool) {
+        if (fd->pos && iobufWriteBehindSubmit(fd)) {
+            return -1;
+        }
+        if (iobufWriteBehindWait(fd)) {
+            return -1;
+        }
+    } else if (fd->pos) {
         int32_t compr_size = skio_compr(fd);
         if (compr_size == -1) {
             return -1;
@@ -1269,11 +2293,20 @@ off_t
 skIOBufTotal(
     sk_iobuf_t         *fd)
 {
+    off_t total;
+
     assert(fd);
     if (fd == NULL) {
         return -1;
     }
 
+    if (fd->pool && fd->is_writer) {
+        /* the compression threads update the total */
+        pthread_mutex_lock(&fd->pool->mutex);
+        total = fd->total;
+        pthread_mutex_unlock(&fd->pool->mutex);
+        return total;
+    }
     return fd->total;
 }
 
@@ -1298,7 +2331,7 @@ skIOBufUpperCompBlockSize(
     }
 
     if (method->block_numbers) {
-        total += sizeof(compr_sizes_t);
+        total += sizeof(compr_sizes_t) + fd->summary_size;
     }
 
     return total;
@@ -1323,9 +2356,24 @@ skIOBufTotalUpperBound(
 
     method = &methods[fd->compr_method];
 
-    total = fd->total + fd->pos;
+    if (fd->pool) {
+        /* add the blocks that have not been written.  Read the total
+         * and the count of those blocks together, since a compression
+         * thread updates both when it writes a block */
+        uint64_t pending;
+
+        pthread_mutex_lock(&fd->pool->mutex);
+        total = fd->total;
+        pending = fd->pool->next_user_seq - fd->pool->released;
+        pthread_mutex_unlock(&fd->pool->mutex);
+        total += pending * skIOBufUpperCompBlockSize(fd);
+    } else {
+        total = fd->total;
+    }
+
+    total += fd->pos;
     if (method->block_numbers) {
-        total += sizeof(compr_sizes_t);
+        total += sizeof(compr_sizes_t) + fd->summary_size;
     }
     if (method->compr_size_method) {
         total += (method->compr_size_method(fd->max_bytes, &fd->compr_opts)
@@ -1393,6 +2441,97 @@ skIOBufSetRecordSize(
 }
 
 
+/* Sets the number of read-ahead threads */
+int
+skIOBufSetReadAhead(
+    sk_iobuf_t         *fd,
+    uint32_t            thread_count)
+{
+    assert(fd);
+    if (fd == NULL) {
+        return -1;
+    }
+    if (fd->is_writer) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOREAD);
+    }
+    if (fd->used) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_USED);
+    }
+    if (thread_count > SKIOBUF_MAX_WORKER_THREADS) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_BADOPT);
+    }
+
+    fd->worker_threads = thread_count;
+    return 0;
+}
+
+
+/* Sets the number of compression threads */
+int
+skIOBufSetCompressionThreads(
+    sk_iobuf_t         *fd,
+    uint32_t            thread_count)
+{
+    assert(fd);
+    if (fd == NULL) {
+        return -1;
+    }
+    if (!fd->is_writer) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_NOWRITE);
+    }
+    if (fd->used) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_USED);
+    }
+    if (thread_count > SKIOBUF_MAX_WORKER_THREADS) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_BADOPT);
+    }
+
+    fd->worker_threads = thread_count;
+    return 0;
+}
+
+
+/* Sets the per-block summary */
+int
+skIOBufSetBlockSummary(
+    sk_iobuf_t             *fd,
+    uint32_t                summary_size,
+    skio_summary_fn_t       summary_fn,
+    skio_summary_check_fn_t check_fn,
+    void                   *cb_data)
+{
+    assert(fd);
+    if (fd == NULL) {
+        return -1;
+    }
+    if (fd->used) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_USED);
+    }
+    if (summary_size > SKIOBUF_MAX_SUMMARYSIZE) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_BADOPT);
+    }
+    if (fd->is_writer && summary_size && NULL == summary_fn) {
+        SKIOBUF_INTERNAL_ERROR(fd, ESKIO_BADOPT);
+    }
+
+    free(fd->summary_buf);
+    fd->summary_buf = NULL;
+    fd->summary_size = 0;
+    if (summary_size && !fd->is_writer) {
+        fd->summary_buf = (uint8_t*)malloc(summary_size);
+        if (NULL == fd->summary_buf) {
+            SKIOBUF_INTERNAL_ERROR(fd, ESKIO_MALLOC);
+        }
+    }
+
+    fd->summary_size = summary_size;
+    fd->summary_fn = summary_fn;
+    fd->summary_check_fn = check_fn;
+    fd->summary_data = cb_data;
+    return 0;
+}
+
+
 /* Create an error message */
 const char *
 skIOBufStrError(
@@ -1851,6 +2990,145 @@ snappy_uncompr_method(
 #endif  /* SK_ENABLE_SNAPPY */
 
 
+#if SK_ENABLE_ZSTD
+
+/* ZSTD methods */
+
+/* iobuf_methods_t.init_method */
+
+/* iobuf_methods_t.uninit_method */
+
+/* iobuf_methods_t.compr_size_method */
+static uint32_t
+zstd_compr_size_method(
+    uint32_t            compr_size,
+    const iobuf_opts_t *opts)
+{
+    (void)opts;                 /* UNUSED */
+
+    return (uint32_t)ZSTD_compressBound(compr_size);
+}
+
+
+/* iobuf_methods_t.compr_method */
+static int
+zstd_compr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts)
+{
+    size_t rv;
+
+    (void)opts;                 /* UNUSED */
+
+    rv = ZSTD_compress(dest, *destlen, source, sourcelen,
+                       SKIOBUF_ZSTD_LEVEL);
+    if (ZSTD_isError(rv)) {
+        return -1;
+    }
+    *destlen = (uint32_t)rv;
+
+    return 0;
+}
+
+
+/* iobuf_methods_t.uncompr_method */
+static int
+zstd_uncompr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts)
+{
+    size_t rv;
+
+    (void)opts;                 /* UNUSED */
+
+    rv = ZSTD_decompress(dest, *destlen, source, sourcelen);
+    if (ZSTD_isError(rv)) {
+        return -1;
+    }
+    *destlen = (uint32_t)rv;
+
+    return 0;
+}
+
+#endif  /* SK_ENABLE_ZSTD */
+
+
+#if SK_ENABLE_LZ4
+
+/* LZ4 methods */
+
+/* iobuf_methods_t.init_method */
+
+/* iobuf_methods_t.uninit_method */
+
+/* iobuf_methods_t.compr_size_method */
+static uint32_t
+lz4_compr_size_method(
+    uint32_t            compr_size,
+    const iobuf_opts_t *opts)
+{
+    (void)opts;                 /* UNUSED */
+
+    return (uint32_t)LZ4_compressBound((int)compr_size);
+}
+
+
+/* iobuf_methods_t.compr_method */
+static int
+lz4_compr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts)
+{
+    int rv;
+
+    (void)opts;                 /* UNUSED */
+
+    rv = LZ4_compress_default((const char*)source, (char*)dest,
+                              (int)sourcelen, (int)*destlen);
+    if (rv <= 0) {
+        return -1;
+    }
+    *destlen = (uint32_t)rv;
+
+    return 0;
+}
+
+
+/* iobuf_methods_t.uncompr_method */
+static int
+lz4_uncompr_method(
+    void               *dest,
+    uint32_t           *destlen,
+    const void         *source,
+    uint32_t            sourcelen,
+    const iobuf_opts_t *opts)
+{
+    int rv;
+
+    (void)opts;                 /* UNUSED */
+
+    rv = LZ4_decompress_safe((const char*)source, (char*)dest,
+                             (int)sourcelen, (int)*destlen);
+    if (rv < 0) {
+        return -1;
+    }
+    *destlen = (uint32_t)rv;
+
+    return 0;
+}
+
+#endif  /* SK_ENABLE_LZ4 */
+
+
 /*
 ** Local Variables:
 ** mode:c
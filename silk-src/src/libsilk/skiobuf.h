@@ -46,12 +46,53 @@ RCSIDENTVAR(rcsID_SKIOBUF_H, "$SiLK: skiobuf.h ef14e54179be 2020-04-14 21:57:45Z
 #define SKIOBUF_DEFAULT_RECORDSIZE 1
 
 
+/**
+ *    The maximum number of threads skIOBufSetReadAhead() and
+ *    skIOBufSetCompressionThreads() accept.
+ */
+#define SKIOBUF_MAX_WORKER_THREADS 32
+
+
+/**
+ *    The maximum size of the per-block summary that
+ *    skIOBufSetBlockSummary() accepts.
+ */
+#define SKIOBUF_MAX_SUMMARYSIZE 0x1000
+
+
 /**
  *    The type of IO buffer objects
  */
 typedef struct sk_iobuf_st sk_iobuf_t;
 
 
+/**
+ *    Signature of the function an IO buffer writer calls as it
+ *    completes each block.  The function must fill 'summary' with the
+ *    summary of the data that was written to the block since the
+ *    previous call.  The size of 'summary' is the 'summary_size'
+ *    given to skIOBufSetBlockSummary().  The function is called by
+ *    the thread that writes to the IO buffer.
+ */
+typedef void
+(*skio_summary_fn_t)(
+    uint8_t        *summary,
+    void           *cb_data);
+
+/**
+ *    Signature of the function an IO buffer reader calls with the
+ *    summary of each block before it reads the block's data.  The
+ *    function should return 0 if the block may be skipped, or
+ *    non-zero to read the block.  When read-ahead is enabled, the
+ *    function is called by a read-ahead thread, but the calls are
+ *    never concurrent.
+ */
+typedef int
+(*skio_summary_check_fn_t)(
+    const uint8_t  *summary,
+    void           *cb_data);
+
+
 /*
  *    skIOBuf can wrap an abstract file descriptor 'fd' if it
  *    implements some of the following functions.  A reading skIOBuf
@@ -346,6 +387,75 @@ skIOBufSetRecordSize(
     uint32_t            size);
 
 
+/**
+ *     Sets the number of threads that read and uncompress blocks
+ *     ahead of the caller on an IO buffer created for reading.  When
+ *     'thread_count' is 0, blocks are read as they are needed.  This
+ *     function can only be called before the first read from the IO
+ *     buffer.  Returns 0 on success, -1 on error.
+ *
+ *     Read-ahead is only used for compression methods that store the
+ *     size of each block; it is ignored for SK_COMPMETHOD_NONE.  The
+ *     threads may read past the data the caller consumes, so the
+ *     underlying file descriptor must not be used by the caller
+ *     while the IO buffer is bound to it.
+ */
+int
+skIOBufSetReadAhead(
+    sk_iobuf_t         *iobuf,
+    uint32_t            thread_count);
+
+
+/**
+ *     Sets the number of threads that compress and write blocks on an
+ *     IO buffer created for writing.  When 'thread_count' is 0, each
+ *     block is compressed and written by the caller as it fills.
+ *     This function can only be called before the first write to the
+ *     IO buffer.  Returns 0 on success, -1 on error.
+ *
+ *     The blocks are written in order, so the output is identical to
+ *     that produced without threads.  The threads are only used for
+ *     compression methods that store the size of each block; the
+ *     setting is ignored for SK_COMPMETHOD_NONE.  Until
+ *     skIOBufFlush() returns, blocks the caller has filled may not
+ *     yet have been written to the underlying file descriptor.
+ */
+int
+skIOBufSetCompressionThreads(
+    sk_iobuf_t         *iobuf,
+    uint32_t            thread_count);
+
+
+/**
+ *     Stores a summary of 'summary_size' bytes between the block sizes
+ *     and the data of each compressed block.  This function can only
+ *     be called before the first read from or write to the IO buffer.
+ *     Returns 0 on success, -1 on error.
+ *
+ *     On an IO buffer created for writing, 'summary_fn' is required;
+ *     it is called to fill the summary as each block is completed.
+ *
+ *     On an IO buffer created for reading, 'check_fn' is called with
+ *     the summary of each block, and blocks for which it returns 0
+ *     are skipped without being uncompressed, using seek when the
+ *     file descriptor supports it.  'check_fn' may be NULL to read
+ *     every block.
+ *
+ *     'cb_data' is passed unchanged to 'summary_fn' and 'check_fn'.
+ *     Summaries are only stored for compression methods that store
+ *     the size of each block; the setting is ignored for
+ *     SK_COMPMETHOD_NONE.  The reader and writer of a file must agree
+ *     on 'summary_size'.
+ */
+int
+skIOBufSetBlockSummary(
+    sk_iobuf_t             *iobuf,
+    uint32_t                summary_size,
+    skio_summary_fn_t       summary_fn,
+    skio_summary_check_fn_t check_fn,
+    void                   *cb_data);
+
+
 /**
  *    Returns a string representing the error state of the IO buffer
  *    'buf'.  This is a static string similar to that used by
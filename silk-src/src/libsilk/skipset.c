@@ -455,6 +455,30 @@ RCSIDENT("$SiLK: skipset.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
  * root of the tree */
 #define IPSET_NO_PARENT                UINT32_MAX
 
+/* Number of lookups skIPSetCheckAddressBatch() advances together */
+#define IPSET_BATCH_GROUP              16
+
+/* Minimum number of leaves in each part of the address space that
+ * ipsetParallelCombine() hands to a thread */
+#define IPSET_PARALLEL_MIN_LEAVES      4096
+
+/* The number of ranges a skipset_builder_t buffers initially */
+#define IPSET_BUILDER_INITIAL_CAPACITY  (1 << 16)
+
+/* Return octet 'ro_k' of the 'lo' member of the ipset_range_t
+ * 'ro_range', where octet 0 is the least significant */
+#define IPSET_RANGE_OCTET(ro_range, ro_k)                       \
+    ((uint8_t)(((ro_k) < 8)                                     \
+               ? ((ro_range)->lo.ip[1] >> (8 * (ro_k)))         \
+               : ((ro_range)->lo.ip[0] >> (8 * ((ro_k) - 8)))))
+
+/* Hint that the memory at 'ip_addr' will be read soon */
+#ifdef __GNUC__
+#define IPSET_PREFETCH(ip_addr)        __builtin_prefetch(ip_addr)
+#else
+#define IPSET_PREFETCH(ip_addr)
+#endif
+
 /* Return the root index for an IPset */
 #define IPSET_ROOT_INDEX(iri_set)      ((iri_set)->s.v3->root_idx)
 
@@ -792,6 +816,24 @@ RCSIDENT("$SiLK: skipset.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 #define IPSET_IPV6_IS_ZERO(ipiz)                        \
     ((0 == (ipiz)->ip[0]) && (0 == (ipiz)->ip[1]))
 
+/* Compare two 'ipset_ipv6_t's; return -1, 0, or 1 */
+#define IPSET_IPV6_CMP(ipcmp_a, ipcmp_b)                                \
+    (((ipcmp_a)->ip[0] != (ipcmp_b)->ip[0])                             \
+     ? (((ipcmp_a)->ip[0] < (ipcmp_b)->ip[0]) ? -1 : 1)                 \
+     : (((ipcmp_a)->ip[1] < (ipcmp_b)->ip[1])                           \
+        ? -1                                                            \
+        : ((ipcmp_a)->ip[1] > (ipcmp_b)->ip[1])))
+
+/* Add one to or subtract one from an 'ipset_ipv6_t' */
+#define IPSET_IPV6_INCR(ipinc)                  \
+    if (0 == ++(ipinc)->ip[1]) {                \
+        ++(ipinc)->ip[0];                       \
+    }
+#define IPSET_IPV6_DECR(ipdec)                  \
+    if (0 == (ipdec)->ip[1]--) {                \
+        --(ipdec)->ip[0];                       \
+    }
+
 /* Set 'mb_result_ptr' to the number of leading 0 bits in
  * 'mb_expression', a 32 bit value */
 #define COUNT_MATCHING_BITS32(mb_result_ptr, mb_expression)     \
@@ -1099,6 +1141,84 @@ typedef struct ipset_intersect_st {
     skipset_iterator_t  iter;
 } ipset_intersect_t;
 
+/* Support structure for the parallel set operations: an inclusive
+ * range of IPs.  IPv4 addresses are held in the lower 32 bits of
+ * ip[1] with ip[0] set to 0. */
+typedef struct ipset_range_st {
+    ipset_ipv6_t        lo;
+    ipset_ipv6_t        hi;
+} ipset_range_t;
+
+/* The operations ipsetParallelCombine() performs */
+typedef enum ipset_combine_en {
+    IPSET_COMBINE_UNION,
+    IPSET_COMBINE_INTERSECT,
+    IPSET_COMBINE_SUBTRACT
+} ipset_combine_t;
+
+/* Support structure for the skIPSetBuilder functions; a sorted
+ * array of ranges */
+typedef struct ipset_run_st {
+    const ipset_range_t    *ranges;
+    size_t                  count;
+} ipset_run_t;
+
+/* Support structure for ipsetParallelCombine() and the skIPSetBuilder
+ * functions; one part of the address space or of the buffered ranges
+ * that is handled by a single thread */
+typedef struct ipset_part_st {
+    /* the IPsets being combined; the result is 'set_a' OP 'set_b' */
+    const skipset_t    *set_a;
+    const skipset_t    *set_b;
+    ipset_combine_t     op;
+    /* the sorted runs of buffered ranges being merged */
+    const ipset_run_t  *runs;
+    uint32_t            run_count;
+    /* space used when sorting 'ranges' */
+    ipset_range_t      *scratch;
+    /* the IPs that this part covers */
+    ipset_range_t       bounds;
+    /* the IPs in the result as sorted, non-adjacent ranges */
+    ipset_range_t      *ranges;
+    size_t              range_count;
+    size_t              range_capacity;
+    /* where to write the leaves of the result, or NULL to count
+     * them */
+    uint8_t            *leaves;
+    size_t              leaf_count;
+    /* SKIPSET_OK or the error that stopped the part */
+    int                 rv;
+    /* whether the leaves are IPv6 */
+    unsigned            is_ipv6 :1;
+} ipset_part_t;
+
+/* Support structure for ipsetParallelCombine(); visits the leaves of
+ * an IPset that overlap the bounds of an ipset_part_t */
+typedef struct ipset_part_iter_st {
+    const skipset_t    *ipset;
+    /* index of the next leaf to visit */
+    uint32_t            idx;
+    /* one more than the index of the final leaf */
+    uint32_t            end;
+    /* the current leaf limited to the bounds of the part */
+    ipset_range_t       cur;
+} ipset_part_iter_t;
+
+/* The skipset_builder_t; see skIPSetBuilderCreate() */
+struct skipset_builder_st {
+    /* the buffered ranges.  The first 'sorted_count' are sorted and
+     * neither overlap nor are adjacent; the others are in the order
+     * they were added */
+    ipset_range_t      *ranges;
+    size_t              count;
+    size_t              capacity;
+    size_t              sorted_count;
+    /* the maximum number of threads to use */
+    uint32_t            thread_count;
+    /* whether the ranges hold IPv6 addresses */
+    unsigned            is_ipv6 :1;
+};
+
 /* Support structure for printing the IPs in an IPset, used by
  * skIPSetPrint() and ipsetPrintCallback() */
 typedef struct ipset_print_st {
@@ -1443,6 +1563,452 @@ ipsetAllocEntries(
 }
 
 
+/*
+ *  node_idx = ipsetBuildTreeV4(ipset, first, last);
+ *  node_idx = ipsetBuildTreeV6(ipset, first, last);
+ *
+ *    Helper functions for ipsetBuildFromLeaves().
+ *
+ *    Create the node whose subtree holds the leaves of 'ipset' from
+ *    'first' to 'last' inclusive, creating any nodes below it, and
+ *    return the index of the node.  There must be at least two
+ *    leaves, and the nodes array must have room for the new nodes.
+ *
+ *    The node's prefix is the longest multiple of NUM_BITS that the
+ *    first and last leaves have in common; since the leaves are
+ *    sorted, every leaf between them shares that prefix.  Runs of
+ *    leaves that fall under the same child[] entry become subtrees.
+ */
+static uint32_t
+ipsetBuildTreeV4(
+    skipset_t          *ipset,
+    uint32_t            first,
+    uint32_t            last)
+{
+    ipset_node_v4_t *node;
+    const ipset_leaf_v4_t *leaf;
+    uint32_t node_idx;
+    uint32_t which_child;
+    uint32_t end_child;
+    uint32_t i;
+    uint32_t j;
+    uint8_t bitpos;
+
+    assert(first < last);
+    assert(ipset->s.v3->nodes.entry_count < ipset->s.v3->nodes.entry_capacity);
+
+    node_idx = ipset->s.v3->nodes.entry_count++;
+    node = NODE_PTR_V4(ipset, node_idx);
+    memset(node, 0, sizeof(ipset_node_v4_t));
+
+    COUNT_MATCHING_BITS32(&bitpos, (LEAF_PTR_V4(ipset, first)->ip
+                                    ^ LEAF_PTR_V4(ipset, last)->ip));
+    node->prefix = bitpos & ~(NUM_BITS - 1);
+    node->ip = LEAF_PTR_V4(ipset, first)->ip & ~(UINT32_MAX >> node->prefix);
+
+    for (i = first; i <= last; i = j + 1) {
+        leaf = LEAF_PTR_V4(ipset, i);
+        which_child = WHICH_CHILD_V4(leaf->ip, node->prefix);
+        j = i;
+        if (leaf->prefix < node->prefix + NUM_BITS) {
+            /* leaf covers several child[] entries */
+            end_child = (which_child - 1
+                         + (1u << (node->prefix + NUM_BITS - leaf->prefix)));
+            for (j = which_child; j <= end_child; ++j) {
+                node->child[j] = i;
+            }
+            NODEPTR_CHILD_SET_LEAF2(node, which_child, end_child);
+            NODEPTR_CHILD_SET_REPEAT2(node, 1 + which_child, end_child);
+            j = i;
+            continue;
+        }
+        while (j < last
+               && (WHICH_CHILD_V4(LEAF_PTR_V4(ipset, j + 1)->ip, node->prefix)
+                   == which_child))
+        {
+            ++j;
+        }
+        if (j == i) {
+            node->child[which_child] = i;
+            NODEPTR_CHILD_SET_LEAF(node, which_child);
+        } else {
+            node->child[which_child] = ipsetBuildTreeV4(ipset, i, j);
+        }
+    }
+
+    return node_idx;
+}
+
+#if SK_ENABLE_IPV6
+static uint32_t
+ipsetBuildTreeV6(
+    skipset_t          *ipset,
+    uint32_t            first,
+    uint32_t            last)
+{
+    ipset_node_v6_t *node;
+    const ipset_leaf_v6_t *leaf;
+    const ipset_leaf_v6_t *leaf_last;
+    uint32_t node_idx;
+    uint32_t which_child;
+    uint32_t end_child;
+    uint32_t i;
+    uint32_t j;
+    uint8_t bitpos;
+
+    assert(first < last);
+    assert(ipset->s.v3->nodes.entry_count < ipset->s.v3->nodes.entry_capacity);
+
+    node_idx = ipset->s.v3->nodes.entry_count++;
+    node = NODE_PTR_V6(ipset, node_idx);
+    memset(node, 0, sizeof(ipset_node_v6_t));
+
+    leaf = LEAF_PTR_V6(ipset, first);
+    leaf_last = LEAF_PTR_V6(ipset, last);
+    if (leaf->ip.ip[0] == leaf_last->ip.ip[0]) {
+        COUNT_MATCHING_BITS64(&bitpos, (leaf->ip.ip[1] ^ leaf_last->ip.ip[1]));
+        bitpos += 64;
+    } else {
+        COUNT_MATCHING_BITS64(&bitpos, (leaf->ip.ip[0] ^ leaf_last->ip.ip[0]));
+    }
+    node->prefix = bitpos & ~(NUM_BITS - 1);
+    IPSET_IPV6_COPY_AND_MASK(&node->ip, &leaf->ip, node->prefix);
+
+    for (i = first; i <= last; i = j + 1) {
+        leaf = LEAF_PTR_V6(ipset, i);
+        which_child = WHICH_CHILD_V6(&leaf->ip, node->prefix);
+        j = i;
+        if (leaf->prefix < node->prefix + NUM_BITS) {
+            /* leaf covers several child[] entries */
+            end_child = (which_child - 1
+                         + (1u << (node->prefix + NUM_BITS - leaf->prefix)));
+            for (j = which_child; j <= end_child; ++j) {
+                node->child[j] = i;
+            }
+            NODEPTR_CHILD_SET_LEAF2(node, which_child, end_child);
+            NODEPTR_CHILD_SET_REPEAT2(node, 1 + which_child, end_child);
+            j = i;
+            continue;
+        }
+        while (j < last
+               && (WHICH_CHILD_V6(&LEAF_PTR_V6(ipset, j + 1)->ip,
+                                  node->prefix)
+                   == which_child))
+        {
+            ++j;
+        }
+        if (j == i) {
+            node->child[which_child] = i;
+            NODEPTR_CHILD_SET_LEAF(node, which_child);
+        } else {
+            node->child[which_child] = ipsetBuildTreeV6(ipset, i, j);
+        }
+    }
+
+    return node_idx;
+}
+#endif  /* SK_ENABLE_IPV6 */
+
+
+/*
+ *  status = ipsetBuildFromLeaves(ipset, leaf_count);
+ *
+ *    Create the nodes of the Radix-Tree based IPset 'ipset' from its
+ *    leaves, which must be at positions 1 through 'leaf_count' of the
+ *    leaves array.  The leaves must be sorted by IP, must not
+ *    overlap, and must already be combined into the largest possible
+ *    CIDR blocks.  Any nodes 'ipset' had are discarded.  The IPset is
+ *    clean on return.
+ *
+ *    This builds the tree in a single pass over the leaves instead of
+ *    inserting each leaf from the root.
+ *
+ *    Return SKIPSET_OK on success, or SKIPSET_ERR_ALLOC if memory
+ *    cannot be allocated.
+ */
+static int
+ipsetBuildFromLeaves(
+    skipset_t          *ipset,
+    uint32_t            leaf_count)
+{
+    uint32_t root_idx;
+
+    assert(ipset);
+    assert(0 == ipset->is_iptree);
+    assert(NULL == ipset->s.v3->mapped_file);
+    assert(0 == leaf_count || leaf_count < ipset->s.v3->leaves.entry_capacity);
+
+    ipset->s.v3->nodes.free_list = 0;
+    ipset->s.v3->leaves.free_list = 0;
+    ipset->is_dirty = 0;
+
+    if (0 == leaf_count) {
+        ipset->s.v3->nodes.entry_count = 0;
+        ipset->s.v3->leaves.entry_count = 0;
+        IPSET_ROOT_INDEX_SET(ipset, 0, 0);
+        return SKIPSET_OK;
+    }
+
+    /* a tree of N leaves has at most N-1 nodes, and node#0 and leaf#0
+     * are always empty */
+    if (ipset->s.v3->nodes.entry_capacity < leaf_count) {
+        if (ipsetAllocEntries(&ipset->s.v3->nodes, leaf_count)) {
+            return SKIPSET_ERR_ALLOC;
+        }
+    }
+    memset(NODE_PTR(ipset, 0), 0, ipset->s.v3->nodes.entry_size);
+    memset(LEAF_PTR(ipset, 0), 0, ipset->s.v3->leaves.entry_size);
+    ipset->s.v3->nodes.entry_count = 1;
+    ipset->s.v3->leaves.entry_count = 1 + leaf_count;
+
+    if (1 == leaf_count) {
+        IPSET_ROOT_INDEX_SET(ipset, 1, 1);
+        return SKIPSET_OK;
+    }
+#if SK_ENABLE_IPV6
+    if (ipset->is_ipv6) {
+        root_idx = ipsetBuildTreeV6(ipset, 1, leaf_count);
+    } else
+#endif
+    {
+        root_idx = ipsetBuildTreeV4(ipset, 1, leaf_count);
+    }
+    IPSET_ROOT_INDEX_SET(ipset, root_idx, 0);
+    assert(0 == ipsetVerify(ipset));
+
+    return SKIPSET_OK;
+}
+
+
+/*
+ *  ipsetCheckAddressGroupIPTree(ipset, ipv4, count, found);
+ *
+ *    Helper function for skIPSetCheckAddressBatch().
+ *
+ *    Check whether each of the 'count' addresses in 'ipv4' whose
+ *    entry in 'found' is non-zero is present in the SiLK-2 IPTree
+ *    'ipset', and set that entry of 'found' to 1 when it is and to 0
+ *    when it is not.  The addresses whose entry in 'found' is 0 are
+ *    not checked.
+ *
+ *    The top-level pointers of all the addresses are prefetched
+ *    before any are read, and the bitmaps they reference are
+ *    prefetched before any bit is tested.
+ */
+static void
+ipsetCheckAddressGroupIPTree(
+    const skipset_t    *ipset,
+    const uint32_t     *ipv4,
+    size_t              count,
+    uint8_t            *found)
+{
+    const skIPNode_t *node[IPSET_BATCH_GROUP];
+    const skIPTree_t *iptree = ipset->s.v2;
+    size_t i;
+
+    assert(count <= IPSET_BATCH_GROUP);
+
+    for (i = 0; i < count; ++i) {
+        IPSET_PREFETCH(&iptree->nodes[ipv4[i] >> 16]);
+    }
+    for (i = 0; i < count; ++i) {
+        node[i] = (found[i] ? iptree->nodes[ipv4[i] >> 16] : NULL);
+        if (node[i]) {
+            IPSET_PREFETCH(&node[i]->addressBlock[(ipv4[i] & 0xFFFF) >> 5]);
+        }
+    }
+    for (i = 0; i < count; ++i) {
+        found[i] = (node[i]
+                    && IPTREE_NODE_CHECK_BIT(node[i], (ipv4[i] & 0xFFFF)));
+    }
+}
+
+
+/*
+ *  ipsetCheckAddressGroupV4(ipset, ipv4, count, found);
+ *
+ *    Helper function for skIPSetCheckAddressBatch().
+ *
+ *    Check whether each of the 'count' addresses in 'ipv4' whose
+ *    entry in 'found' is non-zero is present in the SiLK-3 IPv4
+ *    IPset 'ipset', and set that entry of 'found' to 1 when it is and
+ *    to 0 when it is not.  The addresses whose entry in 'found' is 0
+ *    are not checked.
+ *
+ *    The result for each address is the same as
+ *    ipsetFindV4(ipset, ipv4[i], 32, NULL) == SKIPSET_OK, but rather
+ *    than walking the tree once for each address, each pass over the
+ *    addresses moves every unfinished search down one level and
+ *    prefetches the node or leaf it visits next.  Fetching the next
+ *    level of one search overlaps with the work on the others.
+ */
+static void
+ipsetCheckAddressGroupV4(
+    const skipset_t    *ipset,
+    const uint32_t     *ipv4,
+    size_t              count,
+    uint8_t            *found)
+{
+    const ipset_node_v4_t *node;
+    const ipset_leaf_v4_t *leaf;
+    uint32_t idx[IPSET_BATCH_GROUP];
+    uint8_t is_leaf[IPSET_BATCH_GROUP];
+    uint8_t searching[IPSET_BATCH_GROUP];
+    uint32_t which_child;
+    uint8_t bitpos;
+    size_t active;
+    size_t i;
+
+    assert(count <= IPSET_BATCH_GROUP);
+    assert(0 == ipset->is_iptree);
+    assert(0 == ipset->is_ipv6);
+
+    if (IPSET_ISEMPTY(ipset)) {
+        memset(found, 0, count);
+        return;
+    }
+
+    for (i = 0; i < count; ++i) {
+        searching[i] = found[i];
+        found[i] = 0;
+        idx[i] = IPSET_ROOT_INDEX(ipset);
+        is_leaf[i] = IPSET_ROOT_IS_LEAF(ipset);
+    }
+
+    do {
+        active = 0;
+        for (i = 0; i < count; ++i) {
+            if (!searching[i]) {
+                continue;
+            }
+            if (is_leaf[i]) {
+                leaf = LEAF_PTR_V4(ipset, idx[i]);
+                COUNT_MATCHING_BITS32(&bitpos, (ipv4[i] ^ leaf->ip));
+                found[i] = (bitpos >= leaf->prefix);
+                searching[i] = 0;
+                continue;
+            }
+            assert(idx[i] < ipset->s.v3->nodes.entry_count);
+            node = NODE_PTR_V4(ipset, idx[i]);
+            COUNT_MATCHING_BITS32(&bitpos, (ipv4[i] ^ node->ip));
+            if (bitpos < node->prefix) {
+                searching[i] = 0;
+                continue;
+            }
+            which_child = WHICH_CHILD_V4(ipv4[i], node->prefix);
+            idx[i] = node->child[which_child];
+            if (0 == idx[i]) {
+                searching[i] = 0;
+                continue;
+            }
+            is_leaf[i] = BITMAP_GETBIT(node->child_is_leaf, which_child);
+            if (is_leaf[i]) {
+                IPSET_PREFETCH(LEAF_PTR_V4(ipset, idx[i]));
+            } else {
+                IPSET_PREFETCH(NODE_PTR_V4(ipset, idx[i]));
+            }
+            ++active;
+        }
+    } while (active);
+}
+
+
+#if SK_ENABLE_IPV6
+/*
+ *  ipsetCheckAddressGroupV6(ipset, ipv6, count, found);
+ *
+ *    Helper function for skIPSetCheckAddressBatch().
+ *
+ *    Like ipsetCheckAddressGroupV4() for the SiLK-3 IPv6 IPset
+ *    'ipset'; the result for each address is the same as
+ *    ipsetFindV6(ipset, &ipv6[i], 128, NULL) == SKIPSET_OK.
+ */
+static void
+ipsetCheckAddressGroupV6(
+    const skipset_t    *ipset,
+    const ipset_ipv6_t *ipv6,
+    size_t              count,
+    uint8_t            *found)
+{
+    const ipset_node_v6_t *node;
+    const ipset_leaf_v6_t *leaf;
+    const ipset_ipv6_t *ip;
+    uint32_t idx[IPSET_BATCH_GROUP];
+    uint8_t is_leaf[IPSET_BATCH_GROUP];
+    uint8_t searching[IPSET_BATCH_GROUP];
+    uint32_t which_child;
+    uint8_t bitpos;
+    size_t active;
+    size_t i;
+
+    assert(count <= IPSET_BATCH_GROUP);
+    assert(0 == ipset->is_iptree);
+    assert(ipset->is_ipv6);
+
+    if (IPSET_ISEMPTY(ipset)) {
+        memset(found, 0, count);
+        return;
+    }
+
+    for (i = 0; i < count; ++i) {
+        searching[i] = found[i];
+        found[i] = 0;
+        idx[i] = IPSET_ROOT_INDEX(ipset);
+        is_leaf[i] = IPSET_ROOT_IS_LEAF(ipset);
+    }
+
+    do {
+        active = 0;
+        for (i = 0; i < count; ++i) {
+            if (!searching[i]) {
+                continue;
+            }
+            ip = &ipv6[i];
+            if (is_leaf[i]) {
+                leaf = LEAF_PTR_V6(ipset, idx[i]);
+                if (ip->ip[0] == leaf->ip.ip[0]) {
+                    COUNT_MATCHING_BITS64(&bitpos,
+                                          (ip->ip[1] ^ leaf->ip.ip[1]));
+                    bitpos += 64;
+                } else {
+                    COUNT_MATCHING_BITS64(&bitpos,
+                                          (ip->ip[0] ^ leaf->ip.ip[0]));
+                }
+                found[i] = (bitpos >= leaf->prefix);
+                searching[i] = 0;
+                continue;
+            }
+            assert(idx[i] < ipset->s.v3->nodes.entry_count);
+            node = NODE_PTR_V6(ipset, idx[i]);
+            if (ip->ip[0] == node->ip.ip[0]) {
+                COUNT_MATCHING_BITS64(&bitpos, (ip->ip[1] ^ node->ip.ip[1]));
+                bitpos += 64;
+            } else {
+                COUNT_MATCHING_BITS64(&bitpos, (ip->ip[0] ^ node->ip.ip[0]));
+            }
+            if (bitpos < node->prefix) {
+                searching[i] = 0;
+                continue;
+            }
+            which_child = WHICH_CHILD_V6(ip, node->prefix);
+            idx[i] = node->child[which_child];
+            if (0 == idx[i]) {
+                searching[i] = 0;
+                continue;
+            }
+            is_leaf[i] = BITMAP_GETBIT(node->child_is_leaf, which_child);
+            if (is_leaf[i]) {
+                IPSET_PREFETCH(LEAF_PTR_V6(ipset, idx[i]));
+            } else {
+                IPSET_PREFETCH(NODE_PTR_V6(ipset, idx[i]));
+            }
+            ++active;
+        }
+    } while (active);
+}
+#endif  /* SK_ENABLE_IPV6 */
+
+
 /*
  *  use_iptree = ipsetCheckFormatEnvar();
  *
@@ -6650,19 +7216,1153 @@ ipsetOptionsHandler(
                           opt_arg);
             return -1;
         }
-        ipset_opts->record_version = (uint16_t)tmp32;
-        break;
-
-      case OPT_IPSET_INVOCATION_STRIP:
-        ipset_opts->invocation_strip = 1;
-        break;
+        ipset_opts->record_version = (uint16_t)tmp32;
+        break;
+
+      case OPT_IPSET_INVOCATION_STRIP:
+        ipset_opts->invocation_strip = 1;
+        break;
+
+      default:
+        skAbortBadCase(opt_index);
+    }
+
+    return 0;
+}
+
+
+/*
+ *  ipsetPartSpan(ipset, &first, &end);
+ *
+ *    Helper function for ipsetParallelCombine().
+ *
+ *    Set 'first' and 'end' to the index of the first leaf of the
+ *    clean Radix-Tree based IPset 'ipset' and to one more than the
+ *    index of its final leaf.  Set both to 0 when 'ipset' is empty.
+ */
+static void
+ipsetPartSpan(
+    const skipset_t    *ipset,
+    uint32_t           *first,
+    uint32_t           *end)
+{
+    if (IPSET_ISEMPTY(ipset)) {
+        *first = *end = 0;
+    } else if (IPSET_ROOT_IS_LEAF(ipset)) {
+        *first = IPSET_ROOT_INDEX(ipset);
+        *end = 1 + *first;
+    } else {
+        *first = 1;
+        *end = ipset->s.v3->leaves.entry_count;
+    }
+}
+
+
+/*
+ *  ipsetPartLeafToRange(ipset, leaf_idx, &range);
+ *
+ *    Helper function for ipsetParallelCombine().
+ *
+ *    Set 'range' to the first and last IPs of the leaf at 'leaf_idx'
+ *    in 'ipset'.
+ */
+static void
+ipsetPartLeafToRange(
+    const skipset_t    *ipset,
+    uint32_t            leaf_idx,
+    ipset_range_t      *range)
+{
+    const ipset_leaf_v4_t *leaf4;
+#if SK_ENABLE_IPV6
+    const ipset_leaf_v6_t *leaf6;
+
+    if (ipset->is_ipv6) {
+        leaf6 = LEAF_PTR_V6(ipset, leaf_idx);
+        range->lo = leaf6->ip;
+        range->hi = leaf6->ip;
+        if (leaf6->prefix < 64) {
+            range->hi.ip[0] |= (leaf6->prefix
+                                ? (UINT64_MAX >> leaf6->prefix) : UINT64_MAX);
+            range->hi.ip[1] = UINT64_MAX;
+        } else if (leaf6->prefix < 128) {
+            range->hi.ip[1] |= (UINT64_MAX >> (leaf6->prefix - 64));
+        }
+        return;
+    }
+#endif  /* SK_ENABLE_IPV6 */
+
+    leaf4 = LEAF_PTR_V4(ipset, leaf_idx);
+    range->lo.ip[0] = range->hi.ip[0] = 0;
+    range->lo.ip[1] = leaf4->ip;
+    range->hi.ip[1] = leaf4->ip | (UINT64_C(0xFFFFFFFF) >> leaf4->prefix);
+}
+
+
+/*
+ *  ipsetPartIteratorBind(iter, ipset, part);
+ *
+ *    Helper function for ipsetParallelCombine().
+ *
+ *    Prepare 'iter' to visit the leaves of 'ipset' that overlap the
+ *    bounds of 'part'.  Uses binary searches to find the first and
+ *    final leaves.
+ */
+static void
+ipsetPartIteratorBind(
+    ipset_part_iter_t  *iter,
+    const skipset_t    *ipset,
+    const ipset_part_t *part)
+{
+    ipset_range_t range;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+    uint32_t end;
+
+    iter->ipset = ipset;
+    ipsetPartSpan(ipset, &lo, &end);
+
+    /* find the first leaf whose final IP is not below the bounds */
+    hi = end;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        ipsetPartLeafToRange(ipset, mid, &range);
+        if (IPSET_IPV6_CMP(&range.hi, &part->bounds.lo) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    iter->idx = lo;
+
+    /* find the first leaf that is entirely above the bounds */
+    hi = end;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        ipsetPartLeafToRange(ipset, mid, &range);
+        if (IPSET_IPV6_CMP(&range.lo, &part->bounds.hi) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    iter->end = lo;
+}
+
+
+/*
+ *  have_range = ipsetPartIteratorNext(iter, part);
+ *
+ *    Helper function for ipsetParallelCombine().
+ *
+ *    Set the 'cur' member of 'iter' to the next leaf, limited to the
+ *    bounds of 'part', and return 1.  Return 0 when no leaves remain
+ *    within the bounds.
+ */
+static int
+ipsetPartIteratorNext(
+    ipset_part_iter_t  *iter,
+    const ipset_part_t *part)
+{
+    if (iter->idx >= iter->end) {
+        return 0;
+    }
+    ipsetPartLeafToRange(iter->ipset, iter->idx, &iter->cur);
+    ++iter->idx;
+    if (IPSET_IPV6_CMP(&iter->cur.lo, &part->bounds.lo) < 0) {
+        iter->cur.lo = part->bounds.lo;
+    }
+    if (IPSET_IPV6_CMP(&iter->cur.hi, &part->bounds.hi) > 0) {
+        iter->cur.hi = part->bounds.hi;
+    }
+    return 1;
+}
+
+
+/*
+ *  ipsetPartAppend(part, lo, hi);
+ *
+ *    Helper function for ipsetPartCombine() and ipsetPartMergeRuns().
+ *
+ *    Append the range from 'lo' to 'hi' to the ranges of 'part',
+ *    merging it with the final range when the two overlap or are
+ *    adjacent.  The ranges must be appended in order of their 'lo',
+ *    and the caller must ensure the ranges array has room.
+ */
+static void
+ipsetPartAppend(
+    ipset_part_t       *part,
+    const ipset_ipv6_t *lo,
+    const ipset_ipv6_t *hi)
+{
+    ipset_range_t *last;
+    ipset_ipv6_t next;
+
+    if (part->range_count) {
+        last = &part->ranges[part->range_count - 1];
+        next = last->hi;
+        if (IPSET_IPV6_CMP(&next, lo) < 0) {
+            IPSET_IPV6_INCR(&next);
+        }
+        if (IPSET_IPV6_CMP(&next, lo) >= 0) {
+            if (IPSET_IPV6_CMP(&last->hi, hi) < 0) {
+                last->hi = *hi;
+            }
+            return;
+        }
+    }
+    assert(part->range_count < part->range_capacity);
+    part->ranges[part->range_count].lo = *lo;
+    part->ranges[part->range_count].hi = *hi;
+    ++part->range_count;
+}
+
+
+/*
+ *  NULL = ipsetPartCombine(part);
+ *
+ *    Thread function for ipsetParallelCombine().
+ *
+ *    Fill the ranges of 'part' with the IPs that result from applying
+ *    the operation in 'part' to the leaves of the two IPsets that fall
+ *    within the bounds of 'part'.
+ */
+static void *
+ipsetPartCombine(
+    void               *v_part)
+{
+    ipset_part_t *part = (ipset_part_t*)v_part;
+    ipset_part_iter_t a;
+    ipset_part_iter_t b;
+    ipset_ipv6_t lo;
+    ipset_ipv6_t hi;
+    int have_a;
+    int have_b;
+    int consumed;
+
+    ipsetPartIteratorBind(&a, part->set_a, part);
+    ipsetPartIteratorBind(&b, part->set_b, part);
+
+    /* the result has no more ranges than the inputs have leaves */
+    part->range_capacity = (a.end - a.idx) + (b.end - b.idx);
+    if (part->range_capacity) {
+        part->ranges = ((ipset_range_t*)
+                        malloc(part->range_capacity * sizeof(ipset_range_t)));
+        if (NULL == part->ranges) {
+            part->range_capacity = 0;
+            part->rv = SKIPSET_ERR_ALLOC;
+            return NULL;
+        }
+    }
+
+    have_a = ipsetPartIteratorNext(&a, part);
+    have_b = ipsetPartIteratorNext(&b, part);
+
+    switch (part->op) {
+      case IPSET_COMBINE_UNION:
+        while ((have_a || have_b)) {
+            if (!have_b
+                || (have_a && IPSET_IPV6_CMP(&a.cur.lo, &b.cur.lo) <= 0))
+            {
+                ipsetPartAppend(part, &a.cur.lo, &a.cur.hi);
+                have_a = ipsetPartIteratorNext(&a, part);
+            } else {
+                ipsetPartAppend(part, &b.cur.lo, &b.cur.hi);
+                have_b = ipsetPartIteratorNext(&b, part);
+            }
+        }
+        break;
+
+      case IPSET_COMBINE_INTERSECT:
+        while (have_a && have_b) {
+            lo = ((IPSET_IPV6_CMP(&a.cur.lo, &b.cur.lo) > 0)
+                  ? a.cur.lo : b.cur.lo);
+            hi = ((IPSET_IPV6_CMP(&a.cur.hi, &b.cur.hi) < 0)
+                  ? a.cur.hi : b.cur.hi);
+            if (IPSET_IPV6_CMP(&lo, &hi) <= 0) {
+                ipsetPartAppend(part, &lo, &hi);
+            }
+            if (IPSET_IPV6_CMP(&a.cur.hi, &b.cur.hi) < 0) {
+                have_a = ipsetPartIteratorNext(&a, part);
+            } else {
+                have_b = ipsetPartIteratorNext(&b, part);
+            }
+        }
+        break;
+
+      case IPSET_COMBINE_SUBTRACT:
+        while (have_a) {
+            consumed = 0;
+            /* skip the ranges of 'b' that are below 'a' */
+            while (have_b && IPSET_IPV6_CMP(&b.cur.hi, &a.cur.lo) < 0) {
+                have_b = ipsetPartIteratorNext(&b, part);
+            }
+            /* remove the ranges of 'b' that overlap 'a' */
+            while (have_b && IPSET_IPV6_CMP(&b.cur.lo, &a.cur.hi) <= 0) {
+                if (IPSET_IPV6_CMP(&b.cur.lo, &a.cur.lo) > 0) {
+                    hi = b.cur.lo;
+                    IPSET_IPV6_DECR(&hi);
+                    ipsetPartAppend(part, &a.cur.lo, &hi);
+                }
+                if (IPSET_IPV6_CMP(&b.cur.hi, &a.cur.hi) >= 0) {
+                    /* nothing remains of 'a' */
+                    consumed = 1;
+                    break;
+                }
+                a.cur.lo = b.cur.hi;
+                IPSET_IPV6_INCR(&a.cur.lo);
+                have_b = ipsetPartIteratorNext(&b, part);
+            }
+            if (!consumed) {
+                ipsetPartAppend(part, &a.cur.lo, &a.cur.hi);
+            }
+            have_a = ipsetPartIteratorNext(&a, part);
+        }
+        break;
+    }
+
+    part->rv = SKIPSET_OK;
+    return NULL;
+}
+
+
+/*
+ *  NULL = ipsetPartMakeLeaves(part);
+ *
+ *    Thread function for ipsetPartsToIPSet().
+ *
+ *    Convert the ranges of 'part' to the largest possible CIDR blocks
+ *    and set the 'leaf_count' member of 'part' to the number of
+ *    blocks.  When the 'leaves' member of 'part' is not NULL, also
+ *    write the blocks there as leaves.
+ */
+static void *
+ipsetPartMakeLeaves(
+    void               *v_part)
+{
+    ipset_part_t *part = (ipset_part_t*)v_part;
+    const size_t leaf_size = (part->is_ipv6
+                              ? sizeof(ipset_leaf_v6_t)
+                              : sizeof(ipset_leaf_v4_t));
+    const uint32_t width = (part->is_ipv6 ? 128 : 32);
+    ipset_leaf_v4_t *leaf4;
+    ipset_ipv6_t lo;
+    ipset_ipv6_t mask;
+    ipset_ipv6_t end;
+    uint32_t bits;
+    size_t i;
+
+    part->leaf_count = 0;
+    for (i = 0; i < part->range_count; ++i) {
+        lo = part->ranges[i].lo;
+        for (;;) {
+            /* the largest block that starts at 'lo'... */
+            if (lo.ip[1]) {
+                bits = (((uint32_t)lo.ip[1])
+                        ? ipsetCountTrailingZeros((uint32_t)lo.ip[1])
+                        : 32 + ipsetCountTrailingZeros(lo.ip[1] >> 32));
+            } else if (lo.ip[0]) {
+                bits = 64 + (((uint32_t)lo.ip[0])
+                             ? ipsetCountTrailingZeros((uint32_t)lo.ip[0])
+                             : 32 + ipsetCountTrailingZeros(lo.ip[0] >> 32));
+            } else {
+                bits = width;
+            }
+            /* a leaf may not have a prefix of 0; the full address
+             * space is two leaves */
+            if (bits >= width) {
+                bits = width - 1;
+            }
+            /* ...that does not extend beyond the range */
+            for (;;) {
+                if (bits >= 128) {
+                    mask.ip[0] = mask.ip[1] = UINT64_MAX;
+                } else if (bits >= 64) {
+                    mask.ip[0] = ((bits > 64)
+                                  ? (UINT64_MAX >> (128 - bits)) : 0);
+                    mask.ip[1] = UINT64_MAX;
+                } else {
+                    mask.ip[0] = 0;
+                    mask.ip[1] = (bits ? (UINT64_MAX >> (64 - bits)) : 0);
+                }
+                end.ip[0] = lo.ip[0] | mask.ip[0];
+                end.ip[1] = lo.ip[1] | mask.ip[1];
+                if (IPSET_IPV6_CMP(&end, &part->ranges[i].hi) <= 0) {
+                    break;
+                }
+                --bits;
+            }
+
+            if (NULL == part->leaves) {
+                /* counting only */
+            } else {
+                memset(part->leaves + part->leaf_count * leaf_size, 0,
+                       leaf_size);
+#if SK_ENABLE_IPV6
+                if (part->is_ipv6) {
+                    ipset_leaf_v6_t *leaf6;
+                    leaf6 = ((ipset_leaf_v6_t*)
+                             (part->leaves + part->leaf_count * leaf_size));
+                    leaf6->ip = lo;
+                    leaf6->prefix = 128 - bits;
+                } else
+#endif  /* SK_ENABLE_IPV6 */
+                {
+                    leaf4 = ((ipset_leaf_v4_t*)
+                             (part->leaves + part->leaf_count * leaf_size));
+                    leaf4->ip = (uint32_t)lo.ip[1];
+                    leaf4->prefix = 32 - bits;
+                }
+            }
+            ++part->leaf_count;
+
+            if (IPSET_IPV6_CMP(&end, &part->ranges[i].hi) == 0) {
+                break;
+            }
+            lo = end;
+            IPSET_IPV6_INCR(&lo);
+        }
+    }
+
+    part->rv = SKIPSET_OK;
+    return NULL;
+}
+
+
+/*
+ *  status = ipsetParallelRun(parts, part_count, thread_fn);
+ *
+ *    Helper function for ipsetParallelCombine() and the
+ *    skIPSetBuilder functions.
+ *
+ *    Invoke 'thread_fn' on each of the 'part_count' entries in
+ *    'parts', using one thread per part.  The calling thread handles
+ *    the first part, and it also handles any part for which a thread
+ *    cannot be created.  Return the first error reported by a part.
+ */
+static int
+ipsetParallelRun(
+    ipset_part_t       *parts,
+    uint32_t            part_count,
+    void             *(*thread_fn)(void *))
+{
+    pthread_t *threads;
+    uint8_t *started;
+    uint32_t i;
+    int rv = SKIPSET_OK;
+
+    threads = (pthread_t*)calloc(part_count, sizeof(pthread_t));
+    started = (uint8_t*)calloc(part_count, sizeof(uint8_t));
+    if (threads && started) {
+        for (i = 1; i < part_count; ++i) {
+            started[i] = !pthread_create(&threads[i], NULL, thread_fn,
+                                         &parts[i]);
+        }
+    }
+    for (i = 0; i < part_count; ++i) {
+        if (!started || !started[i]) {
+            thread_fn(&parts[i]);
+        }
+    }
+    for (i = 0; i < part_count; ++i) {
+        if (started && started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    for (i = 0; i < part_count && SKIPSET_OK == rv; ++i) {
+        rv = parts[i].rv;
+    }
+
+    free(threads);
+    free(started);
+    return rv;
+}
+
+
+/*
+ *  ipsetPartsJoin(parts, part_count);
+ *
+ *    Helper function for ipsetParallelCombine() and the
+ *    skIPSetBuilder functions.
+ *
+ *    Join the ranges of the 'part_count' entries in 'parts' so that,
+ *    taken in order, the ranges of all parts are sorted and neither
+ *    overlap nor are adjacent.  The ranges within each part must
+ *    already have that property and the parts must be in order of the
+ *    'lo' of their first ranges.  A range that overlaps or touches
+ *    the first ranges of the following parts is extended over them,
+ *    and those ranges are removed.
+ */
+static void
+ipsetPartsJoin(
+    ipset_part_t       *parts,
+    uint32_t            part_count)
+{
+    ipset_range_t *last = NULL;
+    ipset_ipv6_t next;
+    size_t j;
+    uint32_t i;
+
+    for (i = 0; i < part_count; ++i) {
+        if (last) {
+            for (j = 0; j < parts[i].range_count; ++j) {
+                next = last->hi;
+                if (IPSET_IPV6_CMP(&next, &parts[i].ranges[j].lo) < 0) {
+                    IPSET_IPV6_INCR(&next);
+                    if (IPSET_IPV6_CMP(&next, &parts[i].ranges[j].lo) < 0) {
+                        break;
+                    }
+                }
+                if (IPSET_IPV6_CMP(&last->hi, &parts[i].ranges[j].hi) < 0) {
+                    last->hi = parts[i].ranges[j].hi;
+                }
+            }
+            if (j > 0) {
+                parts[i].range_count -= j;
+                memmove(parts[i].ranges, parts[i].ranges + j,
+                        parts[i].range_count * sizeof(ipset_range_t));
+            }
+        }
+        if (parts[i].range_count) {
+            last = &parts[i].ranges[parts[i].range_count - 1];
+        }
+    }
+}
+
+
+/*
+ *  status = ipsetPartsToIPSet(parts, part_count, is_ipv6, &out_ipset);
+ *
+ *    Helper function for ipsetParallelCombine() and the
+ *    skIPSetBuilder functions.
+ *
+ *    Create a new Radix-Tree based IPset that contains the ranges of
+ *    the 'part_count' entries in 'parts', which must have been joined
+ *    by ipsetPartsJoin(), and store it at the location referenced by
+ *    'out_ipset'.  The IPset holds IPv6 addresses if 'is_ipv6' is
+ *    non-zero.  Each part writes its leaves into its region of the
+ *    new IPset in a separate thread, and then the tree is built from
+ *    the sorted leaves.
+ */
+static int
+ipsetPartsToIPSet(
+    ipset_part_t       *parts,
+    uint32_t            part_count,
+    int                 is_ipv6,
+    skipset_t         **out_ipset)
+{
+    skipset_t *ipset = NULL;
+    size_t total;
+    uint32_t i;
+    int rv;
+
+    for (i = 0; i < part_count; ++i) {
+        parts[i].is_ipv6 = (is_ipv6 ? 1 : 0);
+        parts[i].leaves = NULL;
+    }
+
+    /* count the leaves each part creates, then have each part write
+     * its leaves into its region of the new IPset */
+    rv = ipsetParallelRun(parts, part_count, ipsetPartMakeLeaves);
+    if (rv) {
+        return rv;
+    }
+    total = 0;
+    for (i = 0; i < part_count; ++i) {
+        total += parts[i].leaf_count;
+    }
+    if (total >= UINT32_MAX) {
+        return SKIPSET_ERR_ALLOC;
+    }
+    rv = ipsetCreate(&ipset, is_ipv6, 1);
+    if (rv) {
+        return rv;
+    }
+    if (total) {
+        rv = ipsetAllocEntries(&ipset->s.v3->leaves, 1 + total);
+        if (rv) {
+            goto END;
+        }
+        total = 0;
+        for (i = 0; i < part_count; ++i) {
+            parts[i].leaves = (uint8_t*)LEAF_PTR(ipset, 1 + total);
+            total += parts[i].leaf_count;
+        }
+        rv = ipsetParallelRun(parts, part_count, ipsetPartMakeLeaves);
+        if (rv) {
+            goto END;
+        }
+    }
+
+    /* build the tree of the new IPset */
+    rv = ipsetBuildFromLeaves(ipset, (uint32_t)total);
+
+  END:
+    if (rv) {
+        skIPSetDestroy(&ipset);
+    }
+    *out_ipset = ipset;
+    return rv;
+}
+
+
+/*
+ *  use_parallel = IPSET_PARALLEL_USABLE(result_ipset, ipset, thread_count);
+ *
+ *    Return true when ipsetParallelCombine() may be used to combine
+ *    'result_ipset' and 'ipset'.  The parallel code handles
+ *    Radix-Tree based IPsets of the same IP version, and it requires
+ *    'ipset' to be clean since it cannot modify it.
+ */
+#define IPSET_PARALLEL_USABLE(ipu_result, ipu_ipset, ipu_thread_count)  \
+    ((ipu_thread_count) > 1                                             \
+     && !(ipu_result)->is_iptree && !(ipu_ipset)->is_iptree             \
+     && (ipu_result)->is_ipv6 == (ipu_ipset)->is_ipv6                   \
+     && !(ipu_ipset)->is_dirty)
+
+
+/*
+ *  status = ipsetParallelCombine(result_ipset, ipset, op, thread_count);
+ *
+ *    Helper function for skIPSetUnionParallel(),
+ *    skIPSetIntersectParallel(), and skIPSetSubtractParallel().
+ *
+ *    Replace the contents of 'result_ipset' with 'result_ipset' OP
+ *    'ipset' using at most 'thread_count' threads.  Both IPsets must
+ *    be clean Radix-Tree based IPsets of the same IP version.
+ *
+ *    The address space is split into ranges that hold roughly the
+ *    same number of leaves of the larger IPset, and each thread
+ *    computes the result for one range.  The ranges are then joined,
+ *    and the tree of the result is built from its sorted leaves.
+ */
+static int
+ipsetParallelCombine(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    ipset_combine_t     op,
+    uint32_t            thread_count)
+{
+    const skipset_t *larger;
+    ipset_part_t *parts;
+    skipset_v3_t *swap_v3;
+    skipset_t *tmp_ipset = NULL;
+    uint32_t part_count;
+    uint32_t first;
+    uint32_t end;
+    uint32_t leaf_count;
+    uint32_t i;
+    int rv;
+
+    assert(!result_ipset->is_iptree && !ipset->is_iptree);
+    assert(result_ipset->is_ipv6 == ipset->is_ipv6);
+    assert(!result_ipset->is_dirty && !ipset->is_dirty);
+
+    /* use the IPset with more leaves to choose the parts */
+    ipsetPartSpan(result_ipset, &first, &end);
+    larger = result_ipset;
+    leaf_count = end - first;
+    ipsetPartSpan(ipset, &i, &end);
+    if (end - i > leaf_count) {
+        larger = ipset;
+        first = i;
+        leaf_count = end - i;
+    }
+    part_count = leaf_count / IPSET_PARALLEL_MIN_LEAVES;
+    if (part_count > thread_count) {
+        part_count = thread_count;
+    }
+    if (part_count < 1) {
+        part_count = 1;
+    }
+
+    parts = (ipset_part_t*)calloc(part_count, sizeof(ipset_part_t));
+    if (NULL == parts) {
+        return SKIPSET_ERR_ALLOC;
+    }
+    for (i = 0; i < part_count; ++i) {
+        parts[i].set_a = result_ipset;
+        parts[i].set_b = ipset;
+        parts[i].op = op;
+        if (i > 0) {
+            ipsetPartLeafToRange(
+                larger, first + (uint32_t)((uint64_t)leaf_count * i
+                                           / part_count),
+                &parts[i].bounds);
+            parts[i-1].bounds.hi = parts[i].bounds.lo;
+            IPSET_IPV6_DECR(&parts[i-1].bounds.hi);
+        }
+    }
+    memset(&parts[0].bounds.lo, 0, sizeof(ipset_ipv6_t));
+    if (result_ipset->is_ipv6) {
+        parts[part_count-1].bounds.hi.ip[0] = UINT64_MAX;
+        parts[part_count-1].bounds.hi.ip[1] = UINT64_MAX;
+    } else {
+        parts[part_count-1].bounds.hi.ip[0] = 0;
+        parts[part_count-1].bounds.hi.ip[1] = UINT32_MAX;
+    }
+
+    rv = ipsetParallelRun(parts, part_count, ipsetPartCombine);
+    if (rv) {
+        goto END;
+    }
+
+    ipsetPartsJoin(parts, part_count);
+
+    rv = ipsetPartsToIPSet(parts, part_count, result_ipset->is_ipv6,
+                           &tmp_ipset);
+    if (rv) {
+        goto END;
+    }
+
+    /* move the new tree into the result; the old one is destroyed
+     * with the temporary IPset */
+    swap_v3 = result_ipset->s.v3;
+    result_ipset->s.v3 = tmp_ipset->s.v3;
+    tmp_ipset->s.v3 = swap_v3;
+    result_ipset->is_dirty = 0;
+
+  END:
+    skIPSetDestroy(&tmp_ipset);
+    for (i = 0; i < part_count; ++i) {
+        free(parts[i].ranges);
+    }
+    free(parts);
+    return rv;
+}
+
+
+/*
+ *  NULL = ipsetPartSortRanges(part);
+ *
+ *    Thread function for ipsetBuilderCompact().
+ *
+ *    Sort the ranges of 'part' by their 'lo' members using a
+ *    least-significant-digit radix sort over the octets of the
+ *    address.  The 'scratch' member of 'part' must have room for as
+ *    many ranges.  A pass is skipped when every range has the same
+ *    value for that octet, so IPv4 addresses and IPv6 addresses that
+ *    share a prefix need fewer passes.
+ */
+static void *
+ipsetPartSortRanges(
+    void               *v_part)
+{
+    ipset_part_t *part = (ipset_part_t*)v_part;
+    const size_t count = part->range_count;
+    const unsigned int key_octets = (part->is_ipv6 ? 16 : 4);
+    ipset_range_t *src = part->ranges;
+    ipset_range_t *dst = part->scratch;
+    ipset_range_t *tmp;
+    size_t (*offset)[256];
+    size_t total;
+    size_t c;
+    size_t i;
+    unsigned int k;
+    unsigned int b;
+
+    part->rv = SKIPSET_OK;
+    if (count < 2) {
+        return NULL;
+    }
+    offset = (size_t(*)[256])calloc(key_octets, sizeof(*offset));
+    if (NULL == offset) {
+        part->rv = SKIPSET_ERR_ALLOC;
+        return NULL;
+    }
+
+    /* count the values of every octet in a single pass */
+    for (i = 0; i < count; ++i) {
+        for (k = 0; k < key_octets; ++k) {
+            ++offset[k][IPSET_RANGE_OCTET(&src[i], k)];
+        }
+    }
+
+    for (k = 0; k < key_octets; ++k) {
+        if (offset[k][IPSET_RANGE_OCTET(&src[0], k)] == count) {
+            continue;
+        }
+        total = 0;
+        for (b = 0; b < 256; ++b) {
+            c = offset[k][b];
+            offset[k][b] = total;
+            total += c;
+        }
+        for (i = 0; i < count; ++i) {
+            dst[offset[k][IPSET_RANGE_OCTET(&src[i], k)]++] = src[i];
+        }
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != part->ranges) {
+        memcpy(part->ranges, src, count * sizeof(ipset_range_t));
+    }
+
+    free(offset);
+    return NULL;
+}
+
+
+/*
+ *  idx = ipsetRunSearch(run, ip, after);
+ *
+ *    Helper function for ipsetPartMergeRuns().
+ *
+ *    Return the index of the first range in the sorted 'run' whose
+ *    'lo' is not less than 'ip' when 'after' is 0, or is greater than
+ *    'ip' when 'after' is non-zero.  Return the number of ranges in
+ *    'run' when there is no such range.
+ */
+static size_t
+ipsetRunSearch(
+    const ipset_run_t  *run,
+    const ipset_ipv6_t *ip,
+    int                 after)
+{
+    size_t lo = 0;
+    size_t hi = run->count;
+    size_t mid;
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = IPSET_IPV6_CMP(&run->ranges[mid].lo, ip);
+        if (cmp < 0 || (after && 0 == cmp)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+/*
+ *  NULL = ipsetPartMergeRuns(part);
+ *
+ *    Thread function for ipsetBuilderCompact().
+ *
+ *    Merge the ranges of the sorted runs of 'part' whose 'lo' falls
+ *    within the bounds of 'part' into the ranges of 'part', combining
+ *    ranges that overlap or are adjacent.  The final range may extend
+ *    beyond the bounds of 'part'; ipsetPartsJoin() handles that.
+ */
+static void *
+ipsetPartMergeRuns(
+    void               *v_part)
+{
+    ipset_part_t *part = (ipset_part_t*)v_part;
+    const ipset_range_t *cur;
+    const ipset_range_t *min_range;
+    size_t *pos;
+    size_t *end;
+    uint32_t min;
+    uint32_t r;
+
+    pos = (size_t*)calloc(2 * part->run_count, sizeof(size_t));
+    if (NULL == pos) {
+        part->rv = SKIPSET_ERR_ALLOC;
+        return NULL;
+    }
+    end = pos + part->run_count;
+
+    /* find the ranges of each run that are within the bounds */
+    part->range_capacity = 0;
+    for (r = 0; r < part->run_count; ++r) {
+        pos[r] = ipsetRunSearch(&part->runs[r], &part->bounds.lo, 0);
+        end[r] = ipsetRunSearch(&part->runs[r], &part->bounds.hi, 1);
+        part->range_capacity += end[r] - pos[r];
+    }
+    if (part->range_capacity) {
+        part->ranges = ((ipset_range_t*)
+                        malloc(part->range_capacity * sizeof(ipset_range_t)));
+        if (NULL == part->ranges) {
+            part->range_capacity = 0;
+            free(pos);
+            part->rv = SKIPSET_ERR_ALLOC;
+            return NULL;
+        }
+    }
+
+    /* there are few runs, so find the smallest with a linear scan */
+    for (;;) {
+        min = part->run_count;
+        min_range = NULL;
+        for (r = 0; r < part->run_count; ++r) {
+            if (pos[r] < end[r]) {
+                cur = &part->runs[r].ranges[pos[r]];
+                if (NULL == min_range
+                    || IPSET_IPV6_CMP(&cur->lo, &min_range->lo) < 0)
+                {
+                    min = r;
+                    min_range = cur;
+                }
+            }
+        }
+        if (NULL == min_range) {
+            break;
+        }
+        ipsetPartAppend(part, &min_range->lo, &min_range->hi);
+        ++pos[min];
+    }
+
+    free(pos);
+    part->rv = SKIPSET_OK;
+    return NULL;
+}
+
+
+/*
+ *  part_count = ipsetPartCountFor(item_count, thread_count);
+ *
+ *    Helper function for the skIPSetBuilder functions.
+ *
+ *    Return the number of parts to use for 'item_count' items when
+ *    'thread_count' threads are available, so that each part has at
+ *    least IPSET_PARALLEL_MIN_LEAVES items.  The value is at least 1.
+ */
+static uint32_t
+ipsetPartCountFor(
+    size_t              item_count,
+    uint32_t            thread_count)
+{
+    size_t part_count = item_count / IPSET_PARALLEL_MIN_LEAVES;
+
+    if (part_count > thread_count) {
+        part_count = thread_count;
+    }
+    return ((part_count < 1) ? 1 : (uint32_t)part_count);
+}
+
+
+/*
+ *  status = ipsetBuilderCompact(builder);
+ *
+ *    Helper function for the skIPSetBuilder functions.
+ *
+ *    Sort the unsorted ranges at the end of 'builder' and merge them
+ *    with its sorted ranges, so that all ranges in 'builder' are
+ *    sorted and neither overlap nor are adjacent.
+ *
+ *    The unsorted ranges are split into chunks that are radix sorted
+ *    in separate threads.  The sorted ranges and the chunks are then
+ *    merged in separate threads, where each thread handles the part
+ *    of the address space that holds a similar number of the ranges
+ *    of the largest run.
+ */
+static int
+ipsetBuilderCompact(
+    skipset_builder_t  *builder)
+{
+    const ipset_run_t *largest;
+    ipset_part_t *parts;
+    ipset_run_t *runs;
+    ipset_range_t *scratch;
+    ipset_ipv6_t lo;
+    size_t unsorted;
+    size_t start;
+    size_t total;
+    uint32_t chunk_count;
+    uint32_t part_count;
+    uint32_t run_count;
+    uint32_t i;
+    int rv;
+
+    unsorted = builder->count - builder->sorted_count;
+    if (0 == unsorted) {
+        return SKIPSET_OK;
+    }
+    chunk_count = ipsetPartCountFor(unsorted, builder->thread_count);
+    part_count = ipsetPartCountFor(builder->count, builder->thread_count);
+
+    parts = ((ipset_part_t*)
+             calloc(((chunk_count > part_count) ? chunk_count : part_count),
+                    sizeof(ipset_part_t)));
+    runs = (ipset_run_t*)calloc(1 + chunk_count, sizeof(ipset_run_t));
+    scratch = (ipset_range_t*)malloc(unsorted * sizeof(ipset_range_t));
+    if (!parts || !runs || !scratch) {
+        free(parts);
+        free(runs);
+        free(scratch);
+        return SKIPSET_ERR_ALLOC;
+    }
+
+    /* sort the chunks; each becomes a run */
+    run_count = 0;
+    if (builder->sorted_count) {
+        runs[run_count].ranges = builder->ranges;
+        runs[run_count].count = builder->sorted_count;
+        ++run_count;
+    }
+    for (i = 0; i < chunk_count; ++i) {
+        start = unsorted * i / chunk_count;
+        parts[i].ranges = builder->ranges + builder->sorted_count + start;
+        parts[i].range_count = unsorted * (i + 1) / chunk_count - start;
+        parts[i].scratch = scratch + start;
+        parts[i].is_ipv6 = builder->is_ipv6;
+        runs[run_count].ranges = parts[i].ranges;
+        runs[run_count].count = parts[i].range_count;
+        ++run_count;
+    }
+    rv = ipsetParallelRun(parts, chunk_count, ipsetPartSortRanges);
+    free(scratch);
+    if (rv) {
+        free(parts);
+        free(runs);
+        return rv;
+    }
+
+    /* choose the bounds of the parts from the largest run, skipping
+     * any that would not be larger than the previous bound */
+    memset(parts, 0, part_count * sizeof(ipset_part_t));
+    largest = &runs[0];
+    for (i = 1; i < run_count; ++i) {
+        if (runs[i].count > largest->count) {
+            largest = &runs[i];
+        }
+    }
+    for (i = 1, total = 1; i < part_count; ++i) {
+        lo = largest->ranges[largest->count * i / part_count].lo;
+        if (IPSET_IPV6_CMP(&lo, &parts[total - 1].bounds.lo) > 0) {
+            parts[total].bounds.lo = lo;
+            parts[total - 1].bounds.hi = lo;
+            IPSET_IPV6_DECR(&parts[total - 1].bounds.hi);
+            ++total;
+        }
+    }
+    part_count = (uint32_t)total;
+    parts[part_count - 1].bounds.hi.ip[0] = UINT64_MAX;
+    parts[part_count - 1].bounds.hi.ip[1] = UINT64_MAX;
+    for (i = 0; i < part_count; ++i) {
+        parts[i].runs = runs;
+        parts[i].run_count = run_count;
+    }
+
+    /* merge the runs, and copy the result into the builder */
+    rv = ipsetParallelRun(parts, part_count, ipsetPartMergeRuns);
+    if (rv) {
+        goto END;
+    }
+    ipsetPartsJoin(parts, part_count);
+    total = 0;
+    for (i = 0; i < part_count; ++i) {
+        if (parts[i].range_count) {
+            memcpy(builder->ranges + total, parts[i].ranges,
+                   parts[i].range_count * sizeof(ipset_range_t));
+            total += parts[i].range_count;
+        }
+    }
+    builder->count = builder->sorted_count = total;
+
+  END:
+    for (i = 0; i < part_count; ++i) {
+        free(parts[i].ranges);
+    }
+    free(parts);
+    free(runs);
+    return rv;
+}
+
+
+/*
+ *  status = ipsetBuilderAppend(builder, lo, hi);
+ *
+ *    Helper function for the skIPSetBuilder functions.
+ *
+ *    Add the range from 'lo' to 'hi' to 'builder'.  When every range
+ *    in 'builder' is sorted and the new range does not precede the
+ *    final range, the new range is merged with the final range or is
+ *    kept as a sorted range.  Otherwise, the range is appended to the
+ *    unsorted ranges.  When the buffer is full, compact it, and grow
+ *    it if compacting does not free at least half of it.
+ */
+static int
+ipsetBuilderAppend(
+    skipset_builder_t  *builder,
+    const ipset_ipv6_t *lo,
+    const ipset_ipv6_t *hi)
+{
+    ipset_range_t *last;
+    ipset_range_t *new_ranges;
+    ipset_ipv6_t next;
+    int is_sorted = 0;
+    int rv;
+
+    if (builder->count == builder->sorted_count) {
+        if (0 == builder->count) {
+            is_sorted = 1;
+        } else {
+            last = &builder->ranges[builder->count - 1];
+            if (IPSET_IPV6_CMP(lo, &last->lo) >= 0) {
+                next = last->hi;
+                if (IPSET_IPV6_CMP(&next, lo) < 0) {
+                    IPSET_IPV6_INCR(&next);
+                }
+                if (IPSET_IPV6_CMP(&next, lo) >= 0) {
+                    if (IPSET_IPV6_CMP(&last->hi, hi) < 0) {
+                        last->hi = *hi;
+                    }
+                    return SKIPSET_OK;
+                }
+                is_sorted = 1;
+            }
+        }
+    }
+
+    if (builder->count == builder->capacity) {
+        rv = ipsetBuilderCompact(builder);
+        if (rv) {
+            return rv;
+        }
+        if (builder->count > builder->capacity / 2) {
+            new_ranges = ((ipset_range_t*)
+                          realloc(builder->ranges,
+                                  (2 * builder->capacity
+                                   * sizeof(ipset_range_t))));
+            if (NULL == new_ranges) {
+                return SKIPSET_ERR_ALLOC;
+            }
+            builder->ranges = new_ranges;
+            builder->capacity *= 2;
+        }
+    }
 
-      default:
-        skAbortBadCase(opt_index);
+    builder->ranges[builder->count].lo = *lo;
+    builder->ranges[builder->count].hi = *hi;
+    ++builder->count;
+    if (is_sorted) {
+        ++builder->sorted_count;
     }
+    return SKIPSET_OK;
+}
 
-    return 0;
+
+#if SK_ENABLE_IPV6
+/*
+ *  ipsetBuilderConvertV6(builder);
+ *
+ *    Helper function for the skIPSetBuilder functions.
+ *
+ *    Convert the IPv4 ranges in 'builder' to IPv4-mapped IPv6 ranges.
+ *    This does not change the order of the ranges.
+ */
+static void
+ipsetBuilderConvertV6(
+    skipset_builder_t  *builder)
+{
+    size_t i;
+
+    if (builder->is_ipv6) {
+        return;
+    }
+    for (i = 0; i < builder->count; ++i) {
+        builder->ranges[i].lo.ip[1] |= UINT64_C(0xffff00000000);
+        builder->ranges[i].hi.ip[1] |= UINT64_C(0xffff00000000);
+    }
+    builder->is_ipv6 = 1;
 }
+#endif  /* SK_ENABLE_IPV6 */
 
 
 /*
@@ -11468,6 +13168,278 @@ skIPSetAutoConvertIsEnabled(
 }
 
 
+/* Add a CIDR block to the builder */
+int
+skIPSetBuilderAddAddress(
+    skipset_builder_t  *builder,
+    const skipaddr_t   *ipaddr,
+    uint32_t            prefix)
+{
+    ipset_ipv6_t lo;
+    ipset_ipv6_t hi;
+    uint64_t mask;
+    uint32_t ipv4;
+
+#if  SK_ENABLE_IPV6
+    /* handle auto-conversion */
+    if (skipaddrIsV6(ipaddr) && !builder->is_ipv6) {
+        if (skipaddrGetAsV4(ipaddr, &ipv4)
+            || (prefix <= 96 && 0 != prefix))
+        {
+            ipsetBuilderConvertV6(builder);
+        }
+    }
+
+    if (builder->is_ipv6) {
+        if (skipaddrIsV6(ipaddr)) {
+            IPSET_IPV6_FROM_ADDRV6(&lo, ipaddr);
+            if (0 == prefix) {
+                prefix = 128;
+            } else if (prefix > 128) {
+                return SKIPSET_ERR_PREFIX;
+            }
+        } else {
+            IPSET_IPV6_FROM_ADDRV4(&lo, ipaddr);
+            if (0 == prefix) {
+                prefix = 32;
+            } else if (prefix > 32) {
+                return SKIPSET_ERR_PREFIX;
+            }
+            prefix += 96;
+        }
+        hi = lo;
+        if (prefix < 64) {
+            mask = UINT64_MAX >> prefix;
+            lo.ip[0] &= ~mask;
+            hi.ip[0] |= mask;
+            lo.ip[1] = 0;
+            hi.ip[1] = UINT64_MAX;
+        } else if (prefix < 128) {
+            mask = UINT64_MAX >> (prefix - 64);
+            lo.ip[1] &= ~mask;
+            hi.ip[1] |= mask;
+        }
+        return ipsetBuilderAppend(builder, &lo, &hi);
+    }
+
+    if (skipaddrIsV6(ipaddr)) {
+        /* builder is V4 and address is a V4-mapped V6 address */
+        if (skipaddrGetAsV4(ipaddr, &ipv4)) {
+            return SKIPSET_ERR_IPV6;
+        }
+        if (0 == prefix || 128 == prefix) {
+            prefix = 32;
+        } else if (prefix > 128) {
+            return SKIPSET_ERR_PREFIX;
+        } else {
+            prefix -= 96;
+        }
+    } else
+#endif  /* SK_ENABLE_IPV6 */
+    {
+        ipv4 = skipaddrGetV4(ipaddr);
+        if (0 == prefix) {
+            prefix = 32;
+        } else if (prefix > 32) {
+            return SKIPSET_ERR_PREFIX;
+        }
+    }
+
+    mask = UINT64_C(0xFFFFFFFF) >> prefix;
+    lo.ip[0] = hi.ip[0] = 0;
+    lo.ip[1] = ipv4 & ~mask & UINT64_C(0xFFFFFFFF);
+    hi.ip[1] = ipv4 | mask;
+    return ipsetBuilderAppend(builder, &lo, &hi);
+}
+
+
+/* Add each IP in the IPWildcard to the builder */
+int
+skIPSetBuilderAddIPWildcard(
+    skipset_builder_t      *builder,
+    const skIPWildcard_t   *ipwild)
+{
+    skIPWildcardIterator_t iter;
+    skipaddr_t ip;
+    ipset_ipv6_t lo;
+    ipset_ipv6_t hi;
+    uint32_t prefix;
+    int rv = SKIPSET_OK;
+
+#if  SK_ENABLE_IPV6
+    /* handle auto-conversion */
+    if (skIPWildcardIsV6(ipwild)) {
+        ipsetBuilderConvertV6(builder);
+    }
+
+    if (builder->is_ipv6 && !skIPWildcardIsV6(ipwild)) {
+        skIPWildcardIteratorBindV6(&iter, ipwild);
+    } else
+#endif  /* SK_ENABLE_IPV6 */
+    {
+        skIPWildcardIteratorBind(&iter, ipwild);
+    }
+
+    while (skIPWildcardIteratorNextCidr(&iter, &ip, &prefix)
+           == SK_ITERATOR_OK)
+    {
+        if (0 == prefix) {
+            /* wildcard was x.x.x.x or x:x:x:x:x:x:x:x; a prefix of 0
+             * means a single IP to skIPSetBuilderAddAddress() */
+            memset(&lo, 0, sizeof(lo));
+            hi.ip[0] = (builder->is_ipv6 ? UINT64_MAX : 0);
+            hi.ip[1] = (builder->is_ipv6 ? UINT64_MAX : UINT32_MAX);
+            return ipsetBuilderAppend(builder, &lo, &hi);
+        }
+        rv = skIPSetBuilderAddAddress(builder, &ip, prefix);
+        if (rv) {
+            return rv;
+        }
+    }
+
+    return rv;
+}
+
+
+/* Add a range of IPs to the builder */
+int
+skIPSetBuilderAddRange(
+    skipset_builder_t  *builder,
+    const skipaddr_t   *ipaddr_start,
+    const skipaddr_t   *ipaddr_end)
+{
+    ipset_ipv6_t lo;
+    ipset_ipv6_t hi;
+
+    if (skipaddrCompare(ipaddr_start, ipaddr_end) > 0) {
+        return SKIPSET_ERR_BADINPUT;
+    }
+
+#if  SK_ENABLE_IPV6
+    /* handle auto-conversion */
+    if (skipaddrIsV6(ipaddr_start) || skipaddrIsV6(ipaddr_end)) {
+        ipsetBuilderConvertV6(builder);
+    }
+
+    if (builder->is_ipv6) {
+        if (skipaddrIsV6(ipaddr_start)) {
+            IPSET_IPV6_FROM_ADDRV6(&lo, ipaddr_start);
+        } else {
+            IPSET_IPV6_FROM_ADDRV4(&lo, ipaddr_start);
+        }
+        if (skipaddrIsV6(ipaddr_end)) {
+            IPSET_IPV6_FROM_ADDRV6(&hi, ipaddr_end);
+        } else {
+            IPSET_IPV6_FROM_ADDRV4(&hi, ipaddr_end);
+        }
+        return ipsetBuilderAppend(builder, &lo, &hi);
+    }
+#endif  /* SK_ENABLE_IPV6 */
+
+    lo.ip[0] = hi.ip[0] = 0;
+    lo.ip[1] = skipaddrGetV4(ipaddr_start);
+    hi.ip[1] = skipaddrGetV4(ipaddr_end);
+    return ipsetBuilderAppend(builder, &lo, &hi);
+}
+
+
+/* Create an IPset from the contents of the builder */
+int
+skIPSetBuilderBuild(
+    skipset_builder_t  *builder,
+    skipset_t         **ipset)
+{
+    ipset_part_t *parts;
+    size_t start;
+    uint32_t part_count;
+    uint32_t i;
+    int rv;
+
+    if (!builder || !ipset) {
+        return SKIPSET_ERR_BADINPUT;
+    }
+
+    rv = ipsetBuilderCompact(builder);
+    if (rv) {
+        return rv;
+    }
+
+    /* the ranges are sorted, so each part converts a slice of them to
+     * leaves */
+    part_count = ipsetPartCountFor(builder->count, builder->thread_count);
+    parts = (ipset_part_t*)calloc(part_count, sizeof(ipset_part_t));
+    if (NULL == parts) {
+        return SKIPSET_ERR_ALLOC;
+    }
+    for (i = 0; i < part_count; ++i) {
+        start = builder->count * i / part_count;
+        parts[i].ranges = builder->ranges + start;
+        parts[i].range_count = builder->count * (i + 1) / part_count - start;
+    }
+    rv = ipsetPartsToIPSet(parts, part_count, builder->is_ipv6, ipset);
+    free(parts);
+    return rv;
+}
+
+
+/* Create a builder */
+int
+skIPSetBuilderCreate(
+    skipset_builder_t **builder,
+    int                 support_ipv6,
+    uint32_t            thread_count)
+{
+    if (!builder) {
+        return SKIPSET_ERR_BADINPUT;
+    }
+#if !SK_ENABLE_IPV6
+    if (support_ipv6) {
+        return SKIPSET_ERR_IPV6;
+    }
+#endif  /* SK_ENABLE_IPV6 */
+
+    *builder = (skipset_builder_t*)calloc(1, sizeof(skipset_builder_t));
+    if (NULL == *builder) {
+        return SKIPSET_ERR_ALLOC;
+    }
+    (*builder)->capacity = IPSET_BUILDER_INITIAL_CAPACITY;
+    (*builder)->ranges = ((ipset_range_t*)
+                          malloc((*builder)->capacity
+                                 * sizeof(ipset_range_t)));
+    if (NULL == (*builder)->ranges) {
+        free(*builder);
+        *builder = NULL;
+        return SKIPSET_ERR_ALLOC;
+    }
+    (*builder)->thread_count = ((thread_count < 1) ? 1 : thread_count);
+    (*builder)->is_ipv6 = (support_ipv6 ? 1 : 0);
+
+    return SKIPSET_OK;
+}
+
+
+/* Destroy a builder */
+void
+skIPSetBuilderDestroy(
+    skipset_builder_t **builder)
+{
+    if (builder && *builder) {
+        free((*builder)->ranges);
+        free(*builder);
+        *builder = NULL;
+    }
+}
+
+
+/* Return true if the builder holds IPv6 addresses */
+int
+skIPSetBuilderIsV6(
+    const skipset_builder_t    *builder)
+{
+    return builder->is_ipv6;
+}
+
+
 /* Return true if 'ipset' contains 'ipaddr' */
 int
 skIPSetCheckAddress(
@@ -11516,6 +13488,61 @@ skIPSetCheckAddress(
 }
 
 
+/* Check a batch of addresses; see skIPSetCheckAddress() */
+void
+skIPSetCheckAddressBatch(
+    const skipset_t    *ipset,
+    const skipaddr_t   *ipaddrs,
+    size_t              count,
+    uint8_t            *found)
+{
+    uint32_t ipv4[IPSET_BATCH_GROUP];
+#if SK_ENABLE_IPV6
+    ipset_ipv6_t ipv6[IPSET_BATCH_GROUP];
+#endif
+    size_t group;
+    size_t i;
+
+    assert(ipset);
+    assert(ipaddrs || 0 == count);
+    assert(found || 0 == count);
+
+    for ( ; count > 0; count -= group, ipaddrs += group, found += group) {
+        group = ((count < IPSET_BATCH_GROUP) ? count : IPSET_BATCH_GROUP);
+
+#if SK_ENABLE_IPV6
+        if (ipset->is_ipv6) {
+            for (i = 0; i < group; ++i) {
+                IPSET_IPV6_FROM_ADDRV4(&ipv6[i], &ipaddrs[i]);
+                found[i] = 1;
+            }
+            ipsetCheckAddressGroupV6(ipset, ipv6, group, found);
+            continue;
+        }
+#endif  /* SK_ENABLE_IPV6 */
+
+        /* the IPset is IPv4; an address that cannot be converted to
+         * IPv4 is not in the IPset and is not searched */
+        for (i = 0; i < group; ++i) {
+#if SK_ENABLE_IPV6
+            if (skipaddrIsV6(&ipaddrs[i])) {
+                found[i] = !skipaddrGetAsV4(&ipaddrs[i], &ipv4[i]);
+            } else
+#endif
+            {
+                ipv4[i] = skipaddrGetV4(&ipaddrs[i]);
+                found[i] = 1;
+            }
+        }
+        if (ipset->is_iptree) {
+            ipsetCheckAddressGroupIPTree(ipset, ipv4, group, found);
+        } else {
+            ipsetCheckAddressGroupV4(ipset, ipv4, group, found);
+        }
+    }
+}
+
+
 /* Return true if 'ipset1' and 'ipset2' have any IPs in common. */
 int
 skIPSetCheckIPSet(
@@ -12416,6 +14443,29 @@ skIPSetIntersect(
 }
 
 
+/* Intersect 'result_ipset' with 'ipset' using multiple threads */
+int
+skIPSetIntersectParallel(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    uint32_t            thread_count)
+{
+    int rv;
+
+    if (!result_ipset || !ipset
+        || !IPSET_PARALLEL_USABLE(result_ipset, ipset, thread_count))
+    {
+        return skIPSetIntersect(result_ipset, ipset);
+    }
+    rv = skIPSetClean(result_ipset);
+    if (rv) {
+        return rv;
+    }
+    return ipsetParallelCombine(result_ipset, ipset, IPSET_COMBINE_INTERSECT,
+                                thread_count);
+}
+
+
 /* Return true if 'ipset' can hold IPv6 addresses */
 int
 skIPSetIsV6(
@@ -13837,6 +15887,29 @@ skIPSetSubtract(
 }
 
 
+/* Subtract 'ipset' from 'result_ipset' using multiple threads */
+int
+skIPSetSubtractParallel(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    uint32_t            thread_count)
+{
+    int rv;
+
+    if (!result_ipset || !ipset
+        || !IPSET_PARALLEL_USABLE(result_ipset, ipset, thread_count))
+    {
+        return skIPSetSubtract(result_ipset, ipset);
+    }
+    rv = skIPSetClean(result_ipset);
+    if (rv) {
+        return rv;
+    }
+    return ipsetParallelCombine(result_ipset, ipset, IPSET_COMBINE_SUBTRACT,
+                                thread_count);
+}
+
+
 /* Turn on IPs of 'result_ipset' that are on in 'ipset'. */
 int
 skIPSetUnion(
@@ -13920,6 +15993,29 @@ skIPSetUnion(
 }
 
 
+/* Add 'ipset' to 'result_ipset' using multiple threads */
+int
+skIPSetUnionParallel(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    uint32_t            thread_count)
+{
+    int rv;
+
+    if (!result_ipset || !ipset
+        || !IPSET_PARALLEL_USABLE(result_ipset, ipset, thread_count))
+    {
+        return skIPSetUnion(result_ipset, ipset);
+    }
+    rv = skIPSetClean(result_ipset);
+    if (rv) {
+        return rv;
+    }
+    return ipsetParallelCombine(result_ipset, ipset, IPSET_COMBINE_UNION,
+                                thread_count);
+}
+
+
 /* Invoke the 'callback' function on all IPs in the 'ipset' */
 int
 skIPSetWalk(
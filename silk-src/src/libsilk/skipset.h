@@ -163,6 +163,13 @@ struct skipset_iterator_st {
 };
 typedef struct skipset_iterator_st skipset_iterator_t;
 
+/**
+ *    The skipset_builder_t creates an IPset from a large number of
+ *    addresses more quickly than inserting them into an IPset one at
+ *    a time.  Since SiLK 3.20.0.
+ */
+typedef struct skipset_builder_st skipset_builder_t;
+
 
 /**
  *    By default, attempting to insert an IPv6 addresses into an
@@ -209,6 +216,132 @@ skIPSetAutoConvertIsEnabled(
     const skipset_t    *ipset);
 
 
+/**
+ *    Add the CIDR block 'ipaddr'/'prefix' to 'builder'.  As in
+ *    skIPSetInsertAddress(), a 'prefix' of 0 adds the single address
+ *    'ipaddr', and adding an IPv6 address that cannot be represented
+ *    as IPv4 to an IPv4 builder converts the builder to IPv6.
+ *
+ *    The address is appended to a buffer; the work of sorting the
+ *    buffer and removing duplicates is delayed until the buffer is
+ *    full or skIPSetBuilderBuild() is called.  Addresses that arrive
+ *    in sorted order are never sorted.
+ *
+ *    Return SKIPSET_OK on success, SKIPSET_ERR_PREFIX if 'prefix' is
+ *    too large for 'ipaddr', or SKIPSET_ERR_ALLOC if memory cannot
+ *    be allocated.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetBuilderAddAddress(
+    skipset_builder_t  *builder,
+    const skipaddr_t   *ipaddr,
+    uint32_t            prefix);
+
+
+/**
+ *    Add each address in 'ipwild' to 'builder'.  Adding an IPv6
+ *    IPWildcard to an IPv4 builder converts the builder to IPv6.
+ *
+ *    See skIPSetBuilderAddAddress() for the return values.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetBuilderAddIPWildcard(
+    skipset_builder_t      *builder,
+    const skIPWildcard_t   *ipwild);
+
+
+/**
+ *    Add the addresses from 'ipaddr_start' to 'ipaddr_end' inclusive
+ *    to 'builder'.  When either address is an IPv6 address, an IPv4
+ *    builder is converted to IPv6.
+ *
+ *    Return SKIPSET_ERR_BADINPUT if 'ipaddr_start' is greater than
+ *    'ipaddr_end'; otherwise, see skIPSetBuilderAddAddress() for the
+ *    return values.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetBuilderAddRange(
+    skipset_builder_t  *builder,
+    const skipaddr_t   *ipaddr_start,
+    const skipaddr_t   *ipaddr_end);
+
+
+/**
+ *    Create a new IPset containing the addresses that have been added
+ *    to 'builder' and store it at the location referenced by 'ipset'.
+ *    The new IPset uses the Radix-Tree format regardless of the
+ *    SKIPSET_INCORE_FORMAT environment variable, it is clean, and it
+ *    holds IPv6 addresses when skIPSetBuilderIsV6() is true.
+ *
+ *    The buffered addresses are radix sorted and merged with each
+ *    other using the number of threads given to
+ *    skIPSetBuilderCreate(), and the tree of the IPset is built from
+ *    the resulting CIDR blocks in a single pass.
+ *
+ *    'builder' keeps its addresses, and more addresses may be added
+ *    to it after this call.
+ *
+ *    Return SKIPSET_OK on success, SKIPSET_ERR_BADINPUT if an
+ *    argument is NULL, or SKIPSET_ERR_ALLOC if memory cannot be
+ *    allocated.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetBuilderBuild(
+    skipset_builder_t  *builder,
+    skipset_t         **ipset);
+
+
+/**
+ *    Create a builder for an IPset and store it at the location
+ *    referenced by 'builder'.  The builder holds IPv6 addresses when
+ *    'support_ipv6' is non-zero; otherwise it holds IPv4 addresses
+ *    until an IPv6 address is added.  Up to 'thread_count' threads
+ *    are used to sort the addresses; a value of 0 is treated as 1.
+ *
+ *    Return SKIPSET_OK on success, SKIPSET_ERR_BADINPUT if 'builder'
+ *    is NULL, SKIPSET_ERR_IPV6 if 'support_ipv6' is non-zero and
+ *    SiLK does not support IPv6, or SKIPSET_ERR_ALLOC if memory
+ *    cannot be allocated.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetBuilderCreate(
+    skipset_builder_t **builder,
+    int                 support_ipv6,
+    uint32_t            thread_count);
+
+
+/**
+ *    Destroy the builder at the location referenced by 'builder' and
+ *    set that location to NULL.  Do nothing if 'builder' or the
+ *    location it references is NULL.
+ *
+ *    Since SiLK 3.20.0.
+ */
+void
+skIPSetBuilderDestroy(
+    skipset_builder_t **builder);
+
+
+/**
+ *    Return 1 if 'builder' holds IPv6 addresses; return 0 otherwise.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetBuilderIsV6(
+    const skipset_builder_t    *builder);
+
+
 /**
  *    Return 1 if 'ip' is present in 'ipset'; return 0 otherwise.
  *
@@ -222,6 +355,28 @@ skIPSetCheckAddress(
     const skipaddr_t   *ip);
 
 
+/**
+ *    Check whether each of the 'count' IP addresses in the array
+ *    'ipaddrs' is present in 'ipset'.  Set the corresponding entry in
+ *    the array 'found', which must have room for 'count' entries, to
+ *    1 when the address is present and to 0 otherwise.  IP versions
+ *    are handled as in skIPSetCheckAddress().
+ *
+ *    The result is the same as calling skIPSetCheckAddress() on each
+ *    address, but the lookups are interleaved so that reading the
+ *    tree for one address overlaps with reading it for others, which
+ *    is faster when the IPset is too large to fit in the CPU cache.
+ *
+ *    Since SiLK 3.20.0.
+ */
+void
+skIPSetCheckAddressBatch(
+    const skipset_t    *ipset,
+    const skipaddr_t   *ipaddrs,
+    size_t              count,
+    uint8_t            *found);
+
+
 /**
  *    Return 1 if the IPsets 'ipset1' and 'ipset2' have any IPs in
  *    common; otherwise, return 0.
@@ -477,6 +632,31 @@ skIPSetIntersect(
     const skipset_t    *ipset);
 
 
+/**
+ *    Like skIPSetIntersect(), but use up to 'thread_count' threads to
+ *    compute the intersection.  The address space is divided into
+ *    ranges that hold similar numbers of CIDR blocks, each thread
+ *    computes the result for one range, and the tree of
+ *    'result_ipset' is rebuilt from the combined ranges.  This is
+ *    faster than skIPSetIntersect() when the IPsets are large.
+ *
+ *    Both IPsets must hold the same IP version and use the
+ *    Radix-Tree format, which IPv4 IPsets use only when the
+ *    SKIPSET_INCORE_FORMAT environment variable is "radix", and
+ *    'ipset' must be clean; when these conditions are not met or when
+ *    'thread_count' is less than 2, this function calls
+ *    skIPSetIntersect().  'result_ipset' is cleaned if needed and is
+ *    clean on return.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetIntersectParallel(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    uint32_t            thread_count);
+
+
 /**
  *    Return 1 if the IPset 'ipset' is currently configued to store
  *    IPv6 addresses; return 0 otherwise.
@@ -972,6 +1152,20 @@ skIPSetSubtract(
     const skipset_t    *ipset);
 
 
+/**
+ *    Like skIPSetSubtract(), but use up to 'thread_count' threads to
+ *    compute the difference.  The requirements and fallback are the same
+ *    as for skIPSetIntersectParallel().
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetSubtractParallel(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    uint32_t            thread_count);
+
+
 /**
  *    Add the addresses in 'ipset' to 'result_ipset'.  Returns 0 on
  *    success, or 1 on memory allocation error.
@@ -982,6 +1176,20 @@ skIPSetUnion(
     const skipset_t    *ipset);
 
 
+/**
+ *    Like skIPSetUnion(), but use up to 'thread_count' threads to
+ *    compute the union.  The requirements and fallback are the same
+ *    as for skIPSetIntersectParallel().
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+skIPSetUnionParallel(
+    skipset_t          *result_ipset,
+    const skipset_t    *ipset,
+    uint32_t            thread_count);
+
+
 /**
  *    Call the specified 'callback' function on the contents of the
  *    specified 'ipset'.
@@ -16,6 +16,10 @@
 ** prefixmap file and an IP address and do a lookup on that file to
 ** print the result.
 **
+** With --trie-test, build random prefix maps and check that lookups
+** using the trie that skPrefixMapRead() compiles return the same
+** values as lookups that walk the tree.
+**
 */
 
 
@@ -23,6 +27,7 @@
 
 RCSIDENT("$SiLK: skprefixmap-test.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
+#include <silk/skipaddr.h>
 #include <silk/skprefixmap.h>
 #include <silk/skstream.h>
 #include <silk/utils.h>
@@ -36,6 +41,9 @@ RCSIDENT("$SiLK: skprefixmap-test.c ef14e54179be 2020-04-14 21:57:45Z mthomas $"
 /* max expected length of a pmap dictionary entry */
 #define DICTIONARY_ENTRY_BUFLEN 2048
 
+/* number of random keys that --trie-test looks up in each map */
+#define TRIE_TEST_LOOKUPS  100000
+
 
 /* EXPORTED FUNCTIONS */
 
@@ -47,13 +55,14 @@ RCSIDENT("$SiLK: skprefixmap-test.c ef14e54179be 2020-04-14 21:57:45Z mthomas $"
 /* OPTIONS SETUP */
 
 typedef enum {
-    OPT_MAP_FILE, OPT_ADDRESS, OPT_STRING
+    OPT_MAP_FILE, OPT_ADDRESS, OPT_STRING, OPT_TRIE_TEST
 } appOptionsEnum;
 
 static struct option appOptions[] = {
     {"map-file", REQUIRED_ARG, 0, OPT_MAP_FILE},
     {"address",  REQUIRED_ARG, 0, OPT_ADDRESS},
     {"string",   NO_ARG,       0, OPT_STRING},
+    {"trie-test", REQUIRED_ARG, 0, OPT_TRIE_TEST},
     {0,0,0,0}                   /* sentinel entry */
 };
 
@@ -62,6 +71,8 @@ static const char *appHelp[] = {
     "path name of the map file.",
     "IP address to look up",
     "output dictionary string instead of integer value",
+    ("build random maps, save each to this temporary file and load\n"
+     "\tit, and check that lookups match the tree walk"),
     (char *)NULL
 };
 
@@ -70,8 +81,12 @@ static struct {
     skipaddr_t  address;        /* IP address to look up */
     uint32_t    have_address;   /* whether an address was given */
     uint32_t    string;         /* look up string */
+    const char *trie_test;      /* temporary file for --trie-test */
 } prefixmap_test_opt;
 
+/* state of the random number generator used by --trie-test */
+static uint32_t trie_test_seed = 2004;
+
 
 /* LOCAL FUNCTION PROTOTYPES */
 
@@ -96,7 +111,8 @@ appUsageLong(
     ("[SWITCHES]\n"                                                     \
      "\tSmall application to test the prefixmap library by taking a\n"  \
      "\tprefixmap file and an IP address and searching the file to\n"   \
-     "\tprint the result.\n")
+     "\tprint the result.  With --trie-test, compare the lookups of\n"   \
+     "\tthe compiled trie to those of the tree walk instead.\n")
 
     FILE *fh = USAGE_FH;
 
@@ -178,6 +194,10 @@ appSetup(
         skAppUsage();           /* never returns */
     }
 
+    if (prefixmap_test_opt.trie_test) {
+        return;
+    }
+
     if ( (NULL == prefixmap_test_opt.map_file) ||
          (0 == prefixmap_test_opt.have_address) ) {
         if ( NULL == prefixmap_test_opt.map_file ) {
@@ -237,12 +257,269 @@ appOptionsHandler(
     case OPT_STRING:
         prefixmap_test_opt.string = 1;
         break;
+
+      case OPT_TRIE_TEST:
+        prefixmap_test_opt.trie_test = opt_arg;
+        break;
     }
 
     return 0;  /* OK */
 }
 
 
+/*
+ *  r = trieTestRandom();
+ *
+ *    Return the next value from a small xorshift generator, so that
+ *    the maps --trie-test builds are the same on every platform.
+ */
+static uint32_t
+trieTestRandom(
+    void)
+{
+    trie_test_seed ^= trie_test_seed << 13;
+    trie_test_seed ^= trie_test_seed >> 17;
+    trie_test_seed ^= trie_test_seed << 5;
+    return trie_test_seed;
+}
+
+
+/*
+ *  trieTestRandomKey(content_type, key);
+ *
+ *    Fill 'key' with a random key for a prefix map whose content is
+ *    'content_type'.
+ */
+static void
+trieTestRandomKey(
+    skPrefixMapContent_t    content_type,
+    void                   *key)
+{
+    uint32_t ipv4;
+
+    switch (content_type) {
+      case SKPREFIXMAP_CONT_PROTO_PORT:
+        /* favor TCP and UDP */
+        ipv4 = trieTestRandom();
+        ((skPrefixMapProtoPort_t*)key)->proto
+            = ((ipv4 & 0x1) ? ((ipv4 & 0x2) ? 6 : 17) : (ipv4 >> 24));
+        ((skPrefixMapProtoPort_t*)key)->port = (uint16_t)(ipv4 >> 8);
+        break;
+      case SKPREFIXMAP_CONT_ADDR_V4:
+        ipv4 = trieTestRandom();
+        skipaddrSetV4((skipaddr_t*)key, &ipv4);
+        break;
+#if SK_ENABLE_IPV6
+      case SKPREFIXMAP_CONT_ADDR_V6:
+        {
+            uint8_t ipv6[16];
+            unsigned int i;
+
+            /* keep the keys within 2001:db8::/32 */
+            ipv6[0] = 0x20;
+            ipv6[1] = 0x01;
+            ipv6[2] = 0x0d;
+            ipv6[3] = 0xb8;
+            for (i = 4; i < sizeof(ipv6); i += 4) {
+                ipv4 = trieTestRandom();
+                memcpy(&ipv6[i], &ipv4, sizeof(ipv4));
+            }
+            /* and most of them within its first 256 /48s */
+            if (ipv6[15] & 0x7) {
+                ipv6[4] = 0;
+            }
+            skipaddrSetV6((skipaddr_t*)key, ipv6);
+        }
+        break;
+#endif  /* SK_ENABLE_IPV6 */
+      default:
+        skAbortBadCase(content_type);
+    }
+}
+
+
+/*
+ *  mismatch = trieTestCompare(map, key, expected);
+ *
+ *    Look up 'key' in 'map' with skPrefixMapFindValue(), which uses
+ *    the compiled trie when the map has one, and with
+ *    skPrefixMapFindRange(), which always walks the tree.  Return 1
+ *    if either value differs from the other or from 'expected',
+ *    unless 'expected' is SKPREFIXMAP_NOT_FOUND.  Return 0 otherwise.
+ */
+static int
+trieTestCompare(
+    const skPrefixMap_t    *map,
+    const void             *key,
+    uint32_t                expected)
+{
+    union trie_test_key_un {
+        skipaddr_t              addr;
+        skPrefixMapProtoPort_t  pp;
+    } start, end;
+    uint32_t value;
+
+    value = skPrefixMapFindValue(map, key);
+    if (value != skPrefixMapFindRange(map, key, &start, &end)) {
+        return 1;
+    }
+    return ((SKPREFIXMAP_NOT_FOUND != expected && value != expected)
+            ? 1 : 0);
+}
+
+
+/*
+ *  status = trieTestMap(name, content_type, range_count, max_bits);
+ *
+ *    Create a prefix map whose content is 'content_type' and that
+ *    holds 'range_count' random CIDR blocks, each containing up to
+ *    2^'max_bits' keys.  Save the map to the --trie-test file in each
+ *    record version and load it, then check that the value found for
+ *    every range edge and for TRIE_TEST_LOOKUPS random keys is the
+ *    same whether the trie or the tree is used.  Print a line of
+ *    results for each version.  Return 0 if all lookups match, or -1
+ *    otherwise.
+ */
+static int
+trieTestMap(
+    const char             *name,
+    skPrefixMapContent_t    content_type,
+    uint32_t                range_count,
+    unsigned int            max_bits)
+{
+    static const uint16_t versions[] = {0, 6};
+    union trie_test_key_un {
+        skipaddr_t              addr;
+        skPrefixMapProtoPort_t  pp;
+    } low, high;
+    char word[32];
+    skPrefixMap_t *map;
+    skPrefixMap_t *loaded;
+    uint32_t value_count;
+    skPrefixMapIterator_t iter;
+    uint64_t edges;
+    uint64_t mismatch;
+    uint32_t dict_val;
+    uint32_t width;
+    uint32_t bits;
+    uint32_t i;
+    size_t v;
+    int rv = 0;
+
+    if (skPrefixMapCreate(&map)
+        || skPrefixMapSetContentType(map, content_type)
+        || skPrefixMapSetDefaultVal(map, 0))
+    {
+        skAppPrintErr("Unable to create the %s prefix map", name);
+        return -1;
+    }
+
+    /* a file holding a proto-port map must have a dictionary */
+    value_count = 1000;
+    if (SKPREFIXMAP_CONT_PROTO_PORT == content_type) {
+        value_count = 100;
+        for (i = 0; i <= value_count; ++i) {
+            snprintf(word, sizeof(word), "label-%u", i);
+            if (skPrefixMapDictionaryInsert(map, i, word)) {
+                skAppPrintErr("Unable to add to the %s dictionary", name);
+                skPrefixMapDelete(map);
+                return -1;
+            }
+        }
+    }
+
+    /* add CIDR blocks; later blocks replace the values of earlier
+     * ones where they overlap */
+    for (i = 0; i < range_count; ++i) {
+        trieTestRandomKey(content_type, &low);
+        bits = trieTestRandom() % (max_bits + 1);
+        if (SKPREFIXMAP_CONT_PROTO_PORT == content_type) {
+            /* keep the blocks within TCP and UDP so the map is dense
+             * enough to compile into a trie */
+            low.pp.proto = ((trieTestRandom() & 0x1) ? 6 : 17);
+            width = (1u << bits) - 1;
+            low.pp.port &= ~width;
+            high = low;
+            high.pp.port |= width;
+        } else {
+            width = ((SKPREFIXMAP_CONT_ADDR_V4 == content_type) ? 32 : 128);
+            skCIDR2IPRange(&low.addr, width - bits, &low.addr, &high.addr);
+        }
+        if (skPrefixMapAddRange(map, &low, &high,
+                                1 + trieTestRandom() % value_count))
+        {
+            skAppPrintErr("Unable to add range to the %s prefix map", name);
+            skPrefixMapDelete(map);
+            return -1;
+        }
+    }
+
+    for (v = 0; v < sizeof(versions)/sizeof(versions[0]); ++v) {
+        /* skPrefixMapSave() does not overwrite an existing file */
+        unlink(prefixmap_test_opt.trie_test);
+        if (skPrefixMapSetRecordVersion(map, versions[v])
+            || skPrefixMapSave(map, prefixmap_test_opt.trie_test)
+            || skPrefixMapLoad(&loaded, prefixmap_test_opt.trie_test))
+        {
+            skAppPrintErr("Unable to save and load the %s prefix map", name);
+            rv = -1;
+            break;
+        }
+
+        edges = 0;
+        mismatch = 0;
+        skPrefixMapIteratorBind(&iter, loaded);
+        while (skPrefixMapIteratorNext(&iter, &low, &high, &dict_val)
+               == SK_ITERATOR_OK)
+        {
+            mismatch += trieTestCompare(loaded, &low, dict_val);
+            mismatch += trieTestCompare(loaded, &high, dict_val);
+            edges += 2;
+        }
+        for (i = 0; i < TRIE_TEST_LOOKUPS; ++i) {
+            trieTestRandomKey(content_type, &low);
+            mismatch += trieTestCompare(loaded, &low, SKPREFIXMAP_NOT_FOUND);
+        }
+        skPrefixMapDelete(loaded);
+
+        printf("%s v%u: %" PRIu64 " range edges, %u random keys,"
+               " %" PRIu64 " mismatches\n",
+               name, versions[v], edges, TRIE_TEST_LOOKUPS, mismatch);
+        if (mismatch) {
+            rv = -1;
+        }
+    }
+
+    unlink(prefixmap_test_opt.trie_test);
+    skPrefixMapDelete(map);
+    return rv;
+}
+
+
+/*
+ *  status = trieTest();
+ *
+ *    Run the tests of the --trie-test switch.  The sparse map of
+ *    single IPv4 addresses needs a trie that is larger than the limit
+ *    relative to its tree, so its lookups use the tree walk.  Return
+ *    0 if all lookups match, or -1 otherwise.
+ */
+static int
+trieTest(
+    void)
+{
+    int rv = 0;
+
+    rv |= trieTestMap("ipv4-blocks", SKPREFIXMAP_CONT_ADDR_V4, 20000, 24);
+    rv |= trieTestMap("ipv4-sparse", SKPREFIXMAP_CONT_ADDR_V4, 5000, 0);
+    rv |= trieTestMap("proto-port", SKPREFIXMAP_CONT_PROTO_PORT, 20000, 4);
+#if SK_ENABLE_IPV6
+    rv |= trieTestMap("ipv6-blocks", SKPREFIXMAP_CONT_ADDR_V6, 20000, 80);
+#endif
+    return rv;
+}
+
+
 int main(int argc, char **argv)
 {
     skstream_t *inputFile;
@@ -253,6 +530,12 @@ int main(int argc, char **argv)
 
     appSetup(argc, argv);                       /* never returns on error */
 
+    if (prefixmap_test_opt.trie_test) {
+        rv = trieTest();
+        appTeardown();
+        return ((rv) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
     /* Okay.  Now we should open the prefixmap file, read it in, and */
     /* then look up our address! */
 
@@ -68,6 +68,34 @@
 **    Version 5: (SiLK-3.5.0) Key is an IPv6 address.  There is no
 **    dictionary, and the value represents the country code.
 **
+**    Version 6: (SiLK-3.20.0) Key and value may be any of the above,
+**    and the data is arranged so the file may be mmap()ed.  The
+**    header uses native byte order and a record length of 8 so the
+**    data section begins on an 8-octet boundary.  The data section
+**    holds the record count followed by seven 32-bit words that
+**    describe the layout (the content type, whether there is a
+**    dictionary, the size of the dictionary, the number of key bits
+**    that index the first level and the lower levels of the compiled
+**    trie, the number of entries in the trie, and a reserved word),
+**    then the records of the tree, the entries of the compiled trie,
+**    and the dictionary padded to a multiple of 8 octets.  When the
+**    file is seekable and in native byte order, the reader mmap()s
+**    the file and uses the tree and the trie in place, and it copies
+**    the tree into memory when the map is modified.
+**
+**
+**    When a prefix map is read from a file, the tree is also compiled
+**    into a read-only multibit trie that is used by
+**    skPrefixMapFindValue() and skPrefixMapFindString().  The first
+**    level of the trie is indexed by the 16 most significant bits of
+**    the key.  Each level below it is indexed by the next 8 bits of
+**    a 32-bit key, so a lookup reads at most 3 entries, or by the
+**    next 4 bits of an IPv6 address, which keeps each level of an
+**    IPv6 trie in a single cache line.  Each entry is either a leaf
+**    in the same form as the tree or the position of the entries for
+**    the next level.  The trie is written to disk only in version 6
+**    files, and it is discarded when the map is modified.
+**
 */
 
 #include <silk/silk.h>
@@ -94,6 +122,12 @@ typedef struct skPrefixMapRecord_st {
 struct skPrefixMap_st {
     /* the nodes that make up the tree */
     skPrefixMapRecord_t    *tree;
+    /* the compiled multibit trie for lookups, or NULL */
+    uint32_t               *trie;
+    /* the mmap()ed file holding 'tree' and 'trie', or NULL */
+    void                   *mapped_file;
+    /* the size of the mmap()ed space */
+    size_t                  mapped_size;
     /* the name of the map */
     char                   *mapname;
     /* all terms in dictionary joined by '\0', or NULL for vers 1,5 */
@@ -116,14 +150,29 @@ struct skPrefixMap_st {
     uint32_t                dict_words_size;
     /* max len of word in dictionary, or 0 for vers 1,5 */
     uint32_t                dict_max_wordlen;
+    /* number of entries in the compiled trie, or 0 */
+    uint32_t                trie_entries;
     /* map of dictionary words to values */
     struct rbtree          *word_map;
     /* Memory pool for word map entries */
     sk_mempool_t           *word_map_pool;
     /* type of data in the map */
     skPrefixMapContent_t    content_type;
+    /* record version to use when writing the map, or 0 for default */
+    sk_file_version_t       record_version;
 };
 
+/* The words that follow the record count in a version 6 file */
+typedef struct skPrefixMapLayout_st {
+    uint32_t content_type;
+    uint32_t has_dictionary;
+    uint32_t dict_buf_size;
+    uint32_t trie_root_bits;
+    uint32_t trie_stride;
+    uint32_t trie_entries;
+    uint32_t reserved;
+} skPrefixMapLayout_t;
+
 /* Used as the nodes in the word map dictionary */
 typedef struct skPrefixMapDictNode_st {
     const char *word;
@@ -158,6 +207,25 @@ typedef struct sk_hentry_prefixmap_st {
 #define SKPMAP_WORDS_COUNT_GROW    2048
 
 
+/* The number of key bits that index the first level of the compiled
+ * trie and the number that index each level below it for 32-bit and
+ * for 128-bit keys.  prefixMapTrieFind() assumes these values. */
+#define SKPMAP_TRIE_ROOT_BITS      16
+#define SKPMAP_TRIE_STRIDE32       8
+#define SKPMAP_TRIE_STRIDE128      4
+
+/* The record version of a file that may be mmap()ed, and the record
+ * length used in its header so the data section is 8-octet
+ * aligned */
+#define SKPMAP_VERS_MAPPED         6
+#define SKPMAP_VERS_MAPPED_RECLEN  8
+
+/* The trie is not compiled when its lower levels would use more than
+ * this multiple of the memory used by the tree; lookups then walk
+ * the tree */
+#define SKPMAP_TRIE_MAX_RATIO      4
+
+
 #define SKPMAP_KEY_FROM_PROTO_PORT(kfpp)                \
     ((((skPrefixMapProtoPort_t*)(kfpp))->proto << 16)   \
      | ((skPrefixMapProtoPort_t*)(kfpp))->port)
@@ -477,6 +545,46 @@ prefixMapAdd128(
 #endif  /* SK_ENABLE_IPV6 */
 
 
+/*
+ *  err = prefixMapCopyOnWrite(map);
+ *
+ *    Prepare the tree of 'map' to be modified.  Discard the compiled
+ *    trie, which no longer matches the tree once it is modified, and
+ *    when the tree is in mmap()ed space, copy it into newly allocated
+ *    memory and unmap the file.  Return SKPREFIXMAP_OK on success or
+ *    SKPREFIXMAP_ERR_MEMORY if memory cannot be allocated.
+ */
+static skPrefixMapErr_t
+prefixMapCopyOnWrite(
+    skPrefixMap_t      *map)
+{
+    skPrefixMapRecord_t *tree;
+
+    if (NULL == map->mapped_file) {
+        free(map->trie);
+        map->trie = NULL;
+        map->trie_entries = 0;
+        return SKPREFIXMAP_OK;
+    }
+
+    tree = ((skPrefixMapRecord_t*)
+            malloc(map->tree_size * sizeof(skPrefixMapRecord_t)));
+    if (NULL == tree) {
+        return SKPREFIXMAP_ERR_MEMORY;
+    }
+    memcpy(tree, map->tree, map->tree_used * sizeof(skPrefixMapRecord_t));
+    map->tree = tree;
+    map->trie = NULL;
+    map->trie_entries = 0;
+
+    munmap(map->mapped_file, map->mapped_size);
+    map->mapped_file = NULL;
+    map->mapped_size = 0;
+
+    return SKPREFIXMAP_OK;
+}
+
+
 /*
  *  err = prefixMapDictionaryInsertHelper(map, pdict_val, word);
  *
@@ -1031,66 +1139,21 @@ prefixMapGrowTree(
 
 
 /*
- *    Given an input stream 'in' positioned at the beginning of the
- *    dictionary section of a prefix map file (specifically at the
- *    byte-length of the dictionary), create all the dictionary
- *    structures and read the dictionary entries into those
- *    structures.  The 'swap_flag' is true if the data in the stream
- *    is not in native byte order.
+ *  status = prefixMapIndexDictionary(map);
+ *
+ *    Build the index of the words in the dictionary of 'map', whose
+ *    'dict_buf' member contains 'dict_buf_size' bytes of words that
+ *    were read from a file.
  */
 static skPrefixMapErr_t
-prefixMapReadDictionary(
-    skPrefixMap_t      *map,
-    skstream_t         *in,
-    int                 swap_flag)
+prefixMapIndexDictionary(
+    skPrefixMap_t      *map)
 {
-    char errbuf[2 * PATH_MAX];
     char *current;
     char *start;
     char *end;
     uint32_t i;
-    ssize_t rv;
-
-    /* Get number of bytes in the dictionary */
-    rv = skStreamRead(in, &(map->dict_buf_size), sizeof(uint32_t));
-    if (rv != (ssize_t)sizeof(uint32_t)) {
-        if (-1 == rv) {
-            skStreamLastErrMessage(in, rv, errbuf, sizeof(errbuf));
-        } else {
-            snprintf(errbuf, sizeof(errbuf),
-                     "read %" SK_PRIdZ " bytes of %" SK_PRIuZ " expected",
-                     rv, sizeof(map->dict_buf_size));
-        }
-        skAppPrintErr("Failed to read dictionary entry count (%s)", errbuf);
-        return SKPREFIXMAP_ERR_IO;
-    }
-    if (swap_flag) {
-        map->dict_buf_size = BSWAP32(map->dict_buf_size);
-    }
-    if (0 == map->dict_buf_size) {
-        /* odd, but allow it */
-        return SKPREFIXMAP_OK;
-    }
-
-    map->dict_buf = (char*)malloc(map->dict_buf_size * sizeof(char));
-    if (NULL == map->dict_buf) {
-        skAppPrintErr("Failed to allocate prefix map dictionary");
-        return SKPREFIXMAP_ERR_MEMORY;
-    }
 
-    /* Dictionary is allocated; now read the data. */
-    rv = skStreamRead(in, map->dict_buf, map->dict_buf_size);
-    if (rv != (ssize_t)map->dict_buf_size) {
-        if (-1 == rv) {
-            skStreamLastErrMessage(in, rv, errbuf, sizeof(errbuf));
-        } else {
-            snprintf(errbuf, sizeof(errbuf),
-                     "read %" SK_PRIdZ " bytes of %" PRIu32 " expected",
-                     rv, map->dict_buf_size);
-        }
-        skAppPrintErr("Failed to read dictionary entries (%s)", errbuf);
-        return SKPREFIXMAP_ERR_IO;
-    }
     map->dict_buf_end = map->dict_buf_size;
     map->dict_buf_used = map->dict_buf_size;
 
@@ -1178,6 +1241,576 @@ prefixMapReadDictionary(
 }
 
 
+/*
+ *    Given an input stream 'in' positioned at the beginning of the
+ *    dictionary section of a prefix map file (specifically at the
+ *    byte-length of the dictionary), create all the dictionary
+ *    structures and read the dictionary entries into those
+ *    structures.  The 'swap_flag' is true if the data in the stream
+ *    is not in native byte order.
+ */
+static skPrefixMapErr_t
+prefixMapReadDictionary(
+    skPrefixMap_t      *map,
+    skstream_t         *in,
+    int                 swap_flag)
+{
+    char errbuf[2 * PATH_MAX];
+    ssize_t rv;
+
+    /* Get number of bytes in the dictionary */
+    rv = skStreamRead(in, &(map->dict_buf_size), sizeof(uint32_t));
+    if (rv != (ssize_t)sizeof(uint32_t)) {
+        if (-1 == rv) {
+            skStreamLastErrMessage(in, rv, errbuf, sizeof(errbuf));
+        } else {
+            snprintf(errbuf, sizeof(errbuf),
+                     "read %" SK_PRIdZ " bytes of %" SK_PRIuZ " expected",
+                     rv, sizeof(map->dict_buf_size));
+        }
+        skAppPrintErr("Failed to read dictionary entry count (%s)", errbuf);
+        return SKPREFIXMAP_ERR_IO;
+    }
+    if (swap_flag) {
+        map->dict_buf_size = BSWAP32(map->dict_buf_size);
+    }
+    if (0 == map->dict_buf_size) {
+        /* odd, but allow it */
+        return SKPREFIXMAP_OK;
+    }
+
+    map->dict_buf = (char*)malloc(map->dict_buf_size * sizeof(char));
+    if (NULL == map->dict_buf) {
+        skAppPrintErr("Failed to allocate prefix map dictionary");
+        return SKPREFIXMAP_ERR_MEMORY;
+    }
+
+    /* Dictionary is allocated; now read the data. */
+    rv = skStreamRead(in, map->dict_buf, map->dict_buf_size);
+    if (rv != (ssize_t)map->dict_buf_size) {
+        if (-1 == rv) {
+            skStreamLastErrMessage(in, rv, errbuf, sizeof(errbuf));
+        } else {
+            snprintf(errbuf, sizeof(errbuf),
+                     "read %" SK_PRIdZ " bytes of %" PRIu32 " expected",
+                     rv, map->dict_buf_size);
+        }
+        skAppPrintErr("Failed to read dictionary entries (%s)", errbuf);
+        return SKPREFIXMAP_ERR_IO;
+    }
+    return prefixMapIndexDictionary(map);
+}
+
+
+/*
+ *  status = prefixMapReadBytes(in, buf, count, what);
+ *
+ *    Read 'count' bytes from 'in' into 'buf', or skip them when 'buf'
+ *    is NULL.  If fewer bytes are read, print an error that uses
+ *    'what' to describe the data and return SKPREFIXMAP_ERR_IO.
+ */
+static skPrefixMapErr_t
+prefixMapReadBytes(
+    skstream_t         *in,
+    void               *buf,
+    size_t              count,
+    const char         *what)
+{
+    char errbuf[2 * PATH_MAX];
+    ssize_t rv;
+
+    rv = skStreamRead(in, buf, count);
+    if (rv != (ssize_t)count) {
+        if (-1 == rv) {
+            skStreamLastErrMessage(in, rv, errbuf, sizeof(errbuf));
+        } else {
+            snprintf(errbuf, sizeof(errbuf),
+                     "read %" SK_PRIdZ " bytes of %" SK_PRIuZ " expected",
+                     rv, count);
+        }
+        skAppPrintErr("Failed to read %s (%s)", what, errbuf);
+        return SKPREFIXMAP_ERR_IO;
+    }
+    return SKPREFIXMAP_OK;
+}
+
+
+/*
+ *  status = prefixMapReadVersion6(map, in, hdr, record_count, swap_flag);
+ *
+ *    Read the layout, the tree, the compiled trie, and the dictionary
+ *    of a version 6 prefix map from the stream 'in', which is
+ *    positioned after the 'record_count' and whose header is 'hdr',
+ *    into 'map'.  The 'swap_flag' is true if the data in the stream
+ *    is not in native byte order.
+ *
+ *    When the stream is seekable and in native byte order, mmap() the
+ *    file and point the 'tree' and 'trie' members of 'map' into the
+ *    mapped space.  Otherwise, read the data into allocated memory.
+ *    The trie is ignored when it was compiled with strides that
+ *    differ from those used by this build of SiLK.  The caller must
+ *    validate the tree and the trie.
+ */
+static skPrefixMapErr_t
+prefixMapReadVersion6(
+    skPrefixMap_t          *map,
+    skstream_t             *in,
+    const sk_file_header_t *hdr,
+    uint32_t                record_count,
+    int                     swap_flag)
+{
+    skPrefixMapLayout_t layout;
+    struct stat st;
+    const uint8_t *buf = NULL;
+    uint32_t *word;
+    unsigned int stride;
+    size_t data_start;
+    size_t data_end;
+    size_t tree_size;
+    size_t trie_size;
+    size_t i;
+    skPrefixMapErr_t err;
+
+    err = prefixMapReadBytes(in, &layout, sizeof(layout), "layout");
+    if (err) {
+        return err;
+    }
+    if (swap_flag) {
+        word = (uint32_t*)&layout;
+        for (i = 0; i < sizeof(layout) / sizeof(uint32_t); ++i) {
+            word[i] = BSWAP32(word[i]);
+        }
+    }
+
+    switch (layout.content_type) {
+      case SKPREFIXMAP_CONT_ADDR_V4:
+      case SKPREFIXMAP_CONT_PROTO_PORT:
+        stride = SKPMAP_TRIE_STRIDE32;
+        break;
+      case SKPREFIXMAP_CONT_ADDR_V6:
+#if !SK_ENABLE_IPV6
+        skAppPrintErr("Support for IPv6 prefix maps not included"
+                      " in this installation");
+        return SKPREFIXMAP_ERR_NO_IPV6;
+#else
+        stride = SKPMAP_TRIE_STRIDE128;
+        break;
+#endif  /* SK_ENABLE_IPV6 */
+      default:
+        skAppPrintErr("Prefix map has unrecognized content type %" PRIu32,
+                      layout.content_type);
+        return SKPREFIXMAP_ERR_HEADER;
+    }
+    map->content_type = (skPrefixMapContent_t)layout.content_type;
+    if (!layout.has_dictionary) {
+        layout.dict_buf_size = 0;
+    }
+
+    map->tree_size = record_count;
+    map->tree_used = record_count;
+    tree_size = (size_t)record_count * sizeof(skPrefixMapRecord_t);
+    trie_size = (size_t)layout.trie_entries * sizeof(uint32_t);
+    if (SKPMAP_TRIE_ROOT_BITS == layout.trie_root_bits
+        && stride == layout.trie_stride)
+    {
+        map->trie_entries = layout.trie_entries;
+    }
+
+    /* attempt to mmap() the file.  Compare the start of the data
+     * section in the mapped space with the values read from the
+     * stream, which differ when the stream is compressed. */
+    data_start = skHeaderGetLength(hdr);
+    data_end = (data_start + sizeof(record_count) + sizeof(layout)
+                + tree_size + trie_size + layout.dict_buf_size);
+    if (skStreamIsSeekable(in)
+        && !swap_flag
+        && (0 == data_start % SKPMAP_VERS_MAPPED_RECLEN)
+        && (0 == fstat(skStreamGetDescriptor(in), &st))
+        && ((off_t)data_end <= st.st_size))
+    {
+        map->mapped_size = (size_t)st.st_size;
+        map->mapped_file = mmap(0, map->mapped_size, PROT_READ, MAP_SHARED,
+                                skStreamGetDescriptor(in), 0);
+        if (MAP_FAILED == map->mapped_file) {
+            map->mapped_file = NULL;
+            map->mapped_size = 0;
+        } else {
+            buf = (const uint8_t*)map->mapped_file + data_start;
+            if (memcmp(buf, &record_count, sizeof(record_count))
+                || memcmp(buf + sizeof(record_count), &layout,
+                          sizeof(layout)))
+            {
+                munmap(map->mapped_file, map->mapped_size);
+                map->mapped_file = NULL;
+                map->mapped_size = 0;
+            }
+        }
+    }
+
+    if (map->mapped_file) {
+        /* point into the mapped space */
+        buf += sizeof(record_count) + sizeof(layout);
+        map->tree = (skPrefixMapRecord_t*)buf;
+        buf += tree_size;
+        if (map->trie_entries) {
+            map->trie = (uint32_t*)buf;
+        }
+        buf += trie_size;
+    } else {
+        /* read the tree */
+        map->tree = (skPrefixMapRecord_t*)malloc(tree_size);
+        if (NULL == map->tree) {
+            skAppPrintErr("Failed to allocate prefix map data");
+            return SKPREFIXMAP_ERR_MEMORY;
+        }
+        err = prefixMapReadBytes(in, map->tree, tree_size, "record data");
+        if (err) {
+            return err;
+        }
+        if (swap_flag) {
+            for (i = 0; i < record_count; ++i) {
+                map->tree[i].left = BSWAP32(map->tree[i].left);
+                map->tree[i].right = BSWAP32(map->tree[i].right);
+            }
+        }
+
+        /* read the trie or skip over it */
+        if (map->trie_entries) {
+            map->trie = (uint32_t*)malloc(trie_size);
+            if (NULL == map->trie) {
+                skAppPrintErr("Failed to allocate prefix map trie");
+                return SKPREFIXMAP_ERR_MEMORY;
+            }
+        }
+        err = prefixMapReadBytes(in, map->trie, trie_size, "trie data");
+        if (err) {
+            return err;
+        }
+        if (swap_flag && map->trie) {
+            for (i = 0; i < map->trie_entries; ++i) {
+                map->trie[i] = BSWAP32(map->trie[i]);
+            }
+        }
+    }
+
+    if (0 == layout.dict_buf_size) {
+        return SKPREFIXMAP_OK;
+    }
+
+    /* copy or read the dictionary, then index it */
+    map->dict_buf_size = layout.dict_buf_size;
+    map->dict_buf = (char*)malloc(map->dict_buf_size * sizeof(char));
+    if (NULL == map->dict_buf) {
+        skAppPrintErr("Failed to allocate prefix map dictionary");
+        return SKPREFIXMAP_ERR_MEMORY;
+    }
+    if (map->mapped_file) {
+        memcpy(map->dict_buf, buf, map->dict_buf_size);
+    } else {
+        err = prefixMapReadBytes(in, map->dict_buf, map->dict_buf_size,
+                                 "dictionary entries");
+        if (err) {
+            return err;
+        }
+    }
+    return prefixMapIndexDictionary(map);
+}
+
+
+/*
+ *  count = prefixMapTrieCount(map, branch, depth, stride, limit);
+ *
+ *    Return the number of lower levels of the compiled trie, each
+ *    indexed by 'stride' bits, that are needed for the keys below
+ *    'branch', a member of a node in the tree of 'map' whose keys
+ *    share a 'depth'-bit prefix.  Stop counting and return a value
+ *    larger than 'limit' once the count exceeds 'limit'.  This
+ *    function is recursive.
+ */
+static size_t
+prefixMapTrieCount(
+    const skPrefixMap_t    *map,
+    uint32_t                branch,
+    unsigned int            depth,
+    unsigned int            stride,
+    size_t                  limit)
+{
+    size_t count = 0;
+
+    if (SKPMAP_IS_LEAF(branch)) {
+        return 0;
+    }
+    if (depth >= SKPMAP_TRIE_ROOT_BITS
+        && 0 == (depth - SKPMAP_TRIE_ROOT_BITS) % stride)
+    {
+        count = 1;
+    }
+    count += prefixMapTrieCount(map, map->tree[branch].left, depth + 1,
+                                stride, limit);
+    if (count <= limit) {
+        count += prefixMapTrieCount(map, map->tree[branch].right,
+                                    depth + 1, stride, limit);
+    }
+    return count;
+}
+
+
+/*
+ *  prefixMapTrieFill(map, branch, depth, level_end, stride, entry, next);
+ *
+ *    Fill the entries of the compiled trie on 'map' that begin at
+ *    'entry' with the values for the keys below 'branch', a member
+ *    of a node in the tree whose keys share a 'depth'-bit prefix.
+ *    'level_end' is the number of key bits consumed at the end of the
+ *    level of the trie that holds 'entry'.  A node that reaches the
+ *    end of the level is given a new level of the trie, indexed by
+ *    'stride' bits, at the position specified by 'next', which is
+ *    then advanced.  This function is recursive.
+ */
+static void
+prefixMapTrieFill(
+    skPrefixMap_t      *map,
+    uint32_t            branch,
+    unsigned int        depth,
+    unsigned int        level_end,
+    unsigned int        stride,
+    uint32_t           *entry,
+    uint32_t           *next)
+{
+    uint32_t count;
+    uint32_t i;
+
+    if (depth == level_end) {
+        if (SKPMAP_IS_LEAF(branch)) {
+            *entry = branch;
+            return;
+        }
+        *entry = *next;
+        *next += 1u << stride;
+        prefixMapTrieFill(map, branch, depth, depth + stride, stride,
+                          map->trie + *entry, next);
+        return;
+    }
+
+    if (SKPMAP_IS_LEAF(branch)) {
+        count = 1u << (level_end - depth);
+        for (i = 0; i < count; ++i) {
+            entry[i] = branch;
+        }
+        return;
+    }
+
+    count = 1u << (level_end - depth - 1);
+    prefixMapTrieFill(map, map->tree[branch].left, depth + 1, level_end,
+                      stride, entry, next);
+    prefixMapTrieFill(map, map->tree[branch].right, depth + 1, level_end,
+                      stride, entry + count, next);
+}
+
+
+/*
+ *  prefixMapTrieBuild(map);
+ *
+ *    Compile the tree of 'map', which must be valid, into the
+ *    multibit trie used for lookups.  Leave the 'trie' member of
+ *    'map' as NULL when the trie would be much larger than the tree
+ *    or memory cannot be allocated; lookups then walk the tree.
+ */
+static void
+prefixMapTrieBuild(
+    skPrefixMap_t      *map)
+{
+    unsigned int stride;
+    size_t levels;
+    size_t limit;
+    size_t entries;
+    uint32_t next;
+
+    assert(NULL == map->trie);
+
+    stride = ((SKPREFIXMAP_CONT_ADDR_V6 == map->content_type)
+              ? SKPMAP_TRIE_STRIDE128
+              : SKPMAP_TRIE_STRIDE32);
+
+    limit = (((size_t)map->tree_used * sizeof(skPrefixMapRecord_t)
+              * SKPMAP_TRIE_MAX_RATIO)
+             / (sizeof(uint32_t) << stride));
+    levels = prefixMapTrieCount(map, 0, 0, stride, limit);
+    if (levels > limit) {
+        return;
+    }
+    entries = (1u << SKPMAP_TRIE_ROOT_BITS) + (levels << stride);
+    if (entries > SKPMAP_LEAF_BIT) {
+        return;
+    }
+    map->trie = (uint32_t*)malloc(entries * sizeof(uint32_t));
+    if (NULL == map->trie) {
+        return;
+    }
+    next = 1u << SKPMAP_TRIE_ROOT_BITS;
+    prefixMapTrieFill(map, 0, 0, SKPMAP_TRIE_ROOT_BITS, stride,
+                      map->trie, &next);
+    assert(next == entries);
+    map->trie_entries = (uint32_t)entries;
+}
+
+
+/*
+ *  ok = prefixMapTrieCheck(map, branch, depth, level_end, stride,
+ *                          entry, next);
+ *
+ *    Return 0 if the entries of the trie on 'map' that begin at
+ *    'entry' hold the values that prefixMapTrieFill() would store
+ *    there for the keys below 'branch', or -1 if they do not or if a
+ *    level of the trie would extend beyond its 'trie_entries'.  The
+ *    arguments are the same as for prefixMapTrieFill().  This
+ *    function is recursive.
+ */
+static int
+prefixMapTrieCheck(
+    const skPrefixMap_t    *map,
+    uint32_t                branch,
+    unsigned int            depth,
+    unsigned int            level_end,
+    unsigned int            stride,
+    const uint32_t         *entry,
+    uint32_t               *next)
+{
+    uint32_t count;
+    uint32_t i;
+
+    if (depth == level_end) {
+        if (SKPMAP_IS_LEAF(branch)) {
+            return ((*entry == branch) ? 0 : -1);
+        }
+        if (*entry != *next
+            || (map->trie_entries - *next) < (1u << stride))
+        {
+            return -1;
+        }
+        *next += 1u << stride;
+        return prefixMapTrieCheck(map, branch, depth, depth + stride,
+                                  stride, map->trie + *entry, next);
+    }
+
+    if (SKPMAP_IS_LEAF(branch)) {
+        count = 1u << (level_end - depth);
+        for (i = 0; i < count; ++i) {
+            if (entry[i] != branch) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    count = 1u << (level_end - depth - 1);
+    if (prefixMapTrieCheck(map, map->tree[branch].left, depth + 1,
+                           level_end, stride, entry, next))
+    {
+        return -1;
+    }
+    return prefixMapTrieCheck(map, map->tree[branch].right, depth + 1,
+                              level_end, stride, entry + count, next);
+}
+
+
+/*
+ *  ok = prefixMapTrieVerify(map);
+ *
+ *    Return 0 if the 'trie' member of 'map', which was read from a
+ *    file, is the trie that prefixMapTrieBuild() creates for the
+ *    tree of 'map', which must be valid.  Return -1 otherwise.
+ */
+static int
+prefixMapTrieVerify(
+    const skPrefixMap_t    *map)
+{
+    unsigned int stride;
+    uint32_t next;
+
+    stride = ((SKPREFIXMAP_CONT_ADDR_V6 == map->content_type)
+              ? SKPMAP_TRIE_STRIDE128
+              : SKPMAP_TRIE_STRIDE32);
+
+    next = 1u << SKPMAP_TRIE_ROOT_BITS;
+    if (map->trie_entries < next
+        || prefixMapTrieCheck(map, 0, 0, SKPMAP_TRIE_ROOT_BITS, stride,
+                              map->trie, &next))
+    {
+        return -1;
+    }
+    return ((next == map->trie_entries) ? 0 : -1);
+}
+
+
+/*
+ *  value = prefixMapTrieFind(map, key);
+ *
+ *    Return the dict_val for 'key' using the compiled trie on 'map',
+ *    or SKPREFIXMAP_NOT_FOUND.  This is the equivalent of
+ *    prefixMapFind() for maps that have a trie.
+ */
+static uint32_t
+prefixMapTrieFind(
+    const skPrefixMap_t    *map,
+    const void             *key)
+{
+    const uint32_t *trie = map->trie;
+    uint32_t entry;
+    uint32_t key32;
+
+    switch (map->content_type) {
+#if SK_ENABLE_IPV6
+      case SKPREFIXMAP_CONT_ADDR_V6:
+        {
+            uint8_t key128[16];
+            unsigned int i;
+
+            /* each lower level is indexed by a 4-bit nibble */
+            skipaddrGetAsV6((const skipaddr_t*)key, key128);
+            entry = trie[(key128[0] << 8) | key128[1]];
+            for (i = 2; SKPMAP_IS_NODE(entry); ++i) {
+                assert(i < sizeof(key128));
+                entry = trie[entry + (key128[i] >> 4)];
+                if (SKPMAP_IS_LEAF(entry)) {
+                    break;
+                }
+                entry = trie[entry + (key128[i] & 0xF)];
+            }
+            return SKPMAP_LEAF_VALUE(entry);
+        }
+#endif  /* SK_ENABLE_IPV6 */
+
+      case SKPREFIXMAP_CONT_PROTO_PORT:
+        key32 = SKPMAP_KEY_FROM_PROTO_PORT(key);
+        break;
+
+      case SKPREFIXMAP_CONT_ADDR_V4:
+#if !SK_ENABLE_IPV6
+        key32 = skipaddrGetV4((const skipaddr_t*)key);
+#else
+        if (skipaddrGetAsV4((const skipaddr_t*)key, &key32)) {
+            return SKPREFIXMAP_NOT_FOUND;
+        }
+#endif
+        break;
+
+      default:
+        skAbortBadCase(map->content_type);
+    }
+
+    /* each lower level is indexed by 8 bits */
+    entry = trie[key32 >> 16];
+    if (SKPMAP_IS_NODE(entry)) {
+        entry = trie[entry + ((key32 >> 8) & 0xFF)];
+        if (SKPMAP_IS_NODE(entry)) {
+            entry = trie[entry + (key32 & 0xFF)];
+        }
+    }
+    return SKPMAP_LEAF_VALUE(entry);
+}
+
+
 /*
  *    Ensure that 'map' is a valid prefix map and adjust the
  *    'tree_used' member of 'map' to number of valid nodes in the
@@ -1331,6 +1964,14 @@ skPrefixMapAddRange(
         return SKPREFIXMAP_ERR_ARGS;
     }
 
+    /* discard the compiled trie, and copy a tree that is mmap()ed */
+    if (map->trie || map->mapped_file) {
+        skPrefixMapErr_t err = prefixMapCopyOnWrite(map);
+        if (err) {
+            return err;
+        }
+    }
+
     switch (map->content_type) {
 #if SK_ENABLE_IPV6
       case SKPREFIXMAP_CONT_ADDR_V6:
@@ -1428,8 +2069,11 @@ skPrefixMapDelete(
         if (map->dict_words) {
             free(map->dict_words);
         }
-        if (map->tree) {
+        if (map->mapped_file) {
+            munmap(map->mapped_file, map->mapped_size);
+        } else {
             free(map->tree);
+            free(map->trie);
         }
         if (map->word_map) {
             rbdestroy(map->word_map);
@@ -1624,6 +2268,11 @@ skPrefixMapFindString(
     size_t                  bufsize)
 {
     int depth;
+
+    if (map->trie) {
+        return skPrefixMapDictionaryGetEntry(map, prefixMapTrieFind(map, key),
+                                             out_buf, bufsize);
+    }
     return skPrefixMapDictionaryGetEntry(map, prefixMapFind(map, key, &depth),
                                          out_buf, bufsize);
 }
@@ -1636,6 +2285,10 @@ skPrefixMapFindValue(
     const void             *key)
 {
     int depth;
+
+    if (map->trie) {
+        return prefixMapTrieFind(map, key);
+    }
     return prefixMapFind(map, key, &depth);
 }
 
@@ -1980,7 +2633,9 @@ skPrefixMapRead(
         return SKPREFIXMAP_ERR_IO;
     }
 
-    if (skStreamCheckSilkHeader(in, FT_PREFIXMAP, 1, 5, &skAppPrintErr)){
+    if (skStreamCheckSilkHeader(in, FT_PREFIXMAP, 1, SKPMAP_VERS_MAPPED,
+                                &skAppPrintErr))
+    {
         return SKPREFIXMAP_ERR_HEADER;
     }
     vers = skHeaderGetRecordVersion(hdr);
@@ -2016,12 +2671,35 @@ skPrefixMapRead(
     }
     tree_size = record_count * sizeof(skPrefixMapRecord_t);
 
-    /* Allocate a prefix map, and a storage buffer */
+    /* Allocate a prefix map */
     map = (skPrefixMap_t*)calloc(1, sizeof(skPrefixMap_t));
     if (NULL == map) {
         skAppPrintErr("Failed to allocate prefix map");
         return SKPREFIXMAP_ERR_MEMORY;
     }
+
+    /* Get the mapname from the header if it was specified and if the
+     * header-entry version is 1. */
+    hentry = skHeaderGetFirstMatch(hdr, SK_HENTRY_PREFIXMAP_ID);
+    if ((hentry) && (1 == prefixMapHentryGetVersion(hentry))) {
+        map->mapname = strdup(prefixMapHentryGetMapmame(hentry));
+        if (NULL == map->mapname) {
+            skAppPrintErr("Failed to allocate prefix map name");
+            err = SKPREFIXMAP_ERR_MEMORY;
+            goto ERROR;
+        }
+    }
+
+    if (SKPMAP_VERS_MAPPED == vers) {
+        /* Read or mmap() the tree, the trie, and the dictionary */
+        err = prefixMapReadVersion6(map, in, hdr, record_count, swap_flag);
+        if (err) {
+            goto ERROR;
+        }
+        goto VALIDATE;
+    }
+
+    /* Allocate a storage buffer */
     map->tree = (skPrefixMapRecord_t*)malloc(tree_size);
     if (NULL == map->tree) {
         skAppPrintErr("Failed to allocate prefix map data");
@@ -2069,18 +2747,6 @@ skPrefixMapRead(
         skAbortBadCase(vers);
     }
 
-    /* Get the mapname from the header if it was specified and if the
-     * header-entry version is 1. */
-    hentry = skHeaderGetFirstMatch(hdr, SK_HENTRY_PREFIXMAP_ID);
-    if ((hentry) && (1 == prefixMapHentryGetVersion(hentry))) {
-        map->mapname = strdup(prefixMapHentryGetMapmame(hentry));
-        if (NULL == map->mapname) {
-            skAppPrintErr("Failed to allocate prefix map name");
-            err = SKPREFIXMAP_ERR_MEMORY;
-            goto ERROR;
-        }
-    }
-
     /* Allocation completed successfully, read in the records. */
     rv = skStreamRead(in, map->tree, tree_size);
     if (rv != (ssize_t)(tree_size)) {
@@ -2112,12 +2778,25 @@ skPrefixMapRead(
         }
     }
 
+  VALIDATE:
     /* Validate the prefix map */
     err = prefixMapValidate(map, record_count);
     if (err) {
         goto ERROR;
     }
 
+    if (map->trie) {
+        /* Ensure the trie read from the file matches the tree */
+        if (prefixMapTrieVerify(map)) {
+            skAppPrintErr("Prefix map is malformed (contains invalid trie)");
+            err = SKPREFIXMAP_ERR_IO;
+            goto ERROR;
+        }
+    } else if (NULL == map->mapped_file) {
+        /* Compile the tree for lookups */
+        prefixMapTrieBuild(map);
+    }
+
     *map_parm = map;
     return SKPREFIXMAP_OK;
 
@@ -2216,6 +2895,12 @@ skPrefixMapSetDefaultVal(
     {
         return SKPREFIXMAP_ERR_NOTEMPTY;
     }
+    if (map->trie || map->mapped_file) {
+        skPrefixMapErr_t err = prefixMapCopyOnWrite(map);
+        if (err) {
+            return err;
+        }
+    }
 
     map->tree[0].left = SKPMAP_MAKE_LEAF(dict_val);
     map->tree[0].right = SKPMAP_MAKE_LEAF(dict_val);
@@ -2246,6 +2931,20 @@ skPrefixMapSetMapName(
 }
 
 
+/* Set the record version to use when writing the prefix map */
+skPrefixMapErr_t
+skPrefixMapSetRecordVersion(
+    skPrefixMap_t      *map,
+    sk_file_version_t   record_version)
+{
+    if (0 != record_version && SKPMAP_VERS_MAPPED != record_version) {
+        return SKPREFIXMAP_ERR_ARGS;
+    }
+    map->record_version = record_version;
+    return SKPREFIXMAP_OK;
+}
+
+
 /* Return a textual representation of the specified error code. */
 const char *
 skPrefixMapStrerror(
@@ -2284,6 +2983,7 @@ skPrefixMapWrite(
     skPrefixMap_t      *map,
     skstream_t         *stream)
 {
+    skPrefixMapLayout_t layout;
     sk_file_header_t *hdr;
     sk_file_version_t vers;
     ssize_t rv;
@@ -2309,6 +3009,9 @@ skPrefixMapWrite(
     } else {
         return SKPREFIXMAP_ERR_ARGS;
     }
+    if (SKPMAP_VERS_MAPPED == map->record_version) {
+        vers = SKPMAP_VERS_MAPPED;
+    }
 
     /* create the header */
     hdr = skStreamGetSilkHeader(stream);
@@ -2316,7 +3019,11 @@ skPrefixMapWrite(
     skHeaderSetFileFormat(hdr, FT_PREFIXMAP);
     skHeaderSetRecordVersion(hdr, vers);
     skHeaderSetCompressionMethod(hdr, SK_COMPMETHOD_NONE);
-    skHeaderSetRecordLength(hdr, 1);
+    if (SKPMAP_VERS_MAPPED == vers) {
+        skHeaderSetRecordLength(hdr, SKPMAP_VERS_MAPPED_RECLEN);
+    } else {
+        skHeaderSetRecordLength(hdr, 1);
+    }
 
     /* add the prefixmap header if a mapname was given */
     if (map->mapname) {
@@ -2345,6 +3052,28 @@ skPrefixMapWrite(
         goto ERROR;
     }
 
+    if (SKPMAP_VERS_MAPPED == vers) {
+        /* compile the trie if needed so it may be written */
+        if (NULL == map->trie && NULL == map->mapped_file) {
+            prefixMapTrieBuild(map);
+        }
+
+        /* write the layout */
+        memset(&layout, 0, sizeof(layout));
+        layout.content_type = (uint32_t)map->content_type;
+        layout.has_dictionary = (NULL != map->dict_buf);
+        layout.dict_buf_size = ((map->dict_buf) ? map->dict_buf_used : 0);
+        layout.trie_root_bits = SKPMAP_TRIE_ROOT_BITS;
+        layout.trie_stride = ((SKPREFIXMAP_CONT_ADDR_V6 == map->content_type)
+                              ? SKPMAP_TRIE_STRIDE128
+                              : SKPMAP_TRIE_STRIDE32);
+        layout.trie_entries = ((map->trie) ? map->trie_entries : 0);
+        rv = skStreamWrite(stream, &layout, sizeof(layout));
+        if (rv == -1) {
+            goto ERROR;
+        }
+    }
+
     /* write the records */
     rv = skStreamWrite(stream, map->tree,
                        (size_t)map->tree_used * sizeof(skPrefixMapRecord_t));
@@ -2352,13 +3081,25 @@ skPrefixMapWrite(
         goto ERROR;
     }
 
+    if (SKPMAP_VERS_MAPPED == vers && map->trie) {
+        /* write the trie */
+        rv = skStreamWrite(stream, map->trie,
+                           (size_t)map->trie_entries * sizeof(uint32_t));
+        if (rv == -1) {
+            goto ERROR;
+        }
+    }
+
     if (map->dict_buf) {
         uint32_t i;
 
-        /* write the number of characters in the dictionary */
-        rv = skStreamWrite(stream, &map->dict_buf_used, sizeof(uint32_t));
-        if (rv == -1) {
-            goto ERROR;
+        if (SKPMAP_VERS_MAPPED != vers) {
+            /* write the number of characters in the dictionary */
+            rv = skStreamWrite(stream, &map->dict_buf_used,
+                               sizeof(uint32_t));
+            if (rv == -1) {
+                goto ERROR;
+            }
         }
 
         /* write the dictionary entries */
@@ -2375,6 +3116,20 @@ skPrefixMapWrite(
                 goto ERROR;
             }
         }
+
+        if (SKPMAP_VERS_MAPPED == vers
+            && 0 != map->dict_buf_used % SKPMAP_VERS_MAPPED_RECLEN)
+        {
+            /* pad the data to a multiple of the record length */
+            static const uint8_t pad[SKPMAP_VERS_MAPPED_RECLEN];
+            rv = skStreamWrite(stream, pad,
+                               (SKPMAP_VERS_MAPPED_RECLEN
+                                - (map->dict_buf_used
+                                   % SKPMAP_VERS_MAPPED_RECLEN)));
+            if (rv == -1) {
+                goto ERROR;
+            }
+        }
     }
 
     /* Success */
@@ -454,6 +454,11 @@ skPrefixMapLoad(
  *    pointer.  If skPrefixMapRead() returns an error, *map will not
  *    contain a valid pointer, and any allocated memory will have been
  *    freed.
+ *
+ *    When 'in' is a seekable stream that contains a prefix map
+ *    written with record version 6 in native byte order, the map is
+ *    mmap()ed from the file instead of being read into memory.  The
+ *    map is copied into memory if it is later modified.
  */
 skPrefixMapErr_t
 skPrefixMapRead(
@@ -508,6 +513,25 @@ skPrefixMapSetMapName(
     const char         *name);
 
 
+/**
+ *    Set the record version that skPrefixMapWrite() uses when writing
+ *    the prefix map 'map' to 'record_version'.  When the version is
+ *    0, the map is written in the format that is readable by all
+ *    releases of SiLK, where the version depends on the content type
+ *    of the map and whether it has a dictionary.  When the version is
+ *    6, the map is written in a format that SiLK 3.20.0 and later may
+ *    mmap() when the file is read, which avoids copying the map into
+ *    memory and allows concurrent processes to share a single copy
+ *    of the map.  Return SKPREFIXMAP_ERR_ARGS for any other version.
+ *
+ *    Since SiLK 3.20.0.
+ */
+skPrefixMapErr_t
+skPrefixMapSetRecordVersion(
+    skPrefixMap_t      *map,
+    sk_file_version_t   record_version);
+
+
 /**
  *    Given the 'error_code'---a skPrefixMapErr_t---return a textual
  *    representation of it.
@@ -81,34 +81,38 @@ swapfunc(
 }
 
 
-void
-skQSort_r(
-    void               *a,
+/*
+ *  qsortPartition(a, n, es, cmp, thunk, &left_n, &right, &right_n);
+ *
+ *    Choose a pivot for the 'n' elements of size 'es' at 'a' and
+ *    partition them.  Elements that compare equal to the pivot are
+ *    moved into their final position.  On return, the 'left_n'
+ *    elements at 'a' and the 'right_n' elements at 'right' remain to
+ *    be sorted.  'n' must be at least 7.
+ */
+static void
+qsortPartition(
+    char               *a,
     size_t              n,
     size_t              es,
     int               (*cmp)(const void *, const void *, void *),
-    void               *thunk)
+    void               *thunk,
+    size_t             *left_n,
+    char              **right,
+    size_t             *right_n)
 {
     char *pa, *pb, *pc, *pd, *pl, *pm, *pn;
     int r, swaptype;
     WORD t;
     size_t s;
 
-  loop:
     SWAPINIT(a, es);
-    if (n < 7) {
-        /* use insertion sort on smallest arrays */
-        for (pm = (char*)a + es; pm < (char*)a + n*es; pm += es)
-            for (pl = pm; pl > (char*)a && cmp(pl-es, pl, thunk) > 0; pl -= es)
-                swap(pl, pl-es);
-        return;
-    }
 
     /* determine the pivot, pm */
-    pm = (char*)a + (n/2)*es;           /* small arrays middle element */
+    pm = a + (n/2)*es;                  /* small arrays middle element */
     if (n > 7) {
-        pl = (char*)a;
-        pn = (char*)a + (n - 1)*es;
+        pl = a;
+        pn = a + (n - 1)*es;
         if (n > 40) {
             /* big arays.  Pseudomedian of 9 */
             s = (n / 8) * es;
@@ -121,8 +125,8 @@ skQSort_r(
     /* put pivot into position 0 */
     swap(a, pm);
 
-    pa = pb = (char*)a + es;
-    pc = pd = (char*)a + (n - 1) * es;
+    pa = pb = a + es;
+    pc = pd = a + (n - 1) * es;
     for (;;) {
         while (pb <= pc && (r = cmp(pb, a, thunk)) <= 0) {
             if (r == 0) {
@@ -146,19 +150,51 @@ skQSort_r(
         pc -= es;
     }
 
-    pn = (char*)a + n * es;
-    s = min(pa - (char*)a, pb - pa);
+    pn = a + n * es;
+    s = min(pa - a, pb - pa);
     vecswap(a, pb - s, s);
     s = min((size_t)(pd - pc), pn - pd - es);
     vecswap(pb, pn - s, s);
-    if ((s = pb - pa) > es) {
-        skQSort_r(a, s/es, es, cmp, thunk);
+
+    *left_n = (size_t)(pb - pa) / es;
+    *right_n = (size_t)(pd - pc) / es;
+    *right = pn - (pd - pc);
+}
+
+
+void
+skQSort_r(
+    void               *a,
+    size_t              n,
+    size_t              es,
+    int               (*cmp)(const void *, const void *, void *),
+    void               *thunk)
+{
+    char *pl, *pm, *right;
+    int swaptype;
+    WORD t;
+    size_t left_n;
+    size_t right_n;
+
+  loop:
+    if (n < 7) {
+        /* use insertion sort on smallest arrays */
+        SWAPINIT(a, es);
+        for (pm = (char*)a + es; pm < (char*)a + n*es; pm += es)
+            for (pl = pm; pl > (char*)a && cmp(pl-es, pl, thunk) > 0; pl -= es)
+                swap(pl, pl-es);
+        return;
+    }
+
+    qsortPartition((char*)a, n, es, cmp, thunk, &left_n, &right, &right_n);
+    if (left_n > 1) {
+        skQSort_r(a, left_n, es, cmp, thunk);
     }
-    if ((s = pd - pc) > es) {
+    if (right_n > 1) {
         /* iterate rather than recurse */
-        /* skQSort(pn - s, s/es, es, cmp, thunk); */
-        a = pn - s;
-        n = s / es;
+        /* skQSort(right, right_n, es, cmp, thunk); */
+        a = right;
+        n = right_n;
         goto loop;
     }
 }
@@ -175,6 +211,195 @@ skQSort(
 }
 
 
+
+/*
+ *    When sorting with multiple threads, ranges containing no more
+ *    than this number of elements are sorted by a single thread.
+ */
+#define QSORT_THREAD_MIN_ELEMENTS  16384
+
+/*
+ *    A range of the buffer that still needs to be sorted.
+ */
+typedef struct qsort_range_st {
+    char               *base;
+    size_t              count;
+} qsort_range_t;
+
+/*
+ *    State shared by the threads in skQSortThreaded().  'stack'
+ *    holds ranges larger than 'cutoff' that no thread has claimed;
+ *    'busy' is the number of threads working on a range.  The sort
+ *    is complete when the stack is empty and no thread is busy.
+ */
+typedef struct qsort_pool_st {
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;
+    qsort_range_t      *stack;
+    size_t              stack_count;
+    size_t              busy;
+    size_t              cutoff;
+    size_t              es;
+    int               (*cmp)(const void *, const void *, void *);
+    void               *thunk;
+} qsort_pool_t;
+
+
+/*
+ *  qsortWorker(v_pool);
+ *
+ *    THREAD ENTRY POINT for skQSortThreaded().  Claim a range from
+ *    the stack in 'v_pool' and partition it, pushing the smaller part
+ *    back onto the stack for another thread and continuing with the
+ *    larger part until it falls below the cutoff, at which point sort
+ *    it with skQSort_r().  Return once every range has been sorted.
+ */
+static void *
+qsortWorker(
+    void               *v_pool)
+{
+    qsort_pool_t *pool = (qsort_pool_t*)v_pool;
+    qsort_range_t range;
+    qsort_range_t left;
+    qsort_range_t right;
+    qsort_range_t *small;
+    qsort_range_t *large;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (0 == pool->stack_count && pool->busy > 0) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (0 == pool->stack_count) {
+            /* no work remains and no thread can create more */
+            break;
+        }
+        range = pool->stack[--pool->stack_count];
+        ++pool->busy;
+        pthread_mutex_unlock(&pool->mutex);
+
+        while (range.count > pool->cutoff) {
+            left.base = range.base;
+            qsortPartition(range.base, range.count, pool->es, pool->cmp,
+                           pool->thunk, &left.count, &right.base,
+                           &right.count);
+            if (left.count < right.count) {
+                small = &left;
+                large = &right;
+            } else {
+                small = &right;
+                large = &left;
+            }
+            if (small->count > pool->cutoff) {
+                pthread_mutex_lock(&pool->mutex);
+                pool->stack[pool->stack_count++] = *small;
+                pthread_cond_signal(&pool->cond);
+                pthread_mutex_unlock(&pool->mutex);
+            } else if (small->count > 1) {
+                skQSort_r(small->base, small->count, pool->es, pool->cmp,
+                          pool->thunk);
+            }
+            range = *large;
+        }
+        if (range.count > 1) {
+            skQSort_r(range.base, range.count, pool->es, pool->cmp,
+                      pool->thunk);
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        --pool->busy;
+        if (0 == pool->busy && 0 == pool->stack_count) {
+            pthread_cond_broadcast(&pool->cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+
+void
+skQSortThreaded_r(
+    void               *a,
+    size_t              n,
+    size_t              es,
+    int               (*cmp)(const void *, const void *, void *),
+    void               *thunk,
+    uint32_t            thread_count)
+{
+    qsort_pool_t pool;
+    pthread_t *threads;
+    uint32_t started;
+    uint32_t i;
+
+    if (thread_count < 2 || n <= QSORT_THREAD_MIN_ELEMENTS) {
+        skQSort_r(a, n, es, cmp, thunk);
+        return;
+    }
+
+    memset(&pool, 0, sizeof(pool));
+    pool.es = es;
+    pool.cmp = cmp;
+    pool.thunk = thunk;
+
+    /* create enough ranges that the threads stay busy even when the
+     * pivots are poor */
+    pool.cutoff = n / ((size_t)thread_count * 8);
+    if (pool.cutoff < QSORT_THREAD_MIN_ELEMENTS) {
+        pool.cutoff = QSORT_THREAD_MIN_ELEMENTS;
+    }
+
+    /* every range on the stack is larger than the cutoff and the
+     * ranges do not overlap, which bounds the size of the stack */
+    pool.stack = (qsort_range_t*)malloc((n / pool.cutoff + 1)
+                                        * sizeof(qsort_range_t));
+    threads = (pthread_t*)malloc((thread_count - 1) * sizeof(pthread_t));
+    if (NULL == pool.stack || NULL == threads) {
+        free(pool.stack);
+        free(threads);
+        skQSort_r(a, n, es, cmp, thunk);
+        return;
+    }
+    pool.stack[0].base = (char*)a;
+    pool.stack[0].count = n;
+    pool.stack_count = 1;
+
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    /* if a thread cannot be created, sort with the ones we have; the
+     * calling thread always participates */
+    for (started = 0; started < thread_count - 1; ++started) {
+        if (pthread_create(&threads[started], NULL, &qsortWorker, &pool)) {
+            break;
+        }
+    }
+    qsortWorker(&pool);
+    for (i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.mutex);
+    free(threads);
+    free(pool.stack);
+}
+
+
+void
+skQSortThreaded(
+    void               *a,
+    size_t              n,
+    size_t              es,
+    int               (*cmp)(const void *, const void *),
+    uint32_t            thread_count)
+{
+    skQSortThreaded_r(a, n, es,
+                      (int (*)(const void *, const void *, void *))cmp, NULL,
+                      thread_count);
+}
+
+
 /*
 ** Local Variables:
 ** mode:c
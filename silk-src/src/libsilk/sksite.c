@@ -21,6 +21,7 @@
 
 RCSIDENT("$SiLK: sksite.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
+#include <silk/skipset.h>
 #include <silk/sksite.h>
 #include <silk/skstream.h>
 #include <silk/utils.h>
@@ -3629,6 +3630,121 @@ sksiteParseGeneratePath(
 }
 
 
+int
+sksiteIPsetIndexLoad(
+    skipset_t         **ipset,
+    const char         *datafile,
+    const char         *suffix,
+    uint64_t            datafile_size)
+{
+    const size_t note_len = strlen(SKSITE_IPSET_INDEX_SIZE_NOTE);
+    char path[PATH_MAX];
+    sk_hentry_iterator_t iter;
+    sk_header_entry_t *hentry;
+    sk_file_header_t *hdr;
+    skstream_t *stream = NULL;
+    const char *note;
+    uint64_t size;
+    int valid = 0;
+    int rv;
+
+    assert(ipset);
+    assert(datafile);
+    assert(suffix);
+
+    *ipset = NULL;
+
+    rv = snprintf(path, sizeof(path), "%s%s", datafile, suffix);
+    if ((size_t)rv >= sizeof(path) || !skFileExists(path)) {
+        return -1;
+    }
+
+    if (skStreamCreate(&stream, SK_IO_READ, SK_CONTENT_SILK)
+        || skStreamBind(stream, path)
+        || skStreamOpen(stream)
+        || skStreamReadSilkHeader(stream, &hdr))
+    {
+        goto END;
+    }
+
+    /* the index is only valid when it describes a flow file having
+     * the current size */
+    skHeaderIteratorBindType(&iter, hdr, SK_HENTRY_ANNOTATION_ID);
+    while ((hentry = skHeaderIteratorNext(&iter)) != NULL) {
+        note = skHentryAnnotationGetNote(hentry);
+        if (note
+            && 0 == strncmp(note, SKSITE_IPSET_INDEX_SIZE_NOTE, note_len))
+        {
+            rv = skStringParseUint64(&size, note + note_len, 0, 0);
+            valid = (0 == rv && size == datafile_size);
+            break;
+        }
+    }
+    if (valid && skIPSetRead(ipset, stream)) {
+        *ipset = NULL;
+    }
+
+  END:
+    skStreamDestroy(&stream);
+    return ((*ipset) ? 0 : -1);
+}
+
+
+int
+sksiteIPsetIndexSave(
+    const skipset_t    *ipset,
+    const char         *datafile,
+    const char         *suffix,
+    uint64_t            datafile_size)
+{
+    char note[64];
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    skstream_t *stream = NULL;
+    int retval = -1;
+    int rv;
+
+    assert(ipset);
+    assert(datafile);
+    assert(suffix);
+
+    rv = snprintf(path, sizeof(path), "%s%s", datafile, suffix);
+    if ((size_t)rv >= sizeof(path)) {
+        return -1;
+    }
+    rv = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld",
+                  path, (long)getpid());
+    if ((size_t)rv >= sizeof(tmp_path)) {
+        return -1;
+    }
+    snprintf(note, sizeof(note), "%s%" PRIu64,
+             SKSITE_IPSET_INDEX_SIZE_NOTE, datafile_size);
+
+    /* remove any temporary file left by an earlier failure */
+    unlink(tmp_path);
+
+    if (skStreamCreate(&stream, SK_IO_WRITE, SK_CONTENT_SILK)
+        || skStreamBind(stream, tmp_path)
+        || skStreamOpen(stream)
+        || skHeaderAddAnnotation(skStreamGetSilkHeader(stream), note)
+        || skIPSetWrite(ipset, stream)
+        || skStreamClose(stream))
+    {
+        unlink(tmp_path);
+        goto END;
+    }
+    if (rename(tmp_path, path)) {
+        unlink(tmp_path);
+        goto END;
+    }
+    retval = 0;
+
+  END:
+    skStreamDestroy(&stream);
+    return retval;
+}
+
+
 /** Special Support Functions *****************************************/
 
 /*
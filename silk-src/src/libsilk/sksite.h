@@ -1315,6 +1315,64 @@ sksiteParseGeneratePath(
     char              **reldir_begin,
     char              **filename_begin);
 
+
+/**
+ *    The suffixes that are appended to the pathname of a SiLK Flow
+ *    file to name its optional IPset index files.  These files hold
+ *    the set of source and of destination addresses that appear in
+ *    the flow file.  rwflowappend(8) writes them when given the
+ *    --ipset-index switch, and rwfilter(1) uses them to skip files
+ *    that cannot contain records matching an IP-based partitioning
+ *    switch.
+ */
+#define SKSITE_IPSET_INDEX_SIP_SUFFIX   ".sip"
+#define SKSITE_IPSET_INDEX_DIP_SUFFIX   ".dip"
+
+/**
+ *    An IPset index file contains an annotation header entry
+ *    beginning with this prefix.  The remainder of the annotation is
+ *    the size of the flow file in octets at the time the index was
+ *    written.  An index whose recorded size does not match the
+ *    current size of the flow file is stale and must be ignored.
+ */
+#define SKSITE_IPSET_INDEX_SIZE_NOTE    "ipset-index-file-size:"
+
+/**
+ *    Read into the location referenced by 'ipset' the IPset index
+ *    file whose name is 'datafile' followed by 'suffix', where
+ *    'datafile_size' is the current size of 'datafile' in octets.
+ *
+ *    Return 0 on success.  Return -1 and set '*ipset' to NULL if the
+ *    index does not exist, if it cannot be read, or if it is stale;
+ *    that is, if the size it records is not 'datafile_size'.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+sksiteIPsetIndexLoad(
+    skipset_t         **ipset,
+    const char         *datafile,
+    const char         *suffix,
+    uint64_t            datafile_size);
+
+/**
+ *    Write 'ipset' to the IPset index file whose name is 'datafile'
+ *    followed by 'suffix', recording in the index that 'datafile' is
+ *    'datafile_size' octets long.  The IPset is written to a
+ *    temporary file which is then renamed, so a reader never sees a
+ *    partially written index.  'ipset' must be clean.
+ *
+ *    Return 0 on success, or -1 on error.
+ *
+ *    Since SiLK 3.20.0.
+ */
+int
+sksiteIPsetIndexSave(
+    const skipset_t    *ipset,
+    const char         *datafile,
+    const char         *suffix,
+    uint64_t            datafile_size);
+
 /** Error Reporting Types/Functions************************************/
 
 /**
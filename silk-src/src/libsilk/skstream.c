@@ -41,10 +41,65 @@ RCSIDENT("$SiLK: skstream.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
  *    Name of environment variable that affects how to treat ICMP flow
  *    records.  This variable determines the setting of the
  *    'silk_icmp_nochange' global.  See the detailed note in
- *    skStreamReadRecord().
+ *    streamReadRecordFinish().
  */
 #define SILK_ICMP_SPORT_HANDLER_ENVAR "SILK_ICMP_SPORT_HANDLER"
 
+/*
+ *    Name of environment variable that sets the default number of
+ *    read-ahead threads for streams opened for reading.  This
+ *    variable determines the setting of the 'silk_readahead_threads'
+ *    global.  See skStreamSetReadAhead().
+ */
+#define SILK_READAHEAD_THREADS_ENVAR "SILK_READAHEAD_THREADS"
+
+/*
+ *    Name of environment variable that sets the default number of
+ *    compression threads for streams opened for writing.  This
+ *    variable determines the setting of the
+ *    'silk_compression_threads' global.  See
+ *    skStreamSetCompressionThreads().
+ */
+#define SILK_COMPRESSION_THREADS_ENVAR "SILK_COMPRESSION_THREADS"
+
+/*
+ *    Name of environment variable that, when set to a non-zero
+ *    value, causes streams opened for writing SiLK Flow records to
+ *    write block summaries.  This variable determines the setting of
+ *    the 'silk_block_index' global.  See skStreamSetBlockIndex().
+ */
+#define SILK_BLOCK_INDEX_ENVAR "SILK_BLOCK_INDEX"
+
+/*
+ *    The version and length in octets of the block summaries that
+ *    this release writes.  The summary is stored in network byte
+ *    order as:
+ *
+ *    uint32_t    rec_count         0- 3
+ *    uint32_t    flags             4- 7
+ *    int64_t     stime_min         8-15
+ *    int64_t     stime_max        16-23
+ *    int64_t     etime_min        24-31
+ *    int64_t     etime_max        32-39
+ *    uint8_t[16] sip_min          40-55
+ *    uint8_t[16] sip_max          56-71
+ *    uint8_t[16] dip_min          72-87
+ *    uint8_t[16] dip_max          88-103
+ *    uint8_t[32] protocols       104-135
+ *
+ *    where the IP addresses are IPv6 and IPv4 addresses are mapped
+ *    into ::ffff:0:0/96.
+ */
+#define STREAM_BLOCK_SUMMARY_VERSION  1
+#define STREAM_BLOCK_SUMMARY_LENGTH   136
+
+/*
+ *    Bit set in the flags of a block summary when the block contains
+ *    data not reflected in the summary.  Such a block is never
+ *    skipped.
+ */
+#define STREAM_BLOCK_SUMMARY_PARTIAL  0x1
+
 
 /*
  *    Return SKSTREAM_ERR_NULL_ARGUMENT when 'srin_stream' is NULL.
@@ -85,10 +140,29 @@ RCSIDENT("$SiLK: skstream.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 /*
  *    If nonzero, do not attempt process ICMP values in the sPort
  *    field.  This is 0 unless the SILK_ICMP_SPORT_HANDLER envar is
- *    set to "none".  See the detailed note in skStreamReadRecord().
+ *    set to "none".  See the detailed note in streamReadRecordFinish().
  */
 static int silk_icmp_nochange = 0;
 
+/*
+ *    The default number of read-ahead threads for each stream.  This
+ *    is 0 unless the SILK_READAHEAD_THREADS envar is set.
+ */
+static uint32_t silk_readahead_threads = 0;
+
+/*
+ *    The default number of compression threads for each stream.  This
+ *    is 0 unless the SILK_COMPRESSION_THREADS envar is set.
+ */
+static uint32_t silk_compression_threads = 0;
+
+/*
+ *    If nonzero, streams opened for writing SiLK Flow records write
+ *    block summaries.  This is 0 unless the SILK_BLOCK_INDEX envar is
+ *    set.
+ */
+static int silk_block_index = 0;
+
 #ifdef SILK_CLOBBER_ENVAR
 /*
  *    If nonzero, enable clobbering (overwriting) of existing files
@@ -119,6 +193,188 @@ streamIOBufCallbackSeek(
 
 /* FUNCTION DEFINITIONS */
 
+/*
+ *  streamBlockSummaryAdd(stream, rwrec);
+ *
+ *    Add the SiLK Flow record 'rwrec' to the summary of the block
+ *    that 'stream' is writing.
+ */
+static void
+streamBlockSummaryAdd(
+    skstream_t         *stream,
+    const rwRec        *rwrec)
+{
+    sk_block_summary_t *summ = &stream->block_summary;
+    skipaddr_t ip;
+    sktime_t t;
+    uint8_t proto;
+
+    proto = rwRecGetProto(rwrec);
+    summ->protocols[proto >> 3] |= (uint8_t)(1 << (proto & 0x7));
+
+    if (0 == summ->rec_count++) {
+        summ->stime_min = summ->stime_max = rwRecGetStartTime(rwrec);
+        summ->etime_min = summ->etime_max = rwRecGetEndTime(rwrec);
+        rwRecMemGetSIP(rwrec, &summ->sip_min);
+        skipaddrCopy(&summ->sip_max, &summ->sip_min);
+        rwRecMemGetDIP(rwrec, &summ->dip_min);
+        skipaddrCopy(&summ->dip_max, &summ->dip_min);
+        return;
+    }
+
+    t = rwRecGetStartTime(rwrec);
+    if (t < summ->stime_min) {
+        summ->stime_min = t;
+    } else if (t > summ->stime_max) {
+        summ->stime_max = t;
+    }
+    t = rwRecGetEndTime(rwrec);
+    if (t < summ->etime_min) {
+        summ->etime_min = t;
+    } else if (t > summ->etime_max) {
+        summ->etime_max = t;
+    }
+
+    rwRecMemGetSIP(rwrec, &ip);
+    if (skipaddrCompare(&ip, &summ->sip_min) < 0) {
+        skipaddrCopy(&summ->sip_min, &ip);
+    } else if (skipaddrCompare(&ip, &summ->sip_max) > 0) {
+        skipaddrCopy(&summ->sip_max, &ip);
+    }
+    rwRecMemGetDIP(rwrec, &ip);
+    if (skipaddrCompare(&ip, &summ->dip_min) < 0) {
+        skipaddrCopy(&summ->dip_min, &ip);
+    } else if (skipaddrCompare(&ip, &summ->dip_max) > 0) {
+        skipaddrCopy(&summ->dip_max, &ip);
+    }
+}
+
+
+/*
+ *  keep = streamBlockSummaryCheck(summary, stream);
+ *
+ *    Callback invoked by the IOBuf with the 'summary' of the next
+ *    block in 'stream'.  Decode the summary and return the result of
+ *    the block predicate.  Return 1 when there is no predicate, the
+ *    summary's version is not supported, or the summary is partial.
+ */
+static int
+streamBlockSummaryCheck(
+    const uint8_t      *summary,
+    void               *v_stream)
+{
+    skstream_t *stream = (skstream_t*)v_stream;
+    sk_block_summary_t *summ = &stream->block_summary;
+    skipaddr_t *addr[4];
+    const uint8_t *ip;
+    uint32_t u32;
+    uint64_t u64;
+    int i;
+
+    if (NULL == stream->block_pred
+        || STREAM_BLOCK_SUMMARY_VERSION != stream->block_summary_version)
+    {
+        return 1;
+    }
+    memcpy(&u32, &summary[4], sizeof(u32));
+    if (ntohl(u32) & STREAM_BLOCK_SUMMARY_PARTIAL) {
+        return 1;
+    }
+
+    memcpy(&u32, &summary[0], sizeof(u32));
+    summ->rec_count = ntohl(u32);
+    memcpy(&u64, &summary[8], sizeof(u64));
+    summ->stime_min = (sktime_t)ntoh64(u64);
+    memcpy(&u64, &summary[16], sizeof(u64));
+    summ->stime_max = (sktime_t)ntoh64(u64);
+    memcpy(&u64, &summary[24], sizeof(u64));
+    summ->etime_min = (sktime_t)ntoh64(u64);
+    memcpy(&u64, &summary[32], sizeof(u64));
+    summ->etime_max = (sktime_t)ntoh64(u64);
+
+    /* the minimum and maximum of the sIP and dIP.  In an IPv4-only
+     * build, an address that is not IPv4 widens the range to all of
+     * IPv4 */
+    addr[0] = &summ->sip_min;
+    addr[1] = &summ->sip_max;
+    addr[2] = &summ->dip_min;
+    addr[3] = &summ->dip_max;
+    for (i = 0; i < 4; ++i) {
+        ip = &summary[40 + 16 * i];
+        if (SK_IPV6_IS_V4INV6(ip)) {
+            memcpy(&u32, &ip[SK_IPV6_V4INV6_LEN], sizeof(u32));
+            u32 = ntohl(u32);
+            skipaddrSetV4(addr[i], &u32);
+        } else {
+#if SK_ENABLE_IPV6
+            skipaddrSetV6(addr[i], ip);
+#else
+            u32 = ((i & 0x1) ? UINT32_MAX : 0);
+            skipaddrSetV4(addr[i], &u32);
+#endif
+        }
+    }
+
+    memcpy(summ->protocols, &summary[104], sizeof(summ->protocols));
+
+    return stream->block_pred(summ, stream->block_pred_data);
+}
+
+
+/*
+ *  streamBlockSummaryPack(summary, stream);
+ *
+ *    Callback invoked by the IOBuf when 'stream' completes a block.
+ *    Encode the summary of the block's records into 'summary' and
+ *    reset the summary for the next block.
+ */
+static void
+streamBlockSummaryPack(
+    uint8_t            *summary,
+    void               *v_stream)
+{
+    skstream_t *stream = (skstream_t*)v_stream;
+    sk_block_summary_t *summ = &stream->block_summary;
+    const skipaddr_t *addr[4];
+    uint32_t u32;
+    uint64_t u64;
+    int i;
+
+    u32 = htonl(summ->rec_count);
+    memcpy(&summary[0], &u32, sizeof(u32));
+    u32 = htonl(stream->block_partial ? STREAM_BLOCK_SUMMARY_PARTIAL : 0);
+    memcpy(&summary[4], &u32, sizeof(u32));
+    u64 = hton64((uint64_t)summ->stime_min);
+    memcpy(&summary[8], &u64, sizeof(u64));
+    u64 = hton64((uint64_t)summ->stime_max);
+    memcpy(&summary[16], &u64, sizeof(u64));
+    u64 = hton64((uint64_t)summ->etime_min);
+    memcpy(&summary[24], &u64, sizeof(u64));
+    u64 = hton64((uint64_t)summ->etime_max);
+    memcpy(&summary[32], &u64, sizeof(u64));
+
+    addr[0] = &summ->sip_min;
+    addr[1] = &summ->sip_max;
+    addr[2] = &summ->dip_min;
+    addr[3] = &summ->dip_max;
+    for (i = 0; i < 4; ++i) {
+        uint8_t *ip = &summary[40 + 16 * i];
+#if SK_ENABLE_IPV6
+        skipaddrGetAsV6(addr[i], ip);
+#else
+        memcpy(ip, sk_ipv6_v4inv6, SK_IPV6_V4INV6_LEN);
+        u32 = htonl(skipaddrGetV4(addr[i]));
+        memcpy(&ip[SK_IPV6_V4INV6_LEN], &u32, sizeof(u32));
+#endif
+    }
+
+    memcpy(&summary[104], summ->protocols, sizeof(summ->protocols));
+
+    memset(summ, 0, sizeof(*summ));
+    stream->block_partial = 0;
+}
+
+
 /*
  *    Update 'stream' with the sensor, type, and starting-hour stored
  *    in the stream's header if 'stream' is bound to a packed hourly
@@ -416,9 +672,31 @@ streamIOBufCreate(
         goto END;
     }
 
+    /* enable read-ahead or compression threads.  Only read ahead on
+     * regular files, since a read-ahead thread blocked on a pipe
+     * would prevent the stream from being closed */
+    if (stream->worker_threads) {
+        if (SK_IO_READ != stream->io_mode) {
+            if (-1 == skIOBufSetCompressionThreads(stream->iobuf,
+                                                   stream->worker_threads))
+            {
+                rv = SKSTREAM_ERR_IOBUF;
+                goto END;
+            }
+        } else if (stream->is_seekable) {
+            if (-1 == skIOBufSetReadAhead(stream->iobuf,
+                                          stream->worker_threads))
+            {
+                rv = SKSTREAM_ERR_IOBUF;
+                goto END;
+            }
+        }
+    }
+
     /* get the information for SiLK files */
     if (stream->is_silk) {
         /* make certain the record size is non-zero */
+        sk_header_entry_t *hentry;
         size_t reclen;
         reclen = skHeaderGetRecordLength(stream->silk_hdr);
         if (reclen == 0) {
@@ -431,6 +709,45 @@ streamIOBufCreate(
             rv = SKSTREAM_ERR_IOBUF;
             goto END;
         }
+
+        /* when the header has a blockindex entry, each compressed
+         * block is preceded by a summary.  A reader skips summaries
+         * whose version it does not support; a writer may not append
+         * to such a file */
+        hentry = skHeaderGetFirstMatch(stream->silk_hdr,
+                                       SK_HENTRY_BLOCKINDEX_ID);
+        if (hentry && SK_COMPMETHOD_NONE != compmethod) {
+            uint32_t summary_len = skHentryBlockIndexGetLength(hentry);
+
+            stream->block_summary_version = 0;
+            if (STREAM_BLOCK_SUMMARY_LENGTH == summary_len) {
+                stream->block_summary_version
+                    = skHentryBlockIndexGetVersion(hentry);
+            }
+            memset(&stream->block_summary, 0, sizeof(sk_block_summary_t));
+            if (SK_IO_READ == stream->io_mode) {
+                if (-1 == skIOBufSetBlockSummary(stream->iobuf, summary_len,
+                                                 NULL,
+                                                 &streamBlockSummaryCheck,
+                                                 stream))
+                {
+                    rv = SKSTREAM_ERR_IOBUF;
+                    goto END;
+                }
+            } else if (STREAM_BLOCK_SUMMARY_VERSION
+                       != stream->block_summary_version)
+            {
+                rv = SKSTREAM_ERR_UNSUPPORT_VERSION;
+                goto END;
+            } else if (-1 == skIOBufSetBlockSummary(stream->iobuf,
+                                                    summary_len,
+                                                    &streamBlockSummaryPack,
+                                                    NULL, stream))
+            {
+                rv = SKSTREAM_ERR_IOBUF;
+                goto END;
+            }
+        }
     }
 
     /* bind it to the file descriptor or gzfile */
@@ -1202,6 +1519,122 @@ streamReadNullBuffer(
 }
 
 
+/*
+ *  keep = streamReadRecordFinish(stream, rwrec);
+ *
+ *    Complete the processing of 'rwrec', a record that has just been
+ *    unpacked from 'stream': fix the ICMP type and code, copy the
+ *    record to the copy-input stream, increment the record count, and
+ *    apply the IPv6 policy.
+ *
+ *    Return 1 if the caller should return 'rwrec' to its caller, or
+ *    0 if the IPv6 policy says the record should be ignored.
+ *
+ *    This is a helper function for skStreamReadRecord() and
+ *    skStreamReadRecords().
+ */
+static int
+streamReadRecordFinish(
+    skstream_t         *stream,
+    rwRec              *rwrec)
+{
+    /* Handle incorrectly encoded ICMP Type/Code unless the
+     * SILK_ICMP_SPORT_HANDLER environment variable is set to none. */
+    if (rwRecIsICMP(rwrec)
+        && rwRecGetSPort(rwrec) != 0
+        && rwRecGetDPort(rwrec) == 0
+        && !silk_icmp_nochange)
+    {
+        /*
+         *  There are two ways for the ICMP Type/Code to appear in
+         *  "sPort" instead of in "dPort".
+         *
+         *  (1) The flow was an IPFIX bi-flow record read prior to
+         *  SiLK-3.4.0 where the sPort and dPort of the second record
+         *  were reversed when they should not have been.  Here, the
+         *  sPort contains ((type<<8)|code).
+         *
+         *  (2) The flow was a NetFlowV5 record read from a buggy
+         *  Cisco router and read prior to SiLK-0.8.0.  Here, the
+         *  sPort contains ((code<<8)|type).
+         *
+         *  The following assumes buggy ICMP flow records were created
+         *  from IPFIX sources unless they were created prior to SiLK
+         *  1.0 and appear in certain file formats more closely
+         *  associated with NetFlowV5.
+         *
+         *  Prior to SiLK-3.4.0, the buggy ICMP record would propagate
+         *  through the tool suite and be written to binary output
+         *  files.  As of 3.4.0, we modify the record on read.
+         */
+        if (skHeaderGetFileVersion(stream->silk_hdr) >= 16) {
+            /* File created by SiLK 1.0 or later; most likely the
+             * buggy value originated from an IPFIX source. */
+            rwRecSetDPort(rwrec, rwRecGetSPort(rwrec));
+        } else {
+            switch(skHeaderGetFileFormat(stream->silk_hdr)) {
+              case FT_RWFILTER:
+              case FT_RWNOTROUTED:
+              case FT_RWROUTED:
+              case FT_RWSPLIT:
+              case FT_RWWWW:
+                /* Most likely from a PDU source */
+                rwRecSetDPort(rwrec, BSWAP16(rwRecGetSPort(rwrec)));
+                break;
+              default:
+                /* Assume it is from an IPFIX source */
+                rwRecSetDPort(rwrec, rwRecGetSPort(rwrec));
+                break;
+            }
+        }
+        rwRecSetSPort(rwrec, 0);
+    }
+
+    /* Write to the copy-input stream */
+    if (stream->copyInputFD) {
+        skStreamWriteRecord(stream->copyInputFD, rwrec);
+    }
+
+    /* got a record */
+    ++stream->rec_count;
+
+#if SK_ENABLE_IPV6
+    switch (stream->v6policy) {
+      case SK_IPV6POLICY_MIX:
+        break;
+
+      case SK_IPV6POLICY_IGNORE:
+        if (rwRecIsIPv6(rwrec)) {
+            return 0;
+        }
+        break;
+
+      case SK_IPV6POLICY_ASV4:
+        if (rwRecIsIPv6(rwrec)) {
+            if (rwRecConvertToIPv4(rwrec)) {
+                return 0;
+            }
+        }
+        break;
+
+      case SK_IPV6POLICY_FORCE:
+        if (!rwRecIsIPv6(rwrec)) {
+            rwRecConvertToIPv6(rwrec);
+        }
+        break;
+
+      case SK_IPV6POLICY_ONLY:
+        if (!rwRecIsIPv6(rwrec)) {
+            return 0;
+        }
+        break;
+    }
+#endif /* SK_ENABLE_IPV6 */
+
+    return 1;
+}
+
+
 /*
  *    Read 'skip_count' records from 'stream'.  If 'records_skipped'
  *    is not NULL, fill the location it references with the number of
@@ -1499,6 +1932,11 @@ skStreamClose(
                     rv = SKSTREAM_ERR_IOBUF;
                 }
             }
+        } else if (stream->iobuf) {
+            /* Destroy the reader now, since its read-ahead threads
+             * may be using the file descriptor */
+            skIOBufDestroy(stream->iobuf);
+            stream->iobuf = NULL;
         }
 #if SK_ENABLE_ZLIB
         if (stream->gz) {
@@ -1569,6 +2007,12 @@ skStreamCreate(
     (*new_stream)->io_mode = read_write_append;
     (*new_stream)->content_type = content_type;
     (*new_stream)->fd = -1;
+    if (SK_IO_READ == read_write_append) {
+        (*new_stream)->worker_threads = silk_readahead_threads;
+    } else {
+        (*new_stream)->worker_threads = silk_compression_threads;
+        (*new_stream)->block_index = (silk_block_index ? 1 : 0);
+    }
 
     /* Native format by default, so don't swap */
     (*new_stream)->swapFlag = 0;
@@ -2244,6 +2688,35 @@ skStreamGetUpperBound(
 }
 
 
+/*
+ *  thread_count = streamThreadsEnvar(envar_name);
+ *
+ *    Return the number of threads specified in the environment
+ *    variable 'envar_name', or 0 if the variable is not set or is not
+ *    valid.
+ */
+static uint32_t
+streamThreadsEnvar(
+    const char         *envar_name)
+{
+    const char *env;
+    uint32_t thread_count = 0;
+    int rv;
+
+    env = getenv(envar_name);
+    if (NULL != env && *env) {
+        rv = skStringParseUint32(&thread_count, env,
+                                 0, SKIOBUF_MAX_WORKER_THREADS);
+        if (rv) {
+            skAppPrintErr("Ignoring Invalid %s '%s': %s",
+                          envar_name, env, skStringParseStrerror(rv));
+            thread_count = 0;
+        }
+    }
+    return thread_count;
+}
+
+
 int
 skStreamInitialize(
     void)
@@ -2262,6 +2735,16 @@ skStreamInitialize(
     }
 #endif
 
+    silk_readahead_threads
+        = streamThreadsEnvar(SILK_READAHEAD_THREADS_ENVAR);
+    silk_compression_threads
+        = streamThreadsEnvar(SILK_COMPRESSION_THREADS_ENVAR);
+
+    env = getenv(SILK_BLOCK_INDEX_ENVAR);
+    if (NULL != env && *env && *env != '0') {
+        silk_block_index = 1;
+    }
+
     return 0;
 }
 
@@ -2761,98 +3244,131 @@ skStreamReadRecord(
     }
 #endif
 
-    /* Handle incorrectly encoded ICMP Type/Code unless the
-     * SILK_ICMP_SPORT_HANDLER environment variable is set to none. */
-    if (rwRecIsICMP(rwrec)
-        && rwRecGetSPort(rwrec) != 0
-        && rwRecGetDPort(rwrec) == 0
-        && !silk_icmp_nochange)
-    {
-        /*
-         *  There are two ways for the ICMP Type/Code to appear in
-         *  "sPort" instead of in "dPort".
-         *
-         *  (1) The flow was an IPFIX bi-flow record read prior to
-         *  SiLK-3.4.0 where the sPort and dPort of the second record
-         *  were reversed when they should not have been.  Here, the
-         *  sPort contains ((type<<8)|code).
-         *
-         *  (2) The flow was a NetFlowV5 record read from a buggy
-         *  Cisco router and read prior to SiLK-0.8.0.  Here, the
-         *  sPort contains ((code<<8)|type).
-         *
-         *  The following assumes buggy ICMP flow records were created
-         *  from IPFIX sources unless they were created prior to SiLK
-         *  1.0 and appear in certain file formats more closely
-         *  associated with NetFlowV5.
-         *
-         *  Prior to SiLK-3.4.0, the buggy ICMP record would propagate
-         *  through the tool suite and be written to binary output
-         *  files.  As of 3.4.0, we modify the record on read.
-         */
-        if (skHeaderGetFileVersion(stream->silk_hdr) >= 16) {
-            /* File created by SiLK 1.0 or later; most likely the
-             * buggy value originated from an IPFIX source. */
-            rwRecSetDPort(rwrec, rwRecGetSPort(rwrec));
-        } else {
-            switch(skHeaderGetFileFormat(stream->silk_hdr)) {
-              case FT_RWFILTER:
-              case FT_RWNOTROUTED:
-              case FT_RWROUTED:
-              case FT_RWSPLIT:
-              case FT_RWWWW:
-                /* Most likely from a PDU source */
-                rwRecSetDPort(rwrec, BSWAP16(rwRecGetSPort(rwrec)));
-                break;
-              default:
-                /* Assume it is from an IPFIX source */
-                rwRecSetDPort(rwrec, rwRecGetSPort(rwrec));
-                break;
-            }
-        }
-        rwRecSetSPort(rwrec, 0);
+    if (!streamReadRecordFinish(stream, rwrec)) {
+        goto NEXT_RECORD;
     }
 
-    /* Write to the copy-input stream */
-    if (stream->copyInputFD) {
-        skStreamWriteRecord(stream->copyInputFD, rwrec);
+  END:
+    return (stream->last_rv = rv);
+}
+
+
+int
+skStreamReadRecords(
+    skstream_t         *stream,
+    rwRec              *rwrecs,
+    size_t              count,
+    size_t             *records_read)
+{
+    /* maximum number of packed records to get from the stream in a
+     * single read */
+#define READ_RECORDS_BATCH  128
+
+#ifndef SK_HAVE_ALIGNED_ACCESS_REQUIRED
+    uint8_t ar[READ_RECORDS_BATCH * SK_MAX_RECORD_SIZE];
+#else
+    /* 'ar' holds the packed records and 'aligned' holds a single
+     * packed record aligned on an 8byte boundary, since the unpack
+     * functions treat it as an rwRec and need to access the 64bit
+     * sTime. */
+    uint8_t ar[READ_RECORDS_BATCH * SK_MAX_RECORD_SIZE];
+    union force_align_un {
+        uint8_t  fa_ar[SK_MAX_RECORD_SIZE];
+        uint64_t fa_u64;
+    } force_align;
+    uint8_t *aligned = force_align.fa_ar;
+#endif  /* SK_HAVE_ALIGNED_ACCESS_REQUIRED */
+
+    size_t local_records_read;
+    size_t wanted;
+    size_t avail;
+    size_t i;
+    ssize_t saw;
+    uint8_t *bp;
+    uint8_t *packed;
+    int rv = SKSTREAM_OK;
+
+    if (NULL == records_read) {
+        records_read = &local_records_read;
     }
+    *records_read = 0;
 
-    /* got a record */
-    ++stream->rec_count;
+    if (stream->is_eof) {
+        rv = SKSTREAM_ERR_EOF;
+        goto END;
+    }
 
-#if SK_ENABLE_IPV6
-    switch (stream->v6policy) {
-      case SK_IPV6POLICY_MIX:
-        break;
+    assert(stream);
+    assert(rwrecs || 0 == count);
+    assert(stream->io_mode == SK_IO_READ || stream->io_mode == SK_IO_APPEND);
+    assert(stream->content_type != SK_CONTENT_TEXT);
+    assert(stream->is_binary);
+    assert(stream->fd != -1);
 
-      case SK_IPV6POLICY_IGNORE:
-        if (rwRecIsIPv6(rwrec)) {
-            goto NEXT_RECORD;
+    while (*records_read < count) {
+        /* read as many packed records as will fit into 'ar' */
+        wanted = count - *records_read;
+        if (wanted > READ_RECORDS_BATCH) {
+            wanted = READ_RECORDS_BATCH;
         }
-        break;
-
-      case SK_IPV6POLICY_ASV4:
-        if (rwRecIsIPv6(rwrec)) {
-            if (rwRecConvertToIPv4(rwrec)) {
-                goto NEXT_RECORD;
+        wanted *= stream->recLen;
+        if (stream->iobuf) {
+            saw = skIOBufRead(stream->iobuf, ar, wanted);
+        } else {
+            saw = skStreamRead(stream, ar, wanted);
+        }
+        if (saw <= 0) {
+            /* EOF or error */
+            stream->is_eof = 1;
+            if (saw == 0) {
+                rv = SKSTREAM_ERR_EOF;
+            } else if (stream->iobuf) {
+                rv = SKSTREAM_ERR_IOBUF;
+            } else {
+                rv = -1;
             }
+            goto END;
         }
-        break;
 
-      case SK_IPV6POLICY_FORCE:
-        if (!rwRecIsIPv6(rwrec)) {
-            rwRecConvertToIPv6(rwrec);
+        /* convert each complete byte array to an rwRec in native
+         * byte order */
+        avail = (size_t)saw / stream->recLen;
+        for (i = 0, bp = ar; i < avail; ++i, bp += stream->recLen) {
+            rwRec *rwrec = &rwrecs[*records_read];
+
+            RWREC_CLEAR(rwrec);
+#ifdef SK_HAVE_ALIGNED_ACCESS_REQUIRED
+            memcpy(aligned, bp, stream->recLen);
+            packed = aligned;
+#else
+            packed = bp;
+#endif
+#if SK_ENABLE_IPV6
+            stream->rwUnpackFn(stream, rwrec, packed);
+#else
+            if (stream->rwUnpackFn(stream, rwrec, packed)
+                == SKSTREAM_ERR_UNSUPPORT_IPV6)
+            {
+                continue;
+            }
+#endif
+            if (streamReadRecordFinish(stream, rwrec)) {
+                ++*records_read;
+            }
         }
-        break;
 
-      case SK_IPV6POLICY_ONLY:
-        if (!rwRecIsIPv6(rwrec)) {
-            goto NEXT_RECORD;
+        if ((size_t)saw != wanted) {
+            saw -= avail * stream->recLen;
+            if (saw) {
+                /* short read; a partial record remains */
+                stream->is_eof = 1;
+                stream->errobj.num = saw;
+                rv = SKSTREAM_ERR_READ_SHORT;
+                goto END;
+            }
+            /* else the next read will report EOF or an error */
         }
-        break;
     }
-#endif /* SK_ENABLE_IPV6 */
 
   END:
     return (stream->last_rv = rv);
@@ -2967,6 +3483,58 @@ skStreamReadSilkHeaderStart(
 }
 
 
+int
+skStreamSetBlockIndex(
+    skstream_t         *stream,
+    int                 enable)
+{
+    int rv;
+
+    STREAM_RETURN_IF_NULL(stream);
+
+    if (stream->io_mode != SK_IO_WRITE) {
+        rv = SKSTREAM_ERR_UNSUPPORT_IOMODE;
+        goto END;
+    }
+    if (stream->is_dirty) {
+        rv = SKSTREAM_ERR_PREV_DATA;
+        goto END;
+    }
+    stream->block_index = (enable ? 1 : 0);
+    rv = SKSTREAM_OK;
+
+  END:
+    return (stream->last_rv = rv);
+}
+
+
+int
+skStreamSetBlockPredicate(
+    skstream_t                 *stream,
+    sk_block_predicate_fn_t     block_pred,
+    void                       *cb_data)
+{
+    int rv;
+
+    STREAM_RETURN_IF_NULL(stream);
+
+    if (stream->io_mode != SK_IO_READ) {
+        rv = SKSTREAM_ERR_UNSUPPORT_IOMODE;
+        goto END;
+    }
+    if (stream->rec_count || stream->is_eof) {
+        rv = SKSTREAM_ERR_PREV_DATA;
+        goto END;
+    }
+    stream->block_pred = block_pred;
+    stream->block_pred_data = cb_data;
+    rv = SKSTREAM_OK;
+
+  END:
+    return (stream->last_rv = rv);
+}
+
+
 int
 skStreamSetCommentStart(
     skstream_t         *stream,
@@ -3043,6 +3611,71 @@ skStreamSetIPv6Policy(
 }
 
 
+int
+skStreamSetReadAhead(
+    skstream_t         *stream,
+    uint32_t            thread_count)
+{
+    int rv;
+
+    STREAM_RETURN_IF_NULL(stream);
+
+    if (stream->io_mode != SK_IO_READ) {
+        rv = SKSTREAM_ERR_UNSUPPORT_IOMODE;
+        goto END;
+    }
+    if (thread_count > SKIOBUF_MAX_WORKER_THREADS) {
+        rv = SKSTREAM_ERR_INVALID_INPUT;
+        goto END;
+    }
+    stream->worker_threads = thread_count;
+    if (stream->iobuf && stream->is_seekable) {
+        if (-1 == skIOBufSetReadAhead(stream->iobuf, thread_count)) {
+            rv = SKSTREAM_ERR_IOBUF;
+            goto END;
+        }
+    }
+    rv = SKSTREAM_OK;
+
+  END:
+    return (stream->last_rv = rv);
+}
+
+
+int
+skStreamSetCompressionThreads(
+    skstream_t         *stream,
+    uint32_t            thread_count)
+{
+    int rv;
+
+    STREAM_RETURN_IF_NULL(stream);
+
+    if (stream->io_mode == SK_IO_READ) {
+        rv = SKSTREAM_ERR_UNSUPPORT_IOMODE;
+        goto END;
+    }
+    if (thread_count > SKIOBUF_MAX_WORKER_THREADS) {
+        rv = SKSTREAM_ERR_INVALID_INPUT;
+        goto END;
+    }
+
+    stream->worker_threads = thread_count;
+    if (stream->iobuf) {
+        if (-1 == skIOBufSetCompressionThreads(stream->iobuf,
+                                               thread_count))
+        {
+            rv = SKSTREAM_ERR_IOBUF;
+            goto END;
+        }
+    }
+    rv = SKSTREAM_OK;
+
+  END:
+    return (stream->last_rv = rv);
+}
+
+
 int
 skStreamSetUnbuffered(
     skstream_t         *stream)
@@ -3264,7 +3897,11 @@ skStreamWrite(
     assert(buf);
 
     if (stream->iobuf) {
+        /* the bytes may complete the current block and begin another;
+         * the summaries of both blocks do not reflect the bytes */
+        stream->block_partial = 1;
         written = skIOBufWrite(stream->iobuf, buf, count);
+        stream->block_partial = 1;
         if (written >= 0) {
             return (stream->last_rv = written);
         }
@@ -3315,6 +3952,7 @@ skStreamWriteRecord(
     rwRec rec_copy;
 #endif
 
+    rwRec summ_rec;
     int rv;
     const rwRec *rp = rwrec;
 
@@ -3396,6 +4034,14 @@ skStreamWriteRecord(
             == (ssize_t)stream->recLen)
         {
             ++stream->rec_count;
+            if (stream->block_summary_version) {
+                /* summarize the record as it will be read, since the
+                 * file format may reduce the precision of the values.
+                 * This may modify 'ar', which the IOBuf has copied */
+                RWREC_CLEAR(&summ_rec);
+                stream->rwUnpackFn(stream, &summ_rec, ar);
+                streamBlockSummaryAdd(stream, &summ_rec);
+            }
             return (stream->last_rv = SKSTREAM_OK);
         } else if (stream->is_iobuf_error) {
             stream->is_iobuf_error = 0;
@@ -3499,6 +4145,20 @@ skStreamWriteSilkHeader(
         streamCacheHeader(stream);
     }
 
+    /* Remove any blockindex header entry that was copied from
+     * another file, and add one when writing block summaries */
+    rv = skHeaderRemoveAllMatching(stream->silk_hdr, SK_HENTRY_BLOCKINDEX_ID);
+    if (rv) { goto END; }
+    if (stream->block_index && stream->is_silk_flow
+        && (SK_COMPMETHOD_NONE
+            != skHeaderGetCompressionMethod(stream->silk_hdr)))
+    {
+        rv = skHeaderAddBlockIndex(stream->silk_hdr,
+                                   STREAM_BLOCK_SUMMARY_VERSION,
+                                   STREAM_BLOCK_SUMMARY_LENGTH);
+        if (rv) { goto END; }
+    }
+
     stream->is_dirty = 1;
     skHeaderSetLock(stream->silk_hdr, SKHDR_LOCK_FIXED);
 
@@ -283,6 +283,46 @@ typedef enum {
 #define SKSTREAM_ERROR_IS_FATAL(err) ((err) != SKSTREAM_OK && (err) < 64)
 
 
+/**
+ *    A summary of the SiLK Flow records in one compressed block of a
+ *    stream.  Files whose header contains a blockindex header entry
+ *    (SK_HENTRY_BLOCKINDEX_ID) store one summary before each block;
+ *    see skStreamSetBlockIndex() and skStreamSetBlockPredicate().
+ */
+typedef struct sk_block_summary_st {
+    /** The number of records in the block */
+    uint32_t    rec_count;
+    /** The range of start times of the records in the block */
+    sktime_t    stime_min;
+    sktime_t    stime_max;
+    /** The range of end times of the records in the block */
+    sktime_t    etime_min;
+    sktime_t    etime_max;
+    /** The range of source addresses of the records in the block */
+    skipaddr_t  sip_min;
+    skipaddr_t  sip_max;
+    /** The range of destination addresses of the records in the block */
+    skipaddr_t  dip_min;
+    skipaddr_t  dip_max;
+    /** A bitmap of the IP protocols in the block: protocol 'p' is
+     * present when (protocols[p >> 3] & (1 << (p & 0x7))) is set */
+    uint8_t     protocols[32];
+} sk_block_summary_t;
+
+/**
+ *    Signature of the callback function that skStreamSetBlockPredicate()
+ *    accepts.  The function is given the 'summary' of the next block
+ *    of the stream and the 'cb_data' given to
+ *    skStreamSetBlockPredicate().  The function must return 0 when
+ *    none of the records in the block can be of interest, causing the
+ *    block to be skipped without being read or uncompressed, or
+ *    non-zero to read the block.
+ */
+typedef int (*sk_block_predicate_fn_t)(
+    const sk_block_summary_t   *summary,
+    void                       *cb_data);
+
+
 /**
  *    Set 'stream' to operate on the file specified in 'pathname';
  *    'pathname' may also be one of "stdin", "stdout", or "stderr".
@@ -875,6 +915,29 @@ skStreamReadRecord(
     rwRec              *rec);
 
 
+/**
+ *    Read up to 'count' SiLK Flow records from 'stream' into the
+ *    array 'rwrecs', which must have space for 'count' records.  If
+ *    'records_read' is not NULL, the number of records read is stored
+ *    in that location.
+ *
+ *    Return SKSTREAM_OK if 'count' records were read.  Otherwise,
+ *    return SKSTREAM_ERR_EOF or the error that stopped the read; the
+ *    records read prior to the end of file or error are valid.
+ *
+ *    This function has the same effect as calling
+ *    skStreamReadRecord() 'count' times, but it reads the packed
+ *    records in large blocks, which avoids much of the per-record
+ *    overhead.
+ */
+int
+skStreamReadRecords(
+    skstream_t         *stream,
+    rwRec              *rwrecs,
+    size_t              count,
+    size_t             *records_read);
+
+
 /**
  *    Attempt to read the SiLK file header from 'stream', putting the
  *    data into 'hdr'.  This function requires that 'stream' contain
@@ -938,6 +1001,64 @@ skStreamReadToEndOfFile(
     ssize_t            *length);
 
 
+/**
+ *    Enable or disable the writing of block summaries on 'stream',
+ *    which must be open for writing SiLK Flow records.  When
+ *    'enable' is non-zero, a blockindex header entry is added to the
+ *    file's header and a summary of the records in each compressed
+ *    block (see sk_block_summary_t) is written before the block,
+ *    allowing a reader to skip blocks by calling
+ *    skStreamSetBlockPredicate().  The summaries are not written when
+ *    the stream is not compressed.  The default is not to write the
+ *    summaries unless the SILK_BLOCK_INDEX environment variable is
+ *    set to a non-zero value.
+ *
+ *    This function must be called before writing the header of
+ *    'stream'.  When appending to a file, the summaries are written
+ *    if the file already contains them.
+ *
+ *    Return SKSTREAM_OK on success, or one of the following error
+ *    codes:
+ *
+ *    SKSTREAM_ERR_NULL_ARGUMENT
+ *    SKSTREAM_ERR_PREV_DATA
+ *    SKSTREAM_ERR_UNSUPPORT_IOMODE
+ */
+int
+skStreamSetBlockIndex(
+    skstream_t         *stream,
+    int                 enable);
+
+
+/**
+ *    Call 'block_pred' with the summary of each compressed block of
+ *    'stream' prior to reading the block, and skip the block when
+ *    'block_pred' returns 0.  The 'cb_data' is passed unchanged to
+ *    'block_pred'.  Pass NULL for 'block_pred' to read every block.
+ *
+ *    The function has no effect on files that do not contain block
+ *    summaries.  Since entire blocks are skipped, the records in
+ *    those blocks are not included in the count returned by
+ *    skStreamGetRecordCount(), and they are not copied to the
+ *    stream set by skStreamSetCopyInput().  When the stream uses
+ *    read-ahead threads, 'block_pred' is invoked by one of those
+ *    threads, though never by two threads at once.
+ *
+ *    This function must be called on a stream open for reading
+ *    before any records are read.  Return SKSTREAM_OK on success, or
+ *    one of the following error codes:
+ *
+ *    SKSTREAM_ERR_NULL_ARGUMENT
+ *    SKSTREAM_ERR_PREV_DATA
+ *    SKSTREAM_ERR_UNSUPPORT_IOMODE
+ */
+int
+skStreamSetBlockPredicate(
+    skstream_t                 *stream,
+    sk_block_predicate_fn_t     block_pred,
+    void                       *cb_data);
+
+
 /**
  *    Set the comment string for a textual input file to
  *    'comment_start'.  This function requires that 'stream' be an
@@ -986,6 +1107,57 @@ skStreamSetIPv6Policy(
     sk_ipv6policy_t     policy);
 
 
+/**
+ *    Use 'thread_count' threads to compress and write the blocks of
+ *    'stream', which must be open for writing or appending.  A
+ *    'thread_count' of 0 compresses each block as it fills.  The
+ *    default is 0 unless the SILK_COMPRESSION_THREADS environment
+ *    variable is set.  The blocks are written in order, so the file
+ *    is identical to one written without threads.
+ *
+ *    This function may be called before opening 'stream' or after
+ *    writing its header, but not once records have been written.
+ *    The threads are only used for compressed SiLK files.
+ *
+ *    Return SKSTREAM_OK on success, or one of the following error
+ *    codes:
+ *
+ *    SKSTREAM_ERR_NULL_ARGUMENT
+ *    SKSTREAM_ERR_INVALID_INPUT
+ *    SKSTREAM_ERR_IOBUF
+ *    SKSTREAM_ERR_UNSUPPORT_IOMODE
+ */
+int
+skStreamSetCompressionThreads(
+    skstream_t         *stream,
+    uint32_t            thread_count);
+
+
+/**
+ *    Use 'thread_count' threads to read and uncompress the blocks of
+ *    'stream' ahead of the caller.  A 'thread_count' of 0 disables
+ *    read-ahead.  The default is 0 unless the SILK_READAHEAD_THREADS
+ *    environment variable is set.
+ *
+ *    This function may be called before opening 'stream' or after
+ *    reading its header, but not once records have been read.
+ *    Read-ahead is only used for compressed SiLK files that are
+ *    seekable; for other streams the setting is ignored.
+ *
+ *    Return SKSTREAM_OK on success, or one of the following error
+ *    codes:
+ *
+ *    SKSTREAM_ERR_NULL_ARGUMENT
+ *    SKSTREAM_ERR_INVALID_INPUT
+ *    SKSTREAM_ERR_IOBUF
+ *    SKSTREAM_ERR_UNSUPPORT_IOMODE
+ */
+int
+skStreamSetReadAhead(
+    skstream_t         *stream,
+    uint32_t            thread_count);
+
+
 /**
  *    Do not use buffering on this stream.  This must be called prior
  *    to opening the stream.
@@ -298,6 +298,24 @@ struct skstream_st {
     /* The type of data to read/write: text, silk, silk-flow, etc */
     skcontent_t             content_type;
 
+    /* The number of threads the IOBuf uses to read and uncompress
+     * blocks ahead of the caller or to compress and write blocks;
+     * see skStreamSetReadAhead() and skStreamSetCompressionThreads() */
+    uint32_t                worker_threads;
+
+    /* For a file with block summaries, the summary of the records in
+     * the current block when writing, or the summary of the block the
+     * block predicate is considering when reading */
+    sk_block_summary_t      block_summary;
+
+    /* The function and its data set by skStreamSetBlockPredicate() */
+    sk_block_predicate_fn_t block_pred;
+    void                   *block_pred_data;
+
+    /* The version of the block summaries in the file, or 0 if the
+     * file has no summaries or they are not supported */
+    uint32_t                block_summary_version;
+
     /* Set to 1 if the stream is seekable (i.e., a "real" file) */
     unsigned                is_seekable     :1;
 
@@ -334,10 +352,6 @@ struct skstream_st {
     /* Set to 1 if the stream has reached the end-of-file. */
     unsigned                is_eof          :1;
 
-    /* Set to 1 if an error has occurred in an skStream* function that
-     * was called by an skIOBuf* function as part of a callback */
-    unsigned                is_iobuf_error  :1;
-
     /* Set to 1 if the silk flow data in this stream supports IPv6 */
     unsigned                supports_ipv6   :1;
 
@@ -346,6 +360,19 @@ struct skstream_st {
 
     /* Set to 1 if the data in the stream is in non-native byte order */
     unsigned                swapFlag        :1;
+
+    /* Set to 1 if a blockindex header entry is to be added to the
+     * header of the stream; see skStreamSetBlockIndex() */
+    unsigned                block_index     :1;
+
+    /* Set to 1 if the current block contains bytes written by
+     * skStreamWrite() that are not reflected in its summary */
+    unsigned                block_partial   :1;
+
+    /* Set to 1 if an error has occurred in an skStream* function that
+     * was called by an skIOBuf* function as part of a callback.  This
+     * is not a bit-field since a read-ahead thread may set it. */
+    unsigned                is_iobuf_error;
 };
 /* skstream_t */
 
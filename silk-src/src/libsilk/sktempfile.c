@@ -275,7 +275,8 @@ skTempFileCreateStream(
     ssize_t rv;
     int saved_errno;
 
-    compmethod = SK_COMPMETHOD_BEST;
+    /* temporary files are read once, so favor codec speed */
+    compmethod = skCompMethodGetFastest();
 
     if (NULL == tmpctx || NULL == tmp_idx) {
         errno = 0;
@@ -1,5 +1,5 @@
 #! /usr/bin/perl -w
-# MD5: 9e9b3a5f07154f3dcaf45f84f123bbf9
+# MD5: 4ca6453dfae9cbfc09df8fccf0bf6ad3
 # TEST: ./hashlib_tests 2>&1
 
 use strict;
@@ -7,6 +7,6 @@ use SiLKTests;
 
 my $hashlib_tests = check_silk_app('hashlib_tests');
 my $cmd = "$hashlib_tests 2>&1";
-my $md5 = "9e9b3a5f07154f3dcaf45f84f123bbf9";
+my $md5 = "4ca6453dfae9cbfc09df8fccf0bf6ad3";
 
 check_md5_output($md5, $cmd);
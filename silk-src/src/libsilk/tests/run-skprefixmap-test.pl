@@ -0,0 +1,16 @@
+#! /usr/bin/perl -w
+# MD5: varies
+# TEST: ./skprefixmap-test --trie-test=/tmp/run-skprefixmap-test-pmap 2>&1
+
+use strict;
+use SiLKTests;
+
+my $skprefixmap_test = check_silk_app('skprefixmap-test');
+my %temp;
+$temp{pmap} = make_tempname('pmap');
+my $cmd = "$skprefixmap_test --trie-test=$temp{pmap} 2>&1";
+my $md5 = (($SiLKTests::SK_ENABLE_IPV6)
+           ? "5e15f1d7c28fc3c5fab7984c148dc0ff"
+           : "e5db2a3b8571f45640e7bfc614ab5368");
+
+check_md5_output($md5, $cmd);
@@ -1754,6 +1754,42 @@ skQSort_r(
     int               (*cmp)(const void *a, const void *b, void *thunk),
     void               *thunk);
 
+/**
+ *    Perform the same sort as skQSort() using up to 'thread_count'
+ *    threads, including the calling thread.  The buffer is
+ *    partitioned in place and the threads sort the partitions
+ *    concurrently, so no additional memory is needed for the
+ *    elements.  'cmp' must be safe to call from multiple threads.
+ *
+ *    The function sorts the buffer with a single thread when
+ *    'thread_count' is less than 2, when 'buffer' is small, or when
+ *    threads cannot be created.
+ *
+ *    Since SiLK 3.20.0.
+ */
+void
+skQSortThreaded(
+    void               *buffer,
+    size_t              number_elements,
+    size_t              element_size,
+    int               (*cmp)(const void *a, const void *b),
+    uint32_t            thread_count);
+
+/**
+ *    Perform the same sort as skQSortThreaded(), passing the context
+ *    object 'thunk' as the third argument to 'cmp'.
+ *
+ *    Since SiLK 3.20.0.
+ */
+void
+skQSortThreaded_r(
+    void               *buffer,
+    size_t              number_elements,
+    size_t              element_size,
+    int               (*cmp)(const void *a, const void *b, void *thunk),
+    void               *thunk,
+    uint32_t            thread_count);
+
 
 /*
 **
@@ -73,6 +73,7 @@ __all__ = ['IPAddr', 'IPv4Addr', 'IPv6Addr',
            'IGNORE', 'ASV4', 'MIX', 'FORCE', 'ONLY',
            'READ', 'WRITE', 'APPEND',
            'DEFAULT', 'NO_COMPRESSION', 'ZLIB', 'LZO1X', 'SNAPPY',
+           'ZSTD', 'LZ4',
            'FIN', 'SYN', 'RST', 'PSH', 'ACK', 'URG', 'ECE', 'CWR',
            'TCP_FIN', 'TCP_SYN', 'TCP_RST', 'TCP_PSH',
            'TCP_ACK', 'TCP_URG', 'TCP_ECE', 'TCP_CWR',
@@ -102,6 +103,8 @@ NO_COMPRESSION = pysilk.NO_COMPRESSION
 ZLIB = pysilk.ZLIB
 LZO1X = pysilk.LZO1X
 SNAPPY = pysilk.SNAPPY
+ZSTD = pysilk.ZSTD
+LZ4 = pysilk.LZ4
 BAG_COUNTER_MAX = pysilk.BAG_COUNTER_MAX
 silk_version = pysilk.silk_version
 initial_tcpflags_enabled = pysilk.initial_tcpflags_enabled
@@ -34,6 +34,10 @@ RCSIDENT("$SiLK: rwcut.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
  * parameter to pass to that function. */
 #define CUT_SKIP_COUNT 65536
 
+/* The maximum number of records to read from an input stream at one
+ * time. */
+#define CUT_READ_COUNT 256
+
 /* EXPORTED VARIABLES */
 
 /* The object to convert the record to text; includes pointer to the
@@ -83,15 +87,23 @@ static int
 tailFile(
     skstream_t         *stream)
 {
+    size_t wanted;
+    size_t count;
     int rv = SKSTREAM_OK;
 
-    while ((rv = skStreamReadRecord(stream, tail_buf_cur)) == SKSTREAM_OK) {
-        ++tail_buf_cur;
+    /* read directly into the 'tail_buf', stopping at its end */
+    do {
+        wanted = &tail_buf[tail_recs] - tail_buf_cur;
+        if (wanted > CUT_READ_COUNT) {
+            wanted = CUT_READ_COUNT;
+        }
+        rv = skStreamReadRecords(stream, tail_buf_cur, wanted, &count);
+        tail_buf_cur += count;
         if (tail_buf_cur == &tail_buf[tail_recs]) {
             tail_buf_cur = tail_buf;
             tail_buf_full = 1;
         }
-    }
+    } while (SKSTREAM_OK == rv);
     if (SKSTREAM_ERR_EOF != rv) {
         skStreamPrintLastErr(stream, rv, &skAppPrintErr);
         return -1;
@@ -159,7 +171,10 @@ cutFile(
     skstream_t         *stream)
 {
     static int copy_input_only = 0;
-    rwRec rwrec;
+    rwRec rwrec[CUT_READ_COUNT];
+    size_t wanted;
+    size_t count;
+    size_t i;
     int rv = SKSTREAM_OK;
     size_t num_skipped;
     int ret_val = 0;
@@ -195,18 +210,25 @@ cutFile(
 
     if (0 == num_recs) {
         /* print all records */
-        while ((rv = skStreamReadRecord(stream, &rwrec)) == SKSTREAM_OK) {
-            rwAsciiPrintRec(ascii_str, &rwrec);
-        }
+        do {
+            rv = skStreamReadRecords(stream, rwrec, CUT_READ_COUNT, &count);
+            for (i = 0; i < count; ++i) {
+                rwAsciiPrintRec(ascii_str, &rwrec[i]);
+            }
+        } while (SKSTREAM_OK == rv);
         if (SKSTREAM_ERR_EOF != rv) {
             ret_val = -1;
         }
     } else {
-        while (num_recs
-               && ((rv = skStreamReadRecord(stream, &rwrec)) == SKSTREAM_OK))
-        {
-            rwAsciiPrintRec(ascii_str, &rwrec);
-            --num_recs;
+        /* do not read more than 'num_recs' records */
+        while (num_recs && SKSTREAM_OK == rv) {
+            wanted = ((num_recs < CUT_READ_COUNT)
+                      ? (size_t)num_recs : CUT_READ_COUNT);
+            rv = skStreamReadRecords(stream, rwrec, wanted, &count);
+            for (i = 0; i < count; ++i) {
+                rwAsciiPrintRec(ascii_str, &rwrec[i]);
+            }
+            num_recs -= count;
         }
         switch (rv) {
           case SKSTREAM_OK:
@@ -68,12 +68,22 @@ int reading_records = 1;
 /* whether to print volume statistics */
 int print_volume_stats = 0;
 
+/* whether to print the order in which the checks ran */
+int print_plan = 0;
+
 /* total number of threads */
 uint32_t thread_count = RWFILTER_THREADS_DEFAULT;
 
+/* whether threads must write records in the order they are read */
+int preserve_order = 0;
+
 /* number of checks to preform */
 int checker_count = 0;
 
+/* whether checker[0] is filterCheck(), in which case the records are
+ * passed to filterCheckBatch() in blocks instead */
+int checker_batch = 0;
+
 /* function pointers to handle checking and or processing */
 checktype_t (*checker[MAX_CHECKERS])(rwRec*);
 
@@ -88,21 +98,63 @@ static char **pargv;
 
 /* FUNCTION DEFINITIONS */
 
+/*
+ *  status = writeStreamHeader(stream, in_hdr);
+ *
+ *    Create and print the header to the output file 'stream'; include
+ *    the current command line invocation in the header.  If 'in_hdr'
+ *    is non-null, the file history from that header is also included
+ *    in the header.
+ */
+int
+writeStreamHeader(
+    skstream_t                 *stream,
+    const sk_file_header_t     *in_hdr)
+{
+    sk_file_header_t *out_hdr;
+    int rv = SKSTREAM_OK;
+
+    out_hdr = skStreamGetSilkHeader(stream);
+
+    /* if 'in_hdr' is provided, add its command invocation history to
+     * the output file's headers */
+    if (in_hdr) {
+        rv = skHeaderCopyEntries(out_hdr, in_hdr, SK_HENTRY_INVOCATION_ID);
+        if (rv == SKSTREAM_OK) {
+            rv = skHeaderCopyEntries(out_hdr, in_hdr,
+                                     SK_HENTRY_ANNOTATION_ID);
+        }
+    }
+    if (rv == SKSTREAM_OK) {
+        rv = skHeaderAddInvocation(out_hdr, 1, pargc, pargv);
+    }
+    if (rv == SKSTREAM_OK) {
+        rv = skOptionsNotesAddToStream(stream);
+    }
+    if (rv == SKSTREAM_OK) {
+        rv = skStreamWriteSilkHeader(stream);
+    }
+    if (rv != SKSTREAM_OK) {
+        skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+    }
+    return rv;
+}
+
+
 /*
  *  status = writeHeaders(in_stream);
  *
- *    Create and print the header to each output file; include the
- *    current command line invocation in the header.  If 'in_stream' is
+ *    Create and print the header to each output file, including the
+ *    outputs of the queries from --query-file.  If 'in_stream' is
  *    non-null, the file history from that file is also included in
  *    the header.
  */
-static int
+int
 writeHeaders(
     const skstream_t   *in_stream)
 {
     static int did_headers = 0;
     sk_file_header_t *in_hdr = NULL;
-    sk_file_header_t *out_hdr;
     destination_t *dest;
     int i;
     int rv = SKSTREAM_OK;
@@ -124,33 +176,16 @@ writeHeaders(
 
     for (i = 0; i < DESTINATION_TYPES; ++i) {
         for (dest = dest_type[i].dest_list; dest != NULL; dest = dest->next) {
-            out_hdr = skStreamGetSilkHeader(dest->stream);
-
-            /* if 'in_stream' is provided, add its command invocation
-             * history to each output file's headers */
-            if (in_hdr) {
-                rv = skHeaderCopyEntries(out_hdr, in_hdr,
-                                         SK_HENTRY_INVOCATION_ID);
-                if (rv == SKSTREAM_OK) {
-                    rv = skHeaderCopyEntries(out_hdr, in_hdr,
-                                             SK_HENTRY_ANNOTATION_ID);
-                }
-            }
-            if (rv == SKSTREAM_OK) {
-                rv = skHeaderAddInvocation(out_hdr, 1, pargc, pargv);
-            }
-            if (rv == SKSTREAM_OK) {
-                rv = skOptionsNotesAddToStream(dest->stream);
-            }
-            if (rv == SKSTREAM_OK) {
-                rv = skStreamWriteSilkHeader(dest->stream);
-            }
+            rv = writeStreamHeader(dest->stream, in_hdr);
             if (rv != SKSTREAM_OK) {
-                skStreamPrintLastErr(dest->stream, rv, &skAppPrintErr);
                 return rv;
             }
         }
     }
+    rv = queryWriteHeaders(in_hdr);
+    if (rv != SKSTREAM_OK) {
+        return rv;
+    }
 
     skOptionsNotesTeardown();
 
@@ -306,11 +341,13 @@ logStats(
 }
 
 
-/* Write the statistics in 'sum' to the 'buf' */
+/* Write the statistics in 'sum' to the 'buf'; when 'label' is not
+ * NULL, it names the query whose statistics these are */
 static void
 printStats(
     skstream_t             *stream,
-    const filter_stats_t   *stats)
+    const filter_stats_t   *stats,
+    const char             *label)
 {
     /* check input */
     if (stream == NULL || stats == NULL) {
@@ -325,7 +362,8 @@ printStats(
                        "%5s|%18" PRIu64 "|%18" PRIu64 "|%20" PRIu64 "|%10u|\n"
                        "%5s|%18" PRIu64 "|%18" PRIu64 "|%20" PRIu64 "|%10s|\n"
                        "%5s|%18" PRIu64 "|%18" PRIu64 "|%20" PRIu64 "|%10s|\n"),
-                      /* titles */ "", "Recs", "Packets", "Bytes", "Files",
+                      /* titles */ (label ? label : ""),
+                      "Recs", "Packets", "Bytes", "Files",
 
                       "Total",
                       stats->read.flows,
@@ -346,6 +384,9 @@ printStats(
                       "");
     } else {
         /* simple */
+        if (label) {
+            skStreamPrint(stream, "%s: ", label);
+        }
         skStreamPrint(stream,
                       ("Files %5" PRIu32 ".  Read %10" PRIu64 "."
                        "  Pass %10" PRIu64 ". Fail  %10" PRIu64 ".\n"),
@@ -487,13 +528,12 @@ closeOneOutput(
  *    This is the actual filtering of the file 'datafile'.  The
  *    function will call the function to write the header if required.
  *    The 'ipfile_basename' parameter is passed to filterCheckFile();
- *    it should be NULL or contain the full-path (minus extension) of the
- *    file that contains Bloom filter or IPset information about the
- *    'datafile'.  The function returns 0 on success; or 1 if the
+ *    it should be NULL or the path to which the suffixes of the IPset
+ *    index files for 'datafile' are appended.  The function returns 0 on success; or 1 if the
  *    input file could not be opened.
  *
- *    NOTE: There is a similar function, filterFileThreaded(), in
- *    rwfilterthread.c that is used when running with threads.
+ *    NOTE: The functions openInput() and filterChunk() in
+ *    rwfilterthread.c do similar work when running with threads.
  */
 static int
 filterFile(
@@ -501,11 +541,17 @@ filterFile(
     const char         *ipfile_basename,
     filter_stats_t     *stats)
 {
-    rwRec rwrec;
+    rwRec inbuf[FILTER_READ_RECS];
+    uint32_t selected[FILTER_READ_RECS];
+    rwRec *rwrec;
+    size_t in_count;
+    size_t sel_count = 0;
+    size_t sel_pos = 0;
     skstream_t *in_stream;
     int i;
     int fail_entire_file = 0;
     int result = RWF_PASS;
+    uint64_t skipped_flows = 0;
     int rv = SKSTREAM_OK;
     int in_rv = SKSTREAM_OK;
 
@@ -593,73 +639,107 @@ filterFile(
         }
     }
 
-    /* read and process each record */
-    while (reading_records
-           && (SKSTREAM_OK == (in_rv = skStreamReadRecord(in_stream, &rwrec))))
+    /* when the records that fail are not written or counted, skip the
+     * blocks of the file whose summaries show that all of their
+     * records fail; those records are added to the read count below */
+    if (!fail_entire_file
+        && (dest_type[DEST_ALL].count == 0)
+        && (dest_type[DEST_FAIL].count == 0)
+        && (print_stat == NULL || print_volume_stats == 0))
     {
-        /* increment number of read records */
-        INCR_REC_COUNT(stats->read, &rwrec);
+        skStreamSetBlockPredicate(in_stream, &filterCheckBlock,
+                                  &skipped_flows);
+    }
+
+    /* read the records in blocks and process each record */
+    while (reading_records && SKSTREAM_OK == in_rv) {
+        in_rv = skStreamReadRecords(in_stream, inbuf, FILTER_READ_RECS,
+                                    &in_count);
+        if (checker_batch && !fail_entire_file) {
+            /* run the checks from rwfiltercheck.c on the block */
+            sel_count = filterCheckBatch(inbuf, in_count, selected);
+            sel_pos = 0;
+        }
+        for (rwrec = inbuf;
+             rwrec < inbuf + in_count && reading_records;
+             ++rwrec)
+        {
+            /* increment number of read records */
+            INCR_REC_COUNT(stats->read, rwrec);
 
-        /* the all-dest */
-        if (dest_type[DEST_ALL].count) {
-            PRINT_REC_TO_DEST_ID(&rwrec, DEST_ALL);
+            /* the all-dest */
+            if (dest_type[DEST_ALL].count) {
+                PRINT_REC_TO_DEST_ID(rwrec, DEST_ALL);
 #if 0 /* dest_type[DEST_ALL].max_records is never set */
-            /* close all streams for this destination type if we are
-             * at user's requested max.  If max_records is 0, this
-             * will never be true, and all records will be
-             * processed. */
-            if (stats->read.flows == dest_type[DEST_ALL].max_records) {
-                reading_records = closeOutputDests(DEST_ALL, 0);
-            }
+                /* close all streams for this destination type if we are
+                 * at user's requested max.  If max_records is 0, this
+                 * will never be true, and all records will be
+                 * processed. */
+                if (stats->read.flows == dest_type[DEST_ALL].max_records) {
+                    reading_records = closeOutputDests(DEST_ALL, 0);
+                }
 #endif  /* 0 */
-        }
-
-        if (!fail_entire_file) {
-            /* run all checker()'s until end or one doesn't pass */
-            for (i=0, result=RWF_PASS;
-                 i < checker_count && result == RWF_PASS;
-                 ++i)
-            {
-                result = (*(checker[i]))(&rwrec);
             }
-        }
 
-        switch (result) {
-          case RWF_PASS:
-          case RWF_PASS_NOW:
-            /* increment number of record that pass */
-            INCR_REC_COUNT(stats->pass, &rwrec);
-
-            /* the pass-dest */
-            if (dest_type[DEST_PASS].count) {
-                PRINT_REC_TO_DEST_ID(&rwrec, DEST_PASS);
-                if (stats->pass.flows == dest_type[DEST_PASS].max_records) {
-                    /* close all streams for this destination type
-                     * since we are at user's specified max. */
-                    reading_records = closeOutputDests(DEST_PASS, 0);
+            if (!fail_entire_file) {
+                i = 0;
+                result = RWF_PASS;
+                if (checker_batch) {
+                    /* use the result of filterCheckBatch() */
+                    if (sel_pos < sel_count
+                        && selected[sel_pos] == (uint32_t)(rwrec - inbuf))
+                    {
+                        ++sel_pos;
+                    } else {
+                        result = RWF_FAIL;
+                    }
+                    i = 1;
                 }
-            }
-            break;
-
-          case RWF_FAIL:
-            /* the fail-dest */
-            if (dest_type[DEST_FAIL].count) {
-                PRINT_REC_TO_DEST_ID(&rwrec, DEST_FAIL);
-                if ((stats->read.flows - stats->pass.flows)
-                    == dest_type[DEST_FAIL].max_records)
-                {
-                    /* close all streams for this destination type
-                     * since we are at user's specified max. */
-                    reading_records = closeOutputDests(DEST_FAIL, 0);
+                /* run all other checker()'s until end or one doesn't
+                 * pass */
+                for ( ; i < checker_count && result == RWF_PASS; ++i) {
+                    result = (*(checker[i]))(rwrec);
                 }
             }
-            break;
 
-          default:
-            break;
-        }
+            switch (result) {
+              case RWF_PASS:
+              case RWF_PASS_NOW:
+                /* increment number of record that pass */
+                INCR_REC_COUNT(stats->pass, rwrec);
+
+                /* the pass-dest */
+                if (dest_type[DEST_PASS].count) {
+                    PRINT_REC_TO_DEST_ID(rwrec, DEST_PASS);
+                    if (stats->pass.flows
+                        == dest_type[DEST_PASS].max_records)
+                    {
+                        /* close all streams for this destination type
+                         * since we are at user's specified max. */
+                        reading_records = closeOutputDests(DEST_PASS, 0);
+                    }
+                }
+                break;
+
+              case RWF_FAIL:
+                /* the fail-dest */
+                if (dest_type[DEST_FAIL].count) {
+                    PRINT_REC_TO_DEST_ID(rwrec, DEST_FAIL);
+                    if ((stats->read.flows - stats->pass.flows)
+                        == dest_type[DEST_FAIL].max_records)
+                    {
+                        /* close all streams for this destination type
+                         * since we are at user's specified max. */
+                        reading_records = closeOutputDests(DEST_FAIL, 0);
+                    }
+                }
+                break;
 
-    } /* while (reading_records && skStreamReadRecord()) */
+              default:
+                break;
+            }
+        }
+    } /* while (reading_records && skStreamReadRecords()) */
 
   END:
     if (in_rv == SKSTREAM_OK || in_rv == SKSTREAM_ERR_EOF) {
@@ -671,6 +751,7 @@ filterFile(
 
     /* close input */
     skStreamDestroy(&in_stream);
+    stats->read.flows += skipped_flows;
 
     if (rv) {
         return -1;
@@ -758,6 +839,10 @@ int main(int argc, char **argv)
     SILK_FEATURES_DEFINE_STRUCT(features);
     char datafile[PATH_MAX];
     filter_stats_t stats;
+    filter_stats_t query_stats;
+    const char *query_name;
+    int query_count;
+    int i;
     int rv_file;
     int rv = 0;
     time_t start_timer;
@@ -777,6 +862,9 @@ int main(int argc, char **argv)
     pargc = argc;
     pargv = argv;
 
+    /* the queries from --query-file; appSetup() parsed the file */
+    query_count = queryGetCount();
+
 #if SK_RWFILTER_THREADED
     if (thread_count > 1) {
         /* must dump the headers first */
@@ -790,7 +878,11 @@ int main(int argc, char **argv)
         /* non-threaded */
         filterIgnoreSigPipe();
         while (appNextInput(datafile, sizeof(datafile)) != NULL) {
-            rv_file = filterFile(datafile, NULL, &stats);
+            if (query_count > 0) {
+                rv_file = queryFilterFile(datafile, datafile, &stats);
+            } else {
+                rv_file = filterFile(datafile, datafile, &stats);
+            }
             if (rv_file < 0) {
                 /* fatal */
                 return EXIT_FAILURE;
@@ -815,7 +907,18 @@ int main(int argc, char **argv)
 
     /* Print the statistics */
     if (print_stat && !dryrun_fp) {
-        printStats(print_stat, &stats);
+        if (query_count > 0) {
+            for (i = 0; i < query_count; ++i) {
+                query_stats = stats;
+                query_name = queryGetStats(i, &query_stats);
+                printStats(print_stat, &query_stats, query_name);
+            }
+        } else {
+            printStats(print_stat, &stats, NULL);
+        }
+    }
+    if (print_plan && !dryrun_fp) {
+        filterPrintPlan(print_stat);
     }
 
     time(&end_timer);
@@ -49,6 +49,10 @@ RCSIDENTVAR(rcsID_RWFILTER_H, "$SiLK: rwfilter.h ef14e54179be 2020-04-14 21:57:4
 /* default number of threads to use */
 #define RWFILTER_THREADS_DEFAULT 1
 
+/* environment variable that, when set to a non-zero value, causes
+ * rwfilter to print how long its threads waited on each other */
+#define RWFILTER_THREAD_STATS_ENVAR  "SILK_RWFILTER_THREAD_STATS"
+
 
 /* maximum number of dynamic libraries that we support */
 #define APP_MAX_DYNLIBS 8
@@ -56,6 +60,9 @@ RCSIDENTVAR(rcsID_RWFILTER_H, "$SiLK: rwfilter.h ef14e54179be 2020-04-14 21:57:4
 /* maximum number of filter checks */
 #define MAX_CHECKERS (APP_MAX_DYNLIBS + 2)
 
+/* number of records to read from an input stream at one time */
+#define FILTER_READ_RECS  256
+
 /*
  *  The number and types of skstream_t output streams: pass, fail, all
  */
@@ -92,6 +99,9 @@ typedef struct filter_stats_st {
     uint32_t        files;          /* count of files */
 } filter_stats_t;
 
+/* a set of partitioning checks; defined in rwfiltercheck.c */
+typedef struct filter_checks_st filter_checks_t;
+
 /* output of checker functions */
 typedef enum {
     RWF_FAIL,                   /* filter fails the record */
@@ -158,12 +168,22 @@ extern int reading_records;
 /* whether to print volume statistics */
 extern int print_volume_stats;
 
+/* whether to print the order in which the checks ran */
+extern int print_plan;
+
 /* number of total threads */
 extern uint32_t thread_count;
 
+/* whether threads must write records in the order they are read */
+extern int preserve_order;
+
 /* number of checks to preform */
 extern int checker_count;
 
+/* whether checker[0] is filterCheck(), in which case the records are
+ * passed to filterCheckBatch() in blocks instead */
+extern int checker_batch;
+
 /* function pointers to handle checking and or processing */
 extern checktype_t (*checker[MAX_CHECKERS])(rwRec*);
 
@@ -233,17 +253,36 @@ char *
 appNextInput(
     char               *buf,
     size_t              bufsize);
+int
+writeHeaders(
+    const skstream_t   *in_stream);
+int
+writeStreamHeader(
+    skstream_t                 *stream,
+    const sk_file_header_t     *in_hdr);
 
 
 /* filtering  functions (rwfiltercheck.c) */
 
 int
 filterCheckFile(
-    skstream_t         *path,
-    const char         *ip_dir);
+    skstream_t         *stream,
+    const char         *datafile);
+int
+filterCheckBlock(
+    const sk_block_summary_t   *summary,
+    void                       *skipped_count);
 checktype_t
 filterCheck(
     const rwRec        *rwrec);
+size_t
+filterCheckBatch(
+    const rwRec        *rwrec,
+    size_t              rec_count,
+    uint32_t           *selected);
+void
+filterPrintPlan(
+    skstream_t         *stream);
 void
 filterUsage(
     FILE*);
@@ -259,6 +298,38 @@ filterSetup(
 void
 filterTeardown(
     void);
+int
+filterChecksCreate(
+    filter_checks_t   **new_checks);
+void
+filterChecksDestroy(
+    filter_checks_t   **checks_ptr);
+int
+filterChecksParseOption(
+    filter_checks_t    *new_checks,
+    int                 opt_index,
+    char               *opt_arg);
+int
+filterChecksGetCount(
+    const filter_checks_t  *checks);
+const struct option *
+filterGetOptions(
+    void);
+checktype_t
+filterChecksCheck(
+    filter_checks_t    *checks,
+    const rwRec        *rwrec);
+size_t
+filterChecksCheckBatch(
+    filter_checks_t    *checks,
+    const rwRec        *rwrec,
+    size_t              rec_count,
+    uint32_t           *selected);
+int
+filterChecksCheckFile(
+    const filter_checks_t  *checks,
+    skstream_t             *stream,
+    const char             *datafile);
 
 
 /* filtering functions (rwfiltertuple.c) */
@@ -281,6 +352,37 @@ tupleGetCheckCount(
 
 
 
+/* filtering for several queries at once (rwfilterquery.c) */
+
+int
+querySetup(
+    void);
+void
+queryTeardown(
+    void);
+void
+queryUsage(
+    FILE               *fh);
+int
+queryGetCount(
+    void);
+int
+queryOpenOutputs(
+    sk_compmethod_t     comp_method);
+int
+queryWriteHeaders(
+    const sk_file_header_t *in_hdr);
+int
+queryFilterFile(
+    const char         *datafile,
+    const char         *ipfile_basename,
+    filter_stats_t     *stats);
+const char *
+queryGetStats(
+    int                 idx,
+    filter_stats_t     *stats);
+
+
 /* "main" for filtering when threaded (rwfilterthread.c) */
 
 int
@@ -53,6 +53,15 @@ RCSIDENT("$SiLK: rwfiltercheck.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 /* number of IP Wildcards, IPsets, lists of CIDR blocks */
 #define IP_INDEX_COUNT     4
 
+/* number of records that filterCheck() tests against every check to
+ * estimate how often each check passes before choosing the order in
+ * which to run the checks */
+#define FILTER_PLAN_SAMPLE_RECS  4096
+
+/* number of addresses filterSelectIPSet() passes to each call to
+ * skIPSetCheckAddressBatch() */
+#define FILTER_IPSET_BATCH        256
+
 #define SK_STRINGIFY(sk_s_token)         #sk_s_token
 #define SK_EXPAND_STRINGIFY(sk_es_macro) SK_STRINGIFY(sk_es_macro)
 
@@ -91,8 +100,8 @@ typedef struct high_mask_st {
 #define CHECK_TCP_HIGH_MASK(var, high_mask) \
     TCP_FLAG_TEST_HIGH_MASK((var), (high_mask).high, (high_mask).mask)
 
-/* The filters */
-typedef struct filter_checks_st {
+/* The filters; the typedef is in rwfilter.h */
+struct filter_checks_st {
     /* times */
     uint64_range_t sTime, eTime, active_time, elapsed;
 
@@ -172,14 +181,53 @@ typedef struct filter_checks_st {
     uint8_t checkSet[FILTER_CHECK_MAX];
     uint8_t check_count;
 
-} filter_checks_t;
+    /*
+     *  the checks in checkSet[] sorted into the order in which
+     *  filterCheck() runs them.  'plan_order' is NULL until
+     *  FILTER_PLAN_SAMPLE_RECS records have been sampled, and then it
+     *  points to 'plan'.  plan_pass[i] is the number of sampled
+     *  records that passed the check checkSet[i].
+     */
+    uint8_t plan[FILTER_CHECK_MAX];
+    const uint8_t *plan_order;
+    uint64_t plan_pass[FILTER_CHECK_MAX];
+    uint64_t plan_sampled;
+
+    /* whether each switch has been seen; used to reject duplicates */
+    uint8_t option_seen[FILTER_CHECK_MAX];
+};
 
 
 
 /* LOCAL VARIABLES */
 
+/* the checks given on the command line */
 static filter_checks_t static_checks;
-static filter_checks_t * const checks = &static_checks;
+
+/* the checks that filterOptionsHandler() fills.  This points to
+ * 'static_checks' except while filterChecksParseOption() is
+ * handling a switch for another set of checks.  The functions that
+ * test records take the checks as a parameter. */
+static filter_checks_t *checks = &static_checks;
+
+/* protects the members of 'checks' used while sampling the records */
+static pthread_mutex_t plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Read and publish the 'plan_order' member of 'checks', which other
+ * threads read without holding 'plan_mutex'.  The store must make
+ * the contents of 'plan' visible before the pointer. */
+#ifdef __ATOMIC_ACQUIRE
+#define FILTER_PLAN_ORDER_LOAD(fpo_checks)                      \
+    __atomic_load_n(&(fpo_checks)->plan_order, __ATOMIC_ACQUIRE)
+#define FILTER_PLAN_ORDER_STORE(fpo_checks, fpo_order)          \
+    __atomic_store_n(&(fpo_checks)->plan_order, (fpo_order),    \
+                     __ATOMIC_RELEASE)
+#else
+#define FILTER_PLAN_ORDER_LOAD(fpo_checks)                      \
+    filterPlanOrderLoad(fpo_checks)
+#define FILTER_PLAN_ORDER_STORE(fpo_checks, fpo_order)          \
+    ((fpo_checks)->plan_order = (fpo_order))
+#endif  /* __ATOMIC_ACQUIRE */
 
 
 /* OPTION SETUP */
@@ -527,7 +575,7 @@ filterOptionsHandler(
     int                 opt_index,
     char               *opt_arg)
 {
-    static int option_seen[FILTER_CHECK_MAX];
+    uint8_t *option_seen = checks->option_seen;
     int check_key = opt_index;
     int found_dup = 0;
     int rv = 1;
@@ -1016,415 +1064,1022 @@ compatOptionsHandler(
 
 
 /*
- *  pass = filterCheck(&rwrec)
+ *  pass = filterCheckOne(checks, check_key, &rwrec);
  *
- *    Check the rw record 'rwrec' against all of the checks the user
- *    specified.  If the record fails any check, RWF_PASS is returned.
- *    If the record passes all of the checks, RWF_FAIL is returned.
+ *    Check the rw record 'rwrec' against the single check
+ *    'check_key', which is one of the values in the 'checkSet' array
+ *    of 'checks'.  Return 1 if the record passes the check, or 0 if
+ *    it fails.
  */
-checktype_t
-filterCheck(
+static int
+filterCheckOne(
+    const filter_checks_t  *checks,
+    int                     check_key,
     const rwRec        *rwrec)
 {
     unsigned int i;
-    int j;
     int wanted;
     skipaddr_t ip1;
     skipaddr_t ip2;
     skcidr_t *cidr;
 
-/* If (test) is zero, the record fails the filter and a non-zero value
- * is returned.  Else we continue with additional checks. */
+/* If (test) is zero, the record fails the check and 0 is returned.
+ * Else we continue with additional tests. */
 #define FILTER_CHECK(test) \
-    if (test) {/*pass*/} else return RWF_FAIL
+    if (test) {/*pass*/} else return 0
 
 
-    for (j = 0; j < checks->check_count; j++) {
-        switch (checks->checkSet[j]) {
+    switch (check_key) {
 
-          case OPT_STIME:
-            FILTER_CHECK(CHECK_RANGE((uint64_t)rwRecGetStartTime(rwrec),
-                                     checks->sTime));
-            break;
+      case OPT_STIME:
+        FILTER_CHECK(CHECK_RANGE((uint64_t)rwRecGetStartTime(rwrec),
+                                 checks->sTime));
+        break;
 
-          case OPT_ETIME:
-            FILTER_CHECK(CHECK_RANGE((uint64_t)rwRecGetEndTime(rwrec),
-                                     checks->eTime));
-            break;
+      case OPT_ETIME:
+        FILTER_CHECK(CHECK_RANGE((uint64_t)rwRecGetEndTime(rwrec),
+                                 checks->eTime));
+        break;
 
-          case OPT_ACTIVE_TIME:
-            /* to pass the record; check that flow's start time is
-             * less than the max value of range and that flow's end
-             * time is greater than the min value of the range. */
-            FILTER_CHECK((uint64_t)rwRecGetStartTime(rwrec)
-                         <= checks->active_time.max);
-            FILTER_CHECK((uint64_t)rwRecGetEndTime(rwrec)
-                         >= checks->active_time.min);
-            break;
+      case OPT_ACTIVE_TIME:
+        /* to pass the record; check that flow's start time is
+         * less than the max value of range and that flow's end
+         * time is greater than the min value of the range. */
+        FILTER_CHECK((uint64_t)rwRecGetStartTime(rwrec)
+                     <= checks->active_time.max);
+        FILTER_CHECK((uint64_t)rwRecGetEndTime(rwrec)
+                     >= checks->active_time.min);
+        break;
 
-          case OPT_DURATION:
-            FILTER_CHECK(CHECK_RANGE(rwRecGetElapsed(rwrec),
-                                     checks->elapsed));
-            break;
+      case OPT_DURATION:
+        FILTER_CHECK(CHECK_RANGE(rwRecGetElapsed(rwrec),
+                                 checks->elapsed));
+        break;
 
-          case OPT_SPORT:
-            FILTER_CHECK(skBitmapGetBit(checks->sPort, rwRecGetSPort(rwrec)));
-            break;
+      case OPT_SPORT:
+        FILTER_CHECK(skBitmapGetBit(checks->sPort, rwRecGetSPort(rwrec)));
+        break;
 
-          case OPT_DPORT:
-            FILTER_CHECK(skBitmapGetBit(checks->dPort, rwRecGetDPort(rwrec)));
-            break;
+      case OPT_DPORT:
+        FILTER_CHECK(skBitmapGetBit(checks->dPort, rwRecGetDPort(rwrec)));
+        break;
 
-          case OPT_APORT:
-            FILTER_CHECK(skBitmapGetBit(checks->any_port, rwRecGetSPort(rwrec))
-                         || skBitmapGetBit(checks->any_port,
-                                           rwRecGetDPort(rwrec)));
-            break;
+      case OPT_APORT:
+        FILTER_CHECK(skBitmapGetBit(checks->any_port, rwRecGetSPort(rwrec))
+                     || skBitmapGetBit(checks->any_port,
+                                       rwRecGetDPort(rwrec)));
+        break;
 
-          case OPT_PROTOCOL:
-            FILTER_CHECK(skBitmapGetBit(checks->proto, rwRecGetProto(rwrec)));
-            break;
+      case OPT_PROTOCOL:
+        FILTER_CHECK(skBitmapGetBit(checks->proto, rwRecGetProto(rwrec)));
+        break;
 
-          case OPT_ICMP_TYPE:
-            FILTER_CHECK(rwRecIsICMP(rwrec)
-                         && skBitmapGetBit(checks->icmp_type,
-                                           rwRecGetIcmpType(rwrec)));
-            break;
+      case OPT_ICMP_TYPE:
+        FILTER_CHECK(rwRecIsICMP(rwrec)
+                     && skBitmapGetBit(checks->icmp_type,
+                                       rwRecGetIcmpType(rwrec)));
+        break;
 
-          case OPT_ICMP_CODE:
-            FILTER_CHECK(rwRecIsICMP(rwrec)
-                         && skBitmapGetBit(checks->icmp_code,
-                                           rwRecGetIcmpCode(rwrec)));
-            break;
+      case OPT_ICMP_CODE:
+        FILTER_CHECK(rwRecIsICMP(rwrec)
+                     && skBitmapGetBit(checks->icmp_code,
+                                       rwRecGetIcmpCode(rwrec)));
+        break;
 
-          case OPT_BYTES:
-            FILTER_CHECK(CHECK_RANGE(rwRecGetBytes(rwrec), checks->bytes));
-            break;
+      case OPT_BYTES:
+        FILTER_CHECK(CHECK_RANGE(rwRecGetBytes(rwrec), checks->bytes));
+        break;
 
-          case OPT_PACKETS:
-            FILTER_CHECK(CHECK_RANGE(rwRecGetPkts(rwrec), checks->pkts));
-            break;
+      case OPT_PACKETS:
+        FILTER_CHECK(CHECK_RANGE(rwRecGetPkts(rwrec), checks->pkts));
+        break;
 
-          case OPT_BYTES_PER_PACKET:
-            FILTER_CHECK(CHECK_RANGE(((double)rwRecGetBytes(rwrec)
-                                      / (double)rwRecGetPkts(rwrec)),
-                                     checks->bytes_per_packet));
-            break;
+      case OPT_BYTES_PER_PACKET:
+        FILTER_CHECK(CHECK_RANGE(((double)rwRecGetBytes(rwrec)
+                                  / (double)rwRecGetPkts(rwrec)),
+                                 checks->bytes_per_packet));
+        break;
 
 #if RATE_FILTERS
-          case OPT_BYTES_PER_SECOND:
-            if (rwRecGetElapsed(rwrec) > 0) {
-                FILTER_CHECK(CHECK_RANGE(((double)rwRecGetBytes(rwrec)
-                                          / (double)rwRecGetElapsed(rwrec)),
-                                         checks->bytes_per_second));
-            } else {
-                /* use a one second duration */
-                FILTER_CHECK(CHECK_RANGE((double)rwRecGetBytes(rwrec),
-                                         checks->bytes_per_second));
-            }
-            break;
+      case OPT_BYTES_PER_SECOND:
+        if (rwRecGetElapsed(rwrec) > 0) {
+            FILTER_CHECK(CHECK_RANGE(((double)rwRecGetBytes(rwrec)
+                                      / (double)rwRecGetElapsed(rwrec)),
+                                     checks->bytes_per_second));
+        } else {
+            /* use a one second duration */
+            FILTER_CHECK(CHECK_RANGE((double)rwRecGetBytes(rwrec),
+                                     checks->bytes_per_second));
+        }
+        break;
 
-          case OPT_PACKETS_PER_SECOND:
-            if (rwRecGetElapsed(rwrec) > 0) {
-                FILTER_CHECK(CHECK_RANGE(((double)rwRecGetPkts(rwrec)
-                                          / (double)rwRecGetElapsed(rwrec)),
-                                         checks->packets_per_second));
-            } else {
-                /* use a one second duration */
-                FILTER_CHECK(CHECK_RANGE((double)rwRecGetPkts(rwrec),
-                                         checks->packets_per_second));
-            }
-            break;
+      case OPT_PACKETS_PER_SECOND:
+        if (rwRecGetElapsed(rwrec) > 0) {
+            FILTER_CHECK(CHECK_RANGE(((double)rwRecGetPkts(rwrec)
+                                      / (double)rwRecGetElapsed(rwrec)),
+                                     checks->packets_per_second));
+        } else {
+            /* use a one second duration */
+            FILTER_CHECK(CHECK_RANGE((double)rwRecGetPkts(rwrec),
+                                     checks->packets_per_second));
+        }
+        break;
 #endif  /* RATE_FILTERS */
 
-          case OPT_NOT_SCIDR:
-          case OPT_SCIDR:
-            rwRecMemGetSIP(rwrec, &ip1);
-            wanted = checks->cidr_negated[SRC];
-            for (i = 0, cidr = checks->cidr_list[SRC];
-                 i < checks->cidr_list_len[SRC];
-                 ++i, ++cidr)
-            {
-                if (skcidrCheckIP(cidr, &ip1)) {
-                    wanted = !wanted;
-                    break;
-                }
+      case OPT_NOT_SCIDR:
+      case OPT_SCIDR:
+        rwRecMemGetSIP(rwrec, &ip1);
+        wanted = checks->cidr_negated[SRC];
+        for (i = 0, cidr = checks->cidr_list[SRC];
+             i < checks->cidr_list_len[SRC];
+             ++i, ++cidr)
+        {
+            if (skcidrCheckIP(cidr, &ip1)) {
+                wanted = !wanted;
+                break;
             }
-            FILTER_CHECK(wanted);
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_NOT_DCIDR:
-          case OPT_DCIDR:
-            rwRecMemGetDIP(rwrec, &ip1);
-            wanted = checks->cidr_negated[DST];
-            for (i = 0, cidr = checks->cidr_list[DST];
-                 i < checks->cidr_list_len[DST];
-                 ++i, ++cidr)
-            {
-                if (skcidrCheckIP(cidr, &ip1)) {
-                    wanted = !wanted;
-                    break;
-                }
+      case OPT_NOT_DCIDR:
+      case OPT_DCIDR:
+        rwRecMemGetDIP(rwrec, &ip1);
+        wanted = checks->cidr_negated[DST];
+        for (i = 0, cidr = checks->cidr_list[DST];
+             i < checks->cidr_list_len[DST];
+             ++i, ++cidr)
+        {
+            if (skcidrCheckIP(cidr, &ip1)) {
+                wanted = !wanted;
+                break;
             }
-            FILTER_CHECK(wanted);
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_NOT_NHCIDR:
-          case OPT_NHCIDR:
-            rwRecMemGetNhIP(rwrec, &ip1);
-            wanted = checks->cidr_negated[NHIP];
-            for (i = 0, cidr = checks->cidr_list[NHIP];
-                 i < checks->cidr_list_len[NHIP];
-                 ++i, ++cidr)
-            {
-                if (skcidrCheckIP(cidr, &ip1)) {
-                    wanted = !wanted;
-                    break;
-                }
+      case OPT_NOT_NHCIDR:
+      case OPT_NHCIDR:
+        rwRecMemGetNhIP(rwrec, &ip1);
+        wanted = checks->cidr_negated[NHIP];
+        for (i = 0, cidr = checks->cidr_list[NHIP];
+             i < checks->cidr_list_len[NHIP];
+             ++i, ++cidr)
+        {
+            if (skcidrCheckIP(cidr, &ip1)) {
+                wanted = !wanted;
+                break;
             }
-            FILTER_CHECK(wanted);
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_NOT_ANY_CIDR:
-          case OPT_ANY_CIDR:
-            rwRecMemGetSIP(rwrec, &ip1);
-            rwRecMemGetDIP(rwrec, &ip2);
-            wanted = checks->cidr_negated[ANY];
-            for (i = 0, cidr = checks->cidr_list[ANY];
-                 i < checks->cidr_list_len[ANY];
-                 ++i, ++cidr)
+      case OPT_NOT_ANY_CIDR:
+      case OPT_ANY_CIDR:
+        rwRecMemGetSIP(rwrec, &ip1);
+        rwRecMemGetDIP(rwrec, &ip2);
+        wanted = checks->cidr_negated[ANY];
+        for (i = 0, cidr = checks->cidr_list[ANY];
+             i < checks->cidr_list_len[ANY];
+             ++i, ++cidr)
+        {
+            if (skcidrCheckIP(cidr, &ip1)
+                || skcidrCheckIP(cidr, &ip2))
             {
-                if (skcidrCheckIP(cidr, &ip1)
-                    || skcidrCheckIP(cidr, &ip2))
-                {
-                    wanted = !wanted;
-                    break;
-                }
+                wanted = !wanted;
+                break;
             }
-            FILTER_CHECK(wanted);
-            break;
-
-          case OPT_NOT_SADDRESS:
-          case OPT_SADDRESS:
-            /* Check if record's sIP matches the bitmap.  The record
-             * FAILS the filter when the result of the check MATCHES
-             * the status of the negate flag.  E.g., the record
-             * matches the address-bitmap (skIPWildcardCheckIp()==1)
-             * and the user entered --not-saddr (ipwild_negate==1).
-             * Since the record FAILS when the values are equal, it
-             * will PASS when they are not-equal; i.e., when the
-             * XOR(^) of the two values is true.
-             */
-            rwRecMemGetSIP(rwrec, &ip1);
-            FILTER_CHECK(skIPWildcardCheckIp(&checks->ipwild[SRC], &ip1)
-                         ^ checks->ipwild_negate[SRC]);
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_NOT_DADDRESS:
-          case OPT_DADDRESS:
-            rwRecMemGetDIP(rwrec, &ip1);
-            FILTER_CHECK(skIPWildcardCheckIp(&checks->ipwild[DST], &ip1)
-                         ^ checks->ipwild_negate[DST]);
-            break;
+      case OPT_NOT_SADDRESS:
+      case OPT_SADDRESS:
+        /* Check if record's sIP matches the bitmap.  The record
+         * FAILS the filter when the result of the check MATCHES
+         * the status of the negate flag.  E.g., the record
+         * matches the address-bitmap (skIPWildcardCheckIp()==1)
+         * and the user entered --not-saddr (ipwild_negate==1).
+         * Since the record FAILS when the values are equal, it
+         * will PASS when they are not-equal; i.e., when the
+         * XOR(^) of the two values is true.
+         */
+        rwRecMemGetSIP(rwrec, &ip1);
+        FILTER_CHECK(skIPWildcardCheckIp(&checks->ipwild[SRC], &ip1)
+                     ^ checks->ipwild_negate[SRC]);
+        break;
 
-          case OPT_NOT_NEXT_HOP_ID:
-          case OPT_NEXT_HOP_ID:
-            rwRecMemGetNhIP(rwrec, &ip1);
-            FILTER_CHECK(skIPWildcardCheckIp(&checks->ipwild[NHIP], &ip1)
-                         ^ checks->ipwild_negate[NHIP]);
-            break;
+      case OPT_NOT_DADDRESS:
+      case OPT_DADDRESS:
+        rwRecMemGetDIP(rwrec, &ip1);
+        FILTER_CHECK(skIPWildcardCheckIp(&checks->ipwild[DST], &ip1)
+                     ^ checks->ipwild_negate[DST]);
+        break;
 
-          case OPT_NOT_ANY_ADDRESS:
-          case OPT_ANY_ADDRESS:
-            rwRecMemGetSIP(rwrec, &ip1);
-            rwRecMemGetDIP(rwrec, &ip2);
-            FILTER_CHECK((skIPWildcardCheckIp(&checks->ipwild[ANY], &ip1)
-                          | skIPWildcardCheckIp(&checks->ipwild[ANY], &ip2))
-                         ^ checks->ipwild_negate[ANY]);
-            break;
+      case OPT_NOT_NEXT_HOP_ID:
+      case OPT_NEXT_HOP_ID:
+        rwRecMemGetNhIP(rwrec, &ip1);
+        FILTER_CHECK(skIPWildcardCheckIp(&checks->ipwild[NHIP], &ip1)
+                     ^ checks->ipwild_negate[NHIP]);
+        break;
 
-          case OPT_NOT_SET_SIP:
-          case OPT_SET_SIP:
-            /* As with OPT_SADDRESS, for the record to pass the
-             * filter, the result of the check must not equal the
-             * result of the negate flag. */
-            FILTER_CHECK(skIPSetCheckRecordSIP(checks->ipset[SRC], rwrec)
-                         ^ checks->ipset_reject[SRC]);
-            break;
+      case OPT_NOT_ANY_ADDRESS:
+      case OPT_ANY_ADDRESS:
+        rwRecMemGetSIP(rwrec, &ip1);
+        rwRecMemGetDIP(rwrec, &ip2);
+        FILTER_CHECK((skIPWildcardCheckIp(&checks->ipwild[ANY], &ip1)
+                      | skIPWildcardCheckIp(&checks->ipwild[ANY], &ip2))
+                     ^ checks->ipwild_negate[ANY]);
+        break;
 
-          case OPT_NOT_SET_DIP:
-          case OPT_SET_DIP:
-            FILTER_CHECK(skIPSetCheckRecordDIP(checks->ipset[DST], rwrec)
-                         ^ checks->ipset_reject[DST]);
-            break;
+      case OPT_NOT_SET_SIP:
+      case OPT_SET_SIP:
+        /* As with OPT_SADDRESS, for the record to pass the
+         * filter, the result of the check must not equal the
+         * result of the negate flag. */
+        FILTER_CHECK(skIPSetCheckRecordSIP(checks->ipset[SRC], rwrec)
+                     ^ checks->ipset_reject[SRC]);
+        break;
 
-          case OPT_NOT_SET_NHIP:
-          case OPT_SET_NHIP:
-            FILTER_CHECK(skIPSetCheckRecordNhIP(checks->ipset[NHIP], rwrec)
-                         ^ checks->ipset_reject[NHIP]);
-            break;
+      case OPT_NOT_SET_DIP:
+      case OPT_SET_DIP:
+        FILTER_CHECK(skIPSetCheckRecordDIP(checks->ipset[DST], rwrec)
+                     ^ checks->ipset_reject[DST]);
+        break;
 
-          case OPT_NOT_SET_ANY:
-          case OPT_SET_ANY:
-            FILTER_CHECK((skIPSetCheckRecordSIP(checks->ipset[ANY], rwrec)
-                          | skIPSetCheckRecordDIP(checks->ipset[ANY], rwrec))
-                         ^ checks->ipset_reject[ANY]);
-            break;
+      case OPT_NOT_SET_NHIP:
+      case OPT_SET_NHIP:
+        FILTER_CHECK(skIPSetCheckRecordNhIP(checks->ipset[NHIP], rwrec)
+                     ^ checks->ipset_reject[NHIP]);
+        break;
 
-          case OPT_INPUT_INDEX:
-            FILTER_CHECK(skBitmapGetBit(checks->input_index,
-                                        rwRecGetInput(rwrec)));
-            break;
+      case OPT_NOT_SET_ANY:
+      case OPT_SET_ANY:
+        FILTER_CHECK((skIPSetCheckRecordSIP(checks->ipset[ANY], rwrec)
+                      | skIPSetCheckRecordDIP(checks->ipset[ANY], rwrec))
+                     ^ checks->ipset_reject[ANY]);
+        break;
 
-          case OPT_OUTPUT_INDEX:
-            FILTER_CHECK(skBitmapGetBit(checks->output_index,
-                                        rwRecGetOutput(rwrec)));
-            break;
+      case OPT_INPUT_INDEX:
+        FILTER_CHECK(skBitmapGetBit(checks->input_index,
+                                    rwRecGetInput(rwrec)));
+        break;
 
-          case OPT_ANY_INDEX:
-            FILTER_CHECK(skBitmapGetBit(checks->any_index,rwRecGetInput(rwrec))
-                         || skBitmapGetBit(checks->any_index,
-                                           rwRecGetOutput(rwrec)));
-            break;
+      case OPT_OUTPUT_INDEX:
+        FILTER_CHECK(skBitmapGetBit(checks->output_index,
+                                    rwRecGetOutput(rwrec)));
+        break;
 
-            /*
-             * TCP check.  Passes if there's an intersection between
-             * the raised flags and the filter flags.
-             */
-          case OPT_TCP_FLAGS:
-            FILTER_CHECK(checks->flags & rwRecGetFlags(rwrec));
-            break;
+      case OPT_ANY_INDEX:
+        FILTER_CHECK(skBitmapGetBit(checks->any_index,rwRecGetInput(rwrec))
+                     || skBitmapGetBit(checks->any_index,
+                                       rwRecGetOutput(rwrec)));
+        break;
 
-          case OPT_FLAGS_ALL:
-            wanted = 0;
-            for (i = 0; i < checks->count_flags_all; ++i) {
-                if (CHECK_TCP_HIGH_MASK(rwRecGetFlags(rwrec),
-                                        checks->flags_all[i]))
-                {
-                    wanted = 1;
-                    break; /* wanted */
-                }
-            }
-            FILTER_CHECK(wanted);
-            break;
+        /*
+         * TCP check.  Passes if there's an intersection between
+         * the raised flags and the filter flags.
+         */
+      case OPT_TCP_FLAGS:
+        FILTER_CHECK(checks->flags & rwRecGetFlags(rwrec));
+        break;
 
-          case OPT_FLAGS_INITIAL:
-            wanted = 0;
-            for (i = 0; i < checks->count_flags_init; ++i) {
-                if (CHECK_TCP_HIGH_MASK(rwRecGetInitFlags(rwrec),
-                                        checks->flags_init[i]))
-                {
-                    wanted = 1;
-                    break; /* wanted */
-                }
+      case OPT_FLAGS_ALL:
+        wanted = 0;
+        for (i = 0; i < checks->count_flags_all; ++i) {
+            if (CHECK_TCP_HIGH_MASK(rwRecGetFlags(rwrec),
+                                    checks->flags_all[i]))
+            {
+                wanted = 1;
+                break; /* wanted */
             }
-            FILTER_CHECK(wanted);
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_FLAGS_SESSION:
-            wanted = 0;
-            for (i = 0; i < checks->count_flags_session; ++i) {
-                if (CHECK_TCP_HIGH_MASK(rwRecGetRestFlags(rwrec),
-                                        checks->flags_session[i]))
-                {
-                    wanted = 1;
-                    break;
-                }
+      case OPT_FLAGS_INITIAL:
+        wanted = 0;
+        for (i = 0; i < checks->count_flags_init; ++i) {
+            if (CHECK_TCP_HIGH_MASK(rwRecGetInitFlags(rwrec),
+                                    checks->flags_init[i]))
+            {
+                wanted = 1;
+                break; /* wanted */
             }
-            FILTER_CHECK(wanted);
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_ATTRIBUTES:
-            wanted = 0;
-            for (i = 0; i < checks->count_attributes; ++i) {
-                if (CHECK_TCP_HIGH_MASK(rwRecGetTcpState(rwrec),
-                                        checks->attributes[i]))
-                {
-                    wanted = 1;
-                    break;
-                }
+      case OPT_FLAGS_SESSION:
+        wanted = 0;
+        for (i = 0; i < checks->count_flags_session; ++i) {
+            if (CHECK_TCP_HIGH_MASK(rwRecGetRestFlags(rwrec),
+                                    checks->flags_session[i]))
+            {
+                wanted = 1;
+                break;
             }
-            FILTER_CHECK(wanted);
-            break;
-
-          case OPT_APPLICATION:
-            FILTER_CHECK(skBitmapGetBit(checks->application,
-                                        rwRecGetApplication(rwrec)));
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_IP_VERSION:
-            switch (checks->ipv6_policy) {
-              case SK_IPV6POLICY_MIX:
-                break;
-              case SK_IPV6POLICY_ONLY:
-                FILTER_CHECK(rwRecIsIPv6(rwrec));
-                break;
-              case SK_IPV6POLICY_IGNORE:
-                FILTER_CHECK(!rwRecIsIPv6(rwrec));
+      case OPT_ATTRIBUTES:
+        wanted = 0;
+        for (i = 0; i < checks->count_attributes; ++i) {
+            if (CHECK_TCP_HIGH_MASK(rwRecGetTcpState(rwrec),
+                                    checks->attributes[i]))
+            {
+                wanted = 1;
                 break;
-              case SK_IPV6POLICY_ASV4:
-              case SK_IPV6POLICY_FORCE:
-                /* can't happen */
-                skAbortBadCase(checks->ipv6_policy);
             }
-            break;
+        }
+        FILTER_CHECK(wanted);
+        break;
 
-          case OPT_SENSORS:
-            FILTER_CHECK(skBitmapGetBit(checks->sID, rwRecGetSensor(rwrec)));
-            break;
+      case OPT_APPLICATION:
+        FILTER_CHECK(skBitmapGetBit(checks->application,
+                                    rwRecGetApplication(rwrec)));
+        break;
 
-          case OPT_FLOW_TYPE:
-            FILTER_CHECK(skBitmapGetBit(checks->flow_type,
-                                        rwRecGetFlowType(rwrec)));
+      case OPT_IP_VERSION:
+        switch (checks->ipv6_policy) {
+          case SK_IPV6POLICY_MIX:
             break;
-
-          case OPT_SCC:
-            rwRecMemGetSIP(rwrec, &ip1);
-            FILTER_CHECK(skBitmapGetBit(checks->scc,
-                                        skCountryLookupCode(&ip1)));
+          case SK_IPV6POLICY_ONLY:
+            FILTER_CHECK(rwRecIsIPv6(rwrec));
             break;
-
-          case OPT_DCC:
-            rwRecMemGetDIP(rwrec, &ip1);
-            FILTER_CHECK(skBitmapGetBit(checks->dcc,
-                                        skCountryLookupCode(&ip1)));
+          case SK_IPV6POLICY_IGNORE:
+            FILTER_CHECK(!rwRecIsIPv6(rwrec));
             break;
+          case SK_IPV6POLICY_ASV4:
+          case SK_IPV6POLICY_FORCE:
+            /* can't happen */
+            skAbortBadCase(checks->ipv6_policy);
+        }
+        break;
 
-          case OPT_ANY_CC:
-            rwRecMemGetSIP(rwrec, &ip1);
-            rwRecMemGetDIP(rwrec, &ip2);
-            FILTER_CHECK(skBitmapGetBit(checks->any_cc,
-                                        skCountryLookupCode(&ip1))
-                         || skBitmapGetBit(checks->any_cc,
-                                           skCountryLookupCode(&ip2)));
-            break;
+      case OPT_SENSORS:
+        FILTER_CHECK(skBitmapGetBit(checks->sID, rwRecGetSensor(rwrec)));
+        break;
 
-          default:
-            skAbortBadCase(checks->checkSet[j]);
-        }
-    } /* outer for */
+      case OPT_FLOW_TYPE:
+        FILTER_CHECK(skBitmapGetBit(checks->flow_type,
+                                    rwRecGetFlowType(rwrec)));
+        break;
 
-    return RWF_PASS;                     /* WANTED! */
-}
+      case OPT_SCC:
+        rwRecMemGetSIP(rwrec, &ip1);
+        FILTER_CHECK(skBitmapGetBit(checks->scc,
+                                    skCountryLookupCode(&ip1)));
+        break;
 
+      case OPT_DCC:
+        rwRecMemGetDIP(rwrec, &ip1);
+        FILTER_CHECK(skBitmapGetBit(checks->dcc,
+                                    skCountryLookupCode(&ip1)));
+        break;
 
-/*
- *  pass = filterCheckFile(stream, ip_dir)
+      case OPT_ANY_CC:
+        rwRecMemGetSIP(rwrec, &ip1);
+        rwRecMemGetDIP(rwrec, &ip2);
+        FILTER_CHECK(skBitmapGetBit(checks->any_cc,
+                                    skCountryLookupCode(&ip1))
+                     || skBitmapGetBit(checks->any_cc,
+                                       skCountryLookupCode(&ip2)));
+        break;
+
+      default:
+        skAbortBadCase(check_key);
+    }
+
+    return 1;
+}
+
+
+/*
+ *  cost = filterCheckCost(checks, check_key);
+ *
+ *    Return the relative cost of running the check 'check_key' of
+ *    'checks' on a record, where comparing one field to a range or
+ *    looking it up in a bitmap costs 1.
+ */
+static double
+filterCheckCost(
+    const filter_checks_t  *checks,
+    int                     check_key)
+{
+    switch (check_key) {
+      case OPT_ACTIVE_TIME:
+      case OPT_APORT:
+      case OPT_ICMP_TYPE:
+      case OPT_ICMP_CODE:
+      case OPT_BYTES_PER_PACKET:
+#if RATE_FILTERS
+      case OPT_BYTES_PER_SECOND:
+      case OPT_PACKETS_PER_SECOND:
+#endif
+      case OPT_ANY_INDEX:
+        return 2.0;
+
+      case OPT_SCIDR:
+      case OPT_DCIDR:
+      case OPT_NHCIDR:
+        return 1.0 + checks->cidr_list_len[check_key - OPT_SCIDR];
+      case OPT_ANY_CIDR:
+        return 1.0 + 2.0 * checks->cidr_list_len[ANY];
+
+      case OPT_SADDRESS:
+      case OPT_DADDRESS:
+      case OPT_NEXT_HOP_ID:
+        return 4.0;
+      case OPT_ANY_ADDRESS:
+        return 8.0;
+
+      case OPT_SET_SIP:
+      case OPT_SET_DIP:
+      case OPT_SET_NHIP:
+        return 8.0;
+      case OPT_SET_ANY:
+        return 16.0;
+
+      case OPT_FLAGS_ALL:
+        return checks->count_flags_all;
+      case OPT_FLAGS_INITIAL:
+        return checks->count_flags_init;
+      case OPT_FLAGS_SESSION:
+        return checks->count_flags_session;
+      case OPT_ATTRIBUTES:
+        return checks->count_attributes;
+
+      case OPT_SCC:
+      case OPT_DCC:
+        return 16.0;
+      case OPT_ANY_CC:
+        return 32.0;
+
+      default:
+        return 1.0;
+    }
+}
+
+
+/*
+ *  filterPlanChecks(checks);
+ *
+ *    Fill the 'plan' member of 'checks' with the checks
+ *    sorted by the expected cost of rejecting a record, which is the
+ *    cost of a check divided by the fraction of the sampled records
+ *    that failed it.  Checks that no sampled record failed go last.
+ *    Checks with equal rank keep the order given by the user.
+ */
+static void
+filterPlanChecks(
+    filter_checks_t    *checks)
+{
+    double rank[FILTER_CHECK_MAX];
+    double r;
+    uint8_t key;
+    int i;
+    int j;
+
+    for (i = 0; i < checks->check_count; ++i) {
+        if (checks->plan_pass[i] >= checks->plan_sampled) {
+            r = HUGE_VAL;
+        } else {
+            r = (filterCheckCost(checks, checks->checkSet[i])
+                 * (double)checks->plan_sampled
+                 / (double)(checks->plan_sampled - checks->plan_pass[i]));
+        }
+        /* insertion sort */
+        key = checks->checkSet[i];
+        for (j = i; j > 0 && rank[j - 1] > r; --j) {
+            rank[j] = rank[j - 1];
+            checks->plan[j] = checks->plan[j - 1];
+        }
+        rank[j] = r;
+        checks->plan[j] = key;
+    }
+}
+
+
+#ifndef __ATOMIC_ACQUIRE
+/*
+ *  order = filterPlanOrderLoad(checks);
+ *
+ *    Return the 'plan_order' member of 'checks', holding 'plan_mutex'
+ *    while reading it.  Used when the compiler does not provide
+ *    atomic builtins.
+ */
+static const uint8_t *
+filterPlanOrderLoad(
+    filter_checks_t    *checks)
+{
+    const uint8_t *order;
+
+    pthread_mutex_lock(&plan_mutex);
+    order = checks->plan_order;
+    pthread_mutex_unlock(&plan_mutex);
+    return order;
+}
+#endif  /* __ATOMIC_ACQUIRE */
+
+
+/*
+ *  pass = filterCheckSample(checks, &rwrec);
+ *
+ *    Check the rw record 'rwrec' against every check in 'checks' and
+ *    count the checks it passes.  Once FILTER_PLAN_SAMPLE_RECS
+ *    records have been counted, choose the order in which
+ *    filterChecksCheck() runs the checks.  Return RWF_PASS if the
+ *    record passes all of the checks, else RWF_FAIL.
+ */
+static checktype_t
+filterCheckSample(
+    filter_checks_t    *checks,
+    const rwRec        *rwrec)
+{
+    checktype_t result = RWF_PASS;
+    int i;
+
+    pthread_mutex_lock(&plan_mutex);
+    if (checks->plan_order) {
+        /* another thread finished the sample */
+        pthread_mutex_unlock(&plan_mutex);
+        return filterChecksCheck(checks, rwrec);
+    }
+    for (i = 0; i < checks->check_count; ++i) {
+        if (filterCheckOne(checks, checks->checkSet[i], rwrec)) {
+            ++checks->plan_pass[i];
+        } else {
+            result = RWF_FAIL;
+        }
+    }
+    ++checks->plan_sampled;
+    if (FILTER_PLAN_SAMPLE_RECS == checks->plan_sampled) {
+        filterPlanChecks(checks);
+        FILTER_PLAN_ORDER_STORE(checks, checks->plan);
+    }
+    pthread_mutex_unlock(&plan_mutex);
+
+    return result;
+}
+
+
+/*
+ *  pass = filterChecksCheck(checks, &rwrec)
+ *
+ *    Check the rw record 'rwrec' against all of the checks in
+ *    'checks'.  If the record fails any check, RWF_FAIL is returned.
+ *    If the record passes all of the checks, RWF_PASS is returned.
+ *
+ *    The first FILTER_PLAN_SAMPLE_RECS records are tested against
+ *    every check; after that, the checks most likely to reject a
+ *    record cheaply are run first.
+ */
+checktype_t
+filterChecksCheck(
+    filter_checks_t    *checks,
+    const rwRec        *rwrec)
+{
+    const uint8_t *order = FILTER_PLAN_ORDER_LOAD(checks);
+    int j;
+
+    if (NULL == order) {
+        return filterCheckSample(checks, rwrec);
+    }
+    for (j = 0; j < checks->check_count; ++j) {
+        if (!filterCheckOne(checks, order[j], rwrec)) {
+            return RWF_FAIL;
+        }
+    }
+    return RWF_PASS;                     /* WANTED! */
+}
+
+
+/*
+ *  pass = filterCheck(&rwrec)
+ *
+ *    Check the rw record 'rwrec' against the checks the user
+ *    specified on the command line.  See filterChecksCheck().
+ */
+checktype_t
+filterCheck(
+    const rwRec        *rwrec)
+{
+    return filterChecksCheck(&static_checks, rwrec);
+}
+
+
+/*
+ *  count = filterSelectIPSet(checks, ip_idx, rwrec, selected, count);
+ *
+ *    Helper function for filterSelect() that handles the IPset check
+ *    whose index in the 'ipset' member of 'checks' is 'ip_idx'.
+ *
+ *    Gather the addresses of the records whose indexes are among the
+ *    first 'count' entries of 'selected' and look them up with
+ *    skIPSetCheckAddressBatch(), which interleaves the searches of
+ *    the IPset.  Remove the indexes of the records that fail from
+ *    'selected' and return the number of indexes that remain.
+ */
+static size_t
+filterSelectIPSet(
+    const filter_checks_t  *checks,
+    int                     ip_idx,
+    const rwRec            *rwrec,
+    uint32_t               *selected,
+    size_t                  count)
+{
+    skipaddr_t ipaddr[FILTER_IPSET_BATCH];
+    uint8_t found[FILTER_IPSET_BATCH];
+    uint8_t found_dip[FILTER_IPSET_BATCH];
+    const skipset_t *ipset = checks->ipset[ip_idx];
+    size_t batch;
+    size_t base;
+    size_t i;
+    size_t n = 0;
+
+    for (base = 0; base < count; base += batch) {
+        batch = count - base;
+        if (batch > FILTER_IPSET_BATCH) {
+            batch = FILTER_IPSET_BATCH;
+        }
+
+        switch (ip_idx) {
+          case SRC:
+          case ANY:
+            for (i = 0; i < batch; ++i) {
+                rwRecMemGetSIP(&rwrec[selected[base + i]], &ipaddr[i]);
+            }
+            break;
+          case DST:
+            for (i = 0; i < batch; ++i) {
+                rwRecMemGetDIP(&rwrec[selected[base + i]], &ipaddr[i]);
+            }
+            break;
+          case NHIP:
+            for (i = 0; i < batch; ++i) {
+                rwRecMemGetNhIP(&rwrec[selected[base + i]], &ipaddr[i]);
+            }
+            break;
+          default:
+            skAbortBadCase(ip_idx);
+        }
+        skIPSetCheckAddressBatch(ipset, ipaddr, batch, found);
+
+        if (ANY == ip_idx) {
+            for (i = 0; i < batch; ++i) {
+                rwRecMemGetDIP(&rwrec[selected[base + i]], &ipaddr[i]);
+            }
+            skIPSetCheckAddressBatch(ipset, ipaddr, batch, found_dip);
+            for (i = 0; i < batch; ++i) {
+                found[i] |= found_dip[i];
+            }
+        }
+
+        /* 'n' never exceeds 'base + i', so no index is overwritten
+         * before it is read */
+        for (i = 0; i < batch; ++i) {
+            selected[n] = selected[base + i];
+            n += (found[i] ^ checks->ipset_reject[ip_idx]) ? 1 : 0;
+        }
+    }
+
+    return n;
+}
+
+
+/*
+ *  count = filterSelect(checks, check_key, rwrec, selected, count);
+ *
+ *    Test each record in the array 'rwrec' whose index is among the
+ *    first 'count' entries of 'selected' against the single check
+ *    'check_key' of 'checks'.  Remove the indexes of the records that
+ *    fail from 'selected' and return the number of indexes that
+ *    remain.
+ *
+ *    The common checks that compare one field to a range or a bitmap
+ *    are written as tight loops over the records, and the IPset
+ *    checks use filterSelectIPSet(); the others call filterCheckOne()
+ *    for each record.
+ */
+static size_t
+filterSelect(
+    const filter_checks_t  *checks,
+    int                     check_key,
+    const rwRec            *rwrec,
+    uint32_t               *selected,
+    size_t                  count)
+{
+    const rwRec *r;
+    size_t i;
+    size_t n = 0;
+
+/* Keep the index of each record 'r' for which (test) is true.  The
+ * index is always written and is kept by advancing 'n', which avoids
+ * a branch per record. */
+#define FILTER_SELECT(test)                             \
+    for (i = 0; i < count; ++i) {                       \
+        r = &rwrec[selected[i]];                        \
+        selected[n] = selected[i];                      \
+        n += ((test) ? 1 : 0);                          \
+    }
+
+    switch (check_key) {
+      case OPT_STIME:
+        FILTER_SELECT(CHECK_RANGE((uint64_t)rwRecGetStartTime(r),
+                                  checks->sTime));
+        break;
+      case OPT_ETIME:
+        FILTER_SELECT(CHECK_RANGE((uint64_t)rwRecGetEndTime(r),
+                                  checks->eTime));
+        break;
+      case OPT_DURATION:
+        FILTER_SELECT(CHECK_RANGE(rwRecGetElapsed(r), checks->elapsed));
+        break;
+      case OPT_BYTES:
+        FILTER_SELECT(CHECK_RANGE(rwRecGetBytes(r), checks->bytes));
+        break;
+      case OPT_PACKETS:
+        FILTER_SELECT(CHECK_RANGE(rwRecGetPkts(r), checks->pkts));
+        break;
+      case OPT_SPORT:
+        FILTER_SELECT(skBitmapGetBit(checks->sPort, rwRecGetSPort(r)));
+        break;
+      case OPT_DPORT:
+        FILTER_SELECT(skBitmapGetBit(checks->dPort, rwRecGetDPort(r)));
+        break;
+      case OPT_PROTOCOL:
+        FILTER_SELECT(skBitmapGetBit(checks->proto, rwRecGetProto(r)));
+        break;
+      case OPT_TCP_FLAGS:
+        FILTER_SELECT(checks->flags & rwRecGetFlags(r));
+        break;
+      case OPT_SENSORS:
+        FILTER_SELECT(skBitmapGetBit(checks->sID, rwRecGetSensor(r)));
+        break;
+      case OPT_FLOW_TYPE:
+        FILTER_SELECT(skBitmapGetBit(checks->flow_type,
+                                     rwRecGetFlowType(r)));
+        break;
+      case OPT_SET_SIP:
+      case OPT_NOT_SET_SIP:
+        return filterSelectIPSet(checks, SRC, rwrec, selected, count);
+      case OPT_SET_DIP:
+      case OPT_NOT_SET_DIP:
+        return filterSelectIPSet(checks, DST, rwrec, selected, count);
+      case OPT_SET_NHIP:
+      case OPT_NOT_SET_NHIP:
+        return filterSelectIPSet(checks, NHIP, rwrec, selected, count);
+      case OPT_SET_ANY:
+      case OPT_NOT_SET_ANY:
+        return filterSelectIPSet(checks, ANY, rwrec, selected, count);
+      default:
+        FILTER_SELECT(filterCheckOne(checks, check_key, r));
+        break;
+    }
+
+#undef FILTER_SELECT
+
+    return n;
+}
+
+
+/*
+ *  count = filterChecksCheckBatch(checks, rwrec, rec_count, selected);
+ *
+ *    Check the 'rec_count' records in the array 'rwrec' against all
+ *    of the checks in 'checks'.  Fill 'selected', which must
+ *    have room for 'rec_count' entries, with the indexes of the
+ *    records that pass every check, in ascending order, and return
+ *    the number of those records.
+ *
+ *    Each check is applied to the block of records that passed the
+ *    checks before it, which avoids selecting the check once per
+ *    record.  While the records are being sampled to choose the
+ *    order of the checks, each record is passed to
+ *    filterChecksCheck().
+ */
+size_t
+filterChecksCheckBatch(
+    filter_checks_t    *checks,
+    const rwRec        *rwrec,
+    size_t              rec_count,
+    uint32_t           *selected)
+{
+    const uint8_t *order = FILTER_PLAN_ORDER_LOAD(checks);
+    size_t count = 0;
+    size_t i;
+    int j;
+
+    if (NULL == order) {
+        for (i = 0; i < rec_count; ++i) {
+            if (RWF_PASS == filterChecksCheck(checks, &rwrec[i])) {
+                selected[count] = (uint32_t)i;
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    for (i = 0; i < rec_count; ++i) {
+        selected[i] = (uint32_t)i;
+    }
+    count = rec_count;
+    for (j = 0; j < checks->check_count && count > 0; ++j) {
+        count = filterSelect(checks, order[j], rwrec, selected, count);
+    }
+    return count;
+}
+
+
+/*
+ *  count = filterCheckBatch(rwrec, rec_count, selected);
+ *
+ *    Check the 'rec_count' records in the array 'rwrec' against the
+ *    checks the user specified on the command line.  See
+ *    filterChecksCheckBatch().
+ */
+size_t
+filterCheckBatch(
+    const rwRec        *rwrec,
+    size_t              rec_count,
+    uint32_t           *selected)
+{
+    return filterChecksCheckBatch(&static_checks, rwrec, rec_count,
+                                  selected);
+}
+
+
+/*
+ *  name = filterCheckName(checks, check_key);
+ *
+ *    Return the name of the switch that added the check 'check_key'
+ *    to 'checks'.
+ */
+static const char *
+filterCheckName(
+    const filter_checks_t  *checks,
+    int                     check_key)
+{
+    switch (check_key) {
+      case OPT_SCIDR:
+      case OPT_DCIDR:
+      case OPT_ANY_CIDR:
+      case OPT_NHCIDR:
+        if (checks->cidr_negated[check_key - OPT_SCIDR]) {
+            check_key += IP_INDEX_COUNT;
+        }
+        break;
+      case OPT_SADDRESS:
+      case OPT_DADDRESS:
+      case OPT_ANY_ADDRESS:
+      case OPT_NEXT_HOP_ID:
+        if (checks->ipwild_negate[check_key - OPT_SADDRESS]) {
+            check_key += IP_INDEX_COUNT;
+        }
+        break;
+      case OPT_SET_SIP:
+      case OPT_SET_DIP:
+      case OPT_SET_ANY:
+      case OPT_SET_NHIP:
+        if (checks->ipset_reject[check_key - OPT_SET_SIP]) {
+            check_key += IP_INDEX_COUNT;
+        }
+        break;
+      case OPT_SENSORS:
+        return "sensor";
+      case OPT_FLOW_TYPE:
+        return "flowtype";
+      default:
+        break;
+    }
+    return filterSwitch[check_key].option.name;
+}
+
+
+/*
+ *  filterPrintPlan(stream);
+ *
+ *    Print to 'stream', or to the standard error when 'stream' is
+ *    NULL, the order in which filterCheck() ran the checks, the
+ *    relative cost of each check, and the percentage of the sampled
+ *    records that passed each check.
+ */
+void
+filterPrintPlan(
+    skstream_t         *stream)
+{
+    const uint8_t *order;
+    uint64_t sampled;
+    char line[256];
+    int i;
+    int j;
+
+    pthread_mutex_lock(&plan_mutex);
+    order = checks->plan_order;
+    sampled = checks->plan_sampled;
+    if (NULL == order) {
+        order = checks->checkSet;
+    }
+
+    if (0 == checks->check_count) {
+        snprintf(line, sizeof(line), "No partitioning checks\n");
+    } else if (order == checks->checkSet) {
+        snprintf(line, sizeof(line),
+                 ("Ran partitioning checks in command-line order;"
+                  " sampled %" PRIu64 " of %d records\n"),
+                 sampled, FILTER_PLAN_SAMPLE_RECS);
+    } else {
+        snprintf(line, sizeof(line),
+                 ("Ran partitioning checks in this order;"
+                  " sampled %" PRIu64 " records\n"),
+                 sampled);
+    }
+    if (stream) {
+        skStreamPrint(stream, "%s", line);
+    } else {
+        fprintf(stderr, "%s", line);
+    }
+
+    for (i = 0; i < checks->check_count; ++i) {
+        /* find the sample count of this check */
+        j = 0;
+        while (checks->checkSet[j] != order[i]) {
+            ++j;
+        }
+        snprintf(line, sizeof(line),
+                 "%3d  --%-20s  cost %5.1f  pass %6.2f%%\n",
+                 i + 1, filterCheckName(checks, order[i]),
+                 filterCheckCost(checks, order[i]),
+                 (sampled
+                  ? (100.0 * (double)checks->plan_pass[j] / (double)sampled)
+                  : 0.0));
+        if (stream) {
+            skStreamPrint(stream, "%s", line);
+        } else {
+            fprintf(stderr, "%s", line);
+        }
+    }
+    pthread_mutex_unlock(&plan_mutex);
+}
+
+
+/*
+ *  ipset = filterLoadIPsetIndex(stream, datafile, suffix);
+ *
+ *    Load and return the IPset index file whose name is 'datafile'
+ *    followed by 'suffix', where 'stream' is the open SiLK Flow file
+ *    'datafile'.  Return NULL when 'stream' is not a regular file or
+ *    when the index does not exist or is stale.
+ */
+static skipset_t *
+filterLoadIPsetIndex(
+    skstream_t         *stream,
+    const char         *datafile,
+    const char         *suffix)
+{
+    skipset_t *ipset;
+    struct stat stbuf;
+    int fd;
+
+    fd = skStreamGetDescriptor(stream);
+    if (-1 == fd || -1 == fstat(fd, &stbuf) || !S_ISREG(stbuf.st_mode)) {
+        return NULL;
+    }
+    if (sksiteIPsetIndexLoad(&ipset, datafile, suffix,
+                             (uint64_t)stbuf.st_size))
+    {
+        return NULL;
+    }
+    return ipset;
+}
+
+
+/*
+ *  pass = filterChecksCheckFile(checks, stream, datafile)
  *
  *    Check whether the SiLK Packed data file 'stream' contains records
- *    that match the user's query.  This function uses information
+ *    that match 'checks'.  This function uses information
  *    from the file's header and/or outside the data file---such as
- *    external IPsets or Bloom filters located in the 'ip_dir'---to
- *    see if pathname should be opened and its records read.
+ *    the IPset index files whose names are 'datafile' followed by
+ *    SKSITE_IPSET_INDEX_SIP_SUFFIX or SKSITE_IPSET_INDEX_DIP_SUFFIX
+ *    ---to see if pathname should be opened and its records read.
+ *    'datafile' may be NULL to ignore the index files.
  *
  *    Returns 1 if the file at 'pathname' should be skipped, 0 if the
  *    file should be read, and -1 on error.
  */
 int
-filterCheckFile(
-    skstream_t         *stream,
-    const char  UNUSED(*ip_dir))
+filterChecksCheckFile(
+    const filter_checks_t  *checks,
+    skstream_t             *stream,
+    const char             *datafile)
 {
+    const char *suffix_set[2] = {SKSITE_IPSET_INDEX_SIP_SUFFIX,
+                                 SKSITE_IPSET_INDEX_DIP_SUFFIX};
+    skipset_t *set[2] = {NULL, NULL};
+    int tried_set[2] = {0, 0};
     sk_header_entry_t *pfh;
     sktime_t t = -1;
     int wanted;
@@ -1434,24 +2089,17 @@ filterCheckFile(
     sk_file_header_t *hdr;
     sk_file_format_t file_format;
 
-/*
-**    char ippath[PATH_MAX];
-**    skIPSet_t *set[2] = {NULL, NULL};
-**    int tried_set[2] = {0, 0};
-**    const char *suffix_set[2] = {".sip", ".dip"};
-**
-**#define LOAD_IPSET(idx)                                         \
-**    {                                                           \
-**        if (tried_set[(idx)] == 0) {                            \
-**            tried_set[(idx)] = 1;                               \
-**            if (ip_dir != NULL) {                               \
-**                snprintf(ippath, sizeof(ippath), "%s%s",        \
-**                         ip_dir, suffix_set[(idx)]);            \
-**                skIPSetLoad(&(set[(idx)]), ippath);             \
-**            }                                                   \
-**        }                                                       \
-**    }
-*/
+    /* load the IPset index for 'idx' (SRC or DST) the first time it
+     * is needed; set[idx] remains NULL when there is no usable
+     * index */
+#define LOAD_IPSET(idx)                                                 \
+    if (tried_set[(idx)] == 0) {                                        \
+        tried_set[(idx)] = 1;                                           \
+        if (datafile != NULL) {                                         \
+            set[(idx)] = filterLoadIPsetIndex(stream, datafile,         \
+                                              suffix_set[(idx)]);       \
+        }                                                               \
+    }
 
     hdr = skStreamGetSilkHeader(stream);
     file_format = skHeaderGetFileFormat(hdr);
@@ -1515,101 +2163,82 @@ filterCheckFile(
             }
             break;
 
-/*
-**          case OPT_SADDRESS:
-**            if (set[SRC] == NULL) {
-**                LOAD_IPSET(SRC);
-**                if (set[SRC] == NULL) {
-**                    break;
-**                }
-**            }
-**            skip_file = !skIPSetCheckIPWildcard(set[SRC],
-**                                                &checks->ipwild[SRC]);
-**            break;
-**
-**          case OPT_SET_SIP:
-**#if 1
-**            if (set[SRC] == NULL) {
-**                LOAD_IPSET(SRC);
-**                if (set[SRC] == NULL) {
-**                    break;
-**                }
-**            }
-**            skip_file = !skIPSetCheckIPSet(set[SRC], checks->ipset[SRC]);
-**#else
-**            snprintf(ippath, sizeof(ippath), "%s%s",
-**                     ip_dir, suffix_set[SRC]);
-**            skip_file = skIPSetCheckIPSetFile(checks->ipset[SRC],
-**                                              ippath, NULL);
-**#endif
-**            break;
-**
-**          case OPT_DADDRESS:
-**            if (set[DST] == NULL) {
-**                LOAD_IPSET(DST);
-**                if (set[DST] == NULL) {
-**                    break;
-**                }
-**            }
-**            skip_file = !skIPSetCheckIPWildcard(set[DST],
-**                                                &checks->ipwild[DST]);
-**            break;
-**
-**          case OPT_SET_DIP:
-**#if 1
-**            if (set[DST] == NULL) {
-**                LOAD_IPSET(DST);
-**                if (set[DST] == NULL) {
-**                    break;
-**                }
-**            }
-**            skip_file = !skIPSetCheckIPSet(set[DST], checks->ipset[DST]);
-**#else
-**            snprintf(ippath, sizeof(ippath), "%s%s",
-**                     ip_dir, suffix_set[DST]);
-**            skip_file = skIPSetCheckIPSetFile(checks->ipset[DST],
-**                                              ippath, NULL);
-**#endif
-**            break;
-**
-**          case OPT_ANY_ADDRESS:
-**            if (set[SRC] == NULL) {
-**                LOAD_IPSET(SRC);
-**            }
-**            if (set[SRC]) {
-**                wanted = skIPSetCheckIPWildcard(set[SRC],
-**                                                &checks->ipwild[ANY]);
-**                if (wanted == 1) {
-**                    break;
-**                }
-**            }
-**            if (set[DST] == NULL) {
-**                LOAD_IPSET(DST);
-**            }
-**            if (set[DST]) {
-**                skip_file =
-**                    !skIPSetCheckIPWildcard(set[DST], &checks->ipwild[ANY]);
-**            }
-**            break;
-**
-**          case OPT_SET_ANY:
-**            if (set[SRC] == NULL) {
-**                LOAD_IPSET(SRC);
-**            }
-**            if (set[SRC]) {
-**                wanted = skIPSetCheckIPSet(set[SRC], checks->ipset[ANY]);
-**                if (wanted == 1) {
-**                    break;
-**                }
-**            }
-**            if (set[DST] == NULL) {
-**                LOAD_IPSET(DST);
-**            }
-**            if (set[DST]) {
-**                skip_file = !skIPSetCheckIPSet(set[DST], checks->ipset[ANY]);
-**            }
-**            break;
-*/
+          case OPT_SADDRESS:
+            if (checks->ipwild_negate[SRC]) {
+                break;
+            }
+            LOAD_IPSET(SRC);
+            if (set[SRC]) {
+                skip_file = !skIPSetCheckIPWildcard(set[SRC],
+                                                    &checks->ipwild[SRC]);
+            }
+            break;
+
+          case OPT_SET_SIP:
+            if (checks->ipset_reject[SRC]) {
+                break;
+            }
+            LOAD_IPSET(SRC);
+            if (set[SRC]) {
+                skip_file = !skIPSetCheckIPSet(set[SRC], checks->ipset[SRC]);
+            }
+            break;
+
+          case OPT_DADDRESS:
+            if (checks->ipwild_negate[DST]) {
+                break;
+            }
+            LOAD_IPSET(DST);
+            if (set[DST]) {
+                skip_file = !skIPSetCheckIPWildcard(set[DST],
+                                                    &checks->ipwild[DST]);
+            }
+            break;
+
+          case OPT_SET_DIP:
+            if (checks->ipset_reject[DST]) {
+                break;
+            }
+            LOAD_IPSET(DST);
+            if (set[DST]) {
+                skip_file = !skIPSetCheckIPSet(set[DST], checks->ipset[DST]);
+            }
+            break;
+
+          case OPT_ANY_ADDRESS:
+            /* skip the file only when neither index contains an
+             * address that matches */
+            if (checks->ipwild_negate[ANY]) {
+                break;
+            }
+            LOAD_IPSET(SRC);
+            if (NULL == set[SRC]
+                || skIPSetCheckIPWildcard(set[SRC], &checks->ipwild[ANY]))
+            {
+                break;
+            }
+            LOAD_IPSET(DST);
+            if (set[DST]) {
+                skip_file
+                    = !skIPSetCheckIPWildcard(set[DST], &checks->ipwild[ANY]);
+            }
+            break;
+
+          case OPT_SET_ANY:
+            if (checks->ipset_reject[ANY]) {
+                break;
+            }
+            LOAD_IPSET(SRC);
+            if (NULL == set[SRC]
+                || skIPSetCheckIPSet(set[SRC], checks->ipset[ANY]))
+            {
+                break;
+            }
+            LOAD_IPSET(DST);
+            if (set[DST]) {
+                skip_file = !skIPSetCheckIPSet(set[DST], checks->ipset[ANY]);
+            }
+            break;
 
           case OPT_NEXT_HOP_ID:
             {
@@ -1824,19 +2453,157 @@ filterCheckFile(
         }
     }
 
-/*
-**    if (set[SRC]) {
-**        skIPSetDelete(&set[SRC]);
-**    }
-**    if (set[DST]) {
-**        skIPSetDelete(&set[DST]);
-**    }
-*/
+#undef LOAD_IPSET
+
+    skIPSetDestroy(&set[SRC]);
+    skIPSetDestroy(&set[DST]);
 
     return skip_file;
 }
 
 
+/*
+ *  pass = filterCheckFile(stream, datafile)
+ *
+ *    Check whether the SiLK Packed data file 'stream' contains records
+ *    that match the checks the user specified on the command line.
+ *    See filterChecksCheckFile().
+ */
+int
+filterCheckFile(
+    skstream_t         *stream,
+    const char         *datafile)
+{
+    return filterChecksCheckFile(&static_checks, stream, datafile);
+}
+
+
+/*
+ *  overlap = filterCheckBlockCIDR(idx, min_ip, max_ip);
+ *
+ *    Return 1 if any of the CIDR blocks in the list at 'idx' in
+ *    checks->cidr_list overlaps the range from 'min_ip' to 'max_ip',
+ *    inclusive.  Return 0 otherwise.
+ */
+static int
+filterCheckBlockCIDR(
+    int                 idx,
+    const skipaddr_t   *min_ip,
+    const skipaddr_t   *max_ip)
+{
+    const skcidr_t *cidr;
+    skipaddr_t cidr_min;
+    skipaddr_t cidr_max;
+    skipaddr_t ip;
+    unsigned int i;
+
+    for (i = 0, cidr = checks->cidr_list[idx];
+         i < checks->cidr_list_len[idx];
+         ++i, ++cidr)
+    {
+        skcidrGetIPAddr(cidr, &ip);
+        skCIDR2IPRange(&ip, skcidrGetLength(cidr), &cidr_min, &cidr_max);
+        if (skipaddrCompare(&cidr_min, max_ip) <= 0
+            && skipaddrCompare(&cidr_max, min_ip) >= 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ *  wanted = filterCheckBlock(summary, skipped_count);
+ *
+ *    Check whether the compressed block of a SiLK Flow file described
+ *    by 'summary' may contain records that match the user's query.
+ *    This is the callback given to skStreamSetBlockPredicate().  Only
+ *    the checks whose ranges can be compared to the summary are
+ *    consulted: the times, the protocol, and the CIDR blocks.
+ *
+ *    Return 0 if every record in the block fails the checks, and add
+ *    the number of records in the block to the uint64_t referenced
+ *    by 'skipped_count'.  Return 1 otherwise.
+ */
+int
+filterCheckBlock(
+    const sk_block_summary_t   *summary,
+    void                       *skipped_count)
+{
+    int wanted = 1;
+    int j;
+
+    for (j = 0; wanted && j < checks->check_count; ++j) {
+        switch (checks->checkSet[j]) {
+          case OPT_STIME:
+            wanted = ((uint64_t)summary->stime_max >= checks->sTime.min
+                      && (uint64_t)summary->stime_min <= checks->sTime.max);
+            break;
+
+          case OPT_ETIME:
+            wanted = ((uint64_t)summary->etime_max >= checks->eTime.min
+                      && (uint64_t)summary->etime_min <= checks->eTime.max);
+            break;
+
+          case OPT_ACTIVE_TIME:
+            wanted = (((uint64_t)summary->stime_min
+                       <= checks->active_time.max)
+                      && ((uint64_t)summary->etime_max
+                          >= checks->active_time.min));
+            break;
+
+          case OPT_PROTOCOL:
+            {
+                unsigned int proto;
+                wanted = 0;
+                for (proto = 0; proto < MAX_PROTOCOLS; ++proto) {
+                    if ((summary->protocols[proto >> 3]
+                         & (1 << (proto & 0x7)))
+                        && skBitmapGetBit(checks->proto, proto))
+                    {
+                        wanted = 1;
+                        break;
+                    }
+                }
+            }
+            break;
+
+          case OPT_SCIDR:
+            if (!checks->cidr_negated[SRC]) {
+                wanted = filterCheckBlockCIDR(SRC, &summary->sip_min,
+                                              &summary->sip_max);
+            }
+            break;
+
+          case OPT_DCIDR:
+            if (!checks->cidr_negated[DST]) {
+                wanted = filterCheckBlockCIDR(DST, &summary->dip_min,
+                                              &summary->dip_max);
+            }
+            break;
+
+          case OPT_ANY_CIDR:
+            if (!checks->cidr_negated[ANY]) {
+                wanted = (filterCheckBlockCIDR(ANY, &summary->sip_min,
+                                               &summary->sip_max)
+                          || filterCheckBlockCIDR(ANY, &summary->dip_min,
+                                                  &summary->dip_max));
+            }
+            break;
+
+          default:
+            break;
+        }
+    }
+
+    if (!wanted) {
+        *((uint64_t*)skipped_count) += summary->rec_count;
+    }
+    return wanted;
+}
+
+
 /*
  * int filterSetup()
  *
@@ -1902,12 +2669,13 @@ filterSetup(
 
 
 /*
- * void filterTeardown()
+ *  filterChecksClear(checks);
  *
+ *    Free the bitmaps, IPsets, and CIDR lists that 'checks' owns.
  */
-void
-filterTeardown(
-    void)
+static void
+filterChecksClear(
+    filter_checks_t    *checks)
 {
     int i;
 
@@ -1981,6 +2749,18 @@ filterTeardown(
             checks->cidr_list[i] = NULL;
         }
     }
+}
+
+
+/*
+ * void filterTeardown()
+ *
+ */
+void
+filterTeardown(
+    void)
+{
+    filterChecksClear(&static_checks);
     if (filterOptions) {
         free(filterOptions);
         filterOptions = NULL;
@@ -1993,11 +2773,98 @@ filterTeardown(
 int
 filterGetCheckCount(
     void)
+{
+    return static_checks.check_count;
+}
+
+
+/*
+ *  status = filterChecksCreate(&new_checks);
+ *
+ *    Create a set of checks that is separate from the checks given
+ *    on the command line and store it in the location referenced by
+ *    'new_checks'.  Use filterChecksParseOption() to add checks to
+ *    it.  Return 0 on success, or -1 if memory cannot be allocated.
+ */
+int
+filterChecksCreate(
+    filter_checks_t   **new_checks)
+{
+    *new_checks = (filter_checks_t*)calloc(1, sizeof(filter_checks_t));
+    if (NULL == *new_checks) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ *  filterChecksDestroy(&checks);
+ *
+ *    Free all memory associated with the set of checks at 'checks'
+ *    and set 'checks' to NULL.  Do nothing if 'checks' is NULL.
+ */
+void
+filterChecksDestroy(
+    filter_checks_t   **checks_ptr)
+{
+    if (checks_ptr && *checks_ptr) {
+        filterChecksClear(*checks_ptr);
+        free(*checks_ptr);
+        *checks_ptr = NULL;
+    }
+}
+
+
+/*
+ *  status = filterChecksParseOption(checks, opt_index, opt_arg);
+ *
+ *    Add to 'checks' the check for the partitioning switch at
+ *    position 'opt_index' of the array returned by
+ *    filterGetOptions(), where 'opt_arg' is the switch's argument.
+ *    Return 0 on success or 1 on failure.
+ */
+int
+filterChecksParseOption(
+    filter_checks_t    *new_checks,
+    int                 opt_index,
+    char               *opt_arg)
+{
+    int rv;
+
+    assert(opt_index >= 0 && opt_index < OPT_SENSORS);
+
+    checks = new_checks;
+    rv = filterOptionsHandler(NULL, opt_index, opt_arg);
+    checks = &static_checks;
+    return rv;
+}
+
+
+/* Return number of checks in 'checks'. */
+int
+filterChecksGetCount(
+    const filter_checks_t  *checks)
 {
     return checks->check_count;
 }
 
 
+/*
+ *  options = filterGetOptions();
+ *
+ *    Return the array of partitioning switches, which is terminated
+ *    by an entry whose name is NULL.  The 'val' member of each entry
+ *    is its position in the array.
+ */
+const struct option *
+filterGetOptions(
+    void)
+{
+    return filterOptions;
+}
+
+
 /*
  *  status = filterGetFGlobFilters();
  *
@@ -0,0 +1,1010 @@
+/*
+** Copyright (C) 2020 by Carnegie Mellon University.
+**
+** @OPENSOURCE_LICENSE_START@
+** See license information in ../../LICENSE.txt
+** @OPENSOURCE_LICENSE_END@
+*/
+
+/*
+**    The rwfilterquery.c file adds the --query-file switch, which
+**    runs several named queries over one pass of the input files.
+**    Each line of the query file contains the name of a query
+**    followed by the partitioning switches and the outputs of that
+**    query; for example:
+**
+**        web   --proto=6 --aport=80,443 --pass=web.rw
+**        dns   --proto=17 --aport=53 --pass=dns.rw --fail=nodns.rw
+**
+**    Each query has its own set of checks (see filterChecksCreate())
+**    and its own pass and fail destinations.  The checks given on the
+**    command line, including the --tuple-* switches, the plug-ins,
+**    and the --sensor/--class/--type selection switches, are applied
+**    to each record first; a record that fails them fails every
+**    query.
+**
+**    The queries are evaluated by one thread, since the records of
+**    a block are handed to each query in turn.
+*/
+
+
+#include <silk/silk.h>
+
+RCSIDENT("$SiLK: rwfilterquery.c $");
+
+#include <silk/skstream.h>
+#include "rwfilter.h"
+
+
+/* DEFINES AND TYPEDEFS */
+
+/* maximum length of a line in the query file */
+#define QUERY_LINE_MAX  8192
+
+/* maximum number of words on a line in the query file */
+#define QUERY_MAX_ARGS  256
+
+/* offsets added to the 'val' members of the partitioning switches
+ * and of queryLineOptions[] when both are given to getopt_long() */
+#define QUERY_FILTER_OPTION_OFFSET  256
+#define QUERY_LINE_OPTION_OFFSET    1024
+
+/* a single query */
+typedef struct query_st {
+    /* the name of the query, used when printing statistics */
+    char               *name;
+    /* the partitioning checks of the query */
+    filter_checks_t    *checks;
+    /* the pass and fail destinations of the query */
+    dest_type_t         dest_type[DESTINATION_TYPES];
+    /* the records that passed the query */
+    rec_count_t         pass;
+    /* the number of records written to the fail destinations */
+    uint64_t            fail_written;
+    /* whether every record in the current file fails the query */
+    int                 fail_entire_file;
+    /* whether the query no longer needs to see records */
+    int                 done;
+} query_t;
+
+
+/* LOCAL VARIABLES */
+
+/* the file named by --query-file */
+static const char *query_path = NULL;
+
+/* the queries read from the query file */
+static query_t *query = NULL;
+static int query_count = 0;
+
+/* whether the query file has been parsed; -1 if there was an error */
+static int query_parsed = 0;
+
+
+/* OPTIONS SETUP */
+
+typedef enum {
+    OPT_QUERY_FILE
+} queryOptionsEnum;
+
+static struct option queryOptions[] = {
+    {"query-file",          REQUIRED_ARG, 0, OPT_QUERY_FILE},
+    {0, 0, 0, 0}            /* sentinel */
+};
+
+static const char *queryOptionsHelp[] = {
+    ("Read named queries from this file, one per line, and\n"
+     "\tevaluate all of them in a single pass over the input. Each line\n"
+     "\tholds a name followed by partitioning switches and the query's\n"
+     "\t--pass-destination, --fail-destination, --max-pass-records, and\n"
+     "\t--max-fail-records. Def. No"),
+    (char*)NULL
+};
+
+/* switches that may appear on a line of the query file in addition
+ * to the partitioning switches */
+typedef enum {
+    QOPT_PASS_DEST, QOPT_FAIL_DEST,
+    QOPT_MAX_PASS_RECORDS, QOPT_MAX_FAIL_RECORDS
+} queryLineOptionsEnum;
+
+static struct option queryLineOptions[] = {
+    {"pass-destination",    REQUIRED_ARG, 0, QOPT_PASS_DEST},
+    {"fail-destination",    REQUIRED_ARG, 0, QOPT_FAIL_DEST},
+    {"max-pass-records",    REQUIRED_ARG, 0, QOPT_MAX_PASS_RECORDS},
+    {"max-fail-records",    REQUIRED_ARG, 0, QOPT_MAX_FAIL_RECORDS},
+    {0, 0, 0, 0}            /* sentinel */
+};
+
+
+/* LOCAL FUNCTION DECLARATIONS */
+
+static int queryAddDestination(query_t *q, int dest_id, const char *path);
+static int queryCloseDests(query_t *q, int dest_id);
+static int queryOptionsHandler(clientData cData, int opt_index, char *opt_arg);
+static int queryParseFile(void);
+static int queryParseLine(struct option *line_opts, char *line);
+
+
+/* FUNCTION DEFINITIONS */
+
+/*
+ *  ok = querySetup();
+ *
+ *    Setup the query module and register its options.  Return 0 on
+ *    success, or non-zero on error.
+ */
+int
+querySetup(
+    void)
+{
+    /* verify same number of options and help strings */
+    assert((sizeof(queryOptions)/sizeof(struct option))
+           == (sizeof(queryOptionsHelp)/sizeof(char*)));
+
+    /* register the options */
+    if (skOptionsRegister(queryOptions, &queryOptionsHandler, NULL)) {
+        skAppPrintErr("Unable to register query options");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/*
+ *  queryTeardown();
+ *
+ *    Teardown the module: close the outputs of the queries and free
+ *    all memory the module uses.
+ */
+void
+queryTeardown(
+    void)
+{
+    int i;
+
+    for (i = 0; i < query_count; ++i) {
+        queryCloseDests(&query[i], DEST_PASS);
+        queryCloseDests(&query[i], DEST_FAIL);
+        filterChecksDestroy(&query[i].checks);
+        free(query[i].name);
+    }
+    free(query);
+    query = NULL;
+    query_count = 0;
+}
+
+
+/*
+ *  queryUsage(fh);
+ *
+ *    Print the --help output for the options this module supports to
+ *    the file handle 'fh'.
+ */
+void
+queryUsage(
+    FILE               *fh)
+{
+    int i;
+
+    fprintf(fh, "\nMULTI-QUERY SWITCHES:\n\n");
+    for (i = 0; queryOptions[i].name != NULL; ++i) {
+        fprintf(fh, "--%s %s. %s\n", queryOptions[i].name,
+                SK_OPTION_HAS_ARG(queryOptions[i]), queryOptionsHelp[i]);
+    }
+}
+
+
+/*
+ *  ok = queryOptionsHandler(cData, opt_index, opt_arg);
+ *
+ *    The options handler for the switches that this file registers.
+ *    Returns 0 on success or 1 on failure.
+ */
+static int
+queryOptionsHandler(
+    clientData   UNUSED(cData),
+    int                 opt_index,
+    char               *opt_arg)
+{
+    switch ((queryOptionsEnum)opt_index) {
+      case OPT_QUERY_FILE:
+        if (query_path) {
+            skAppPrintErr("Invalid %s: Switch used multiple times",
+                          queryOptions[opt_index].name);
+            return 1;
+        }
+        query_path = opt_arg;
+        break;
+    }
+
+    return 0;
+}
+
+
+/*
+ *  count = queryGetCount();
+ *
+ *    Return the number of queries in the file given to --query-file,
+ *    0 if the switch was not given, or -1 on error.  The first call
+ *    parses the file and creates the outputs of the queries.
+ */
+int
+queryGetCount(
+    void)
+{
+    if (NULL == query_path) {
+        return 0;
+    }
+    if (0 == query_parsed) {
+        query_parsed = ((queryParseFile() == 0) ? 1 : -1);
+    }
+    if (query_parsed < 0) {
+        return -1;
+    }
+    return query_count;
+}
+
+
+/*
+ *  status = queryParseFile();
+ *
+ *    Read the queries from the file 'query_path'.  Return 0 on
+ *    success, or -1 on error.
+ */
+static int
+queryParseFile(
+    void)
+{
+    const struct option *filter_opts;
+    struct option *line_opts = NULL;
+    char line[QUERY_LINE_MAX];
+    skstream_t *stream = NULL;
+    const char *path;
+    int stdout_used;
+    destination_t *dest;
+    int dest_id;
+    int lc = 0;
+    int count;
+    int i;
+    int j;
+    int rv = -1;
+
+    /* create the switches for a line: the partitioning switches
+     * followed by queryLineOptions[] */
+    filter_opts = filterGetOptions();
+    count = 0;
+    while (filter_opts[count].name) {
+        ++count;
+    }
+    line_opts = ((struct option*)
+                 calloc(count + (sizeof(queryLineOptions)
+                                 / sizeof(struct option)),
+                        sizeof(struct option)));
+    if (NULL == line_opts) {
+        skAppPrintOutOfMemory(NULL);
+        return -1;
+    }
+    for (i = 0; i < count; ++i) {
+        line_opts[i] = filter_opts[i];
+        line_opts[i].val = QUERY_FILTER_OPTION_OFFSET + i;
+    }
+    for (j = 0; queryLineOptions[j].name; ++i, ++j) {
+        line_opts[i] = queryLineOptions[j];
+        line_opts[i].val = QUERY_LINE_OPTION_OFFSET + queryLineOptions[j].val;
+    }
+
+    if ((rv = skStreamCreate(&stream, SK_IO_READ, SK_CONTENT_TEXT))
+        || (rv = skStreamBind(stream, query_path))
+        || (rv = skStreamSetCommentStart(stream, "#"))
+        || (rv = skStreamOpen(stream)))
+    {
+        skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+        rv = -1;
+        goto END;
+    }
+
+    rv = -1;
+    while ((i = skStreamGetLine(stream, line, sizeof(line), &lc))
+           != SKSTREAM_ERR_EOF)
+    {
+        if (i != SKSTREAM_OK) {
+            if (i == SKSTREAM_ERR_LONG_LINE) {
+                skAppPrintErr("Line %d of query file '%s' is too long",
+                              lc, query_path);
+            } else {
+                skStreamPrintLastErr(stream, i, &skAppPrintErr);
+            }
+            goto END;
+        }
+        if (queryParseLine(line_opts, line)) {
+            skAppPrintErr("Error parsing line %d of query file '%s'",
+                          lc, query_path);
+            goto END;
+        }
+    }
+
+    if (0 == query_count) {
+        skAppPrintErr("No queries were read from query file '%s'",
+                      query_path);
+        goto END;
+    }
+
+    /* only one output may use the standard output, and none may use
+     * the standard error */
+    stdout_used = 0;
+    if (print_stat) {
+        path = skStreamGetPathname(print_stat);
+        stdout_used = (0 == strcmp(path, "stdout") || 0 == strcmp(path, "-"));
+    }
+    for (i = 0; i < query_count; ++i) {
+        for (dest_id = DEST_PASS; dest_id <= DEST_FAIL; ++dest_id) {
+            for (dest = query[i].dest_type[dest_id].dest_list;
+                 dest != NULL;
+                 dest = dest->next)
+            {
+                path = skStreamGetPathname(dest->stream);
+                if (0 == strcmp(path, "stderr")) {
+                    skAppPrintErr(("Invalid destination of query '%s':"
+                                   " Will not write binary data to the"
+                                   " standard error"),
+                                  query[i].name);
+                    goto END;
+                }
+                if (0 == strcmp(path, "stdout") || 0 == strcmp(path, "-")) {
+                    if (stdout_used) {
+                        skAppPrintErr(("Invalid destination of query '%s':"
+                                       " The standard output is already"
+                                       " allocated"),
+                                      query[i].name);
+                        goto END;
+                    }
+                    stdout_used = 1;
+                }
+            }
+        }
+    }
+
+    rv = 0;
+
+  END:
+    skStreamDestroy(&stream);
+    free(line_opts);
+    return rv;
+}
+
+
+/*
+ *  status = queryParseLine(line_opts, line);
+ *
+ *    Parse 'line', a line from the query file, and append the query it
+ *    describes to the global 'query' array, where 'line_opts' holds the
+ *    switches that may appear on the line.  Do nothing when 'line'
+ *    contains only whitespace.  Return 0 on success or -1 on failure.
+ */
+static int
+queryParseLine(
+    struct option      *line_opts,
+    char               *line)
+{
+    char *argv[QUERY_MAX_ARGS + 1];
+    query_t *new_query;
+    query_t *q;
+    char *cp;
+    int argc;
+    int opt_index;
+    int c;
+    int i;
+    int rv;
+
+    /* split the line into words; argv[0] is the name of the
+     * application so getopt_long() may print errors */
+    argv[0] = (char*)skAppName();
+    argc = 1;
+    cp = line;
+    for (;;) {
+        while (isspace((int)*cp)) {
+            ++cp;
+        }
+        if ('\0' == *cp) {
+            break;
+        }
+        if (argc == QUERY_MAX_ARGS) {
+            skAppPrintErr("Query has more than %d words", QUERY_MAX_ARGS);
+            return -1;
+        }
+        argv[argc++] = cp;
+        while (*cp && !isspace((int)*cp)) {
+            ++cp;
+        }
+        if (*cp) {
+            *cp++ = '\0';
+        }
+    }
+    argv[argc] = NULL;
+    if (1 == argc) {
+        return 0;
+    }
+
+    /* the first word is the name of the query */
+    if ('-' == argv[1][0]) {
+        skAppPrintErr("Query does not begin with a name: '%s'", argv[1]);
+        return -1;
+    }
+    for (i = 0; i < query_count; ++i) {
+        if (0 == strcmp(query[i].name, argv[1])) {
+            skAppPrintErr("Query name '%s' is used multiple times",
+                          argv[1]);
+            return -1;
+        }
+    }
+
+    new_query = (query_t*)realloc(query, (query_count + 1) * sizeof(query_t));
+    if (NULL == new_query) {
+        skAppPrintOutOfMemory(NULL);
+        return -1;
+    }
+    query = new_query;
+    q = &query[query_count];
+    memset(q, 0, sizeof(query_t));
+    q->name = strdup(argv[1]);
+    if (NULL == q->name || filterChecksCreate(&q->checks)) {
+        skAppPrintOutOfMemory(NULL);
+        free(q->name);
+        return -1;
+    }
+    ++query_count;
+
+    /* the remaining words are switches; shift them so they begin at
+     * argv[1] */
+    for (i = 1; i < argc; ++i) {
+        argv[i] = argv[i + 1];
+    }
+    --argc;
+
+#ifdef SK_USE_OPTRESET
+    optreset = 1;
+#endif
+#ifdef SK_HAVE_GETOPT_LONG_ONLY
+    optind = 1;
+#else
+    optind = 0;
+#endif
+    for (;;) {
+#ifdef SK_HAVE_GETOPT_LONG_ONLY
+        c = getopt_long_only(argc, argv, "", line_opts, &opt_index);
+#else
+        c = _getopt_internal(argc, argv, "", line_opts, &opt_index, 1);
+#endif
+        if (-1 == c) {
+            break;
+        }
+        if (c < QUERY_FILTER_OPTION_OFFSET) {
+            /* getopt_long() printed the error */
+            return -1;
+        }
+        if (c < QUERY_LINE_OPTION_OFFSET) {
+            if (filterChecksParseOption(q->checks,
+                                        c - QUERY_FILTER_OPTION_OFFSET,
+                                        optarg))
+            {
+                return -1;
+            }
+            continue;
+        }
+        switch ((queryLineOptionsEnum)(c - QUERY_LINE_OPTION_OFFSET)) {
+          case QOPT_PASS_DEST:
+            if (queryAddDestination(q, DEST_PASS, optarg)) {
+                return -1;
+            }
+            break;
+
+          case QOPT_FAIL_DEST:
+            if (queryAddDestination(q, DEST_FAIL, optarg)) {
+                return -1;
+            }
+            break;
+
+          case QOPT_MAX_PASS_RECORDS:
+          case QOPT_MAX_FAIL_RECORDS:
+            rv = skStringParseUint64(
+                &(q->dest_type[((QOPT_MAX_PASS_RECORDS
+                                 == c - QUERY_LINE_OPTION_OFFSET)
+                                ? DEST_PASS : DEST_FAIL)].max_records),
+                optarg, 0, 0);
+            if (rv) {
+                skAppPrintErr("Invalid %s '%s': %s",
+                              line_opts[opt_index].name, optarg,
+                              skStringParseStrerror(rv));
+                return -1;
+            }
+            break;
+        }
+    }
+    if (optind < argc) {
+        skAppPrintErr("Unexpected argument '%s' in query '%s'",
+                      argv[optind], q->name);
+        return -1;
+    }
+
+    if (0 == filterChecksGetCount(q->checks)) {
+        skAppPrintErr("Query '%s' has no partitioning switches", q->name);
+        return -1;
+    }
+    if (0 == q->dest_type[DEST_PASS].count
+        && 0 == q->dest_type[DEST_FAIL].count
+        && NULL == print_stat)
+    {
+        skAppPrintErr("Query '%s' has no output", q->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ *  status = queryAddDestination(q, dest_id, path);
+ *
+ *    Create a stream that writes to 'path' and append it to the
+ *    destinations of type 'dest_id' of query 'q'.  Return 0 on
+ *    success or -1 on failure.
+ */
+static int
+queryAddDestination(
+    query_t            *q,
+    int                 dest_id,
+    const char         *path)
+{
+    destination_t *dest;
+    destination_t **end;
+    int rv;
+
+    dest = (destination_t*)calloc(1, sizeof(destination_t));
+    if (dest == NULL) {
+        skAppPrintOutOfMemory(NULL);
+        return -1;
+    }
+    if ((rv = skStreamCreate(&dest->stream, SK_IO_WRITE,
+                             SK_CONTENT_SILK_FLOW))
+        || (rv = skStreamBind(dest->stream, path)))
+    {
+        skStreamPrintLastErr(dest->stream, rv, &skAppPrintErr);
+        skStreamDestroy(&dest->stream);
+        free(dest);
+        return -1;
+    }
+
+    ++q->dest_type[dest_id].count;
+    end = &q->dest_type[dest_id].dest_list;
+    while (*end != NULL) {
+        end = &((*end)->next);
+    }
+    *end = dest;
+    return 0;
+}
+
+
+/*
+ *  status = queryOpenOutputs(comp_method);
+ *
+ *    Open the outputs of every query, using 'comp_method' to compress
+ *    the records.  Return 0 on success or -1 on failure.
+ */
+int
+queryOpenOutputs(
+    sk_compmethod_t     comp_method)
+{
+    destination_t *dest;
+    int dest_id;
+    int i;
+    int rv;
+
+    for (i = 0; i < query_count; ++i) {
+        for (dest_id = DEST_PASS; dest_id <= DEST_FAIL; ++dest_id) {
+            for (dest = query[i].dest_type[dest_id].dest_list;
+                 dest != NULL;
+                 dest = dest->next)
+            {
+                rv = skHeaderSetCompressionMethod(
+                    skStreamGetSilkHeader(dest->stream), comp_method);
+                if (rv == SKSTREAM_OK) {
+                    rv = skStreamOpen(dest->stream);
+                }
+                if (rv) {
+                    skStreamPrintLastErr(dest->stream, rv, &skAppPrintErr);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+
+/*
+ *  status = queryWriteHeaders(in_hdr);
+ *
+ *    Write the header to each output of every query.  See
+ *    writeStreamHeader().  Return SKSTREAM_OK on success or an
+ *    skstream error code on failure.
+ */
+int
+queryWriteHeaders(
+    const sk_file_header_t *in_hdr)
+{
+    destination_t *dest;
+    int dest_id;
+    int i;
+    int rv;
+
+    for (i = 0; i < query_count; ++i) {
+        for (dest_id = DEST_PASS; dest_id <= DEST_FAIL; ++dest_id) {
+            for (dest = query[i].dest_type[dest_id].dest_list;
+                 dest != NULL;
+                 dest = dest->next)
+            {
+                rv = writeStreamHeader(dest->stream, in_hdr);
+                if (rv) {
+                    return rv;
+                }
+            }
+        }
+    }
+    return SKSTREAM_OK;
+}
+
+
+/*
+ *  status = queryCloseDests(q, dest_id);
+ *
+ *    Close and destroy the destinations of type 'dest_id' of query
+ *    'q'.  Return 0 if they all closed cleanly, or non-zero if there
+ *    was an error closing any stream.
+ */
+static int
+queryCloseDests(
+    query_t            *q,
+    int                 dest_id)
+{
+    destination_t *dest;
+    destination_t *next_dest;
+    int rv = 0;
+    int io_rv;
+
+    for (dest = q->dest_type[dest_id].dest_list; dest; dest = next_dest) {
+        next_dest = dest->next;
+        io_rv = skStreamClose(dest->stream);
+        switch (io_rv) {
+          case SKSTREAM_OK:
+          case SKSTREAM_ERR_NOT_OPEN:
+          case SKSTREAM_ERR_CLOSED:
+            break;
+          default:
+            rv |= io_rv;
+            skStreamPrintLastErr(dest->stream, io_rv, &skAppPrintErr);
+            break;
+        }
+        skStreamDestroy(&dest->stream);
+        free(dest);
+    }
+    q->dest_type[dest_id].dest_list = NULL;
+    q->dest_type[dest_id].count = 0;
+
+    return rv;
+}
+
+
+/*
+ *  status = queryWriteRecord(q, dest_id, rwrec);
+ *
+ *    Write 'rwrec' to each destination of type 'dest_id' of query
+ *    'q'.  A destination whose reader has gone away is closed.  Close
+ *    all of the destinations of that type once the query's maximum
+ *    number of records has been written.  Return 0 on success or -1
+ *    on a fatal error.
+ */
+static int
+queryWriteRecord(
+    query_t            *q,
+    int                 dest_id,
+    const rwRec        *rwrec)
+{
+    dest_type_t *d_type = &q->dest_type[dest_id];
+    destination_t **dest_prev;
+    destination_t *dest;
+    uint64_t written;
+    int rv;
+
+    dest_prev = &d_type->dest_list;
+    while ((dest = *dest_prev) != NULL) {
+        rv = skStreamWriteRecord(dest->stream, rwrec);
+        if (!SKSTREAM_ERROR_IS_FATAL(rv)) {
+            dest_prev = &dest->next;
+        } else if (skStreamGetLastErrno(dest->stream) == EPIPE) {
+            /* quietly close this one stream */
+            *dest_prev = dest->next;
+            skStreamDestroy(&dest->stream);
+            free(dest);
+            --d_type->count;
+        } else {
+            skStreamPrintLastErr(dest->stream, rv, &skAppPrintErr);
+            return -1;
+        }
+    }
+
+    if (DEST_PASS == dest_id) {
+        written = q->pass.flows;
+    } else {
+        written = ++q->fail_written;
+    }
+    if (written == d_type->max_records) {
+        queryCloseDests(q, dest_id);
+    }
+    return 0;
+}
+
+
+/*
+ *  ok = queryFilterFile(datafile, ipfile_basename, stats);
+ *
+ *    Read the records in 'datafile' and give them to every query.
+ *    The function will call the function to write the header if
+ *    required.  The 'ipfile_basename' is passed to filterCheckFile()
+ *    and filterChecksCheckFile().  The 'stats' are updated with the
+ *    number of records read and the number that pass the checks from
+ *    the command line.  Return 0 on success; 1 if the input file
+ *    could not be opened or read; or -1 on a fatal error.
+ *
+ *    NOTE: The function filterFile() in rwfilter.c does similar work
+ *    when there are no queries.
+ */
+int
+queryFilterFile(
+    const char         *datafile,
+    const char         *ipfile_basename,
+    filter_stats_t     *stats)
+{
+    rwRec inbuf[FILTER_READ_RECS];
+    rwRec prebuf[FILTER_READ_RECS];
+    uint32_t pre_index[FILTER_READ_RECS];
+    uint32_t selected[FILTER_READ_RECS];
+    const rwRec *recs;
+    size_t in_count;
+    size_t pre_count;
+    size_t sel_count;
+    size_t sel_pos;
+    size_t r;
+    skstream_t *in_stream;
+    query_t *q;
+    int fail_entire_file;
+    int result;
+    int live;
+    int any_fail_dest;
+    int i;
+    int k;
+    uint64_t skipped_flows = 0;
+    int rv = SKSTREAM_OK;
+    int in_rv = SKSTREAM_OK;
+
+    /* nothing to do in dry-run mode but print the file names */
+    if (dryrun_fp) {
+        fprintf(dryrun_fp, "%s\n", datafile);
+        return 0;
+    }
+
+    if (!reading_records) {
+        return 0;
+    }
+
+    /* print filenames if requested */
+    if (filenames_fp) {
+        fprintf(filenames_fp, "%s\n", datafile);
+    }
+
+    /* open the input file */
+    in_rv = skStreamOpenSilkFlow(&in_stream, datafile, SK_IO_READ);
+    if (in_rv) {
+        goto END;
+    }
+
+    ++stats->files;
+
+    if (stats->files == 1) {
+        /* first file, print the headers to the output file(s) */
+        rv = writeHeaders(in_stream);
+        if (rv) {
+            goto END;
+        }
+    }
+
+    /* determine which queries fail every record in the file.  when no
+     * query passes any record and none writes the records that fail,
+     * the file can be handled more efficiently */
+    fail_entire_file = (filterCheckFile(in_stream, ipfile_basename) == 1);
+    live = 0;
+    any_fail_dest = 0;
+    for (i = 0, q = query; i < query_count; ++i, ++q) {
+        if (q->done) {
+            continue;
+        }
+        q->fail_entire_file
+            = (fail_entire_file
+               || (filterChecksCheckFile(q->checks, in_stream,
+                                         ipfile_basename) == 1));
+        live += !q->fail_entire_file;
+        any_fail_dest += q->dest_type[DEST_FAIL].count;
+    }
+    if (0 == live && 0 == any_fail_dest) {
+        if (print_stat == NULL) {
+            goto END;
+        }
+        if (print_volume_stats == 0) {
+            size_t skipped = 0;
+            in_rv = skStreamSkipRecords(in_stream, SIZE_MAX, &skipped);
+            stats->read.flows += skipped;
+            goto END;
+        }
+    }
+
+    /* when the records that fail are not written or counted, skip the
+     * blocks of the file whose records all fail the checks given on
+     * the command line */
+    if (!fail_entire_file
+        && 0 == any_fail_dest
+        && (print_stat == NULL || print_volume_stats == 0))
+    {
+        skStreamSetBlockPredicate(in_stream, &filterCheckBlock,
+                                  &skipped_flows);
+    }
+
+    while (reading_records && SKSTREAM_OK == in_rv) {
+        in_rv = skStreamReadRecords(in_stream, inbuf, FILTER_READ_RECS,
+                                    &in_count);
+        for (r = 0; r < in_count; ++r) {
+            INCR_REC_COUNT(stats->read, &inbuf[r]);
+        }
+
+        /* apply the checks from the command line, copying the
+         * records that pass them to 'prebuf' */
+        if (fail_entire_file) {
+            recs = inbuf;
+            pre_count = 0;
+        } else if (0 == checker_count) {
+            recs = inbuf;
+            pre_count = in_count;
+            for (r = 0; r < in_count; ++r) {
+                pre_index[r] = (uint32_t)r;
+            }
+        } else {
+            recs = prebuf;
+            pre_count = 0;
+            sel_count = 0;
+            sel_pos = 0;
+            if (checker_batch) {
+                sel_count = filterCheckBatch(inbuf, in_count, selected);
+            }
+            for (r = 0; r < in_count; ++r) {
+                result = RWF_PASS;
+                k = 0;
+                if (checker_batch) {
+                    if (sel_pos < sel_count && selected[sel_pos] == r) {
+                        ++sel_pos;
+                    } else {
+                        result = RWF_FAIL;
+                    }
+                    k = 1;
+                }
+                for ( ; k < checker_count && result == RWF_PASS; ++k) {
+                    result = (*(checker[k]))(&inbuf[r]);
+                }
+                if (RWF_PASS == result || RWF_PASS_NOW == result) {
+                    INCR_REC_COUNT(stats->pass, &inbuf[r]);
+                    RWREC_COPY(&prebuf[pre_count], &inbuf[r]);
+                    pre_index[pre_count] = (uint32_t)r;
+                    ++pre_count;
+                }
+            }
+        }
+
+        /* give the records to each query */
+        live = 0;
+        for (i = 0, q = query; i < query_count; ++i, ++q) {
+            if (q->done) {
+                continue;
+            }
+            sel_count = 0;
+            if (pre_count && !q->fail_entire_file) {
+                sel_count = filterChecksCheckBatch(q->checks, recs,
+                                                   pre_count, selected);
+            }
+            /* visit the records in order; when the query has no fail
+             * destination, visit only the records that pass */
+            sel_pos = 0;
+            r = 0;
+            while (r < in_count) {
+                if (sel_pos < sel_count
+                    && pre_index[selected[sel_pos]] == r)
+                {
+                    ++sel_pos;
+                    INCR_REC_COUNT(q->pass, &inbuf[r]);
+                    if (q->dest_type[DEST_PASS].count
+                        && queryWriteRecord(q, DEST_PASS, &inbuf[r]))
+                    {
+                        rv = -1;
+                        goto END;
+                    }
+                } else if (q->dest_type[DEST_FAIL].count) {
+                    if (queryWriteRecord(q, DEST_FAIL, &inbuf[r])) {
+                        rv = -1;
+                        goto END;
+                    }
+                } else if (sel_pos < sel_count) {
+                    r = pre_index[selected[sel_pos]];
+                    continue;
+                } else {
+                    break;
+                }
+                ++r;
+            }
+
+            if (0 == q->dest_type[DEST_PASS].count
+                && 0 == q->dest_type[DEST_FAIL].count
+                && NULL == print_stat)
+            {
+                q->done = 1;
+            } else {
+                ++live;
+            }
+        }
+        if (0 == live) {
+            reading_records = 0;
+        }
+    }
+
+  END:
+    if (in_rv == SKSTREAM_OK || in_rv == SKSTREAM_ERR_EOF) {
+        in_rv = 0;
+    } else {
+        skStreamPrintLastErr(in_stream, in_rv, &skAppPrintErr);
+        in_rv = 1;
+    }
+
+    /* close input */
+    skStreamDestroy(&in_stream);
+    stats->read.flows += skipped_flows;
+
+    if (rv) {
+        return -1;
+    }
+    return in_rv;
+}
+
+
+/*
+ *  name = queryGetStats(idx, stats);
+ *
+ *    Replace the pass counts in 'stats' with the number of records
+ *    that passed the query at position 'idx' and return the name of
+ *    that query.  The caller fills the number of files and of
+ *    records read.
+ */
+const char *
+queryGetStats(
+    int                 idx,
+    filter_stats_t     *stats)
+{
+    assert(idx >= 0 && idx < query_count);
+    stats->pass = query[idx].pass;
+    return query[idx].name;
+}
+
+
+/*
+** Local Variables:
+** mode:c
+** indent-tabs-mode:nil
+** c-basic-offset:4
+** End:
+*/
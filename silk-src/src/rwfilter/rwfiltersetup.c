@@ -65,10 +65,10 @@ static const char *app_plugin_names[] = {
 typedef enum {
     OPT_DRY_RUN,
 #if SK_RWFILTER_THREADED
-    OPT_THREADS,
+    OPT_THREADS, OPT_PRESERVE_ORDER,
 #endif
     OPT_MAX_PASS_RECORDS, OPT_MAX_FAIL_RECORDS,
-    OPT_PRINT_FILE, OPT_PLUGIN,
+    OPT_PRINT_FILE, OPT_PRINT_PLAN, OPT_PLUGIN,
     OPT_INPUT_PIPE, OPT_XARGS,
     OPT_PASS_DEST, OPT_FAIL_DEST, OPT_ALL_DEST,
     OPT_PRINT_STAT, OPT_PRINT_VOLUME
@@ -78,10 +78,12 @@ static struct option appOptions[] = {
     {"dry-run",                 NO_ARG,       0, OPT_DRY_RUN},
 #if SK_RWFILTER_THREADED
     {"threads",                 REQUIRED_ARG, 0, OPT_THREADS},
+    {"preserve-order",          NO_ARG,       0, OPT_PRESERVE_ORDER},
 #endif
     {"max-pass-records",        REQUIRED_ARG, 0, OPT_MAX_PASS_RECORDS},
     {"max-fail-records",        REQUIRED_ARG, 0, OPT_MAX_FAIL_RECORDS},
     {"print-filenames",         NO_ARG,       0, OPT_PRINT_FILE},
+    {"print-plan",              NO_ARG,       0, OPT_PRINT_PLAN},
     {"plugin",                  REQUIRED_ARG, 0, OPT_PLUGIN},
 
     {"input-pipe",              REQUIRED_ARG, 0, OPT_INPUT_PIPE},
@@ -98,12 +100,17 @@ static const char *appHelp[] = {
     "Parse command line switches but do not process records",
 #if SK_RWFILTER_THREADED
     "Use this number of threads. Def $SILK_RWFILTER_THREADS or 1",
+    ("When using multiple threads, write records in the order\n"
+     "\tin which they are read. Def. Records may be reordered"),
 #endif
     ("Write at most this many records to\n"
      "\tthe pass-destination; 0 for all.  Def. 0"),
     ("Write at most this many records to\n"
      "\tthe fail-destination; 0 for all.  Def. 0"),
     "Print names of input files during processing. Def. No",
+    ("Print the order in which the partitioning checks ran\n"
+     "\tand how often each passed to the --print-statistics\n"
+     "\tdestination or to stderr. Def. No"),
     ("Augment processing with the specified plug-in.\n"
      "\tSwitch may be repeated to load multiple plug-ins. No default"),
     ("Read SiLK flow records from a pipe: 'stdin' or\n"
@@ -191,6 +198,9 @@ appUsageLong(
     filterUsage(fh);
     tupleUsage(fh);
 
+    /* --query-file */
+    queryUsage(fh);
+
     /* switches from plug-ins */
     skPluginOptionsUsage(fh);
 }
@@ -215,6 +225,7 @@ appSetup(
     int j;
     int input_count;
     int output_count;
+    int query_count;
 
     /* verify same number of options and help strings */
     assert((sizeof(appHelp)/sizeof(char*)) ==
@@ -245,6 +256,12 @@ appSetup(
         exit(EXIT_FAILURE);
     }
 
+    /* load query module */
+    if (querySetup()) {
+        skAppPrintErr("Unable to setup query module");
+        exit(EXIT_FAILURE);
+    }
+
     skPluginSetup(1, SKPLUGIN_APP_FILTER);
 
     /* register the options */
@@ -340,7 +357,37 @@ appSetup(
         /* fatal error. msg already printed */
         exit(EXIT_FAILURE);
     }
-    if (output_count == 0) {
+
+    /* read the queries from --query-file.  The outputs of the
+     * queries replace the pass, fail, and all destinations, and the
+     * queries are evaluated by a single thread. */
+    query_count = queryGetCount();
+    if (query_count < 0) {
+        /* fatal error. msg already printed */
+        exit(EXIT_FAILURE);
+    }
+    if (query_count > 0) {
+        for (j = 0; j < DESTINATION_TYPES; ++j) {
+            if (dest_type[j].count) {
+                skAppPrintErr("May not use --%s with --query-file",
+                              appOptions[OPT_PASS_DEST + j].name);
+                skAppUsage();
+            }
+        }
+        if (dest_type[DEST_PASS].max_records) {
+            skAppPrintErr("May not use --%s with --query-file",
+                          appOptions[OPT_MAX_PASS_RECORDS].name);
+            skAppUsage();
+        }
+        if (dest_type[DEST_FAIL].max_records) {
+            skAppPrintErr("May not use --%s with --query-file",
+                          appOptions[OPT_MAX_FAIL_RECORDS].name);
+            skAppUsage();
+        }
+#if SK_RWFILTER_THREADED
+        thread_count = 1;
+#endif
+    } else if (output_count == 0) {
         skAppPrintErr("No output(s) specified");
         skAppUsage();
     }
@@ -353,7 +400,7 @@ appSetup(
         /* fatal error */
         exit(EXIT_FAILURE);
     }
-    if (checker_count == 0) {
+    if (checker_count == 0 && query_count == 0) {
         if (dest_type[DEST_PASS].dest_list) {
             skAppPrintErr("Must specify partitioning rules when using --%s",
                           appOptions[OPT_PASS_DEST].name);
@@ -378,7 +425,7 @@ appSetup(
 
     /* open the output streams, unless this is a "dry-run" */
     if (NULL == dryrun_fp) {
-        if (filterOpenOutputs()) {
+        if (filterOpenOutputs() || queryOpenOutputs(comp_method)) {
             /* fatal error. msg already printed */
             exit(EXIT_FAILURE);
         }
@@ -461,6 +508,10 @@ appOptionsHandler(
             goto PARSE_ERROR;
         }
         break;
+
+      case OPT_PRESERVE_ORDER:
+        preserve_order = 1;
+        break;
 #endif  /* SK_RWFILTER_THREADED */
 
       case OPT_INPUT_PIPE:
@@ -491,6 +542,10 @@ appOptionsHandler(
         filenames_fp = PRINT_FILENAMES_FH;
         break;
 
+      case OPT_PRINT_PLAN:
+        print_plan = 1;
+        break;
+
       case OPT_PRINT_VOLUME:
         print_volume_stats = 1;
         /* FALLTHROUGH */
@@ -580,6 +635,7 @@ appTeardown(
     skPluginRunCleanup(SKPLUGIN_APP_FILTER);
     skPluginTeardown();
 
+    queryTeardown();
     tupleTeardown();
     filterTeardown();
     skOptionsNotesTeardown();
@@ -852,6 +908,7 @@ filterSetCheckers(
     if (filterGetCheckCount() > 0) {
         checker[count] = (checktype_t (*)(rwRec*))filterCheck;
         ++count;
+        checker_batch = 1;
     }
 
     rv = tupleGetCheckCount();
@@ -11,6 +11,23 @@
 **
 **    Variables/Functions to support having rwfilter spawn multiple
 **    threads to process files.
+**
+**    The threads share the work at the level of chunks of records
+**    rather than whole files, so that a single large file or a pipe
+**    keeps every thread busy.  A thread that needs work reads the
+**    next chunk from one of the open inputs while holding that
+**    input's mutex, and then runs the checks on the chunk in parallel
+**    with the other threads.  Up to 'thread_count' inputs are open at
+**    once.  When 'preserve_order' is set, only one input is open,
+**    chunks are numbered as they are read, and each thread waits for
+**    its turn to write the records from its chunk.
+**
+**    The threads do not write records themselves.  For each type of
+**    output (pass, fail, all) there is one writer thread and a fixed
+**    pool of record buffers.  A thread fills a buffer, hands it to the
+**    writer, and takes an empty buffer in exchange, so the threads
+**    wait only when the writer falls behind.  The writer uses
+**    additional threads to compress the blocks of its outputs.
 */
 
 #include <silk/silk.h>
@@ -25,16 +42,127 @@ RCSIDENT("$SiLK: rwfilterthread.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 /*
  *    Size of buffer, in bytes, for storing records prior to writing
  *    them.  There will be one of these buffers per destination type
- *    per thread.
+ *    per thread.  This is also the size of the chunk of records that
+ *    a thread reads from an input at one time.
  */
 #define THREAD_RECBUF_SIZE   0x10000
 
+/*
+ *    Maximum number of threads to request for reading ahead and
+ *    uncompressing the blocks of the final input file.
+ */
+#define THREAD_READAHEAD_MAX  8
+
+/*
+ *    Maximum number of threads to request for compressing the blocks
+ *    of each output file.
+ */
+#define THREAD_COMPRESS_MAX  8
+
+/*
+ *    Number of record buffers per worker thread in the pool of each
+ *    writer.  Each worker holds one buffer; the remainder are either
+ *    waiting to be written or waiting to be refilled.
+ */
+#define THREAD_BUFFERS_PER_WORKER  3
+
+/*
+ *    Number of microseconds between two timevals.
+ */
+#define TIMEVAL_DIFF_USEC(tv_start, tv_end)                             \
+    ((int64_t)((tv_end).tv_sec - (tv_start).tv_sec) * 1000000           \
+     + ((tv_end).tv_usec - (tv_start).tv_usec))
+
+
+/*
+ *    An input file that is being read by one or more threads.
+ */
+typedef struct filter_input_st {
+    /* the stream being read */
+    skstream_t             *stream;
+    /* the next input in 'input_list' */
+    struct filter_input_st *next;
+    /* number of records skipped by filterCheckBlock() */
+    uint64_t                skipped_flows;
+    /* protects 'stream' and 'eof' */
+    pthread_mutex_t         mutex;
+    /* number of threads that are reading a chunk from this input;
+     * protected by 'input_mutex' */
+    uint32_t                users;
+    /* whether all the records in the file fail the checks */
+    int                     fail_entire_file;
+    /* whether the stream has reached its end; protected by 'mutex' */
+    int                     eof;
+    /* whether the end of the stream has been seen by a thread that
+     * holds 'input_mutex'; protected by 'input_mutex' */
+    int                     done;
+} filter_input_t;
+
+
+/*
+ *    A buffer of records that is passed between a worker thread and
+ *    the writer thread for one destination type.
+ */
+typedef struct filter_recbuf_st {
+    rwRec          *recs;
+    uint32_t        count;
+} filter_recbuf_t;
+
+
+/*
+ *    The writer thread for one destination type and its pool of
+ *    record buffers.  The buffers waiting to be written are in the
+ *    circular array 'full'; the buffers available for filling are on
+ *    the stack 'empty'.  Each array can hold every buffer in the pool.
+ */
+typedef struct filter_writer_st {
+    /* all the buffers in the pool */
+    filter_recbuf_t    *pool;
+    /* buffers waiting to be written */
+    filter_recbuf_t   **full;
+    /* buffers waiting to be filled */
+    filter_recbuf_t   **empty;
+    /* number of buffers in the pool */
+    uint32_t            pool_size;
+    /* index of the oldest buffer in 'full' */
+    uint32_t            full_head;
+    /* number of buffers in 'full' and in 'empty' */
+    uint32_t            full_count;
+    uint32_t            empty_count;
+    /* protects 'full', 'empty', their indexes and counts, and 'stop' */
+    pthread_mutex_t     mutex;
+    /* signaled when a buffer is added to 'full' or 'stop' is set */
+    pthread_cond_t      full_cond;
+    /* signaled when a buffer is added to 'empty' */
+    pthread_cond_t      empty_cond;
+    pthread_t           thread;
+    /* number of buffers written */
+    uint64_t            buffers;
+    /* microseconds spent waiting for a full buffer */
+    uint64_t            idle_usec;
+    /* whether the writer thread was started */
+    int                 started;
+    /* whether the writer should exit once 'full' is empty */
+    int                 stop;
+    /* non-zero when writing to an output failed */
+    int                 rv;
+} filter_writer_t;
+
 
 typedef struct filter_thread_st {
-    rwRec          *recbuf[DESTINATION_TYPES];
-    filter_stats_t  stats;
-    pthread_t       thread;
-    int             rv;
+    filter_recbuf_t    *recbuf[DESTINATION_TYPES];
+    rwRec              *inbuf;
+    /* indexes of the records in 'inbuf' that pass filterCheckBatch() */
+    uint32_t           *selected;
+    filter_stats_t      stats;
+    pthread_t           thread;
+    /* number of times and microseconds spent waiting for an empty
+     * buffer from a writer */
+    uint64_t            block_count;
+    uint64_t            block_usec;
+    /* microseconds spent waiting for the turn to write a chunk when
+     * preserving the order */
+    uint64_t            order_usec;
 } filter_thread_t;
 
 
@@ -43,10 +171,51 @@ typedef struct filter_thread_st {
 /* the main thread */
 static pthread_t main_thread;
 
-static pthread_mutex_t next_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* protects the variables that describe the inputs, below */
+static pthread_mutex_t input_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* signaled when an input is opened or closed */
+static pthread_cond_t input_cond = PTHREAD_COND_INITIALIZER;
+
+/* the open inputs, in the order they were opened */
+static filter_input_t *input_list = NULL;
+
+/* the number of inputs on 'input_list' plus those being opened */
+static uint32_t input_count = 0;
+
+/* the number of inputs that threads are currently opening */
+static uint32_t input_opening = 0;
+
+/* maximum value for 'input_count' */
+static uint32_t input_max;
+
+/* the name of the next file to open.  The name is fetched one file
+ * early so the final file, which may need to be shared by all the
+ * threads, is known when it is opened. */
+static char next_input[PATH_MAX];
+
+/* whether the names of all input files have been fetched */
+static int inputs_exhausted = 0;
+
+/* the sequence number to give the next chunk that is read, and the
+ * sequence number of the chunk to write next, when preserving the
+ * order of the records; protected by 'input_mutex' and
+ * 'order_mutex', respectively */
+static uint64_t read_seq = 0;
+static uint64_t write_seq = 0;
+
+static pthread_mutex_t order_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_cond_t order_cond = PTHREAD_COND_INITIALIZER;
 
 static pthread_mutex_t dest_mutex[DESTINATION_TYPES];
 
+/* the writer for each destination type that has outputs */
+static filter_writer_t writer[DESTINATION_TYPES];
+
+/* names of the destination types, for the thread statistics */
+static const char *dest_name[DESTINATION_TYPES] = {"pass", "fail", "all"};
+
 /* max number of records the recbuf can hold */
 static const size_t recbuf_max_recs = THREAD_RECBUF_SIZE / sizeof(rwRec);
 
@@ -177,60 +346,90 @@ dumpBuffer(
 
 
 /*
- *  ok = filterFileThreaded(datafile, ipfile_basename, stats, recbuf,reccount);
+ *  queueBuffer(thread, dest_id);
  *
- *    This is the actual filtering of the file named 'datafile'.
- *    The 'ipfile_basename' parameter is passed to filterCheckFile();
- *    it should be NULL or contain the full-path (minus extension) of the
- *    file that contains Bloom filter or IPset information about the
- *    'datafile'.  The function returns 0 on success; or 1 if the
- *    input file could not be opened.
+ *    Give the record buffer of 'thread' for the destination type
+ *    'dest_id' to the writer for that type, and replace it with an
+ *    empty buffer, waiting for one if necessary.
+ */
+static void
+queueBuffer(
+    filter_thread_t    *thread,
+    int                 dest_id)
+{
+    filter_writer_t *w = &writer[dest_id];
+    struct timeval start;
+    struct timeval end;
+
+    pthread_mutex_lock(&w->mutex);
+    assert(w->full_count < w->pool_size);
+    w->full[(w->full_head + w->full_count) % w->pool_size]
+        = thread->recbuf[dest_id];
+    ++w->full_count;
+    pthread_cond_signal(&w->full_cond);
+
+    if (0 == w->empty_count) {
+        ++thread->block_count;
+        gettimeofday(&start, NULL);
+        while (0 == w->empty_count) {
+            pthread_cond_wait(&w->empty_cond, &w->mutex);
+        }
+        gettimeofday(&end, NULL);
+        thread->block_usec += TIMEVAL_DIFF_USEC(start, end);
+    }
+    --w->empty_count;
+    thread->recbuf[dest_id] = w->empty[w->empty_count];
+    pthread_mutex_unlock(&w->mutex);
+}
+
+
+/*
+ *  bufferRecord(thread, dest_id, rwrec);
  *
- *    'recbuf' contains pointers to DESTINATION_TYPES number of record
- *    buffers.  A record buffer may be NULL if that output was not
- *    requested to that dest_id.  'reccount' is the current number of
- *    records in each record buffer.  Records that PASS or FAIL the
- *    checks are written into the appropriate record buffer.  When the
- *    count for the buffer reaches the buffer size, the records in the
- *    buffer are written to the output stream.
+ *    Append 'rwrec' to the record buffer of 'thread' for the
+ *    destination type 'dest_id'.  Unless the order of the records is
+ *    being preserved, give the buffer to the writer once it becomes
+ *    full.
  */
-static int
-filterFileThreaded(
+static void
+bufferRecord(
+    filter_thread_t    *thread,
+    int                 dest_id,
+    const rwRec        *rwrec)
+{
+    filter_recbuf_t *recbuf = thread->recbuf[dest_id];
+
+    memcpy(&recbuf->recs[recbuf->count], rwrec, sizeof(rwRec));
+    ++recbuf->count;
+    if (recbuf->count == recbuf_max_recs && !preserve_order) {
+        queueBuffer(thread, dest_id);
+    }
+}
+
+
+/*
+ *  input = openInput(thread, datafile, is_last);
+ *
+ *    Open the file named 'datafile' and return an object to read it.
+ *    Update the statistics of 'thread'.  'is_last' is true when no
+ *    other file follows 'datafile'.  Return NULL when the file cannot
+ *    be opened or when it does not need to be read.
+ */
+static filter_input_t *
+openInput(
+    filter_thread_t    *thread,
     const char         *datafile,
-    const char         *ipfile_basename,
-    filter_stats_t     *stats,
-    rwRec              *recbuf[],
-    uint32_t            recbuf_count[])
+    int                 is_last)
 {
-    rwRec rwrec;
-    skstream_t *in_stream;
-    int i;
-    int fail_entire_file = 0;
-    int result = RWF_PASS;
-    int rv = SKSTREAM_OK;
-    int in_rv = SKSTREAM_OK;
-    rwRec *recbuf_pos[DESTINATION_TYPES];
+    filter_stats_t *stats = &thread->stats;
+    filter_input_t *input;
+    size_t skipped;
+    int rv;
 
     /* nothing to do in dry-run mode but print the file names */
     if (dryrun_fp) {
         fprintf(dryrun_fp, "%s\n", datafile);
-        return 0;
-    }
-
-    if (!reading_records) {
-        return 0;
-    }
-
-    /* initialize: set each buffer's current record pointer to the
-     * appropriate location */
-    for (i = 0; i < DESTINATION_TYPES; ++i) {
-        if (dest_type[i].count) {
-            assert(NULL != recbuf[i]);
-            recbuf_pos[i] = recbuf[i] + recbuf_count[i];
-        } else {
-            /* not used.  initialize to avoid gcc warning. */
-            recbuf_pos[i] = NULL;
-        }
+        return NULL;
     }
 
     /* print filenames if requested */
@@ -238,19 +437,25 @@ filterFileThreaded(
         fprintf(filenames_fp, "%s\n", datafile);
     }
 
+    input = (filter_input_t*)calloc(1, sizeof(filter_input_t));
+    if (NULL == input) {
+        skAppPrintOutOfMemory("input");
+        return NULL;
+    }
+
     /* open the input file */
-    in_rv = skStreamOpenSilkFlow(&in_stream, datafile, SK_IO_READ);
-    if (in_rv) {
-        goto END;
+    rv = skStreamOpenSilkFlow(&input->stream, datafile, SK_IO_READ);
+    if (rv) {
+        skStreamPrintLastErr(input->stream, rv, &skAppPrintErr);
+        goto ERROR;
     }
 
     ++stats->files;
 
     /* determine if all the records in the file will fail the checks */
-    if (filterCheckFile(in_stream, ipfile_basename) == 1) {
+    if (filterCheckFile(input->stream, datafile) == 1) {
         /* all records in the file will fail the user's tests */
-        fail_entire_file = 1;
-        result = RWF_FAIL;
+        input->fail_entire_file = 1;
 
         /* determine if we can more efficiently handle the file */
         if ((dest_type[DEST_ALL].count == 0)
@@ -260,51 +465,260 @@ filterFileThreaded(
             if (print_stat == NULL) {
                 /* not generating statistics either.  we can move to
                  * the next file */
-                goto END;
+                goto ERROR;
             }
             if (print_volume_stats == 0) {
                 /* all we need to do is to count the records in the
                  * file, which we can do by skipping them all. */
-                size_t skipped = 0;
-                in_rv = skStreamSkipRecords(in_stream, SIZE_MAX, &skipped);
+                skipped = 0;
+                rv = skStreamSkipRecords(input->stream, SIZE_MAX, &skipped);
                 stats->read.flows += skipped;
-                goto END;
+                if (rv != SKSTREAM_OK && rv != SKSTREAM_ERR_EOF) {
+                    skStreamPrintLastErr(input->stream, rv, &skAppPrintErr);
+                }
+                goto ERROR;
             }
             /* else computing volume stats, and we need to read each
              * record to get its byte and packet counts. */
         }
     }
 
-    /* read and process each record */
-    while (reading_records
-           && (SKSTREAM_OK == (in_rv = skStreamReadRecord(in_stream, &rwrec))))
+    /* when the records that fail are not written or counted, skip the
+     * blocks of the file whose summaries show that all of their
+     * records fail; those records are added to the read count when
+     * the input is closed */
+    if (!input->fail_entire_file
+        && (dest_type[DEST_ALL].count == 0)
+        && (dest_type[DEST_FAIL].count == 0)
+        && (print_stat == NULL || print_volume_stats == 0))
+    {
+        skStreamSetBlockPredicate(input->stream, &filterCheckBlock,
+                                  &input->skipped_flows);
+    }
+
+    /* when every thread may be reading this file, use additional
+     * threads to uncompress its blocks; failure is not an error */
+    if (is_last || preserve_order) {
+        skStreamSetReadAhead(input->stream,
+                             ((thread_count < THREAD_READAHEAD_MAX)
+                              ? thread_count : THREAD_READAHEAD_MAX));
+    }
+
+    pthread_mutex_init(&input->mutex, NULL);
+    return input;
+
+  ERROR:
+    skStreamDestroy(&input->stream);
+    free(input);
+    return NULL;
+}
+
+
+/*
+ *  closeInput(thread, input);
+ *
+ *    Close the stream in 'input', add the records it skipped to the
+ *    statistics of 'thread', and free 'input'.
+ */
+static void
+closeInput(
+    filter_thread_t    *thread,
+    filter_input_t     *input)
+{
+    skStreamDestroy(&input->stream);
+    thread->stats.read.flows += input->skipped_flows;
+    pthread_mutex_destroy(&input->mutex);
+    free(input);
+}
+
+
+/*
+ *  more = nextChunk(thread, &rec_count, &fail_entire_file, &seq);
+ *
+ *    Read the next chunk of records into the input buffer of 'thread'
+ *    and set 'rec_count' to the number of records read.  Open
+ *    additional inputs as needed.  Set 'fail_entire_file' to true
+ *    when every record in the chunk fails the checks.  When the order
+ *    of the records is being preserved, set 'seq' to the sequence
+ *    number of the chunk.
+ *
+ *    Return 1 when records were read, or 0 when no records remain or
+ *    processing is stopping.
+ */
+static int
+nextChunk(
+    filter_thread_t    *thread,
+    size_t             *rec_count,
+    int                *fail_entire_file,
+    uint64_t           *seq)
+{
+    char datafile[PATH_MAX];
+    filter_input_t **prev;
+    filter_input_t *input;
+    int saw_end;
+    int is_last;
+    int rv;
+
+    *rec_count = 0;
+
+    pthread_mutex_lock(&input_mutex);
+    while (0 == *rec_count) {
+        if (!reading_records) {
+            break;
+        }
+
+        /* open another input if fewer than the maximum are open */
+        if (!inputs_exhausted && input_count < input_max) {
+            memcpy(datafile, next_input, sizeof(datafile));
+            if (NULL == appNextInput(next_input, sizeof(next_input))) {
+                inputs_exhausted = 1;
+            }
+            is_last = inputs_exhausted;
+            ++input_count;
+            ++input_opening;
+            pthread_mutex_unlock(&input_mutex);
+
+            input = openInput(thread, datafile, is_last);
+
+            pthread_mutex_lock(&input_mutex);
+            --input_opening;
+            if (NULL == input) {
+                --input_count;
+            } else {
+                prev = &input_list;
+                while (*prev) {
+                    prev = &(*prev)->next;
+                }
+                *prev = input;
+            }
+            pthread_cond_broadcast(&input_cond);
+            continue;
+        }
+
+        /* find an input that has records to read */
+        input = input_list;
+        while (input && input->done) {
+            input = input->next;
+        }
+        if (NULL == input) {
+            if (inputs_exhausted && 0 == input_opening) {
+                break;
+            }
+            /* wait for an input to be opened or closed */
+            pthread_cond_wait(&input_cond, &input_mutex);
+            continue;
+        }
+
+        /* read a chunk.  When preserving order, hold 'input_mutex'
+         * while reading so that chunks are numbered in the order in
+         * which they are read */
+        ++input->users;
+        if (!preserve_order) {
+            pthread_mutex_unlock(&input_mutex);
+        }
+        pthread_mutex_lock(&input->mutex);
+        saw_end = 0;
+        if (!input->eof) {
+            rv = skStreamReadRecords(input->stream, thread->inbuf,
+                                     recbuf_max_recs, rec_count);
+            if (rv != SKSTREAM_OK) {
+                if (rv != SKSTREAM_ERR_EOF) {
+                    skStreamPrintLastErr(input->stream, rv, &skAppPrintErr);
+                }
+                input->eof = 1;
+                saw_end = 1;
+            }
+        }
+        pthread_mutex_unlock(&input->mutex);
+        if (!preserve_order) {
+            pthread_mutex_lock(&input_mutex);
+        } else if (*rec_count) {
+            *seq = read_seq++;
+        }
+        *fail_entire_file = input->fail_entire_file;
+        --input->users;
+        if (saw_end) {
+            input->done = 1;
+        }
+
+        /* close the input once every thread has finished with it */
+        if (input->done && 0 == input->users) {
+            prev = &input_list;
+            while (*prev != input) {
+                prev = &(*prev)->next;
+            }
+            *prev = input->next;
+            --input_count;
+            pthread_mutex_unlock(&input_mutex);
+            closeInput(thread, input);
+            pthread_mutex_lock(&input_mutex);
+            pthread_cond_broadcast(&input_cond);
+        }
+    }
+    pthread_mutex_unlock(&input_mutex);
+
+    return (*rec_count > 0);
+}
+
+
+/*
+ *  filterChunk(thread, rec_count, fail_entire_file);
+ *
+ *    Run the checks on the 'rec_count' records in the input buffer of
+ *    'thread', update its statistics, and add the records to its
+ *    record buffers.  When 'fail_entire_file' is true, every record
+ *    fails.
+ */
+static void
+filterChunk(
+    filter_thread_t    *thread,
+    size_t              rec_count,
+    int                 fail_entire_file)
+{
+    filter_stats_t *stats = &thread->stats;
+    rwRec *rwrec;
+    size_t sel_count = 0;
+    size_t sel_pos = 0;
+    int result = RWF_FAIL;
+    int i;
+
+    if (checker_batch && !fail_entire_file) {
+        /* run the checks from rwfiltercheck.c on the chunk */
+        sel_count = filterCheckBatch(thread->inbuf, rec_count,
+                                     thread->selected);
+    }
+
+    for (rwrec = thread->inbuf;
+         rwrec < thread->inbuf + rec_count && reading_records;
+         ++rwrec)
     {
         /* increment number of read records */
-        INCR_REC_COUNT(stats->read, &rwrec);
+        INCR_REC_COUNT(stats->read, rwrec);
 
         /* the all-dest */
         if (dest_type[DEST_ALL].count) {
-            memcpy(recbuf_pos[DEST_ALL], &rwrec, sizeof(rwRec));
-            ++recbuf_pos[DEST_ALL];
-            ++recbuf_count[DEST_ALL];
-            if (recbuf_count[DEST_ALL] == recbuf_max_recs) {
-                rv = dumpBuffer(DEST_ALL, recbuf[DEST_ALL],
-                                recbuf_count[DEST_ALL]);
-                if (rv) {
-                    goto END;
-                }
-                recbuf_pos[DEST_ALL] = recbuf[DEST_ALL];
-                recbuf_count[DEST_ALL] = 0;
-            }
+            bufferRecord(thread, DEST_ALL, rwrec);
         }
 
         if (!fail_entire_file) {
-            /* run all checker()'s until end or one doesn't pass */
-            for (i=0, result=RWF_PASS;
-                 i < checker_count && result == RWF_PASS;
-                 ++i)
-            {
-                result = (*(checker[i]))(&rwrec);
+            i = 0;
+            result = RWF_PASS;
+            if (checker_batch) {
+                /* use the result of filterCheckBatch() */
+                if (sel_pos < sel_count
+                    && (thread->selected[sel_pos]
+                        == (uint32_t)(rwrec - thread->inbuf)))
+                {
+                    ++sel_pos;
+                } else {
+                    result = RWF_FAIL;
+                }
+                i = 1;
+            }
+            /* run all other checker()'s until end or one doesn't
+             * pass */
+            for ( ; i < checker_count && result == RWF_PASS; ++i) {
+                result = (*(checker[i]))(rwrec);
             }
         }
 
@@ -312,86 +726,61 @@ filterFileThreaded(
           case RWF_PASS:
           case RWF_PASS_NOW:
             /* increment number of record that pass */
-            INCR_REC_COUNT(stats->pass, &rwrec);
+            INCR_REC_COUNT(stats->pass, rwrec);
 
             /* the pass-dest */
             if (dest_type[DEST_PASS].count) {
-                memcpy(recbuf_pos[DEST_PASS], &rwrec, sizeof(rwRec));
-                ++recbuf_pos[DEST_PASS];
-                ++recbuf_count[DEST_PASS];
-                if (recbuf_count[DEST_PASS] == recbuf_max_recs) {
-                    rv = dumpBuffer(DEST_PASS, recbuf[DEST_PASS],
-                                    recbuf_count[DEST_PASS]);
-                    if (rv) {
-                        goto END;
-                    }
-                    recbuf_pos[DEST_PASS] = recbuf[DEST_PASS];
-                    recbuf_count[DEST_PASS] = 0;
-                }
+                bufferRecord(thread, DEST_PASS, rwrec);
             }
             break;
 
           case RWF_FAIL:
             /* the fail-dest */
             if (dest_type[DEST_FAIL].count) {
-                memcpy(recbuf_pos[DEST_FAIL], &rwrec, sizeof(rwRec));
-                ++recbuf_pos[DEST_FAIL];
-                ++recbuf_count[DEST_FAIL];
-                if (recbuf_count[DEST_FAIL] == recbuf_max_recs) {
-                    rv = dumpBuffer(DEST_FAIL, recbuf[DEST_FAIL],
-                                    recbuf_count[DEST_FAIL]);
-                    if (rv) {
-                        goto END;
-                    }
-                    recbuf_pos[DEST_FAIL] = recbuf[DEST_FAIL];
-                    recbuf_count[DEST_FAIL] = 0;
-                }
+                bufferRecord(thread, DEST_FAIL, rwrec);
             }
             break;
 
           default:
             break;
         }
-
-    } /* while (reading_records && skStreamReadRecord()) */
-
-  END:
-    if (in_rv == SKSTREAM_OK || in_rv == SKSTREAM_ERR_EOF) {
-        in_rv = 0;
-    } else {
-        skStreamPrintLastErr(in_stream, in_rv, &skAppPrintErr);
-        in_rv = 1;
     }
-
-    /* close input */
-    skStreamDestroy(&in_stream);
-
-    if (rv) {
-        return -1;
-    }
-    return in_rv;
 }
 
 
 /*
- *  filename = nextInputThreaded(buf, bufsize);
+ *  writeChunkInOrder(thread, seq);
  *
- *    Fill 'buf', a buffer of size 'bufsize' with the name of the next
- *    file to process.  Return 'buf' if there are more files to
- *    process, NULL if there are no more files or on error.
+ *    Wait until every chunk numbered before 'seq' has been given to
+ *    the writers, then give them the record buffers of 'thread',
+ *    which hold the records from chunk 'seq'.
  */
-static char *
-nextInputThreaded(
-    char               *buf,
-    size_t              bufsize)
+static void
+writeChunkInOrder(
+    filter_thread_t    *thread,
+    uint64_t            seq)
 {
-    char *fname;
-
-    pthread_mutex_lock(&next_file_mutex);
-    fname = appNextInput(buf, bufsize);
-    pthread_mutex_unlock(&next_file_mutex);
+    struct timeval start;
+    struct timeval end;
+    int i;
 
-    return fname;
+    pthread_mutex_lock(&order_mutex);
+    if (seq != write_seq) {
+        gettimeofday(&start, NULL);
+        while (seq != write_seq) {
+            pthread_cond_wait(&order_cond, &order_mutex);
+        }
+        gettimeofday(&end, NULL);
+        thread->order_usec += TIMEVAL_DIFF_USEC(start, end);
+    }
+    for (i = 0; i < DESTINATION_TYPES; ++i) {
+        if (thread->recbuf[i] && thread->recbuf[i]->count) {
+            queueBuffer(thread, i);
+        }
+    }
+    ++write_seq;
+    pthread_cond_broadcast(&order_cond);
+    pthread_mutex_unlock(&order_mutex);
 }
 
 
@@ -428,49 +817,205 @@ skthread_ignore_signals(
 #endif  /* #ifndef SKTHREAD_UNKNOWN_ID */
 
 
+/*
+ *  writerThread(&writer);
+ *
+ *    THREAD ENTRY POINT.
+ *
+ *    Writes the buffers that the worker threads give to 'writer' and
+ *    returns them to the writer's pool.  Once writing to an output
+ *    fails, discards the buffers so the workers are not blocked.
+ *    Stops when the 'stop' member is set and no buffers remain.
+ */
+static void *
+writerThread(
+    void               *v_writer)
+{
+    filter_writer_t *w = (filter_writer_t*)v_writer;
+    filter_recbuf_t *recbuf;
+    struct timeval start;
+    struct timeval end;
+    int dest_id = (int)(w - writer);
+
+    skthread_ignore_signals();
+
+    pthread_mutex_lock(&w->mutex);
+    for (;;) {
+        if (0 == w->full_count && !w->stop) {
+            gettimeofday(&start, NULL);
+            while (0 == w->full_count && !w->stop) {
+                pthread_cond_wait(&w->full_cond, &w->mutex);
+            }
+            gettimeofday(&end, NULL);
+            w->idle_usec += TIMEVAL_DIFF_USEC(start, end);
+        }
+        if (0 == w->full_count) {
+            break;
+        }
+        recbuf = w->full[w->full_head];
+        w->full_head = (w->full_head + 1) % w->pool_size;
+        --w->full_count;
+        pthread_mutex_unlock(&w->mutex);
+
+        if (0 == w->rv && recbuf->count) {
+            w->rv = dumpBuffer(dest_id, recbuf->recs, recbuf->count);
+        }
+        recbuf->count = 0;
+
+        pthread_mutex_lock(&w->mutex);
+        ++w->buffers;
+        w->empty[w->empty_count] = recbuf;
+        ++w->empty_count;
+        pthread_cond_signal(&w->empty_cond);
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    return NULL;
+}
+
+
+/*
+ *  status = writerCreate(dest_id, &thread_list);
+ *
+ *    Create the pool of record buffers for the destination type
+ *    'dest_id', give one buffer to each thread in 'thread_list', ask
+ *    for the outputs to be compressed by additional threads, and
+ *    start the writer thread.  Return 0 on success, -1 on failure.
+ */
+static int
+writerCreate(
+    int                 dest_id,
+    filter_thread_t    *thread_list)
+{
+    filter_writer_t *w = &writer[dest_id];
+    destination_t *dest;
+    uint32_t j;
+
+    w->pool_size = THREAD_BUFFERS_PER_WORKER * thread_count;
+    w->pool = (filter_recbuf_t*)calloc(w->pool_size, sizeof(filter_recbuf_t));
+    w->full = (filter_recbuf_t**)calloc(w->pool_size,
+                                        sizeof(filter_recbuf_t*));
+    w->empty = (filter_recbuf_t**)calloc(w->pool_size,
+                                         sizeof(filter_recbuf_t*));
+    if (NULL == w->pool || NULL == w->full || NULL == w->empty) {
+        skAppPrintOutOfMemory("record buffers");
+        return -1;
+    }
+    for (j = 0; j < w->pool_size; ++j) {
+        w->pool[j].recs = (rwRec*)malloc(recbuf_max_recs * sizeof(rwRec));
+        if (NULL == w->pool[j].recs) {
+            skAppPrintOutOfMemory("record buffers");
+            return -1;
+        }
+        w->empty[w->empty_count] = &w->pool[j];
+        ++w->empty_count;
+    }
+    for (j = 0; j < thread_count; ++j) {
+        --w->empty_count;
+        thread_list[j].recbuf[dest_id] = w->empty[w->empty_count];
+    }
+
+    /* the header of each output has been written, so the number of
+     * compression threads may still be changed; failure is not an
+     * error */
+    for (dest = dest_type[dest_id].dest_list; dest; dest = dest->next) {
+        skStreamSetCompressionThreads(dest->stream,
+                                      ((thread_count < THREAD_COMPRESS_MAX)
+                                       ? thread_count : THREAD_COMPRESS_MAX));
+    }
+
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->full_cond, NULL);
+    pthread_cond_init(&w->empty_cond, NULL);
+    if (pthread_create(&w->thread, NULL, &writerThread, w)) {
+        skAppPrintErr("Unable to create writer thread");
+        pthread_cond_destroy(&w->empty_cond);
+        pthread_cond_destroy(&w->full_cond);
+        pthread_mutex_destroy(&w->mutex);
+        return -1;
+    }
+    w->started = 1;
+    return 0;
+}
+
+
+/*
+ *  status = writerDestroy(dest_id);
+ *
+ *    Tell the writer for the destination type 'dest_id' to stop once
+ *    it has written the buffers it holds, wait for it, and free its
+ *    pool.  The writer's counters are kept.  Return 0 if the writer
+ *    wrote every record, -1 otherwise.
+ */
+static int
+writerDestroy(
+    int                 dest_id)
+{
+    filter_writer_t *w = &writer[dest_id];
+    uint32_t j;
+
+    if (w->started) {
+        pthread_mutex_lock(&w->mutex);
+        w->stop = 1;
+        pthread_cond_signal(&w->full_cond);
+        pthread_mutex_unlock(&w->mutex);
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->empty_cond);
+        pthread_cond_destroy(&w->full_cond);
+        pthread_mutex_destroy(&w->mutex);
+        w->started = 0;
+    }
+    if (w->pool) {
+        for (j = 0; j < w->pool_size; ++j) {
+            free(w->pool[j].recs);
+        }
+        free(w->pool);
+        w->pool = NULL;
+    }
+    free(w->full);
+    w->full = NULL;
+    free(w->empty);
+    w->empty = NULL;
+    return (w->rv ? -1 : 0);
+}
+
+
 /*
  *  workerThread(&filter_thread_data);
  *
  *    THREAD ENTRY POINT.
  *
- *    Gets the name of the next file to process and calls
- *    filterFileThreaded() to process that file.  Stops processing
- *    when there are no more files to process or when an error occurs.
+ *    Gets the next chunk of records to process and calls
+ *    filterChunk() to process it.  Stops processing when there are no
+ *    more records to process or when an error occurs.
  */
 static void *
 workerThread(
     void               *v_thread)
 {
-    filter_stats_t *stats = &(((filter_thread_t*)v_thread)->stats);
-    rwRec **recbuf = ((filter_thread_t*)v_thread)->recbuf;
-    uint32_t recbuf_count[DESTINATION_TYPES];
-    char datafile[PATH_MAX];
-    int rv = 0;
+    filter_thread_t *thread = (filter_thread_t*)v_thread;
+    int fail_entire_file;
+    size_t rec_count;
+    uint64_t seq = 0;
     int i;
 
     /* ignore all signals unless this thread is the main thread */
-    if (!pthread_equal(main_thread, ((filter_thread_t*)v_thread)->thread)) {
+    if (!pthread_equal(main_thread, thread->thread)) {
         skthread_ignore_signals();
     }
 
-    memset(recbuf_count, 0, sizeof(recbuf_count));
-
-    ((filter_thread_t*)v_thread)->rv = 0;
-
-    while (nextInputThreaded(datafile, sizeof(datafile)) != NULL) {
-        rv = filterFileThreaded(datafile, NULL, stats, recbuf, recbuf_count);
-        if (rv < 0) {
-            /* fatal error */
-            ((filter_thread_t*)v_thread)->rv = rv;
-            return NULL;
+    while (nextChunk(thread, &rec_count, &fail_entire_file, &seq)) {
+        filterChunk(thread, rec_count, fail_entire_file);
+        if (preserve_order) {
+            /* always take the turn so later chunks are not blocked */
+            writeChunkInOrder(thread, seq);
         }
-        /* if (rv > 0) there was an error opening/reading input: ignore */
     }
 
-    /* dump any records still in the buffers */
+    /* give any records still in the buffers to the writers */
     for (i = 0; i < DESTINATION_TYPES; ++i) {
-        if (recbuf_count[i]) {
-            dumpBuffer(i, recbuf[i], recbuf_count[i]);
+        if (thread->recbuf[i] && thread->recbuf[i]->count) {
+            queueBuffer(thread, i);
         }
     }
 
@@ -478,6 +1023,43 @@ workerThread(
 }
 
 
+/*
+ *  printThreadStats(thread_list);
+ *
+ *    Print to the standard error the number of files and records that
+ *    each thread in 'thread_list' processed and how long the threads
+ *    and the writers waited on each other.
+ */
+static void
+printThreadStats(
+    const filter_thread_t  *thread_list)
+{
+    uint32_t j;
+    int i;
+
+    for (j = 0; j < thread_count; ++j) {
+        skAppPrintErr(("Thread %" PRIu32 ": %" PRIu32 " files,"
+                       " passed %" PRIu64 "/%" PRIu64 " flows,"
+                       " blocked %" PRIu64 " times for %.6f seconds,"
+                       " waited %.6f seconds for its turn"),
+                      j, thread_list[j].stats.files,
+                      thread_list[j].stats.pass.flows,
+                      thread_list[j].stats.read.flows,
+                      thread_list[j].block_count,
+                      (double)thread_list[j].block_usec / 1.0e6,
+                      (double)thread_list[j].order_usec / 1.0e6);
+    }
+    for (i = 0; i < DESTINATION_TYPES; ++i) {
+        if (writer[i].pool_size) {
+            skAppPrintErr(("Writer %s: %" PRIu64 " buffers,"
+                           " idle for %.6f seconds"),
+                          dest_name[i], writer[i].buffers,
+                          (double)writer[i].idle_usec / 1.0e6);
+        }
+    }
+}
+
+
 /*
  *  status = threadedFilter(&stats);
  *
@@ -493,6 +1075,8 @@ threadedFilter(
     filter_stats_t     *stats)
 {
     filter_thread_t *thread;
+    filter_input_t *input;
+    const char *env;
     int i;
     uint32_t j;
     int rv = 0;
@@ -513,19 +1097,36 @@ threadedFilter(
         pthread_mutex_init(&dest_mutex[i], NULL);
     }
 
+    /* only one input may be open when preserving the order */
+    input_max = (preserve_order ? 1 : thread_count);
+
+    /* get the name of the first input */
+    if (NULL == appNextInput(next_input, sizeof(next_input))) {
+        inputs_exhausted = 1;
+    }
+
     /* create the data structures used by each thread */
     thread = (filter_thread_t*)calloc(thread_count, sizeof(filter_thread_t));
     if (thread == NULL) {
+        skAppPrintOutOfMemory("thread data");
+        rv = -1;
         goto END;
     }
+    for (j = 0; j < thread_count; ++j) {
+        thread[j].inbuf = (rwRec*)malloc(recbuf_max_recs * sizeof(rwRec));
+        thread[j].selected
+            = (uint32_t*)malloc(recbuf_max_recs * sizeof(uint32_t));
+        if (thread[j].inbuf == NULL || thread[j].selected == NULL) {
+            skAppPrintOutOfMemory("record buffers");
+            rv = -1;
+            goto END;
+        }
+    }
     for (i = 0; i < DESTINATION_TYPES; ++i) {
         if (dest_type[i].count) {
-            for (j = 0; j < thread_count; ++j) {
-                thread[j].recbuf[i]
-                    = (rwRec*)malloc(recbuf_max_recs * sizeof(rwRec));
-                if (thread[j].recbuf[i] == NULL) {
-                    goto END;
-                }
+            if (writerCreate(i, thread)) {
+                rv = -1;
+                goto END;
             }
         }
     }
@@ -546,7 +1147,20 @@ threadedFilter(
         if (j > 0) {
             pthread_join(thread[j].thread, NULL);
         }
-        rv |= thread[j].rv;
+    }
+
+    /* close any inputs left open by an early exit */
+    while ((input = input_list) != NULL) {
+        input_list = input->next;
+        closeInput(&thread[0], input);
+    }
+
+    /* wait for the writers to write the remaining buffers */
+    for (i = 0; i < DESTINATION_TYPES; ++i) {
+        rv |= writerDestroy(i);
+    }
+
+    for (j = 0; j < thread_count; ++j) {
         stats->read.flows += thread[j].stats.read.flows;
         stats->read.pkts  += thread[j].stats.read.pkts;
         stats->read.bytes += thread[j].stats.read.bytes;
@@ -554,23 +1168,21 @@ threadedFilter(
         stats->pass.pkts  += thread[j].stats.pass.pkts;
         stats->pass.bytes += thread[j].stats.pass.bytes;
         stats->files      += thread[j].stats.files;
-#if 0
-        fprintf(stderr,
-                "thread %d processed %" PRIu32 " files and "
-                "passed %" PRIu64 "/%" PRIu64 " flows\n",
-                j, thread[j].stats.files, thread[j].stats.pass.flows,
-                thread[j].stats.read.flows);
-#endif
+    }
+
+    env = getenv(RWFILTER_THREAD_STATS_ENVAR);
+    if (env && *env && strcmp(env, "0")) {
+        printThreadStats(thread);
     }
 
   END:
+    for (i = 0; i < DESTINATION_TYPES; ++i) {
+        rv |= writerDestroy(i);
+    }
     if (thread) {
-        for (i = 0; i < DESTINATION_TYPES; ++i) {
-            for (j = 0; j < thread_count; ++j) {
-                if (thread[j].recbuf[i]) {
-                    free(thread[j].recbuf[i]);
-                }
-            }
+        for (j = 0; j < thread_count; ++j) {
+            free(thread[j].inbuf);
+            free(thread[j].selected);
         }
         free(thread);
     }
@@ -19,16 +19,23 @@
 **    direction.
 **
 **    The implemention reads the user's text file, creates one or more
-**    tuples for each row, and stores the tuples in a red-black tree.
-**    When partitioning the data, the values from the rwRec are used
-**    to fill a tuple, and the red-black tree is searched for that
-**    tuple.
+**    tuples for each row, and stores the tuples as fixed-length keys
+**    in a hash table (see hashlib.h).  When partitioning the data,
+**    the values from the rwRec are used to fill a key, and the hash
+**    table is probed for that key.  Since the table is not modified
+**    once the file has been read, the probes may be made from
+**    multiple threads.
 **
-**    Because the implemention uses a red-black tree to store the
-**    data, we must search for individual points, and we cannot search
-**    for a range of values.  If the user provides a CIDR block, the
-**    red-black tree will contain an entry for every IP in the CIDR
-**    block.
+**    The keys may be written to a binary tuple file (--tuple-save),
+**    and when the --tuple-file is such a file, the keys are read
+**    directly and the text parsing is skipped.  The SiLK header of a
+**    binary tuple file has a 'tuple' header entry that lists the
+**    fields in each key.
+**
+**    Because the implemention uses a hash table to store the data, we
+**    must search for individual points, and we cannot search for a
+**    range of values.  If the user provides a CIDR block, the hash
+**    table will contain an entry for every IP in the CIDR block.
 **
 **    To allow for searching of ranges (so we don't need to explode
 **    every CIDR block), we would need to use some other data
@@ -42,9 +49,9 @@
 
 RCSIDENT("$SiLK: rwfiltertuple.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
-#include <silk/skvector.h>
-#include <silk/redblack.h>
+#include <silk/hashlib.h>
 #include <silk/rwascii.h>
+#include <silk/skstream.h>
 #include <silk/skstringmap.h>
 #include "rwfilter.h"
 
@@ -54,15 +61,31 @@ RCSIDENT("$SiLK: rwfiltertuple.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 /* Maximum number of fields we support */
 #define TUPLE_MAX  5
 
+/* Maximum length of a key: two IPs, two ports, and a protocol */
+#define TUPLE_KEY_MAX    (2 * 16 + 2 * 2 + 1)
+
+/* Initial number of entries to allocate in the hash table.  The
+ * table grows as needed, and it is rehashed into a single block once
+ * the file has been read. */
+#define TUPLE_INITIAL_SIZE  65536
+
 /*
- *  As we read the user's text file, we create nodes and hand pointers
- *  those nodes to the redblack tree.  We want to avoid doing an
- *  allocation for every node, but we cannot create a large memory
- *  block and realloc() it later since that will make redblack's
- *  pointers invalid.  Instead, we'll use a vector of array of nodes,
- *  where each array contains NODE_ARRAY_SIZE nodes.
+ *  The record version of a binary tuple file.  The record version
+ *  determines the width of the IP addresses in each key: four octets
+ *  in version 1 and sixteen octets in version 2.  The ports and IPv4
+ *  addresses are in the byte order given in the file's header; IPv6
+ *  addresses are in network byte order.
  */
-#define NODE_ARRAY_SIZE  65536
+#define TUPLE_REC_VERSION_IPV4  1
+#define TUPLE_REC_VERSION_IPV6  2
+#if SK_ENABLE_IPV6
+#  define TUPLE_REC_VERSION  TUPLE_REC_VERSION_IPV6
+#else
+#  define TUPLE_REC_VERSION  TUPLE_REC_VERSION_IPV4
+#endif
+
+/* Number of keys to read from a binary tuple file at once */
+#define TUPLE_READ_KEYS  4096
 
 /* the possible direction(s) for the user's test */
 #define  TUPLE_FORWARD   (1 << 0)
@@ -87,11 +110,11 @@ typedef struct number_list_st {
 
 /* LOCAL VARIABLES */
 
-/* the vector of node arrays */
-static sk_vector_t *array_vec = NULL;
+/* the hash table holding the keys */
+static HashTable *tuple_table = NULL;
 
-/* the redblack tree */
-static struct rbtree *rb = NULL;
+/* the number of buckets in the hash table when it was created */
+static uint64_t tuple_initial_buckets = 0;
 
 /* the direction to test;  */
 static int direction = TUPLE_FORWARD;
@@ -110,6 +133,9 @@ static char delimiter = '|';
 /* the name of the file to process */
 static const char *input_file = NULL;
 
+/* the name of the binary tuple file to write */
+static const char *save_file = NULL;
+
 /* the number of fields in each input line */
 static uint32_t num_fields = 0;
 
@@ -135,7 +161,8 @@ static sk_stringmap_t *field_map = NULL;
  */
 typedef enum tupleOptionsEnum_en {
     OPT_TUPLE_FILE, OPT_TUPLE_FIELDS,
-    OPT_TUPLE_DIRECTION, OPT_TUPLE_DELIMITER
+    OPT_TUPLE_DIRECTION, OPT_TUPLE_DELIMITER,
+    OPT_TUPLE_SAVE
 } tupleOptionsEnum;
 
 static struct option tupleOptions[] = {
@@ -143,6 +170,7 @@ static struct option tupleOptions[] = {
     {"tuple-fields",        REQUIRED_ARG, 0, OPT_TUPLE_FIELDS},
     {"tuple-direction",     REQUIRED_ARG, 0, OPT_TUPLE_DIRECTION},
     {"tuple-delimiter",     REQUIRED_ARG, 0, OPT_TUPLE_DELIMITER},
+    {"tuple-save",          REQUIRED_ARG, 0, OPT_TUPLE_SAVE},
     {0, 0, 0, 0}            /* sentinel */
 };
 
@@ -153,20 +181,25 @@ static const char *tupleOptionsHelp[] = {
     "Field(s) in input. List fields separated by commas:",
     "Specify how the fields map to the records:",
     "Character separating the input fields. Def. '|'",
+    ("Write the tuples read from the tuple-file to this\n"
+     "\tfile in a binary form that loads more quickly. Def. No"),
     (char*)NULL
 };
 
 
 /* LOCAL FUNCTION DECLARATIONS */
 
-static int tupleCompare(const void *pa, const void *pb, const void *config);
+static int tupleAddField(uint32_t type);
 static int tupleCreateFieldMap(void);
-static uint8_t *tupleGrowMemory(void);
+static int tupleFileIsBinary(void);
 static int tupleInitializeMemory(void);
+static int tupleInsertKey(const uint8_t *key);
 static int tupleOptionsHandler(clientData cData, int opt_index, char *opt_arg);
 static int tupleParseFile(void);
 static int tupleParseFieldNames(const char *field_string);
 static int tupleParseDirection(const char *direction_str);
+static int tupleReadBinaryFile(void);
+static int tupleWriteBinaryFile(void);
 
 
 /* FUNCTION DEFINITIONS */
@@ -206,8 +239,6 @@ tupleTeardown(
     void)
 {
     static int teardownFlag = 0;
-    size_t i;
-    void **a;
 
     if (teardownFlag) {
         return;
@@ -220,22 +251,10 @@ tupleTeardown(
         field_map = NULL;
     }
 
-    /* destroy the redblack trees */
-    if (rb) {
-        rbdestroy(rb);
-        rb = NULL;
-    }
-
-    /* destroy the vector of array of nodes */
-    if (array_vec) {
-        for (i = 0;
-             NULL != (a = (void**)skVectorGetValuePointer(array_vec, i));
-             ++i)
-        {
-            free(*a);
-        }
-        skVectorDestroy(array_vec);
-        array_vec = NULL;
+    /* destroy the hash table */
+    if (tuple_table) {
+        hashlib_free_table(tuple_table);
+        tuple_table = NULL;
     }
 
     return;
@@ -336,6 +355,15 @@ tupleOptionsHandler(
         }
         break;
 
+      case OPT_TUPLE_SAVE:
+        if (save_file) {
+            skAppPrintErr("Invalid %s: Switch used multiple times",
+                          tupleOptions[opt_index].name);
+            return 1;
+        }
+        save_file = opt_arg;
+        break;
+
       case OPT_TUPLE_FIELDS:
         if (num_fields > 0) {
             skAppPrintErr("Invalid %s: Switch used multiple times",
@@ -370,7 +398,31 @@ tupleGetCheckCount(
         return 0;
     }
 
-    if (tupleParseFile()) {
+    if (tupleFileIsBinary()) {
+        if (tupleReadBinaryFile()) {
+            return -1;
+        }
+    } else if (tupleParseFile()) {
+        return -1;
+    }
+
+    /* return error code if we do not have any entries */
+    if (NULL == tuple_table || 0 == hashlib_count_entries(tuple_table)) {
+        skAppPrintErr("No valid entries read from input file '%s'",
+                      input_file);
+        return -1;
+    }
+
+    /* when the table grew beyond its initial block, rehash it into a
+     * single block so each lookup probes one block */
+    if (hashlib_count_buckets(tuple_table) > tuple_initial_buckets) {
+        if (hashlib_rehash(tuple_table) != OK) {
+            skAppPrintErr("Insufficient memory to rehash tuples");
+            return -1;
+        }
+    }
+
+    if (save_file && tupleWriteBinaryFile()) {
         return -1;
     }
 
@@ -388,7 +440,8 @@ checktype_t
 tupleCheck(
     const rwRec        *rwrec)
 {
-    uint8_t key[SK_MAX_RECORD_SIZE];
+    uint8_t key[TUPLE_KEY_MAX];
+    uint8_t *value;
     uint32_t i;
 
     if (direction & TUPLE_FORWARD) {
@@ -427,7 +480,7 @@ tupleCheck(
             }
         }
 
-        if (rbfind(&key, rb) != NULL) {
+        if (hashlib_lookup(tuple_table, key, &value) == OK) {
             /* found it */
             return RWF_PASS;
         }
@@ -469,7 +522,7 @@ tupleCheck(
             }
         }
 
-        if (rbfind(&key, rb) != NULL) {
+        if (hashlib_lookup(tuple_table, key, &value) == OK) {
             /* found it */
             return RWF_PASS;
         }
@@ -480,30 +533,11 @@ tupleCheck(
 }
 
 
-/*
- *  gt_lt_eq = tupleCompare(key_a, key_b, config);
- *
- *    Comparison function for the redblack tree; compares the
- *    keyortpair_t's key_a and key_b, returning -1 if key_a comes
- *    before key_b.
- */
-static int
-tupleCompare(
-    const void         *pa,
-    const void         *pb,
-    const void  UNUSED(*config))
-{
-    return memcmp(pa, pb, node_length);
-}
-
-
 /*
  *  ok = tupleInitializeMemory();
  *
- *    Create a redblack tree to hold information about the tuples.
- *
- *    Create the global 'array_vec' that is used to store pointers to
- *    arrays of nodes that we feed to redblack.
+ *    Create the hash table to hold the keys of the tuples.  The
+ *    length of a key, 'node_length', must be known.
  *
  *    Return 0 on success, or non-zero on allocation failure.
  */
@@ -511,49 +545,54 @@ static int
 tupleInitializeMemory(
     void)
 {
-    /* Create the vectory to store the array of nodes */
-    array_vec = skVectorNew(sizeof(uint8_t**));
-    if (array_vec == NULL) {
-        skAppPrintErr("Insufficient memory to create vector");
-        return -1;
-    }
-
-    /* Create the redblack tree */
-    rb = rbinit(&tupleCompare, NULL);
-    if (rb == NULL) {
-        skAppPrintErr("Insufficient memory to create redblack tree");
+    assert(NULL == tuple_table);
+    assert(node_length > 0 && node_length <= TUPLE_KEY_MAX);
+
+    /* The value of each entry is a single octet that is set to 1;
+     * the keys are the tuples */
+    tuple_table = hashlib_create_table((uint8_t)node_length, 1, HTT_INPLACE,
+                                       NULL, NULL, 0, TUPLE_INITIAL_SIZE,
+                                       DEFAULT_LOAD_FACTOR);
+    if (NULL == tuple_table) {
+        skAppPrintErr("Insufficient memory to create hash table");
         return -1;
     }
+    tuple_initial_buckets = hashlib_count_buckets(tuple_table);
 
     return 0;
 }
 
 
 /*
- *  new_mem = tupleGrowMemory();
+ *  ok = tupleInsertKey(key);
  *
- *    Create a new array of nodes for the redblack tree, put a pointer
- *    to that array into the global 'array_vec', and return the array.
- *    Return NULL for an allocation error.
+ *    Add the tuple whose key is 'key' to the hash table, creating the
+ *    table if necessary.  A key that is already present is ignored.
+ *    Return 0 on success, or -1 on allocation failure.
  */
-static uint8_t *
-tupleGrowMemory(
-    void)
+static int
+tupleInsertKey(
+    const uint8_t      *key)
 {
-    uint8_t *new_mem;
+    uint8_t *value;
 
-    assert(array_vec != NULL);
-    new_mem = (uint8_t*)calloc(NODE_ARRAY_SIZE, node_length);
-    if (new_mem == NULL) {
-        return NULL;
+    if (NULL == tuple_table) {
+        if (tupleInitializeMemory()) {
+            return -1;
+        }
     }
 
-    if (skVectorAppendValue(array_vec, &new_mem)) {
-        free(new_mem);
-        return NULL;
+    switch (hashlib_insert(tuple_table, key, &value)) {
+      case OK:
+        *value = 1;
+        break;
+      case OK_DUPLICATE:
+        break;
+      default:
+        skAppPrintErr("Insufficient memory to add tuple to hash table");
+        return -1;
     }
-
-    return new_mem;
+    return 0;
 }
 
 
@@ -660,6 +699,56 @@ tupleParseDirection(
 }
 
 
+/*
+ *  status = tupleAddField(type);
+ *
+ *    Append the field whose identifier is 'type' to the global
+ *    'field[]' array, updating 'num_fields' and 'node_length'.
+ *
+ *    Return 0 on success; -1 if too many fields have been specified.
+ */
+static int
+tupleAddField(
+    uint32_t            type)
+{
+    if (num_fields >= TUPLE_MAX) {
+        skAppPrintErr("Only %d tuple-fields are supported",
+                      TUPLE_MAX);
+        return -1;
+    }
+
+    switch (type) {
+      case RWREC_FIELD_SIP:
+      case RWREC_FIELD_DIP:
+#if SK_ENABLE_IPV6
+        field[num_fields].length = RWREC_SIZEOF_SIPv6;
+#else
+        field[num_fields].length = RWREC_SIZEOF_SIPv4;
+#endif
+        break;
+
+      case RWREC_FIELD_SPORT:
+      case RWREC_FIELD_DPORT:
+        field[num_fields].length = RWREC_SIZEOF_SPORT;
+        break;
+
+      case RWREC_FIELD_PROTO:
+        field[num_fields].length = RWREC_SIZEOF_PROTO;
+        break;
+
+      default:
+        skAbortBadCase(type);
+    }
+
+    field[num_fields].type = type;
+    field[num_fields].offset = node_length;
+    node_length += field[num_fields].length;
+    ++num_fields;
+
+    return 0;
+}
+
+
 /*
  *  status = tupleParseFieldNames(fields_string);
  *
@@ -697,39 +786,9 @@ tupleParseFieldNames(
     }
 
     while (skStringMapIterNext(iter, &entry, NULL) == SK_ITERATOR_OK) {
-        if (num_fields >= TUPLE_MAX) {
-            skAppPrintErr("Only %d tuple-fields are supported",
-                          TUPLE_MAX);
+        if (tupleAddField(entry->id)) {
             goto END;
         }
-
-        switch (entry->id) {
-          case RWREC_FIELD_SIP:
-          case RWREC_FIELD_DIP:
-#if SK_ENABLE_IPV6
-            field[num_fields].length = RWREC_SIZEOF_SIPv6;
-#else
-            field[num_fields].length = RWREC_SIZEOF_SIPv4;
-#endif
-            break;
-
-          case RWREC_FIELD_SPORT:
-          case RWREC_FIELD_DPORT:
-            field[num_fields].length = RWREC_SIZEOF_SPORT;
-            break;
-
-          case RWREC_FIELD_PROTO:
-            field[num_fields].length = RWREC_SIZEOF_PROTO;
-            break;
-
-          default:
-            skAbortBadCase(field[num_fields].type);
-        }
-
-        field[num_fields].type = entry->id;
-        field[num_fields].offset = node_length;
-        node_length += field[num_fields].length;
-        ++num_fields;
     }
 
     rv = 0;
@@ -845,10 +904,7 @@ static int
 tupleProcessFields(
     char               *field_val[])
 {
-    static uint8_t *node_array = NULL;
-    static uint8_t *cur_node = NULL;
-    static uint8_t *final_node = NULL;
-    const uint8_t *dup_check;
+    uint8_t cur_node[TUPLE_KEY_MAX];
     uint32_t cidr;
     uint32_t i;
     tuple_cidr_t sip;
@@ -870,17 +926,6 @@ tupleProcessFields(
     memset(&dport, 0, sizeof(number_list_t));
     memset(&proto, 0, sizeof(number_list_t));
 
-    if (node_array == NULL) {
-        /* create an array of nodes */
-        node_array = tupleGrowMemory();
-        if (node_array == NULL) {
-            skAppPrintErr("Cannot create array of nodes");
-            return -1;
-        }
-        cur_node = node_array;
-        final_node = node_array + (NODE_ARRAY_SIZE * node_length);
-    }
-
     /* parse the fields */
     for (i = 0; i < num_fields; ++i) {
 
@@ -1052,27 +1097,10 @@ tupleProcessFields(
             } /* switch */
         }
 
-        dup_check = (const uint8_t*)rbsearch(cur_node, rb);
-        if (dup_check == cur_node) {
-            /* new node added */
-            cur_node += node_length;
-
-            if (cur_node >= final_node) {
-                assert(cur_node == final_node);
-
-                /* need more entries */
-                node_array = tupleGrowMemory();
-                if (node_array == NULL) {
-                    skAppPrintErr("Cannot create array of nodes");
-                    goto END;
-                }
-                cur_node = node_array;
-                final_node = node_array + (NODE_ARRAY_SIZE * node_length);
-            }
-
-
+        /* add the key; a duplicate key is ignored */
+        if (tupleInsertKey(cur_node)) {
+            goto END;
         }
-        /* else key was duplicate and we ignore it */
 
     } while (incremented != 0);
 
@@ -1129,10 +1157,6 @@ tupleParseFile(
         }
     }
 
-    if (tupleInitializeMemory()) {
-        return 1;
-    }
-
     rv = filterOpenInputData(&stream, SK_CONTENT_TEXT, input_file);
     if (rv == -1) {
         skAppPrintErr("Problem with input file %s", input_file);
@@ -1254,18 +1278,291 @@ tupleParseFile(
     if (err_count) {
         return -1;
     }
-    /* return error code if we do not have any entries */
-    if (array_vec == NULL
-        || 0 == skVectorGetCount(array_vec))
+    return 0;
+}
+
+
+/*
+ *  is_binary = tupleFileIsBinary();
+ *
+ *    Return 1 if the file named by the global 'input_file' is a
+ *    regular file that begins with the SiLK magic number, or 0
+ *    otherwise.  The standard input and named pipes are always
+ *    treated as text since they cannot be read twice.
+ */
+static int
+tupleFileIsBinary(
+    void)
+{
+    uint8_t magic[4];
+    FILE *fp;
+    int is_binary = 0;
+
+    if (0 == strcmp(input_file, "-")
+        || 0 == strcmp(input_file, "stdin")
+        || !skFileExists(input_file)
+        || isFIFO(input_file))
     {
-        skAppPrintErr("No valid entries read from input file '%s'",
+        return 0;
+    }
+    fp = fopen(input_file, "rb");
+    if (NULL == fp) {
+        /* let the text reader report the error */
+        return 0;
+    }
+    if (fread(magic, sizeof(magic), 1, fp) == 1
+        && 0xDE == magic[0] && 0xAD == magic[1]
+        && 0xBE == magic[2] && 0xEF == magic[3])
+    {
+        is_binary = 1;
+    }
+    fclose(fp);
+
+    return is_binary;
+}
+
+
+/*
+ *  tupleSwapKey(key);
+ *
+ *    Swap the byte order of the ports and IPv4 addresses in 'key', a
+ *    key read from a binary tuple file whose byte order differs from
+ *    that of this machine.
+ */
+static void
+tupleSwapKey(
+    uint8_t            *key)
+{
+#if !SK_ENABLE_IPV6
+    uint32_t ipv4;
+#endif
+    uint16_t port;
+    uint32_t i;
+
+    for (i = 0; i < num_fields; ++i) {
+        switch (field[i].type) {
+          case RWREC_FIELD_SIP:
+          case RWREC_FIELD_DIP:
+#if !SK_ENABLE_IPV6
+            memcpy(&ipv4, key + field[i].offset, sizeof(ipv4));
+            ipv4 = BSWAP32(ipv4);
+            memcpy(key + field[i].offset, &ipv4, sizeof(ipv4));
+#endif
+            break;
+          case RWREC_FIELD_SPORT:
+          case RWREC_FIELD_DPORT:
+            memcpy(&port, key + field[i].offset, sizeof(port));
+            port = BSWAP16(port);
+            memcpy(key + field[i].offset, &port, sizeof(port));
+            break;
+          case RWREC_FIELD_PROTO:
+            break;
+          default:
+            skAbortBadCase(field[i].type);
+        }
+    }
+}
+
+
+/*
+ *  ok = tupleReadBinaryFile();
+ *
+ *    Read the binary tuple file named by the global 'input_file' and
+ *    add its keys to the hash table.  The fields are taken from the
+ *    tuple header entry of the file; when the user also gave
+ *    --tuple-fields, those fields must match the file's.
+ *
+ *    Return 0 on success, or -1 otherwise.
+ */
+static int
+tupleReadBinaryFile(
+    void)
+{
+    uint8_t buf[TUPLE_READ_KEYS * TUPLE_KEY_MAX];
+    sk_file_header_t *hdr;
+    sk_header_entry_t *hentry;
+    skstream_t *stream = NULL;
+    uint32_t field_count;
+    uint32_t type;
+    uint32_t j;
+    size_t read_len;
+    ssize_t got;
+    ssize_t i;
+    int swap_flag;
+    int rv = -1;
+
+    if ((got = skStreamCreate(&stream, SK_IO_READ, SK_CONTENT_SILK))
+        || (got = skStreamBind(stream, input_file))
+        || (got = skStreamOpen(stream))
+        || (got = skStreamReadSilkHeader(stream, &hdr)))
+    {
+        skStreamPrintLastErr(stream, got, &skAppPrintErr);
+        goto END;
+    }
+    if (skStreamCheckSilkHeader(stream, FT_RWTUPLE, TUPLE_REC_VERSION_IPV4,
+                                TUPLE_REC_VERSION_IPV6, &skAppPrintErr))
+    {
+        goto END;
+    }
+    if (skHeaderGetRecordVersion(hdr) != TUPLE_REC_VERSION) {
+#if SK_ENABLE_IPV6
+        skAppPrintErr(("Cannot read tuple file '%s': File was written"
+                       " by a SiLK without IPv6 support"), input_file);
+#else
+        skAppPrintErr(("Cannot read tuple file '%s': File was written"
+                       " by a SiLK with IPv6 support"), input_file);
+#endif
+        goto END;
+    }
+
+    /* get the fields from the header */
+    hentry = skHeaderGetFirstMatch(hdr, SK_HENTRY_TUPLE_ID);
+    if (NULL == hentry) {
+        skAppPrintErr("Tuple file '%s' does not contain a list of fields",
                       input_file);
+        goto END;
+    }
+    field_count = skHentryTupleGetFieldCount(hentry);
+    if (num_fields) {
+        /* fields given by --tuple-fields must match */
+        for (j = 0; j < field_count && j < num_fields; ++j) {
+            if (field[j].type != skHentryTupleGetFieldId(hentry, j)) {
+                break;
+            }
+        }
+        if (j != field_count || j != num_fields) {
+            skAppPrintErr(("The --%s do not match the fields"
+                           " of the tuple file '%s'"),
+                          tupleOptions[OPT_TUPLE_FIELDS].name, input_file);
+            goto END;
+        }
+    } else {
+        for (j = 0; j < field_count; ++j) {
+            type = skHentryTupleGetFieldId(hentry, j);
+            switch (type) {
+              case RWREC_FIELD_SIP:
+              case RWREC_FIELD_DIP:
+              case RWREC_FIELD_SPORT:
+              case RWREC_FIELD_DPORT:
+              case RWREC_FIELD_PROTO:
+                break;
+              default:
+                skAppPrintErr("Tuple file '%s' contains an unknown field %"
+                              PRIu32, input_file, type);
+                goto END;
+            }
+            if (tupleAddField(type)) {
+                goto END;
+            }
+        }
+    }
+    if (0 == node_length || skHeaderGetRecordLength(hdr) != node_length) {
+        skAppPrintErr("Tuple file '%s' has an invalid record length",
+                      input_file);
+        goto END;
+    }
+    swap_flag = !skHeaderIsNativeByteOrder(hdr);
+
+    /* read the keys */
+    read_len = TUPLE_READ_KEYS * node_length;
+    while ((got = skStreamRead(stream, buf, read_len)) > 0) {
+        if (0 != got % node_length) {
+            skAppPrintErr("Tuple file '%s' is truncated", input_file);
+            goto END;
+        }
+        for (i = 0; i < got; i += node_length) {
+            if (swap_flag) {
+                tupleSwapKey(buf + i);
+            }
+            if (tupleInsertKey(buf + i)) {
+                goto END;
+            }
+        }
+    }
+    if (got < 0) {
+        skStreamPrintLastErr(stream, skStreamGetLastReturnValue(stream),
+                             &skAppPrintErr);
+        goto END;
+    }
+
+    rv = 0;
+
+  END:
+    skStreamDestroy(&stream);
+    return rv;
+}
+
+
+/*
+ *  ok = tupleWriteBinaryFile();
+ *
+ *    Write the keys in the hash table to the binary tuple file named
+ *    by the global 'save_file'.  Return 0 on success, or -1 on error.
+ */
+static int
+tupleWriteBinaryFile(
+    void)
+{
+    uint32_t field_ids[TUPLE_MAX];
+    sk_file_header_t *hdr;
+    skstream_t *stream = NULL;
+    HASH_ITER iter;
+    uint8_t *key;
+    uint8_t *value;
+    ssize_t rv;
+    uint32_t i;
+
+    for (i = 0; i < num_fields; ++i) {
+        field_ids[i] = field[i].type;
+    }
+
+    if ((rv = skStreamCreate(&stream, SK_IO_WRITE, SK_CONTENT_SILK))
+        || (rv = skStreamBind(stream, save_file)))
+    {
+        goto END;
+    }
+
+    /* prep the header */
+    hdr = skStreamGetSilkHeader(stream);
+    skHeaderSetByteOrder(hdr, SILK_ENDIAN_NATIVE);
+    skHeaderSetFileFormat(hdr, FT_RWTUPLE);
+    skHeaderSetRecordVersion(hdr, TUPLE_REC_VERSION);
+    skHeaderSetRecordLength(hdr, node_length);
+    if ((rv = skHeaderSetCompressionMethod(hdr, skCompMethodGetDefault()))
+        || (rv = skHeaderAddTuple(hdr, num_fields, field_ids)))
+    {
+        skAppPrintErr("Unable to create header for tuple file '%s': %s",
+                      save_file, skHeaderStrerror(rv));
+        skStreamDestroy(&stream);
         return -1;
     }
+
+    if ((rv = skStreamOpen(stream))
+        || (rv = skStreamWriteSilkHeader(stream)))
+    {
+        goto END;
+    }
+
+    iter = hashlib_create_iterator(tuple_table);
+    while (hashlib_iterate(tuple_table, &iter, &key, &value) == OK) {
+        rv = skStreamWrite(stream, key, node_length);
+        if (rv != (ssize_t)node_length) {
+            rv = skStreamGetLastReturnValue(stream);
+            goto END;
+        }
+    }
+    rv = skStreamClose(stream);
+
+  END:
+    if (rv) {
+        skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+        skStreamDestroy(&stream);
+        return -1;
+    }
+    skStreamDestroy(&stream);
     return 0;
 }
 
-
 /*
 ** Local Variables:
 ** mode:c
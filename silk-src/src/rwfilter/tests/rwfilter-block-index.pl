@@ -0,0 +1,20 @@
+#! /usr/bin/perl -w
+# MD5: adaf05ba2f6aceea553d60ee1bd1d1f7
+# TEST: SILK_BLOCK_INDEX=1 ../rwcat/rwcat --compression-method=zlib --output-path=/tmp/rwfilter-block-index-indexed ../../tests/data.rwf && ./rwfilter --threads=2 --stime=2009/02/13T12-2009/02/13T13 --proto=6,17 --dcidr=10.0.0.0/8,192.168.0.0/16 --print-stat=/tmp/rwfilter-block-index-stat --pass=stdout /tmp/rwfilter-block-index-indexed | ../rwsort/rwsort --fields=1-5,stime | ../rwcut/rwcut --fields=1-10 --ipv6-policy=ignore && cat /tmp/rwfilter-block-index-stat
+
+use strict;
+use SiLKTests;
+
+my $rwfilter = check_silk_app('rwfilter');
+my $rwcat = check_silk_app('rwcat');
+my $rwsort = check_silk_app('rwsort');
+my $rwcut = check_silk_app('rwcut');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my %temp;
+$temp{indexed} = make_tempname('indexed');
+$temp{stat} = make_tempname('stat');
+my $cmd = "SILK_BLOCK_INDEX=1 $rwcat --compression-method=zlib --output-path=$temp{indexed} $file{data} && $rwfilter --threads=2 --stime=2009/02/13T12-2009/02/13T13 --proto=6,17 --dcidr=10.0.0.0/8,192.168.0.0/16 --print-stat=$temp{stat} --pass=stdout $temp{indexed} | $rwsort --fields=1-5,stime | $rwcut --fields=1-10 --ipv6-policy=ignore && cat $temp{stat}";
+my $md5 = "adaf05ba2f6aceea553d60ee1bd1d1f7";
+
+check_md5_output($md5, $cmd);
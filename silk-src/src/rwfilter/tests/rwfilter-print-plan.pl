@@ -0,0 +1,14 @@
+#! /usr/bin/perl -w
+# MD5: 2dd7d2124b7d4f2111a07e02556adaef
+# TEST: ./rwfilter --sport=0-1023 --proto=6 --any-cidr=192.168.0.0/16 --print-statistics --print-plan --pass=/dev/null ../../tests/data.rwf 2>&1
+
+use strict;
+use SiLKTests;
+
+my $rwfilter = check_silk_app('rwfilter');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwfilter --sport=0-1023 --proto=6 --any-cidr=192.168.0.0/16 --print-statistics --print-plan --pass=/dev/null $file{data} 2>&1";
+my $md5 = "2dd7d2124b7d4f2111a07e02556adaef";
+
+check_md5_output($md5, $cmd);
@@ -0,0 +1,18 @@
+#! /usr/bin/perl -w
+# MD5: 3ba978946e0cf58bf1e88c692964b611
+# TEST: printf 'web --proto=6 --aport=80,443 --pass=/tmp/rwfilter-query-file-web\ndns --proto=17 --aport=53 --pass=/tmp/rwfilter-query-file-dns\n' | ./rwfilter --query-file=- --sport=0-1023 ../../tests/data.rwf && ../rwcat/rwcat --compression-method=none --byte-order=little --ipv4-output /tmp/rwfilter-query-file-web /tmp/rwfilter-query-file-dns
+
+use strict;
+use SiLKTests;
+
+my $rwfilter = check_silk_app('rwfilter');
+my $rwcat = check_silk_app('rwcat');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my %temp;
+$temp{web} = make_tempname('web');
+$temp{dns} = make_tempname('dns');
+my $cmd = "printf 'web --proto=6 --aport=80,443 --pass=$temp{web}\\ndns --proto=17 --aport=53 --pass=$temp{dns}\\n' | $rwfilter --query-file=- --sport=0-1023 $file{data} && $rwcat --compression-method=none --byte-order=little --ipv4-output $temp{web} $temp{dns}";
+my $md5 = "3ba978946e0cf58bf1e88c692964b611";
+
+check_md5_output($md5, $cmd);
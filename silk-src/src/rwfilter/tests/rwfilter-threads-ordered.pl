@@ -0,0 +1,15 @@
+#! /usr/bin/perl -w
+# MD5: b20302c98facd13915b48dc041e1d649
+# TEST: ./rwfilter --threads=4 --preserve-order --proto=17 --pass=stdout ../../tests/data.rwf ../../tests/data.rwf | ../rwcut/rwcut --fields=1-5,stime --ipv6-policy=ignore --timestamp-format=epoch --delimited --no-titles
+
+use strict;
+use SiLKTests;
+
+my $rwfilter = check_silk_app('rwfilter');
+my $rwcut = check_silk_app('rwcut');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwfilter --threads=4 --preserve-order --proto=17 --pass=stdout $file{data} $file{data} | $rwcut --fields=1-5,stime --ipv6-policy=ignore --timestamp-format=epoch --delimited --no-titles";
+my $md5 = "b20302c98facd13915b48dc041e1d649";
+
+check_md5_output($md5, $cmd);
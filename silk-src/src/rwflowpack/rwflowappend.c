@@ -19,6 +19,7 @@ RCSIDENT("$SiLK: rwflowappend.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 #include <silk/redblack.h>
 #include <silk/rwrec.h>
 #include <silk/skdaemon.h>
+#include <silk/skipset.h>
 #include <silk/sklog.h>
 #include <silk/skpolldir.h>
 #include <silk/sksite.h>
@@ -144,6 +145,10 @@ static sk_compmethod_t comp_method;
  * --no-file-locking */
 static int no_file_locking = 0;
 
+/* whether to maintain IPset index files that contain the source and
+ * destination addresses of each hourly file */
+static int ipset_index = 0;
+
 /* whether we are in shut-down mode */
 static volatile int shuttingdown = 0;
 
@@ -181,6 +186,7 @@ typedef enum {
     OPT_THREADS,
     OPT_REJECT_HOURS_PAST, OPT_REJECT_HOURS_FUTURE,
     OPT_NO_FILE_LOCKING,
+    OPT_IPSET_INDEX,
     OPT_POLLING_INTERVAL,
     OPT_BYTE_ORDER, OPT_PAD_HEADER
 } appOptionsEnum;
@@ -197,6 +203,7 @@ static struct option appOptions[] = {
     {"reject-hours-past",       REQUIRED_ARG, 0, OPT_REJECT_HOURS_PAST},
     {"reject-hours-future",     REQUIRED_ARG, 0, OPT_REJECT_HOURS_FUTURE},
     {"no-file-locking",         NO_ARG,       0, OPT_NO_FILE_LOCKING},
+    {"ipset-index",             NO_ARG,       0, OPT_IPSET_INDEX},
     {"polling-interval",        REQUIRED_ARG, 0, OPT_POLLING_INTERVAL},
     {"byte-order",              REQUIRED_ARG, 0, OPT_BYTE_ORDER},
     {"pad-header",              NO_ARG,       0, OPT_PAD_HEADER},
@@ -231,6 +238,8 @@ static const char *appHelp[] = {
      "\tfiles are moved into the error directory.  Def. Accept all files"),
     ("Do not attempt to lock the files prior to writing\n"
      "\trecords to them. Def. Use locking"),
+    ("Maintain IPset files holding the source and destination\n"
+     "\taddresses in each hourly file, for use by rwfilter. Def. No"),
     ("Check the incoming-directory this often for new\n"
      "\tincremental files (in seconds)"),
     ("Create new hourly files in this byte order. Def. 'as-is'.\n"
@@ -602,6 +611,10 @@ appOptionsHandler(
         no_file_locking = 1;
         break;
 
+      case OPT_IPSET_INDEX:
+        ipset_index = 1;
+        break;
+
       case OPT_POLLING_INTERVAL:
         rv = skStringParseUint32(&polling_interval, opt_arg, 1, 0);
         if (rv) {
@@ -1104,6 +1117,66 @@ openInputStream(
 }
 
 
+/*
+ *  updateIPsetIndex(state, index_set, close_pos);
+ *
+ *    Update the IPset index files of the hourly file 'state->out_path'
+ *    after the addresses in 'index_set' have been appended to it,
+ *    growing it from 'state->pos' octets to 'close_pos' octets.  The
+ *    caller must still hold the hourly file.  Destroy the IPsets in
+ *    'index_set'.
+ *
+ *    When the hourly file existed and its index is missing or stale,
+ *    remove the index files since they cannot be made accurate.
+ *    Errors are logged but are not fatal: rwfilter reads the hourly
+ *    file in its entirety when it has no valid index.
+ */
+static void
+updateIPsetIndex(
+    appender_state_t   *state,
+    skipset_t          *index_set[2],
+    int64_t             close_pos)
+{
+    const char *suffix[2] = {SKSITE_IPSET_INDEX_SIP_SUFFIX,
+                             SKSITE_IPSET_INDEX_DIP_SUFFIX};
+    char path[PATH_MAX];
+    skipset_t *old_set;
+    unsigned int i;
+
+    for (i = 0; i < 2; ++i) {
+        if (state->pos != 0) {
+            if (sksiteIPsetIndexLoad(&old_set, state->out_path, suffix[i],
+                                     (uint64_t)state->pos))
+            {
+                skIPSetDestroy(&index_set[i]);
+            } else {
+                if (skIPSetUnion(index_set[i], old_set)) {
+                    skIPSetDestroy(&index_set[i]);
+                }
+                skIPSetDestroy(&old_set);
+            }
+        }
+        if (index_set[i]) {
+            skIPSetClean(index_set[i]);
+            if (0 == sksiteIPsetIndexSave(index_set[i], state->out_path,
+                                          suffix[i], (uint64_t)close_pos))
+            {
+                skIPSetDestroy(&index_set[i]);
+                continue;
+            }
+            WARNINGMSG("Unable to write IPset index for '%s'",
+                       state->out_path);
+            skIPSetDestroy(&index_set[i]);
+        }
+        snprintf(path, sizeof(path), "%s%s", state->out_path, suffix[i]);
+        if (unlink(path) && errno != ENOENT) {
+            WARNINGMSG("Unable to remove stale IPset index '%s': %s",
+                       path, strerror(errno));
+        }
+    }
+}
+
+
 /*
  *  THREAD ENTRY POINT
  *
@@ -1122,6 +1195,8 @@ appender_main(
     char errbuf[2 * PATH_MAX];
     const sk_header_entry_t *hentry;
     skPollDirErr_t pderr;
+    skipset_t *index_set[2];
+    skipaddr_t ip;
     int64_t close_pos;
     int rv;
     int out_rv;
@@ -1282,6 +1357,19 @@ appender_main(
         /* initialize close_pos */
         close_pos = 0;
 
+        /* create the IPsets that hold the addresses being appended;
+         * if an IPset cannot be created, its index is removed */
+        index_set[0] = index_set[1] = NULL;
+        if (ipset_index) {
+            if (skIPSetCreate(&index_set[0], 0)
+                || skIPSetCreate(&index_set[1], 0))
+            {
+                WARNINGMSG("Unable to create IPset index for '%s'",
+                           state->out_path);
+                skIPSetDestroy(&index_set[0]);
+            }
+        }
+
         /* Write record to output and read next record from input */
         do {
             out_rv = skStreamWriteRecord(state->out_stream, &rwrec);
@@ -1290,6 +1378,20 @@ appender_main(
                     goto APPEND_ERROR;
                 }
                 skStreamPrintLastErr(state->out_stream, out_rv, &WARNINGMSG);
+            } else if (index_set[1]) {
+                rwRecMemGetSIP(&rwrec, &ip);
+                rv = skIPSetInsertAddress(index_set[0], &ip, 0);
+                if (0 == rv) {
+                    rwRecMemGetDIP(&rwrec, &ip);
+                    rv = skIPSetInsertAddress(index_set[1], &ip, 0);
+                }
+                if (rv) {
+                    /* an incomplete index must not be written */
+                    WARNINGMSG("Unable to update IPset index for '%s': %s",
+                               state->out_path, skIPSetStrerror(rv));
+                    skIPSetDestroy(&index_set[0]);
+                    skIPSetDestroy(&index_set[1]);
+                }
             }
         } while ((rv = skStreamReadRecord(state->in_stream, &rwrec))
                  == SKSTREAM_OK);
@@ -1317,6 +1419,10 @@ appender_main(
                  skStreamGetRecordCount(state->out_stream),state->out_basename,
                  state->pos, close_pos);
 
+        if (ipset_index) {
+            updateIPsetIndex(state, index_set, close_pos);
+        }
+
         destroyOutputStream(state);
 
         if (SKSTREAM_ERR_EOF != rv) {
@@ -1353,6 +1459,8 @@ appender_main(
     ERRMSG("Fatal error writing to hourly file: %s", errbuf);
     ERRMSG(("APPEND FAILED '%s' to '%s' @ %" PRId64),
            state->in_basename, state->out_path, state->pos);
+    skIPSetDestroy(&index_set[0]);
+    skIPSetDestroy(&index_set[1]);
     if (close_pos) {
         /* flush was okay but close failed. */
         ERRMSG(("Repository file '%s' in unknown state since flush"
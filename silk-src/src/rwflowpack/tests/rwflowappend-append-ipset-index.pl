@@ -0,0 +1,103 @@
+#! /usr/bin/perl -w
+#
+#
+# RCSIDENT("$SiLK: rwflowappend-append-ipset-index.pl $")
+
+use strict;
+use SiLKTests;
+use File::Temp ();
+
+
+# set envvar to run app under valgrind when SK_TESTS_VALGRIND is set
+check_silk_app('rwflowappend');
+
+# find the apps we need.  this will exit 77 if they're not available
+my $rwfilter = check_silk_app('rwfilter');
+my $rwset = check_silk_app('rwset');
+my $rwsetbuild = check_silk_app('rwsetbuild');
+my $rwsetcat = check_silk_app('rwsetcat');
+
+# find the data files we use as sources, or exit 77
+my %file;
+$file{data} = get_data_or_exit77('data');
+
+# prefix any existing PYTHONPATH with the proper directories
+check_python_bin();
+
+# create our tempdir
+my $tmpdir = make_tempdir();
+
+# create the two files
+my %input_files = (
+    dns  => File::Temp::mktemp("$tmpdir/in-S8_20090212.01.XXXXXX"),
+    rest => File::Temp::mktemp("$tmpdir/in-S8_20090212.01.XXXXXX"),
+    );
+
+my $cmd = ("$rwfilter --type=in --sensor=S8 --pass=stdout"
+           ." --stime=2009/02/12:01-2009/02/12:01 $file{data}"
+           ." | $rwfilter --input-pipe=- --sport=53 --print-volume"
+           ." --pass=$input_files{dns} --fail=$input_files{rest} 2>&1");
+check_md5_output('5d44a50315bfe60379fc1b0e7fec5a04', $cmd);
+
+
+# the command that wraps rwflowappend
+$cmd = join " ", ("$SiLKTests::PYTHON $srcdir/tests/rwflowappend-daemon.py",
+                  ($ENV{SK_TESTS_VERBOSE} ? "--verbose" : ()),
+                  ($ENV{SK_TESTS_LOG_DEBUG} ? "--log-level=debug" : ()),
+                  "--copy $input_files{dns}:incoming",
+                  "--copy $input_files{rest}:incoming",
+                  "--basedir=$tmpdir",
+                  "--",
+                  "--polling-interval=5",
+                  "--ipset-index",
+                  "--flat-archive",
+    );
+
+
+# run it and check the MD5 hash of its output
+check_md5_output('be50bfa0b38f0179132c2d2319ef1ad6', $cmd);
+
+
+# the following directories should be empty
+verify_empty_dirs($tmpdir, qw(error incoming));
+
+# verify files are in the archive directory
+verify_directory_files("$tmpdir/archive", values %input_files);
+
+
+# expected data file and its indexes
+my $data_file = "$tmpdir/root/in/2009/02/12/in-S8_20090212.01";
+for my $f ($data_file, "$data_file.sip", "$data_file.dip") {
+    die "ERROR: Missing file '$f'\n"
+        unless -f $f;
+}
+
+# each index must hold the addresses in the data file, which was
+# written by two appends
+for my $dir (qw(sip dip)) {
+    my ($index_md5, $data_md5);
+
+    $cmd = "$rwsetcat --cidr-blocks=0 $data_file.$dir";
+    compute_md5(\$index_md5, $cmd);
+
+    $cmd = ("$rwset --$dir-file=stdout $data_file"
+            ." | $rwsetcat --cidr-blocks=0");
+    compute_md5(\$data_md5, $cmd);
+
+    die "ERROR: $dir index mismatch [$index_md5] [$data_md5]\n"
+        unless $index_md5 eq $data_md5;
+}
+
+# replace the source index with an empty IPset that is valid for the
+# data file; rwfilter must trust it and skip the file
+my $size = -s $data_file;
+unlink "$data_file.sip"
+    or die "ERROR: Cannot remove '$data_file.sip': $!\n";
+$cmd = ("$rwsetbuild --note-add=ipset-index-file-size:$size"
+        ." /dev/null $data_file.sip");
+check_md5_output('d41d8cd98f00b204e9800998ecf8427e', $cmd);
+
+$cmd = "$rwfilter --saddress=172.24.3.123 --print-stat $data_file 2>&1";
+check_md5_output('0c20fbbdc245d58f271349bec41e65e9', $cmd);
+
+exit 0;
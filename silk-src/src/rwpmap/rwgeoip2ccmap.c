@@ -833,6 +833,10 @@ static int dry_run = 0;
  * map file. set by --invocation-strip */
 static int invocation_strip = 0;
 
+/* the record version of the prefix map file; 0 to use the version
+ * that all releases of SiLK can read.  set by --record-version */
+static sk_file_version_t record_version = 0;
+
 
 /* OPTIONS SETUP */
 
@@ -843,6 +847,7 @@ typedef enum {
     OPT_DRY_RUN,
     OPT_INVOCATION_STRIP,
     OPT_FIELDS,
+    OPT_RECORD_VERSION,
     OPT_CSV_INPUT,
     OPT_V6_CSV_INPUT,
     OPT_ENCODED_INPUT
@@ -862,6 +867,7 @@ static struct option appOptions[] = {
     {"dry-run",             NO_ARG,       0, OPT_DRY_RUN},
     {"invocation-strip",    NO_ARG,       0, OPT_INVOCATION_STRIP},
     {"fields",              REQUIRED_ARG, 0, OPT_FIELDS},
+    {"record-version",      REQUIRED_ARG, 0, OPT_RECORD_VERSION},
     {0,0,0,0}               /* sentinel entry */
 };
 
@@ -880,6 +886,10 @@ static const char *appHelp[] = {
      "\tDef. Record command used to create the file"),
     ("Choose which of the fields provided by GeoIP2 data files\n"
      "\tare checked for a valid country code.\n"),
+    ("Specify the format of the prefix map file: 0 to use the\n"
+     "\tformat that all releases of SiLK read, or 6 to use the format\n"
+     "\tthat SiLK 3.20.0 and later may mmap() when reading the file.\n"
+     "\tDef. 0"),
     (char *)NULL
 };
 
@@ -974,7 +984,7 @@ SK_DIAGNOSTIC_IGNORE_PUSH("-Wwrite-strings")
 
 
 
-#line 978 "rwgeoip2ccmap.c"
+#line 988 "rwgeoip2ccmap.c"
 
 #define INITIAL 0
 #define ST_CSV2 1
@@ -1142,10 +1152,10 @@ YY_DECL
 	register char *yy_cp, *yy_bp;
 	register int yy_act;
     
-#line 479 "rwgeoip2ccmap.l"
+#line 489 "rwgeoip2ccmap.l"
 
 
-#line 1149 "rwgeoip2ccmap.c"
+#line 1159 "rwgeoip2ccmap.c"
 
 	if ( !(yy_init) )
 		{
@@ -1226,7 +1236,7 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 481 "rwgeoip2ccmap.l"
+#line 491 "rwgeoip2ccmap.l"
 { if (csv2Column(geoip2ccmap_text)) {
                                             BEGIN(ST_CSV2_ERROR);
                                         } else {
@@ -1235,7 +1245,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 487 "rwgeoip2ccmap.l"
+#line 497 "rwgeoip2ccmap.l"
 { if (csv2Column(geoip2ccmap_text)) {
                                             next_state = ST_CSV2;
                                             BEGIN(ST_CSV2_ERROR);
@@ -1243,27 +1253,27 @@ YY_RULE_SETUP
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 492 "rwgeoip2ccmap.l"
+#line 502 "rwgeoip2ccmap.l"
 { BEGIN(ST_CSV2_DQ); }
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 493 "rwgeoip2ccmap.l"
+#line 503 "rwgeoip2ccmap.l"
 { BEGIN(ST_CSV2_NEXT); }
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 494 "rwgeoip2ccmap.l"
+#line 504 "rwgeoip2ccmap.l"
 { column += geoip2ccmap_leng;
                                         BEGIN(ST_CSV2); }
 	YY_BREAK
 case 6:
 /* rule 6 can match eol */
-#line 498 "rwgeoip2ccmap.l"
+#line 508 "rwgeoip2ccmap.l"
 case 7:
 /* rule 7 can match eol */
 YY_RULE_SETUP
-#line 498 "rwgeoip2ccmap.l"
+#line 508 "rwgeoip2ccmap.l"
 { column += geoip2ccmap_leng;
                                         csv2CreateEntry();
                                         ++linenum;
@@ -1271,7 +1281,7 @@ YY_RULE_SETUP
                                         BEGIN(ST_CSV2); }
 	YY_BREAK
 case YY_STATE_EOF(ST_CSV2):
-#line 504 "rwgeoip2ccmap.l"
+#line 514 "rwgeoip2ccmap.l"
 { if (column) {
                                             csv2CreateEntry();
                                         }
@@ -1283,7 +1293,7 @@ case YY_STATE_EOF(ST_CSV2):
                                       }
 	YY_BREAK
 case YY_STATE_EOF(ST_CSV2_NEXT):
-#line 513 "rwgeoip2ccmap.l"
+#line 523 "rwgeoip2ccmap.l"
 { /* unusual */
                                         if (column) {
                                             ++column;
@@ -1299,7 +1309,7 @@ case YY_STATE_EOF(ST_CSV2_NEXT):
 case 8:
 /* rule 8 can match eol */
 YY_RULE_SETUP
-#line 525 "rwgeoip2ccmap.l"
+#line 535 "rwgeoip2ccmap.l"
 { /* probably an error */
                                         if (column) {
                                             csv2CreateEntry();
@@ -1311,7 +1321,7 @@ YY_RULE_SETUP
 case 9:
 /* rule 9 can match eol */
 YY_RULE_SETUP
-#line 533 "rwgeoip2ccmap.l"
+#line 543 "rwgeoip2ccmap.l"
 { scanErr("Closing quote not found");
                                         ++linenum;
                                         csv2Reset();
@@ -1319,7 +1329,7 @@ YY_RULE_SETUP
                                       }
 	YY_BREAK
 case YY_STATE_EOF(ST_CSV2_DQ):
-#line 538 "rwgeoip2ccmap.l"
+#line 548 "rwgeoip2ccmap.l"
 { scanErr("Closing quote not found");
                                         if (csv2NextFile()) {
                                             return 0;
@@ -1330,12 +1340,12 @@ case YY_STATE_EOF(ST_CSV2_DQ):
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 546 "rwgeoip2ccmap.l"
+#line 556 "rwgeoip2ccmap.l"
 ;
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 547 "rwgeoip2ccmap.l"
+#line 557 "rwgeoip2ccmap.l"
 { scanErr("Expected ',', found %c",
                                                 *geoip2ccmap_text);
                                         next_state = ST_CSV2;
@@ -1344,20 +1354,20 @@ YY_RULE_SETUP
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 553 "rwgeoip2ccmap.l"
+#line 563 "rwgeoip2ccmap.l"
 ;
 	YY_BREAK
 case 13:
 /* rule 13 can match eol */
 YY_RULE_SETUP
-#line 554 "rwgeoip2ccmap.l"
+#line 564 "rwgeoip2ccmap.l"
 { ++linenum;
                                         csv2Reset();
                                         BEGIN(ST_CSV2);
                                       }
 	YY_BREAK
 case YY_STATE_EOF(ST_CSV2_ERROR):
-#line 558 "rwgeoip2ccmap.l"
+#line 568 "rwgeoip2ccmap.l"
 { if (csv2NextFile()) {
                                             return 0;
                                         }
@@ -1368,17 +1378,17 @@ case YY_STATE_EOF(ST_CSV2_ERROR):
 case 14:
 /* rule 14 can match eol */
 YY_RULE_SETUP
-#line 567 "rwgeoip2ccmap.l"
+#line 577 "rwgeoip2ccmap.l"
 { ++linenum; legacyReset(); }
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 568 "rwgeoip2ccmap.l"
+#line 578 "rwgeoip2ccmap.l"
 { BEGIN(ST_LEG_ENTRY); }
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 570 "rwgeoip2ccmap.l"
+#line 580 "rwgeoip2ccmap.l"
 { if (legacyColumn(geoip2ccmap_text)) {
                                             BEGIN(ST_LEG_ERROR);
                                         } else {
@@ -1387,29 +1397,29 @@ YY_RULE_SETUP
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 576 "rwgeoip2ccmap.l"
+#line 586 "rwgeoip2ccmap.l"
 { BEGIN(ST_LEG_NEXT_ENTRY); }
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 577 "rwgeoip2ccmap.l"
+#line 587 "rwgeoip2ccmap.l"
 { ++column; }
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 578 "rwgeoip2ccmap.l"
+#line 588 "rwgeoip2ccmap.l"
 { BEGIN(ST_LEG_ENTRY); }
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 579 "rwgeoip2ccmap.l"
+#line 589 "rwgeoip2ccmap.l"
 ;
 	YY_BREAK
 case 21:
 /* rule 21 can match eol */
-#line 582 "rwgeoip2ccmap.l"
+#line 592 "rwgeoip2ccmap.l"
 case YY_STATE_EOF(ST_LEG_NEXT_ENTRY):
-#line 582 "rwgeoip2ccmap.l"
+#line 592 "rwgeoip2ccmap.l"
 { ++column;
                                         legacyCreateEntry();
                                         ++linenum;
@@ -1418,7 +1428,7 @@ case YY_STATE_EOF(ST_LEG_NEXT_ENTRY):
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 588 "rwgeoip2ccmap.l"
+#line 598 "rwgeoip2ccmap.l"
 { scanErr("Column %u is empty string",
                                                 column);
                                         BEGIN(ST_LEG_ERROR);
@@ -1427,7 +1437,7 @@ YY_RULE_SETUP
 case 23:
 /* rule 23 can match eol */
 YY_RULE_SETUP
-#line 593 "rwgeoip2ccmap.l"
+#line 603 "rwgeoip2ccmap.l"
 { scanErr(("Unexpected end-of-line"
                                                  " found in column %u"),
                                                 column);
@@ -1437,7 +1447,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case YY_STATE_EOF(ST_LEG_ENTRY):
 case YY_STATE_EOF(ST_LEG_CLOSE_ENTRY):
-#line 600 "rwgeoip2ccmap.l"
+#line 610 "rwgeoip2ccmap.l"
 {
                                         scanErr(("Unexpected end-of-stream"
                                                  " found in column %u"),
@@ -1446,35 +1456,35 @@ case YY_STATE_EOF(ST_LEG_CLOSE_ENTRY):
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 606 "rwgeoip2ccmap.l"
+#line 616 "rwgeoip2ccmap.l"
 { scanErr("Unexpected input '%c'",
                                                 *geoip2ccmap_text);
                                         BEGIN(ST_LEG_ERROR); }
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 610 "rwgeoip2ccmap.l"
+#line 620 "rwgeoip2ccmap.l"
 ;
 	YY_BREAK
 case 26:
 /* rule 26 can match eol */
 YY_RULE_SETUP
-#line 611 "rwgeoip2ccmap.l"
+#line 621 "rwgeoip2ccmap.l"
 { ++linenum;
                                         legacyReset();
                                         BEGIN(INITIAL); }
 	YY_BREAK
 case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(ST_LEG_ERROR):
-#line 615 "rwgeoip2ccmap.l"
+#line 625 "rwgeoip2ccmap.l"
 { return 0; }
 	YY_BREAK
 case 27:
 YY_RULE_SETUP
-#line 617 "rwgeoip2ccmap.l"
+#line 627 "rwgeoip2ccmap.l"
 ECHO;
 	YY_BREAK
-#line 1478 "rwgeoip2ccmap.c"
+#line 1488 "rwgeoip2ccmap.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -2365,7 +2375,7 @@ void geoip2ccmap_free (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 617 "rwgeoip2ccmap.l"
+#line 627 "rwgeoip2ccmap.l"
 
 
 
@@ -2642,6 +2652,7 @@ appOptionsHandler(
     int                 opt_index,
     char               *opt_arg)
 {
+    uint32_t tmp32;
     ssize_t rv;
     int idx;
 
@@ -2684,6 +2695,22 @@ appOptionsHandler(
         }
         break;
 
+      case OPT_RECORD_VERSION:
+        rv = skStringParseUint32(&tmp32, opt_arg, 0, UINT8_MAX);
+        if (rv) {
+            skAppPrintErr("Invalid %s '%s': %s",
+                          appOptions[opt_index].name, opt_arg,
+                          skStringParseStrerror(rv));
+            return 1;
+        }
+        if (0 != tmp32 && 6 != tmp32) {
+            skAppPrintErr("Invalid %s '%s': Version must be 0 or 6",
+                          appOptions[opt_index].name, opt_arg);
+            return 1;
+        }
+        record_version = (sk_file_version_t)tmp32;
+        break;
+
       case OPT_DRY_RUN:
         dry_run = 1;
         break;
@@ -3279,6 +3306,7 @@ writeOutput(
         exit(EXIT_FAILURE);
     }
 
+    skPrefixMapSetRecordVersion(map, record_version);
     rv = skPrefixMapWrite(map, out_stream);
     if (rv != SKPREFIXMAP_OK) {
         if (rv == SKPREFIXMAP_ERR_IO) {
@@ -707,6 +707,10 @@ static int dry_run = 0;
  * by --ignore-errors */
 static int ignore_errors = 0;
 
+/* the record version of the prefix map file; 0 to use the version
+ * that all releases of SiLK can read.  set by --record-version */
+static sk_file_version_t record_version = 0;
+
 /* do not record the command line invocation in the generated prefix
  * map file. set by --invocation-strip */
 static int invocation_strip = 0;
@@ -720,6 +724,7 @@ typedef enum {
     OPT_MODE,
     OPT_DRY_RUN,
     OPT_IGNORE_ERRORS,
+    OPT_RECORD_VERSION,
     OPT_INVOCATION_STRIP
 } appOptionsEnum;
 
@@ -729,6 +734,7 @@ static struct option appOptions[] = {
     {"mode",                REQUIRED_ARG, 0, OPT_MODE},
     {"dry-run",             NO_ARG,       0, OPT_DRY_RUN},
     {"ignore-errors",       NO_ARG,       0, OPT_IGNORE_ERRORS},
+    {"record-version",      REQUIRED_ARG, 0, OPT_RECORD_VERSION},
     {"invocation-strip",    NO_ARG,       0, OPT_INVOCATION_STRIP},
     {0,0,0,0}               /* sentinel entry */
 };
@@ -741,6 +747,10 @@ static const char *appHelp[] = {
      "\tstatement in the input."),
     "Do not write the output file",
     "Write the output file despite any errors in the input",
+    ("Specify the format of the prefix map file: 0 to use the\n"
+     "\tformat that all releases of SiLK read, or 6 to use the format\n"
+     "\tthat SiLK 3.20.0 and later may mmap() when reading the file.\n"
+     "\tDef. 0"),
     ("Strip invocation history from the prefix map file.\n"
      "\tDef. Record command used to create the file"),
     (char *)NULL
@@ -819,7 +829,7 @@ SK_DIAGNOSTIC_IGNORE_PUSH("-Wwrite-strings")
 
 
 
-#line 823 "rwpmapbuild.c"
+#line 833 "rwpmapbuild.c"
 
 #define INITIAL 0
 #define ST_EOL 1
@@ -988,10 +998,10 @@ YY_DECL
 	register char *yy_cp, *yy_bp;
 	register int yy_act;
     
-#line 270 "rwpmapbuild.l"
+#line 280 "rwpmapbuild.l"
 
 
-#line 995 "rwpmapbuild.c"
+#line 1005 "rwpmapbuild.c"
 
 	if ( !(yy_init) )
 		{
@@ -1072,12 +1082,12 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 272 "rwpmapbuild.l"
+#line 282 "rwpmapbuild.l"
 { BEGIN(ST_MODE); }
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 274 "rwpmapbuild.l"
+#line 284 "rwpmapbuild.l"
 { if (stmtMode(0, pmapbuild_text)) {
                                         ++error_count;
                                         return 0;
@@ -1086,12 +1096,12 @@ YY_RULE_SETUP
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 281 "rwpmapbuild.l"
+#line 291 "rwpmapbuild.l"
 { BEGIN(ST_MAPNAME); }
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 283 "rwpmapbuild.l"
+#line 293 "rwpmapbuild.l"
 { if (stmtMapName(0, pmapbuild_text)) {
                                         ++error_count;
                                     }
@@ -1099,7 +1109,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 289 "rwpmapbuild.l"
+#line 299 "rwpmapbuild.l"
 { if (stmtDefault(0, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1109,7 +1119,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 296 "rwpmapbuild.l"
+#line 306 "rwpmapbuild.l"
 { if (stmtLabel(0, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1119,7 +1129,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 303 "rwpmapbuild.l"
+#line 313 "rwpmapbuild.l"
 { if (stmtLabel(1, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1129,7 +1139,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 310 "rwpmapbuild.l"
+#line 320 "rwpmapbuild.l"
 { if (stmtCIDR(0, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1139,7 +1149,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 317 "rwpmapbuild.l"
+#line 327 "rwpmapbuild.l"
 { if (stmtIPs(0, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1149,7 +1159,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 324 "rwpmapbuild.l"
+#line 334 "rwpmapbuild.l"
 { if (stmtIPs(1, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1159,7 +1169,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 331 "rwpmapbuild.l"
+#line 341 "rwpmapbuild.l"
 { if (stmtProPorts(0, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1169,7 +1179,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 338 "rwpmapbuild.l"
+#line 348 "rwpmapbuild.l"
 { if (stmtProPorts(1, pmapbuild_text)) {
                                             ++error_count;
                                             BEGIN(ST_ERROR);
@@ -1179,7 +1189,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 345 "rwpmapbuild.l"
+#line 355 "rwpmapbuild.l"
 { if (stmtNumbers(0, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1189,7 +1199,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 352 "rwpmapbuild.l"
+#line 362 "rwpmapbuild.l"
 { if (stmtNumbers(1, pmapbuild_text)) {
                                         ++error_count;
                                         BEGIN(ST_ERROR);
@@ -1199,7 +1209,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 359 "rwpmapbuild.l"
+#line 369 "rwpmapbuild.l"
 { if (gotLabel(pmapbuild_text)) {
                                         ++error_count;
                                     }
@@ -1208,18 +1218,18 @@ YY_RULE_SETUP
 case 16:
 /* rule 16 can match eol */
 YY_RULE_SETUP
-#line 364 "rwpmapbuild.l"
+#line 374 "rwpmapbuild.l"
 { ++linenum; BEGIN(INITIAL); }
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 366 "rwpmapbuild.l"
+#line 376 "rwpmapbuild.l"
 ;
 	YY_BREAK
 case 18:
 /* rule 18 can match eol */
 YY_RULE_SETUP
-#line 368 "rwpmapbuild.l"
+#line 378 "rwpmapbuild.l"
 {
                             skAppPrintErr("Incomplete %s statement on line %d",
                                           pmapbuild_text, linenum);
@@ -1229,7 +1239,7 @@ YY_RULE_SETUP
 case 19:
 /* rule 19 can match eol */
 YY_RULE_SETUP
-#line 374 "rwpmapbuild.l"
+#line 384 "rwpmapbuild.l"
 {
                             skAppPrintErr("Incomplete statement on line %d",
                                           linenum);
@@ -1239,7 +1249,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 381 "rwpmapbuild.l"
+#line 391 "rwpmapbuild.l"
 { skAppPrintErr(("Too many arguments in statement"
                                            " on line %d"),
                                           linenum);
@@ -1248,7 +1258,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 387 "rwpmapbuild.l"
+#line 397 "rwpmapbuild.l"
 { skAppPrintErr("Unrecognized input on line %d",
                                           linenum);
                             ++error_count;
@@ -1257,15 +1267,15 @@ YY_RULE_SETUP
 case 22:
 /* rule 22 can match eol */
 YY_RULE_SETUP
-#line 392 "rwpmapbuild.l"
+#line 402 "rwpmapbuild.l"
 { ++linenum; BEGIN(INITIAL); }
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 394 "rwpmapbuild.l"
+#line 404 "rwpmapbuild.l"
 ECHO;
 	YY_BREAK
-#line 1269 "rwpmapbuild.c"
+#line 1279 "rwpmapbuild.c"
 case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(ST_EOL):
 case YY_STATE_EOF(ST_ERROR):
@@ -2167,7 +2177,7 @@ void pmapbuild_free (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 394 "rwpmapbuild.l"
+#line 404 "rwpmapbuild.l"
 
 
 
@@ -2383,6 +2393,7 @@ appOptionsHandler(
     int                 opt_index,
     char               *opt_arg)
 {
+    uint32_t tmp32;
     int rv;
 
     SK_UNUSED_PARAM(cData);
@@ -2441,6 +2452,22 @@ appOptionsHandler(
         ignore_errors = 1;
         break;
 
+      case OPT_RECORD_VERSION:
+        rv = skStringParseUint32(&tmp32, opt_arg, 0, UINT8_MAX);
+        if (rv) {
+            skAppPrintErr("Invalid %s '%s': %s",
+                          appOptions[opt_index].name, opt_arg,
+                          skStringParseStrerror(rv));
+            return 1;
+        }
+        if (0 != tmp32 && 6 != tmp32) {
+            skAppPrintErr("Invalid %s '%s': Version must be 0 or 6",
+                          appOptions[opt_index].name, opt_arg);
+            return 1;
+        }
+        record_version = (sk_file_version_t)tmp32;
+        break;
+
       case OPT_INVOCATION_STRIP:
         invocation_strip = 1;
         break;
@@ -3171,6 +3198,7 @@ int main(
         exit(EXIT_FAILURE);
     }
 
+    skPrefixMapSetRecordVersion(map, record_version);
     rv = skPrefixMapWrite(map, out_stream);
     if (rv != SKPREFIXMAP_OK) {
         if (rv == SKPREFIXMAP_ERR_IO) {
@@ -0,0 +1,32 @@
+#! /usr/bin/perl -w
+# MD5: multiple
+# TEST: multiple
+
+use strict;
+use SiLKTests;
+
+my $rwpmapbuild = check_silk_app('rwpmapbuild');
+my $rwfileinfo = check_silk_app('rwfileinfo');
+my $rwpmapcat = check_silk_app('rwpmapcat');
+my $rwpmaplookup = check_silk_app('rwpmaplookup');
+check_features(qw(ipv6));
+my %temp;
+$temp{v6_ip_map} = make_tempname('v6_ip_map');
+
+my ($cmd, $md5);
+
+$md5 = "d41d8cd98f00b204e9800998ecf8427e";
+$cmd = "$rwpmapbuild --input-path $SiLKTests::top_srcdir/tests/ip-map-v6.txt --output-path $temp{v6_ip_map} --record-version=6";
+check_md5_output($md5, $cmd);
+
+$md5 = "0ce7fcdf6722144052f4558bdf81f3bb";
+$cmd = "$rwpmapcat $temp{v6_ip_map}";
+check_md5_output($md5, $cmd);
+
+$md5 = "5e91da9822234b33b8affd196936a178";
+$cmd = "cat $temp{v6_ip_map} | $rwpmaplookup --map-file=- --fields=value --no-title -delim --no-files 2001:db8:ac:18::ba:d";
+check_md5_output($md5, $cmd);
+
+$md5 = "6f68f214a1dc5e84f933f233d8f549e9";
+$cmd = "cat $temp{v6_ip_map} | $rwfileinfo --fields=format,record-version,count-records -";
+check_md5_output($md5, $cmd);
@@ -0,0 +1,31 @@
+#! /usr/bin/perl -w
+# MD5: multiple
+# TEST: multiple
+
+use strict;
+use SiLKTests;
+
+my $rwpmapbuild = check_silk_app('rwpmapbuild');
+my $rwfileinfo = check_silk_app('rwfileinfo');
+my $rwpmapcat = check_silk_app('rwpmapcat');
+my $rwpmaplookup = check_silk_app('rwpmaplookup');
+my %temp;
+$temp{ip_map} = make_tempname('ip_map');
+
+my ($cmd, $md5);
+
+$md5 = "d41d8cd98f00b204e9800998ecf8427e";
+$cmd = "$rwpmapbuild --input-path $SiLKTests::top_srcdir/tests/ip-map.txt --output-path $temp{ip_map} --record-version=6";
+check_md5_output($md5, $cmd);
+
+$md5 = "a6eacd9b7f2783c5dde924a8ee18dc4b";
+$cmd = "$rwpmapcat $temp{ip_map}";
+check_md5_output($md5, $cmd);
+
+$md5 = "d57a7ce057f42c4585e28acc4dc4a895";
+$cmd = "cat $temp{ip_map} | $rwpmaplookup --map-file=- --no-title --fields=block,key,value --no-files 172.16.17.18 172.30.31.32";
+check_md5_output($md5, $cmd);
+
+$md5 = "53a918ca7ac9cb9abed99d4139a962cd";
+$cmd = "cat $temp{ip_map} | $rwfileinfo --fields=format,record-version,count-records -";
+check_md5_output($md5, $cmd);
@@ -50,11 +50,12 @@ RCSIDENT("$SiLK: rwset.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
 /* LOCAL VARIABLES */
 
-/* the IPsets and the streams where they will be written */
+/* the builders of the IPsets and the streams where the IPsets will
+ * be written */
 static struct sets_st {
-    skipset_t  *ipset;
-    skstream_t *stream;
-    int         set_type;
+    skipset_builder_t  *builder;
+    skstream_t         *stream;
+    int                 set_type;
 } sets[SET_FILE_TYPES];
 
 /* number of sets to write */
@@ -72,6 +73,9 @@ static sk_ipv6policy_t ipv6_policy = SK_IPV6POLICY_MIX;
 /* options for write the IPsets */
 static skipset_options_t set_options;
 
+/* number of threads to use when building the IPsets */
+static uint32_t thread_count = 1;
+
 
 /* OPTIONS SETUP */
 
@@ -79,7 +83,8 @@ typedef enum {
     OPT_SIP_FILE,
     OPT_DIP_FILE,
     OPT_NHIP_FILE,
-    OPT_ANY_FILE
+    OPT_ANY_FILE,
+    OPT_THREADS
 } appOptionsEnum;
 
 static struct option appOptions[] = {
@@ -87,6 +92,7 @@ static struct option appOptions[] = {
     {"dip-file",            REQUIRED_ARG, 0, OPT_DIP_FILE},
     {"nhip-file",           REQUIRED_ARG, 0, OPT_NHIP_FILE},
     {"any-file",            REQUIRED_ARG, 0, OPT_ANY_FILE},
+    {"threads",             REQUIRED_ARG, 0, OPT_THREADS},
     {0,0,0,0}               /* sentinel entry */
 };
 
@@ -99,6 +105,8 @@ static const char *appHelp[] = {
      "\tand write it to the named file. Def. No"),
     ("Create an IPset containing the unique source AND destination\n"
      "\taddresses and write it to the named file. Def. No"),
+    ("Use this number of threads to sort and merge the addresses\n"
+     "\twhen building the IPsets. Def. 1"),
     (char *)NULL
 };
 
@@ -163,9 +171,8 @@ appTeardown(
     teardownFlag = 1;
 
     for (i = 0; i < num_sets; ++i) {
-        if (sets[i].ipset) {
-            skIPSetDestroy(&sets[i].ipset);
-            sets[i].ipset = NULL;
+        if (sets[i].builder) {
+            skIPSetBuilderDestroy(&sets[i].builder);
         }
         if (sets[i].stream) {
             skStreamDestroy(&sets[i].stream);
@@ -268,6 +275,10 @@ appSetup(
     /* Open each output file; if any open fails, remove any files we
      * have previously opened. */
     for (i = 0; i < num_sets; ++i) {
+        /* create the IPset builder */
+        if (skIPSetBuilderCreate(&sets[i].builder, 0, thread_count)) {
+            EXIT_NO_MEMORY;
+        }
         rv = skStreamOpen(sets[i].stream);
         if (rv) {
             skStreamPrintLastErr(sets[i].stream, rv, &skAppPrintErr);
@@ -347,13 +358,18 @@ appOptionsHandler(
             skStreamDestroy(&(sets[num_sets].stream));
             return 1;
         }
-        /* create the IPset */
-        if (skIPSetCreate(&(sets[num_sets].ipset), 0)) {
-            EXIT_NO_MEMORY;
-        }
-        skIPSetOptionsBind(sets[num_sets].ipset, &set_options);
         ++num_sets;
         break;
+
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            skAppPrintErr("Invalid %s '%s': %s",
+                          appOptions[opt_index].name, opt_arg,
+                          skStringParseStrerror(rv));
+            return 1;
+        }
+        break;
     }
 
     return 0;                     /* OK */
@@ -402,28 +418,28 @@ rwsetProcessFile(
             switch (sets[i].set_type) {
               case OPT_SIP_FILE:
                 rwRecMemGetSIP(&rwrec, &ip);
-                rv = skIPSetInsertAddress(sets[i].ipset, &ip, 0);
+                rv = skIPSetBuilderAddAddress(sets[i].builder, &ip, 0);
                 if (rv) {
                     goto END;
                 }
                 break;
               case OPT_ANY_FILE:
                 rwRecMemGetSIP(&rwrec, &ip);
-                rv = skIPSetInsertAddress(sets[i].ipset, &ip, 0);
+                rv = skIPSetBuilderAddAddress(sets[i].builder, &ip, 0);
                 if (rv) {
                     goto END;
                 }
                 /* FALLTHROUGH */
               case OPT_DIP_FILE:
                 rwRecMemGetDIP(&rwrec, &ip);
-                rv = skIPSetInsertAddress(sets[i].ipset, &ip, 0);
+                rv = skIPSetBuilderAddAddress(sets[i].builder, &ip, 0);
                 if (rv) {
                     goto END;
                 }
                 break;
               case OPT_NHIP_FILE:
                 rwRecMemGetNhIP(&rwrec, &ip);
-                rv = skIPSetInsertAddress(sets[i].ipset, &ip, 0);
+                rv = skIPSetBuilderAddAddress(sets[i].builder, &ip, 0);
                 if (rv) {
                     goto END;
                 }
@@ -452,6 +468,7 @@ rwsetProcessFile(
 int main(int argc, char **argv)
 {
     skstream_t *stream;
+    skipset_t *ipset;
     char errbuf[2 * PATH_MAX];
     ssize_t rv;
     int had_err = 0;
@@ -476,8 +493,13 @@ int main(int argc, char **argv)
 
     /* Write the output */
     for (i = 0; i < num_sets; ++i) {
-        skIPSetClean(sets[i].ipset);
-        rv = skIPSetWrite(sets[i].ipset, sets[i].stream);
+        ipset = NULL;
+        rv = skIPSetBuilderBuild(sets[i].builder, &ipset);
+        skIPSetBuilderDestroy(&sets[i].builder);
+        if (SKIPSET_OK == rv) {
+            skIPSetOptionsBind(ipset, &set_options);
+            rv = skIPSetWrite(ipset, sets[i].stream);
+        }
         if (SKIPSET_OK == rv) {
             rv = skStreamClose(sets[i].stream);
             if (rv) {
@@ -501,8 +523,7 @@ int main(int argc, char **argv)
                           skIPSetStrerror(rv));
         }
         skStreamDestroy(&sets[i].stream);
-        skIPSetDestroy(&sets[i].ipset);
-        sets[i].ipset = NULL;
+        skIPSetDestroy(&ipset);
     }
 
     /* done */
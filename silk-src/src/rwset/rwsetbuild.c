@@ -52,8 +52,8 @@ RCSIDENT("$SiLK: rwsetbuild.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
 /* LOCAL VARIABLES */
 
-/* the IPset the application creates. */
-static skipset_t *ipset = NULL;
+/* the builder of the IPset the application creates. */
+static skipset_builder_t *builder = NULL;
 
 /* input and output streams */
 static skstream_t *in_stream = NULL;
@@ -68,15 +68,20 @@ static char delimiter = '-';
 /* parameters to use when writing the IPset */
 static skipset_options_t set_options;
 
+/* number of threads to use when building the IPset */
+static uint32_t thread_count = 1;
+
 
 /* OPTIONS SETUP */
 
 typedef enum {
-    OPT_IP_RANGES
+    OPT_IP_RANGES,
+    OPT_THREADS
 } appOptionsEnum;
 
 static struct option appOptions[] = {
     {"ip-ranges",       OPTIONAL_ARG, 0, OPT_IP_RANGES},
+    {"threads",         REQUIRED_ARG, 0, OPT_THREADS},
     {0,0,0,0}           /* sentinel entry */
 };
 
@@ -84,6 +89,8 @@ static const char *appHelp[] = {
     ("Allow input to contain IP-IP or NUM-NUM. Optional\n"
      "\targument is the delimiter to use between the values. Def. No, '-'.\n"
      "\tUse of this switch disables support for SiLK Wildcard IPs"),
+    ("Use this number of threads to sort and merge the addresses\n"
+     "\twhen building the IPset. Def. 1"),
     (char *)NULL
 };
 
@@ -144,8 +151,8 @@ appTeardown(
     }
     teardownFlag = 1;
 
-    if (ipset) {
-        skIPSetDestroy(&ipset);
+    if (builder) {
+        skIPSetBuilderDestroy(&builder);
     }
     skStreamDestroy(&in_stream);
     skStreamDestroy(&out_stream);
@@ -245,11 +252,10 @@ appSetup(
     /* we should have processed all arguments */
     assert(arg_index == argc);
 
-    /* create the IPset */
-    if (skIPSetCreate(&ipset, 0)) {
+    /* create the IPset builder */
+    if (skIPSetBuilderCreate(&builder, 0, thread_count)) {
         EXIT_NO_MEMORY;
     }
-    skIPSetOptionsBind(ipset, &set_options);
 
     /* create input */
     if ((rv = skStreamCreate(&in_stream, SK_IO_READ, SK_CONTENT_TEXT))
@@ -305,6 +311,8 @@ appOptionsHandler(
     int                 opt_index,
     char               *opt_arg)
 {
+    int rv;
+
     switch ((appOptionsEnum)opt_index) {
       case OPT_IP_RANGES:
         ip_ranges = 1;
@@ -336,6 +344,16 @@ appOptionsHandler(
             delimiter = opt_arg[0];
         }
         break;
+
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            skAppPrintErr("Invalid %s '%s': %s",
+                          appOptions[opt_index].name, opt_arg,
+                          skStringParseStrerror(rv));
+            return 1;
+        }
+        break;
     }
 
     return 0;
@@ -346,7 +364,7 @@ appOptionsHandler(
  *  buildIPSetRanges(stream);
  *
  *    Read IP addresses from the stream named by 'stream' and use them
- *    to build the global ipset.  Allow the input to support ranges of
+ *    to fill the global builder.  Allow the input to support ranges of
  *    IPs.  Return 0 on success or -1 on failure.
  */
 static int
@@ -426,7 +444,7 @@ buildIPSetRanges(
                 }
             } else if (SETBUILD_BUF_IS_INT(line_buf)) {
                 saw_integer = 1;
-                if (skIPSetIsV6(ipset)) {
+                if (skIPSetBuilderIsV6(builder)) {
                     skAppPrintErr("Error on line %d: %s",
                                   lc, SETBUILD_ERR_MIX_INT_V6);
                     rv = -1;
@@ -435,7 +453,7 @@ buildIPSetRanges(
             }
 #endif  /* SK_ENABLE_IPV6 */
 
-            rv = skIPSetInsertAddress(ipset, &ip, prefix);
+            rv = skIPSetBuilderAddAddress(builder, &ip, prefix);
             if (rv) {
                 skAppPrintErr("Error adding IP on line %d to IPset: %s",
                               lc, skIPSetStrerror(rv));
@@ -478,7 +496,7 @@ buildIPSetRanges(
             }
         } else if (SETBUILD_BUF_IS_INT(line_buf) || SETBUILD_BUF_IS_INT(sep)) {
             saw_integer = 1;
-            if (skIPSetIsV6(ipset)) {
+            if (skIPSetBuilderIsV6(builder)) {
                 skAppPrintErr("Error on line %d: %s",
                               lc, SETBUILD_ERR_MIX_INT_V6);
                 rv = -1;
@@ -487,7 +505,7 @@ buildIPSetRanges(
         }
 #endif  /* SK_ENABLE_IPV6 */
 
-        rv = skIPSetInsertRange(ipset, &ip_min, &ip_max);
+        rv = skIPSetBuilderAddRange(builder, &ip_min, &ip_max);
         if (rv) {
             skAppPrintErr("Error adding IP range on line %d to IPset: %s",
                           lc, skIPSetStrerror(rv));
@@ -510,7 +528,7 @@ buildIPSetRanges(
  *  buildIPSetWildcards(stream);
  *
  *    Read IP addresses from the stream named by 'stream' and use them
- *    to build the global ipset.  Allow the input to contain
+ *    to fill the global builder.  Allow the input to contain
  *    IPWildcards.  Return 0 on success or -1 on failure.
  */
 static int
@@ -561,7 +579,7 @@ buildIPSetWildcards(
                 }
             } else if (SETBUILD_BUF_IS_INT(line_buf)) {
                 saw_integer = 1;
-                if (skIPSetIsV6(ipset)) {
+                if (skIPSetBuilderIsV6(builder)) {
                     skAppPrintErr("Error on line %d: %s",
                                   lc, SETBUILD_ERR_MIX_INT_V6);
                     rv = -1;
@@ -570,7 +588,7 @@ buildIPSetWildcards(
             }
 #endif  /* SK_ENABLE_IPV6 */
 
-            rv = skIPSetInsertAddress(ipset, &ip, prefix);
+            rv = skIPSetBuilderAddAddress(builder, &ip, prefix);
             if (rv) {
                 skAppPrintErr("Error adding IP on line %d to IPset: %s",
                               lc, skIPSetStrerror(rv));
@@ -635,7 +653,7 @@ buildIPSetWildcards(
         }
 #endif  /* SK_ENABLE_IPV6 */
 
-        rv = skIPSetInsertIPWildcard(ipset, &ipwild);
+        rv = skIPSetBuilderAddIPWildcard(builder, &ipwild);
         if (rv) {
             skAppPrintErr("Error adding IP Wildcard on line %d to IPset: %s",
                           lc, skIPSetStrerror(rv));
@@ -656,6 +674,7 @@ buildIPSetWildcards(
 
 int main(int argc, char **argv)
 {
+    skipset_t *ipset = NULL;
     int rv;
 
     appSetup(argc, argv);
@@ -671,10 +690,18 @@ int main(int argc, char **argv)
         }
     }
 
-    skIPSetClean(ipset);
+    /* create the IPset */
+    rv = skIPSetBuilderBuild(builder, &ipset);
+    if (rv) {
+        skAppPrintErr("Unable to create IPset: %s", skIPSetStrerror(rv));
+        return 1;
+    }
+    skIPSetBuilderDestroy(&builder);
+    skIPSetOptionsBind(ipset, &set_options);
 
     /* write output to stream */
     rv = skIPSetWrite(ipset, out_stream);
+    skIPSetDestroy(&ipset);
     if (rv) {
         if (SKIPSET_ERR_FILEIO == rv) {
             skStreamPrintLastErr(out_stream,
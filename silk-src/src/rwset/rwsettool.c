@@ -87,6 +87,10 @@ static int fill_blocks = 0;
 /* options for writing the IPset */
 static skipset_options_t set_options;
 
+/* number of threads to use for the union, intersect, and difference
+ * operations */
+static uint32_t thread_count = 1;
+
 
 /* OPTIONS SETUP */
 
@@ -103,7 +107,8 @@ typedef enum {
     OPT_SAMPLE_SIZE,
     OPT_SAMPLE_RATIO,
     OPT_SAMPLE_SEED,
-    OPT_OUTPUT_PATH
+    OPT_OUTPUT_PATH,
+    OPT_THREADS
 } appOptionsEnum;
 
 static struct option appOptions[] = {
@@ -118,6 +123,7 @@ static struct option appOptions[] = {
     {"ratio",           REQUIRED_ARG, 0, OPT_SAMPLE_RATIO},
     {"seed",            REQUIRED_ARG, 0, OPT_SAMPLE_SEED},
     {"output-path",     REQUIRED_ARG, 0, OPT_OUTPUT_PATH},
+    {"threads",         REQUIRED_ARG, 0, OPT_THREADS},
     {0, 0, 0, 0}        /* sentinel entry */
 };
 
@@ -150,6 +156,8 @@ static const char *appHelp[] = {
     ("Specify the seed for the pseudo-random number generator used by\n"
      "\tthe --sample operation"),
     ("Write the resulting IPset to this location. Def. stdout"),
+    ("Use this number of threads for the --union, --intersect,\n"
+     "\tand --difference operations on IPv6 IPsets. Def. 1"),
     (char *) NULL
 };
 
@@ -479,6 +487,13 @@ appOptionsHandler(
             return 1;
         }
         break;
+
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
     }
 
     return 0;                   /* OK */
@@ -839,7 +854,7 @@ intersectSets(
             in_set = NULL;
             skIPSetOptionsBind(out_set, &set_options);
         } else {
-            rv = skIPSetIntersect(out_set, in_set);
+            rv = skIPSetIntersectParallel(out_set, in_set, thread_count);
             skIPSetDestroy(&in_set);
             in_set = NULL;
             if (rv) {
@@ -1003,6 +1018,37 @@ unionCallback(
 }
 
 
+/*
+ *  status = combineSetParallel(in_stream, out_set);
+ *
+ *    Read the IPset from 'in_stream' and add it to or subtract it
+ *    from 'out_set' using 'thread_count' threads.  This is used
+ *    instead of skIPSetProcessStream() when --threads is greater than
+ *    1, since the parallel functions require the entire IPset to be
+ *    in memory.  Return SKIPSET_OK or an SKIPSET_ERR_* value.
+ */
+static int
+combineSetParallel(
+    skstream_t         *in_stream,
+    skipset_t          *out_set)
+{
+    skipset_t *in_set;
+    int rv;
+
+    rv = skIPSetRead(&in_set, in_stream);
+    if (rv) {
+        return rv;
+    }
+    if (OPT_DIFFERENCE == operation) {
+        rv = skIPSetSubtractParallel(out_set, in_set, thread_count);
+    } else {
+        rv = skIPSetUnionParallel(out_set, in_set, thread_count);
+    }
+    skIPSetDestroy(&in_set);
+    return rv;
+}
+
+
 int main(int argc, char **argv)
 {
     skipset_procstream_parm_t param;
@@ -1071,10 +1117,15 @@ int main(int argc, char **argv)
 
         /* read remaining sets */
         while (1 == (have_input = appNextInput(argc, argv, &in_stream))) {
-            param.v6_policy = (skIPSetIsV6(out_set)
-                               ? SK_IPV6POLICY_FORCE
-                               : SK_IPV6POLICY_ASV4);
-            rv = skIPSetProcessStream(in_stream, cb_init, out_set, &param);
+            if (thread_count > 1) {
+                rv = combineSetParallel(in_stream, out_set);
+            } else {
+                param.v6_policy = (skIPSetIsV6(out_set)
+                                   ? SK_IPV6POLICY_FORCE
+                                   : SK_IPV6POLICY_ASV4);
+                rv = skIPSetProcessStream(in_stream, cb_init, out_set,
+                                          &param);
+            }
             if (rv) {
                 char errbuf[2 * PATH_MAX];
 
@@ -0,0 +1,17 @@
+#! /usr/bin/perl -w
+# MD5: cac0436a41fc954fff0357ceab3631cc
+# TEST: ./rwsettool --intersect --threads=4 ../../tests/set3-v6.set ../../tests/set4-v6.set | ./rwsetcat --cidr
+
+use strict;
+use SiLKTests;
+
+my $rwsettool = check_silk_app('rwsettool');
+my $rwsetcat = check_silk_app('rwsetcat');
+my %file;
+$file{v6set3} = get_data_or_exit77('v6set3');
+$file{v6set4} = get_data_or_exit77('v6set4');
+check_features(qw(ipset_v6));
+my $cmd = "$rwsettool --intersect --threads=4 $file{v6set3} $file{v6set4} | $rwsetcat --cidr";
+my $md5 = "cac0436a41fc954fff0357ceab3631cc";
+
+check_md5_output($md5, $cmd);
@@ -84,6 +84,9 @@ sk_tempfilectx_t *tmpctx;
 /* maximum amount of RAM to attempt to allocate */
 size_t buffer_size;
 
+/* number of threads to use when sorting the buffer */
+uint32_t thread_count = 1;
+
 /* maximum amount of idle time to allow between flows */
 int64_t max_idle_time = INT64_MAX;
 
@@ -982,7 +985,8 @@ sortRandom(
             if (record_count == buffer_max_recs) {
                 /* Sort */
                 TRACEMSG(("Sorting %" SK_PRIuZ " records...", record_count));
-                skQSort(record_buffer, record_count, NODE_SIZE, &rwrecCompare);
+                skQSortThreaded(record_buffer, record_count, NODE_SIZE,
+                                &rwrecCompare, thread_count);
                 TRACEMSG(("Sorting %" SK_PRIuZ " records...done",
                           record_count));
 
@@ -1007,7 +1011,8 @@ sortRandom(
     /* Sort (and maybe store) last batch of records */
     if (record_count > 0) {
         TRACEMSG(("Sorting %" SK_PRIuZ " records...", record_count));
-        skQSort(record_buffer, record_count, NODE_SIZE, &rwrecCompare);
+        skQSortThreaded(record_buffer, record_count, NODE_SIZE,
+                        &rwrecCompare, thread_count);
         TRACEMSG(("Sorting %" SK_PRIuZ " records...done", record_count));
 
         if (temp_file_idx >= 0) {
@@ -115,6 +115,9 @@ extern sk_tempfilectx_t *tmpctx;
 /* maximum amount of RAM to attempt to allocate */
 extern size_t buffer_size;
 
+/* number of threads to use when sorting the buffer */
+extern uint32_t thread_count;
+
 /* maximum amount of idle time to allow between flows */
 extern int64_t max_idle_time;
 
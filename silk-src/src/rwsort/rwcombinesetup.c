@@ -76,7 +76,8 @@ typedef enum {
     OPT_MAX_IDLE_TIME,
     OPT_PRINT_STATISTICS,
     OPT_OUTPUT_PATH,
-    OPT_BUFFER_SIZE
+    OPT_BUFFER_SIZE,
+    OPT_THREADS
 } appOptionsEnum;
 
 static struct option appOptions[] = {
@@ -87,6 +88,7 @@ static struct option appOptions[] = {
     {"print-statistics",    OPTIONAL_ARG, 0, OPT_PRINT_STATISTICS},
     {"output-path",         REQUIRED_ARG, 0, OPT_OUTPUT_PATH},
     {"buffer-size",         REQUIRED_ARG, 0, OPT_BUFFER_SIZE},
+    {"threads",             REQUIRED_ARG, 0, OPT_THREADS},
     {0,0,0,0}               /* sentinel entry */
 };
 
@@ -104,6 +106,7 @@ static const char *appHelp[] = {
     ("Write the combined SiLK Flow records to this location\n"
      "\t(a file, named pipe, or '-' or 'stdout'). Def. stdout"),
     NULL, /* generated dynamically */
+    "Sort the in-memory buffer using this number of threads. Def. 1",
     (char *)NULL
 };
 
@@ -517,6 +520,13 @@ appOptionsHandler(
         }
         buffer_size = tmp64;
         break;
+
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
     }
 
     return 0;                     /* OK */
@@ -73,6 +73,9 @@ sk_tempfilectx_t *tmpctx;
 /* maximum amount of RAM to attempt to allocate */
 size_t buffer_size;
 
+/* number of threads to use when sorting the buffer */
+uint32_t thread_count = 1;
+
 /* differences to allow between flows */
 flow_delta_t delta;
 
@@ -716,7 +719,8 @@ sortRandom(
             if (record_count == buffer_max_recs) {
                 /* Sort */
                 TRACEMSG(("Sorting %" SK_PRIuZ " records...", record_count));
-                skQSort(record_buffer, record_count, NODE_SIZE, &rwrecCompare);
+                skQSortThreaded(record_buffer, record_count, NODE_SIZE,
+                                &rwrecCompare, thread_count);
                 TRACEMSG(("Sorting %" SK_PRIuZ " records...done",
                           record_count));
 
@@ -741,7 +745,8 @@ sortRandom(
     /* Sort (and maybe store) last batch of records */
     if (record_count > 0) {
         TRACEMSG(("Sorting %" SK_PRIuZ " records...", record_count));
-        skQSort(record_buffer, record_count, NODE_SIZE, &rwrecCompare);
+        skQSortThreaded(record_buffer, record_count, NODE_SIZE,
+                        &rwrecCompare, thread_count);
         TRACEMSG(("Sorting %" SK_PRIuZ " records...done", record_count));
 
         if (temp_file_idx >= 0) {
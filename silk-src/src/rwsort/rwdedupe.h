@@ -126,6 +126,9 @@ extern sk_tempfilectx_t *tmpctx;
 /* maximum amount of RAM to attempt to allocate */
 extern size_t buffer_size;
 
+/* number of threads to use when sorting the buffer */
+extern uint32_t thread_count;
+
 /* differences to allow between flows */
 extern flow_delta_t delta;
 
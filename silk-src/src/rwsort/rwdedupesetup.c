@@ -68,7 +68,8 @@ typedef enum {
     OPT_STIME_DELTA,
     OPT_DURATION_DELTA,
     OPT_OUTPUT_PATH,
-    OPT_BUFFER_SIZE
+    OPT_BUFFER_SIZE,
+    OPT_THREADS
 } appOptionsEnum;
 
 static struct option appOptions[] = {
@@ -80,6 +81,7 @@ static struct option appOptions[] = {
     {"duration-delta",      REQUIRED_ARG, 0, OPT_DURATION_DELTA},
     {"output-path",         REQUIRED_ARG, 0, OPT_OUTPUT_PATH},
     {"buffer-size",         REQUIRED_ARG, 0, OPT_BUFFER_SIZE},
+    {"threads",             REQUIRED_ARG, 0, OPT_THREADS},
     {0,0,0,0}               /* sentinel entry */
 };
 
@@ -98,6 +100,7 @@ static const char *appHelp[] = {
     ("Destination for output (stdout|pipe).\n"
      "\tDefault is stdout if stdout is not a terminal"),
     NULL, /* generated dynamically */
+    "Sort the in-memory buffer using this number of threads. Def. 1",
     (char *)NULL
 };
 
@@ -481,6 +484,13 @@ appOptionsHandler(
         }
         buffer_size = tmp64;
         break;
+
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
     }
 
     return 0;                     /* OK */
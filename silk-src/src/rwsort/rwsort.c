@@ -69,8 +69,9 @@ uint32_t *sort_fields = NULL;
 
 /* the size of a "node".  Because the output from rwsort are SiLK
  * records, the node size includes the complete rwRec, plus any binary
- * fields that we get from plug-ins to use as the key.  This node_size
- * value may increase when we parse the --fields switch. */
+ * fields that we get from plug-ins to use as the key or the
+ * normalized key.  This node_size value may increase when we parse
+ * the --fields switch. */
 size_t node_size = sizeof(rwRec);
 
 /* the columns that make up the key that come from plug-ins */
@@ -94,6 +95,28 @@ int presorted_input = 0;
 /* maximum amount of RAM to attempt to allocate */
 size_t sort_buffer_size;
 
+/* number of threads to use when sorting the buffer */
+uint32_t thread_count = 1;
+
+/* whether to sort the buffer with a radix sort on a normalized key */
+int radix_sort = 0;
+
+/* when non-zero, every node holds a normalized key of this many
+ * octets immediately after the rwRec, and comparing the keys with
+ * memcmp() gives the same order as rwrecCompare().  See
+ * nodeNormalizeKey(). */
+size_t norm_key_width = 0;
+
+
+/* LOCAL DEFINES AND TYPEDEFS */
+
+/* when radix sorting the nodes, sort a range containing no more
+ * than this number of nodes by comparing the keys */
+#define RADIX_SORT_CUTOFF  64
+
+/* return a pointer to the normalized key in node 'n_node' */
+#define NODE_KEY(n_node)   ((uint8_t*)(n_node) + sizeof(rwRec))
+
 
 /* FUNCTION DEFINITIONS */
 
@@ -322,6 +345,367 @@ rwrecCompare(
 }
 
 
+/*
+ *  width = normKeyFieldWidth(field_id);
+ *
+ *    Return the number of octets that the built-in field 'field_id'
+ *    occupies in the normalized key.  Return 0 for a field that
+ *    comes from a plug-in.
+ */
+size_t
+normKeyFieldWidth(
+    uint32_t            field_id)
+{
+    switch (field_id) {
+      case RWREC_FIELD_SIP:
+      case RWREC_FIELD_DIP:
+      case RWREC_FIELD_NHIP:
+#if !SK_ENABLE_IPV6
+        return sizeof(uint32_t);
+#else
+        return 16;
+#endif
+      case RWREC_FIELD_STIME:
+      case RWREC_FIELD_STIME_MSEC:
+      case RWREC_FIELD_ETIME:
+      case RWREC_FIELD_ETIME_MSEC:
+        return sizeof(uint64_t);
+      case RWREC_FIELD_PKTS:
+      case RWREC_FIELD_BYTES:
+      case RWREC_FIELD_ELAPSED:
+      case RWREC_FIELD_ELAPSED_MSEC:
+        return sizeof(uint32_t);
+      case RWREC_FIELD_SPORT:
+      case RWREC_FIELD_DPORT:
+      case RWREC_FIELD_SID:
+      case RWREC_FIELD_INPUT:
+      case RWREC_FIELD_OUTPUT:
+      case RWREC_FIELD_APPLICATION:
+        return sizeof(uint16_t);
+      case RWREC_FIELD_PROTO:
+      case RWREC_FIELD_FLAGS:
+      case RWREC_FIELD_INIT_FLAGS:
+      case RWREC_FIELD_REST_FLAGS:
+      case RWREC_FIELD_TCP_STATE:
+      case RWREC_FIELD_FTYPE_CLASS:
+      case RWREC_FIELD_FTYPE_TYPE:
+      case RWREC_FIELD_ICMP_TYPE:
+      case RWREC_FIELD_ICMP_CODE:
+        return sizeof(uint8_t);
+      default:
+        break;
+    }
+    return 0;
+}
+
+
+/*
+ *  nodeNormalizeKey(node);
+ *
+ *    Fill the normalized key of 'node' from the rwRec at the start
+ *    of the node.  Each field is written in network byte order so
+ *    that memcmp() orders the keys; the start and end times have
+ *    their sign bit flipped.  The binary values from plug-ins must
+ *    already be in place.  When sorting in reverse, every octet of
+ *    the key is complemented.
+ */
+static void
+nodeNormalizeKey(
+    uint8_t            *node)
+{
+    const rwRec *rwrec = (const rwRec*)node;
+    key_field_t *key = key_fields;
+    uint8_t *pos = NODE_KEY(node);
+    uint64_t tmp64;
+    uint32_t tmp32;
+    uint16_t tmp16;
+#if SK_ENABLE_IPV6
+    skipaddr_t ip;
+#endif
+    size_t i;
+
+    for (i = 0; i < num_fields; ++i) {
+        switch (sort_fields[i]) {
+#if !SK_ENABLE_IPV6
+          case RWREC_FIELD_SIP:
+            tmp32 = htonl(rwRecGetSIPv4(rwrec));
+            memcpy(pos, &tmp32, sizeof(tmp32));
+            break;
+          case RWREC_FIELD_DIP:
+            tmp32 = htonl(rwRecGetDIPv4(rwrec));
+            memcpy(pos, &tmp32, sizeof(tmp32));
+            break;
+          case RWREC_FIELD_NHIP:
+            tmp32 = htonl(rwRecGetNhIPv4(rwrec));
+            memcpy(pos, &tmp32, sizeof(tmp32));
+            break;
+#else
+          case RWREC_FIELD_SIP:
+            rwRecMemGetSIP(rwrec, &ip);
+            skipaddrGetAsV6(&ip, pos);
+            break;
+          case RWREC_FIELD_DIP:
+            rwRecMemGetDIP(rwrec, &ip);
+            skipaddrGetAsV6(&ip, pos);
+            break;
+          case RWREC_FIELD_NHIP:
+            rwRecMemGetNhIP(rwrec, &ip);
+            skipaddrGetAsV6(&ip, pos);
+            break;
+#endif  /* SK_ENABLE_IPV6 */
+
+          case RWREC_FIELD_SPORT:
+            tmp16 = htons(rwRecGetSPort(rwrec));
+            memcpy(pos, &tmp16, sizeof(tmp16));
+            break;
+          case RWREC_FIELD_DPORT:
+            tmp16 = htons(rwRecGetDPort(rwrec));
+            memcpy(pos, &tmp16, sizeof(tmp16));
+            break;
+          case RWREC_FIELD_SID:
+            tmp16 = htons(rwRecGetSensor(rwrec));
+            memcpy(pos, &tmp16, sizeof(tmp16));
+            break;
+          case RWREC_FIELD_INPUT:
+            tmp16 = htons(rwRecGetInput(rwrec));
+            memcpy(pos, &tmp16, sizeof(tmp16));
+            break;
+          case RWREC_FIELD_OUTPUT:
+            tmp16 = htons(rwRecGetOutput(rwrec));
+            memcpy(pos, &tmp16, sizeof(tmp16));
+            break;
+          case RWREC_FIELD_APPLICATION:
+            tmp16 = htons(rwRecGetApplication(rwrec));
+            memcpy(pos, &tmp16, sizeof(tmp16));
+            break;
+
+          case RWREC_FIELD_PKTS:
+            tmp32 = htonl(rwRecGetPkts(rwrec));
+            memcpy(pos, &tmp32, sizeof(tmp32));
+            break;
+          case RWREC_FIELD_BYTES:
+            tmp32 = htonl(rwRecGetBytes(rwrec));
+            memcpy(pos, &tmp32, sizeof(tmp32));
+            break;
+          case RWREC_FIELD_ELAPSED:
+          case RWREC_FIELD_ELAPSED_MSEC:
+            tmp32 = htonl(rwRecGetElapsed(rwrec));
+            memcpy(pos, &tmp32, sizeof(tmp32));
+            break;
+
+          case RWREC_FIELD_STIME:
+          case RWREC_FIELD_STIME_MSEC:
+            tmp64 = ((uint64_t)rwRecGetStartTime(rwrec)) ^ UINT64_C(1) << 63;
+            tmp64 = hton64(tmp64);
+            memcpy(pos, &tmp64, sizeof(tmp64));
+            break;
+          case RWREC_FIELD_ETIME:
+          case RWREC_FIELD_ETIME_MSEC:
+            tmp64 = ((uint64_t)rwRecGetEndTime(rwrec)) ^ UINT64_C(1) << 63;
+            tmp64 = hton64(tmp64);
+            memcpy(pos, &tmp64, sizeof(tmp64));
+            break;
+
+          case RWREC_FIELD_PROTO:
+            *pos = rwRecGetProto(rwrec);
+            break;
+          case RWREC_FIELD_FLAGS:
+            *pos = rwRecGetFlags(rwrec);
+            break;
+          case RWREC_FIELD_INIT_FLAGS:
+            *pos = rwRecGetInitFlags(rwrec);
+            break;
+          case RWREC_FIELD_REST_FLAGS:
+            *pos = rwRecGetRestFlags(rwrec);
+            break;
+          case RWREC_FIELD_TCP_STATE:
+            *pos = rwRecGetTcpState(rwrec);
+            break;
+          case RWREC_FIELD_FTYPE_CLASS:
+          case RWREC_FIELD_FTYPE_TYPE:
+            *pos = rwRecGetFlowType(rwrec);
+            break;
+          case RWREC_FIELD_ICMP_TYPE:
+            *pos = getIcmpType(rwrec);
+            break;
+          case RWREC_FIELD_ICMP_CODE:
+            *pos = getIcmpCode(rwrec);
+            break;
+
+          default:
+            /* the plug-in wrote its binary value in place */
+            assert((size_t)(key - key_fields) < key_num_fields);
+            assert(pos == node + key->kf_offset);
+            pos += key->kf_width;
+            ++key;
+            continue;
+        }
+        pos += normKeyFieldWidth(sort_fields[i]);
+    }
+    assert(pos == NODE_KEY(node) + norm_key_width);
+
+    if (reverse) {
+        for (i = 0, pos = NODE_KEY(node); i < norm_key_width; ++i, ++pos) {
+            *pos = ~*pos;
+        }
+    }
+}
+
+
+/*
+ *  cmp = nodeCompareKeys(a, b);
+ *
+ *    Compare the normalized keys of the nodes 'a' and 'b'.
+ */
+static int
+nodeCompareKeys(
+    const void         *a,
+    const void         *b)
+{
+    return memcmp(NODE_KEY(a), NODE_KEY(b), norm_key_width);
+}
+
+
+/*
+ *  sortNodesRadix(base, count, depth);
+ *
+ *    Sort the 'count' nodes at 'base' by their normalized keys, all
+ *    of which have the same initial 'depth' octets.  This is an
+ *    in-place most-significant-digit radix sort: the nodes are
+ *    permuted into 256 buckets on the octet at 'depth' and each
+ *    bucket is sorted on the following octet.  Buckets with few
+ *    nodes are sorted with skQSort().
+ */
+static void
+sortNodesRadix(
+    uint8_t            *base,
+    size_t              count,
+    size_t              depth)
+{
+    size_t next[256];
+    size_t end[256];
+    uint8_t tmp[2][MAX_NODE_SIZE];
+    uint8_t *carry;
+    uint8_t *spare;
+    uint8_t *swap;
+    uint8_t *node;
+    uint8_t *dest;
+    size_t prefix;
+    size_t start;
+    size_t i;
+    size_t j;
+    unsigned int b;
+    unsigned int c;
+
+    for (;;) {
+        if (depth >= norm_key_width) {
+            /* all keys are identical */
+            return;
+        }
+        if (count <= RADIX_SORT_CUTOFF) {
+            if (count > 1) {
+                skQSort(base, count, node_size, &nodeCompareKeys);
+            }
+            return;
+        }
+
+        /* count the nodes in each bucket */
+        memset(end, 0, sizeof(end));
+        for (i = 0, node = base; i < count; ++i, node += node_size) {
+            ++end[NODE_KEY(node)[depth]];
+        }
+        b = NODE_KEY(base)[depth];
+        if (end[b] != count) {
+            break;
+        }
+        /* every node is in the same bucket.  Rather than counting
+         * each following octet, find the length of the prefix that
+         * all keys share in one pass and skip it. */
+        prefix = norm_key_width;
+        node = base;
+        for (i = 1; i < count; ++i) {
+            node += node_size;
+            j = depth + 1;
+            while (j < prefix && NODE_KEY(base)[j] == NODE_KEY(node)[j]) {
+                ++j;
+            }
+            prefix = j;
+        }
+        depth = prefix;
+    }
+
+    /* convert the counts to the bounds of each bucket */
+    start = 0;
+    for (b = 0; b < 256; ++b) {
+        next[b] = start;
+        start += end[b];
+        end[b] = start;
+    }
+
+    /* move each node into its bucket, swapping out the node that
+     * occupies the destination */
+    for (b = 0; b < 256; ++b) {
+        while (next[b] < end[b]) {
+            node = base + next[b] * node_size;
+            c = NODE_KEY(node)[depth];
+            if (c == b) {
+                ++next[b];
+                continue;
+            }
+            /* carry the misplaced node around its cycle until a node
+             * that belongs in bucket 'b' is found */
+            carry = tmp[0];
+            spare = tmp[1];
+            memcpy(carry, node, node_size);
+            do {
+                dest = base + next[c] * node_size;
+                ++next[c];
+                c = NODE_KEY(dest)[depth];
+                memcpy(spare, dest, node_size);
+                memcpy(dest, carry, node_size);
+                swap = carry;
+                carry = spare;
+                spare = swap;
+            } while (c != b);
+            memcpy(node, carry, node_size);
+            ++next[b];
+        }
+    }
+
+    /* sort each bucket on the next octet */
+    start = 0;
+    for (b = 0; b < 256; ++b) {
+        if (end[b] - start > 1) {
+            sortNodesRadix(base + start * node_size, end[b] - start,
+                           depth + 1);
+        }
+        start = end[b];
+    }
+}
+
+
+/*
+ *  sortBuffer(buffer, count);
+ *
+ *    Sort the 'count' nodes in 'buffer'.
+ */
+static void
+sortBuffer(
+    uint8_t            *buffer,
+    size_t              count)
+{
+    if (0 == norm_key_width) {
+        skQSortThreaded(buffer, count, node_size, &rwrecCompare,
+                        thread_count);
+    } else if (thread_count > 1) {
+        skQSortThreaded(buffer, count, node_size, &nodeCompareKeys,
+                        thread_count);
+    } else {
+        sortNodesRadix(buffer, count, 0);
+    }
+}
+
+
 /*
  *  status = compHeapNodes(b, a, v_recs);
  *
@@ -339,6 +723,10 @@ compHeapNodes(
 {
     uint8_t *recs = (uint8_t*)v_recs;
 
+    if (norm_key_width) {
+        return nodeCompareKeys(&recs[*(uint16_t*)a * MAX_NODE_SIZE],
+                               &recs[*(uint16_t*)b * MAX_NODE_SIZE]);
+    }
     return rwrecCompare(&recs[*(uint16_t*)a * MAX_NODE_SIZE],
                         &recs[*(uint16_t*)b * MAX_NODE_SIZE]);
 }
@@ -385,10 +773,74 @@ fillRecordAndKey(
             appExit(EXIT_FAILURE);
         }
     }
+    if (norm_key_width) {
+        nodeNormalizeKey(buf);
+    }
     return 1;
 }
 
 
+/*
+ *  count = fillRecordsAndKeys(stream, buf, max_count);
+ *
+ *    Reads up to 'max_count' flow records from 'stream' into 'buf',
+ *    an array of nodes where each node is 'node_size' bytes.  Fills
+ *    each node with the record and then the key, as described in
+ *    fillRecordAndKey().  Return the number of records read; a
+ *    return value of 0 indicates end of file or error.
+ */
+static size_t
+fillRecordsAndKeys(
+    skstream_t         *stream,
+    uint8_t            *buf,
+    size_t              max_count)
+{
+    rwRec recs[SORT_READ_RECS];
+    skplugin_err_t err;
+    const char **name;
+    size_t count;
+    size_t c;
+    size_t i;
+    int rv;
+
+    if (node_size == sizeof(rwRec)) {
+        /* the nodes contain no plug-in keys, so read the records
+         * directly into 'buf' */
+        rv = skStreamReadRecords(stream, (rwRec*)buf, max_count, &count);
+    } else {
+        if (max_count > SORT_READ_RECS) {
+            max_count = SORT_READ_RECS;
+        }
+        rv = skStreamReadRecords(stream, recs, max_count, &count);
+        for (c = 0; c < count; ++c, buf += node_size) {
+            memcpy(buf, &recs[c], sizeof(rwRec));
+
+            /* lookup data from plug-in */
+            for (i = 0; i < key_num_fields; ++i) {
+                err = (skPluginFieldRunRecToBinFn(
+                           key_fields[i].kf_field_handle,
+                           &(buf[key_fields[i].kf_offset]), &recs[c], NULL));
+                if (err != SKPLUGIN_OK) {
+                    skPluginFieldName(key_fields[i].kf_field_handle, &name);
+                    skAppPrintErr(("Plugin-based field %s failed "
+                                   "converting to binary "
+                                   "with error code %d"), name[0], err);
+                    appExit(EXIT_FAILURE);
+                }
+            }
+            if (norm_key_width) {
+                nodeNormalizeKey(buf);
+            }
+        }
+    }
+    if (rv && SKSTREAM_ERR_EOF != rv) {
+        /* error getting records */
+        skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+    }
+    return count;
+}
+
+
 /*
  *    Create and return a new temporary file, putting the index of the
  *    file in 'temp_idx'.  Exit the application on failure.
@@ -460,51 +912,6 @@ sortTempClose(
     skStreamDestroy(&stream);
 }
 
-/*
- *    Read 'str_size' bytes from 'str_stream' into 'str_buf'.  Return
- *    'str_size' on success or 0 for other condition (end-of-file,
- *    short read, error).
- */
-#define sortTempRead(str_stream, str_buf, str_size)                     \
-    sortTempReadHelper(str_stream, str_buf, str_size, __FILE__, __LINE__)
-
-static ssize_t
-sortTempReadHelper(
-    skstream_t         *stream,
-    void               *buf,
-    size_t              size,
-    const char         *file_name,
-    int                 file_line)
-{
-    ssize_t rv;
-
-    rv = skStreamRead(stream, buf, size);
-    if (rv == (ssize_t)size) {
-        return rv;
-    }
-#if TRACEMSG_LEVEL == 0
-    (void)file_name;
-    (void)file_line;
-#else
-    if (rv == 0) {
-        TRACEMSG(("%s:%d: Failed to read %" SK_PRIuZ " bytes: EOF on '%s'",
-                  file_name, file_line, size, skStreamGetPathname(stream)));
-    } else if (rv > 0) {
-        TRACEMSG(("%s:%d: Failed to read %" SK_PRIuZ " bytes:"
-                  " Short read of %" SK_PRIdZ " on '%s'",
-                  file_name, file_line, size, rv, skStreamGetPathname(stream)));
-    } else {
-        char errbuf[2 * PATH_MAX];
-
-        skStreamLastErrMessage(stream, rv, errbuf, sizeof(errbuf));
-        TRACEMSG(("%s:%d: Failed to read %" SK_PRIuZ " bytes: %s",
-                  file_name, file_line, size, errbuf));
-    }
-#endif
-    return 0;
-}
-
-
 /*
  *    Write 'stw_size' bytes from 'stw_buf' to 'stw_stream'.  Return
  *    'stw_size' on success and exit the appliation on error or short
@@ -576,42 +983,437 @@ sortTempWriteBuffer(
 }
 
 
+/*
+ *    A sorted run being read by mergeFiles(): an open temporary file
+ *    and two buffers of nodes.  The merge consumes the nodes in the
+ *    active buffer while the reader thread fills the other one.
+ */
+typedef struct merge_run_st {
+    skstream_t         *stream;
+    uint8_t            *buf[2];
+    /* number of octets in each buffer */
+    size_t              len[2];
+    /* the current node and the end of the active buffer */
+    uint8_t            *cur;
+    uint8_t            *end;
+    /* return value of the read that reached the end of the file */
+    ssize_t             read_rv;
+    /* index of the buffer being merged */
+    unsigned int        active;
+    /* whether the other buffer is waiting to be filled */
+    unsigned int        pending :1;
+    /* whether the end of the file has been reached */
+    unsigned int        eof     :1;
+    /* whether every node in the run has been merged */
+    unsigned int        done    :1;
+} merge_run_t;
+
+/*
+ *    The state of one merge pass.
+ */
+typedef struct merge_st {
+    merge_run_t        *runs;
+    /* the loser tree: tree[0] is the run holding the lowest node;
+     * tree[1] through tree[run_count-1] are the runs that lost the
+     * match at that node of the tree */
+    uint32_t           *tree;
+    /* the runs whose other buffer the reader thread must fill */
+    uint32_t           *queue;
+    uint32_t            queue_head;
+    uint32_t            queue_count;
+    /* the number of runs and the capacity of 'runs' */
+    uint32_t            run_count;
+    uint32_t            run_max;
+    /* the size of each buffer, in octets */
+    size_t              buf_size;
+    /* the memory holding every run's buffers */
+    uint8_t            *buf_mem;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond_request;
+    pthread_cond_t      cond_filled;
+    pthread_t           reader;
+    unsigned int        reader_running :1;
+    unsigned int        stopping       :1;
+} merge_t;
+
+
+/*
+ *  len = mergeReadBuffer(run, which, &read_rv);
+ *
+ *    Fill buffer 'which' of 'run' from its temporary file.  Return
+ *    the number of octets read.  When the buffer is not filled, set
+ *    'read_rv' to the value returned by the final read: 0 at end of
+ *    file, or an error code.
+ */
+static size_t
+mergeReadBuffer(
+    merge_t            *merge,
+    merge_run_t        *run,
+    unsigned int        which,
+    ssize_t            *read_rv)
+{
+    size_t len = 0;
+    ssize_t rv;
+
+    while (len < merge->buf_size) {
+        rv = skStreamRead(run->stream, run->buf[which] + len,
+                          merge->buf_size - len);
+        if (rv <= 0) {
+            *read_rv = rv;
+            break;
+        }
+        len += rv;
+    }
+    return len;
+}
+
+
+/*
+ *  mergeReader(v_merge);
+ *
+ *    THREAD ENTRY POINT for the thread that reads ahead in the
+ *    temporary files.  Fill the buffers that mergeRequestFill() puts
+ *    on the queue of the merge_t 'v_merge' until mergeFiles() sets
+ *    the 'stopping' flag.
+ */
+static void *
+mergeReader(
+    void               *v_merge)
+{
+    merge_t *merge = (merge_t*)v_merge;
+    merge_run_t *run;
+    unsigned int which;
+    ssize_t read_rv;
+    size_t len;
+
+    pthread_mutex_lock(&merge->mutex);
+    for (;;) {
+        while (0 == merge->queue_count && !merge->stopping) {
+            pthread_cond_wait(&merge->cond_request, &merge->mutex);
+        }
+        if (0 == merge->queue_count) {
+            break;
+        }
+        run = &merge->runs[merge->queue[merge->queue_head]];
+        merge->queue_head = (merge->queue_head + 1) % merge->run_max;
+        --merge->queue_count;
+        /* the merge does not touch this buffer while it is pending */
+        which = 1 - run->active;
+        pthread_mutex_unlock(&merge->mutex);
+
+        read_rv = 1;
+        len = mergeReadBuffer(merge, run, which, &read_rv);
+
+        pthread_mutex_lock(&merge->mutex);
+        run->len[which] = len;
+        if (read_rv <= 0) {
+            run->read_rv = read_rv;
+            run->eof = 1;
+        }
+        run->pending = 0;
+        pthread_cond_broadcast(&merge->cond_filled);
+    }
+    pthread_mutex_unlock(&merge->mutex);
+
+    return NULL;
+}
+
+
+/*
+ *  mergeRequestFill(merge, run_idx);
+ *
+ *    Arrange for the buffer of run 'run_idx' that is not active to
+ *    be filled.  The reader thread fills it when it is running;
+ *    otherwise it is filled now.
+ */
+static void
+mergeRequestFill(
+    merge_t            *merge,
+    uint32_t            run_idx)
+{
+    merge_run_t *run = &merge->runs[run_idx];
+    ssize_t read_rv;
+    size_t len;
+
+    if (!merge->reader_running) {
+        read_rv = 1;
+        len = mergeReadBuffer(merge, run, 1 - run->active, &read_rv);
+        run->len[1 - run->active] = len;
+        if (read_rv <= 0) {
+            run->read_rv = read_rv;
+            run->eof = 1;
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&merge->mutex);
+    run->pending = 1;
+    merge->queue[(merge->queue_head + merge->queue_count) % merge->run_max]
+        = run_idx;
+    ++merge->queue_count;
+    pthread_cond_signal(&merge->cond_request);
+    pthread_mutex_unlock(&merge->mutex);
+}
+
+
+/*
+ *  mergeSwapBuffers(merge, run_idx);
+ *
+ *    Make the other buffer of run 'run_idx' the active one, waiting
+ *    for the reader thread to fill it if necessary, and request that
+ *    the buffer just consumed be refilled.  Mark the run as done when
+ *    no nodes remain.  Exit the application on a read error.
+ */
+static void
+mergeSwapBuffers(
+    merge_t            *merge,
+    uint32_t            run_idx)
+{
+    merge_run_t *run = &merge->runs[run_idx];
+    char errbuf[2 * PATH_MAX];
+    unsigned int which;
+
+    if (merge->reader_running) {
+        pthread_mutex_lock(&merge->mutex);
+        while (run->pending) {
+            pthread_cond_wait(&merge->cond_filled, &merge->mutex);
+        }
+        pthread_mutex_unlock(&merge->mutex);
+    }
+
+    which = 1 - run->active;
+    if (0 == run->len[which]) {
+        run->done = 1;
+        if (run->read_rv < 0) {
+            skStreamLastErrMessage(run->stream, run->read_rv,
+                                   errbuf, sizeof(errbuf));
+            skAppPrintErr("Error reading temporary file: %s", errbuf);
+            appExit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (run->len[which] % node_size) {
+        skAppPrintErr("Short read from temporary file '%s'",
+                      skStreamGetPathname(run->stream));
+        appExit(EXIT_FAILURE);
+    }
+
+    run->len[run->active] = 0;
+    run->active = which;
+    run->cur = run->buf[which];
+    run->end = run->cur + run->len[which];
+    if (!run->eof) {
+        mergeRequestFill(merge, run_idx);
+    }
+}
+
+
+/*
+ *  is_less = mergeRunLess(merge, a, b);
+ *
+ *    Return 1 if the current node of run 'a' sorts before that of
+ *    run 'b', and 0 otherwise.  A run that is done sorts after every
+ *    other run, and the index 'run_count' is a virtual run that sorts
+ *    before every other run.  Ties are broken by the run index, which
+ *    keeps the merge stable.
+ */
+static int
+mergeRunLess(
+    const merge_t      *merge,
+    uint32_t            a,
+    uint32_t            b)
+{
+    const merge_run_t *run_a;
+    const merge_run_t *run_b;
+    int cmp;
+
+    if (a == merge->run_count) {
+        return 1;
+    }
+    if (b == merge->run_count) {
+        return 0;
+    }
+    run_a = &merge->runs[a];
+    run_b = &merge->runs[b];
+    if (run_a->done) {
+        return 0;
+    }
+    if (run_b->done) {
+        return 1;
+    }
+    if (norm_key_width) {
+        cmp = nodeCompareKeys(run_a->cur, run_b->cur);
+    } else {
+        cmp = rwrecCompare(run_a->cur, run_b->cur);
+    }
+    if (cmp) {
+        return (cmp < 0);
+    }
+    return (a < b);
+}
+
+
+/*
+ *  mergeReplay(merge, run_idx);
+ *
+ *    Replay the matches in the loser tree from the leaf for run
+ *    'run_idx' to the root after that run's current node changed, and
+ *    store the overall winner in tree[0].
+ */
+static void
+mergeReplay(
+    merge_t            *merge,
+    uint32_t            run_idx)
+{
+    uint32_t winner = run_idx;
+    uint32_t loser;
+    uint32_t t;
+
+    for (t = (run_idx + merge->run_count) >> 1; t > 0; t >>= 1) {
+        if (mergeRunLess(merge, merge->tree[t], winner)) {
+            loser = winner;
+            winner = merge->tree[t];
+            merge->tree[t] = loser;
+        }
+    }
+    merge->tree[0] = winner;
+}
+
+
+/*
+ *  fan_in = mergeChooseFanIn(file_count, &buf_size);
+ *
+ *    Choose how many of the 'file_count' temporary files to merge at
+ *    once and the size of each read-ahead buffer, given the memory
+ *    allowed by --sort-buffer-size.  The fan-in is the smallest one
+ *    that needs no more passes over the data than the largest fan-in
+ *    would, since a smaller fan-in leaves more memory for each
+ *    file's buffers.
+ */
+static uint32_t
+mergeChooseFanIn(
+    uint32_t            file_count,
+    size_t             *buf_size)
+{
+    uint64_t limit;
+    uint64_t reach;
+    uint32_t fan_in;
+    unsigned int passes;
+    unsigned int i;
+
+    /* the largest fan-in that gives each file its smallest buffers */
+    limit = sort_buffer_size / (2 * MERGE_BUFFER_MIN);
+    if (limit > MAX_MERGE_FILES) {
+        limit = MAX_MERGE_FILES;
+    } else if (limit < 2) {
+        limit = 2;
+    }
+
+    /* the number of passes the merge needs at that fan-in */
+    passes = 1;
+    for (reach = limit; reach < file_count; reach *= limit) {
+        ++passes;
+    }
+
+    /* the smallest fan-in that needs no more passes */
+    for (fan_in = 2; fan_in < limit; ++fan_in) {
+        reach = fan_in;
+        for (i = 1; i < passes && reach < file_count; ++i) {
+            reach *= fan_in;
+        }
+        if (reach >= file_count) {
+            break;
+        }
+    }
+
+    *buf_size = sort_buffer_size / (2 * fan_in);
+    if (*buf_size > MERGE_BUFFER_MAX) {
+        *buf_size = MERGE_BUFFER_MAX;
+    }
+    *buf_size -= *buf_size % node_size;
+    if (*buf_size < node_size) {
+        *buf_size = node_size;
+    }
+
+    TRACEMSG((("Merging %" PRIu32 " files in %u passes with fan-in %" PRIu32
+               " and %" SK_PRIuZ "-byte buffers"),
+              file_count, passes, fan_in, *buf_size));
+    return fan_in;
+}
+
+
 /*
  *  mergeFiles(temp_file_idx)
  *
  *    Merge the temporary files numbered from 0 to 'temp_file_idx'
  *    inclusive into the output file 'out_stream', maintaining sorted
  *    order.  Exits the application if an error occurs.
+ *
+ *    The files are merged with a loser tree.  Each file has two
+ *    read-ahead buffers, one of which a separate thread fills while
+ *    the merge consumes the other.  When there are more files than
+ *    the fan-in chosen by mergeChooseFanIn(), groups of files are
+ *    merged into intermediate temporary files first.
  */
 static void
 mergeFiles(
     int                 temp_file_idx)
 {
-    skstream_t *fps[MAX_MERGE_FILES];
-    uint8_t recs[MAX_MERGE_FILES][MAX_NODE_SIZE];
+    merge_t merge;
+    merge_run_t *run;
+    uint32_t fan_in;
+    uint32_t remaining;
+    uint32_t want;
+    uint32_t i;
     int j;
-    uint16_t open_count;
-    uint16_t i;
-    uint16_t *top_heap;
-    uint16_t lowest;
     int tmp_idx_a;
     int tmp_idx_b;
     skstream_t *fp_intermediate = NULL;
     int tmp_idx_intermediate;
     int opened_all_temps = 0;
-    skheap_t *heap;
-    uint32_t heap_count;
+    ssize_t read_rv;
     int rv;
 
     TRACEMSG(("Merging #%d through #%d into '%s'",
               0, temp_file_idx, skStreamGetPathname(out_stream)));
 
-    heap = skHeapCreate2(compHeapNodes, MAX_MERGE_FILES, sizeof(uint16_t),
-                         NULL, recs);
-    if (NULL == heap) {
-        skAppPrintOutOfMemory("heap");
+    memset(&merge, 0, sizeof(merge));
+    fan_in = mergeChooseFanIn(temp_file_idx + 1, &merge.buf_size);
+    merge.run_max = fan_in;
+
+    merge.runs = (merge_run_t*)calloc(fan_in, sizeof(merge_run_t));
+    merge.tree = (uint32_t*)calloc(fan_in, sizeof(uint32_t));
+    merge.queue = (uint32_t*)calloc(fan_in, sizeof(uint32_t));
+    if (!merge.runs || !merge.tree || !merge.queue) {
+        skAppPrintOutOfMemory("merge state");
         appExit(EXIT_FAILURE);
     }
+    /* allocate the buffers, using smaller buffers if necessary */
+    for (;;) {
+        merge.buf_mem = (uint8_t*)malloc(2 * fan_in * merge.buf_size);
+        if (merge.buf_mem) {
+            break;
+        }
+        if (merge.buf_size == node_size) {
+            skAppPrintOutOfMemory("merge buffers");
+            appExit(EXIT_FAILURE);
+        }
+        merge.buf_size /= 2;
+        merge.buf_size -= merge.buf_size % node_size;
+        if (merge.buf_size < node_size) {
+            merge.buf_size = node_size;
+        }
+        TRACEMSG(("malloc() failed; reducing merge buffers to %" SK_PRIuZ,
+                  merge.buf_size));
+    }
+    for (i = 0; i < fan_in; ++i) {
+        merge.runs[i].buf[0] = merge.buf_mem + 2 * i * merge.buf_size;
+        merge.runs[i].buf[1] = merge.runs[i].buf[0] + merge.buf_size;
+    }
+
+    pthread_mutex_init(&merge.mutex, NULL);
+    pthread_cond_init(&merge.cond_request, NULL);
+    pthread_cond_init(&merge.cond_filled, NULL);
 
     /* the index of the first temp file to the merge */
     tmp_idx_a = 0;
@@ -619,25 +1421,32 @@ mergeFiles(
     /* This loop repeats as long as we haven't read all of the temp
      * files generated in the sorting stage. */
     do {
-        assert(SKHEAP_ERR_EMPTY==skHeapPeekTop(heap,(skheapnode_t*)&top_heap));
+        /* choose the number of files to merge in this pass.  When
+         * intermediate merges are needed, size the first one so that
+         * every later merge has exactly 'fan_in' files. */
+        remaining = (uint32_t)(temp_file_idx - tmp_idx_a + 1);
+        if (remaining <= fan_in) {
+            want = remaining;
+        } else {
+            want = (remaining - 2) % (fan_in - 1) + 2;
+        }
 
         /* the index of the last temp file to merge */
-        tmp_idx_b = temp_file_idx;
+        tmp_idx_b = tmp_idx_a + want - 1;
 
         /* open an intermediate temp file.  The merge-sort will have
          * to write records here if there are not enough file handles
          * available to open all the existing tempoary files. */
         fp_intermediate = sortTempCreate(&tmp_idx_intermediate);
 
-        /* count number of files we open */
-        open_count = 0;
-
-        /* Attempt to open up to MAX_MERGE_FILES, though we an open
-         * may fail due to lack of resources (EMFILE or ENOMEM) */
+        /* Attempt to open the files, though we an open may fail due
+         * to lack of resources (EMFILE or ENOMEM) */
+        merge.run_count = 0;
         for (j = tmp_idx_a; j <= tmp_idx_b; ++j) {
-            fps[open_count] = sortTempReopen(j);
-            if (NULL == fps[open_count]) {
-                if (0 == open_count) {
+            run = &merge.runs[merge.run_count];
+            run->stream = sortTempReopen(j);
+            if (NULL == run->stream) {
+                if (0 == merge.run_count) {
                     skAppPrintErr("Unable to open any temporary files");
                     appExit(EXIT_FAILURE);
                 }
@@ -651,31 +1460,23 @@ mergeFiles(
                      strerror(errno)));
                 break;
             }
-
-            /* read the first record */
-            if (sortTempRead(fps[open_count], recs[open_count], node_size)) {
-                /* insert the file index into the heap */
-                skHeapInsert(heap, &open_count);
-                ++open_count;
-                if (open_count == MAX_MERGE_FILES) {
-                    /* We've reached the limit for this pass.  Set
-                     * tmp_idx_b to the file we just opened. */
-                    tmp_idx_b = j;
-                    TRACEMSG((("MAX_MERGE_FILES limit hit--"
-                               "merging #%d through #%d into #%d"),
-                              tmp_idx_a, tmp_idx_b, tmp_idx_intermediate));
-                    break;
-                }
-            } else {
-                if (skStreamGetLastReturnValue(fps[open_count]) != 0) {
-                    skAppPrintSyserror(("Error reading first record from"
-                                        " temporary file '%s'"),
-                                       skTempFileGetName(tmpctx, j));
-                    appExit(EXIT_FAILURE);
-                }
+            ++merge.run_count;
+
+            /* fill the first buffer */
+            run->active = 1;
+            run->len[0] = run->len[1] = 0;
+            run->read_rv = 0;
+            run->pending = run->eof = run->done = 0;
+            read_rv = 1;
+            run->len[0] = mergeReadBuffer(&merge, run, 0, &read_rv);
+            if (read_rv <= 0) {
+                run->read_rv = read_rv;
+                run->eof = 1;
+            }
+            mergeSwapBuffers(&merge, merge.run_count - 1);
+            if (run->done) {
                 TRACEMSG(("Ignoring empty temporary file '%s'",
                           skTempFileGetName(tmpctx, j)));
-                skStreamDestroy(&fps[open_count]);
             }
         }
 
@@ -694,26 +1495,40 @@ mergeFiles(
             temp_file_idx = tmp_idx_intermediate;
         }
 
-        TRACEMSG((("Merging %" PRIu16 " temporary files"), open_count));
+        TRACEMSG((("Merging %" PRIu32 " temporary files"), merge.run_count));
 
-        heap_count = skHeapGetNumberEntries(heap);
-        assert(heap_count == open_count);
+        /* start the thread that reads ahead; when it cannot be
+         * started, buffers are filled as they are needed */
+        merge.queue_head = merge.queue_count = 0;
+        merge.stopping = 0;
+        merge.reader_running = 0;
+        if (0 == pthread_create(&merge.reader, NULL, &mergeReader, &merge)) {
+            merge.reader_running = 1;
+        }
 
-        /* exit this while() once we are only processing a single
-         * file */
-        while (heap_count > 1) {
-            /* entry at the top of the heap has the lowest key */
-            skHeapPeekTop(heap, (skheapnode_t*)&top_heap);
-            lowest = *top_heap;
+        /* build the loser tree */
+        for (i = 0; i < merge.run_count; ++i) {
+            merge.tree[i] = merge.run_count;
+        }
+        for (i = merge.run_count; i > 0; --i) {
+            mergeReplay(&merge, i - 1);
+        }
 
-            /* write the lowest record */
+        /* write the lowest node and advance its run until every run
+         * is done */
+        for (;;) {
+            i = merge.tree[0];
+            run = &merge.runs[i];
+            if (run->done) {
+                break;
+            }
             if (fp_intermediate) {
                 /* write record to intermediate tmp file */
-                sortTempWrite(fp_intermediate, recs[lowest], node_size);
+                sortTempWrite(fp_intermediate, run->cur, node_size);
             } else {
                 /* we successfully opened all (remaining) temp files,
                  * write to record to the final destination */
-                rv = skStreamWriteRecord(out_stream,(rwRec*)recs[lowest]);
+                rv = skStreamWriteRecord(out_stream, (rwRec*)run->cur);
                 if (0 != rv) {
                     skStreamPrintLastErr(out_stream, rv, &skAppPrintErr);
                     if (SKSTREAM_ERROR_IS_FATAL(rv)) {
@@ -721,50 +1536,30 @@ mergeFiles(
                     }
                 }
             }
-
-            /* replace the record we just wrote */
-            if (sortTempRead(fps[lowest], recs[lowest], node_size)) {
-                /* read was successful.  "insert" the new entry into
-                 * the heap (which has same value as old entry). */
-                skHeapReplaceTop(heap, &lowest, NULL);
-            } else {
-                /* no more data for this file; remove it from the
-                 * heap */
-                skHeapExtractTop(heap, NULL);
-                --heap_count;
-                TRACEMSG(("Finished reading file #%u; %u files remain",
-                          tmp_idx_a + lowest, heap_count));
+            run->cur += node_size;
+            if (run->cur == run->end) {
+                mergeSwapBuffers(&merge, i);
             }
+            mergeReplay(&merge, i);
         }
 
-        /* get index of the remaining file */
-        skHeapExtractTop(heap, &lowest);
-        assert(SKHEAP_ERR_EMPTY==skHeapPeekTop(heap,(skheapnode_t*)&top_heap));
-
-        /* read records from the remaining file */
-        if (fp_intermediate) {
-            do {
-                sortTempWrite(fp_intermediate, recs[lowest], node_size);
-            } while (sortTempRead(fps[lowest], recs[lowest], node_size));
-        } else {
-            do {
-                rv = skStreamWriteRecord(out_stream, (rwRec*)recs[lowest]);
-                if (0 != rv) {
-                    skStreamPrintLastErr(out_stream, rv, &skAppPrintErr);
-                    if (SKSTREAM_ERROR_IS_FATAL(rv)) {
-                        appExit(EXIT_FAILURE);
-                    }
-                }
-            } while (sortTempRead(fps[lowest], recs[lowest], node_size));
+        /* stop the reader thread */
+        if (merge.reader_running) {
+            pthread_mutex_lock(&merge.mutex);
+            merge.stopping = 1;
+            pthread_cond_broadcast(&merge.cond_request);
+            pthread_mutex_unlock(&merge.mutex);
+            pthread_join(merge.reader, NULL);
+            merge.reader_running = 0;
         }
 
-        TRACEMSG(("Finished reading file #%u; 0 files remain", lowest));
         TRACEMSG((("Finished processing #%d through #%d"),
                   tmp_idx_a, tmp_idx_b));
 
         /* Close all open temp files */
-        for (i = 0; i < open_count; ++i) {
-            sortTempClose(fps[i]);
+        for (i = 0; i < merge.run_count; ++i) {
+            sortTempClose(merge.runs[i].stream);
+            merge.runs[i].stream = NULL;
         }
         /* Delete all temp files we opened (or attempted to open) this
          * time */
@@ -783,7 +1578,13 @@ mergeFiles(
 
     } while (!opened_all_temps);
 
-    skHeapFree(heap);
+    pthread_cond_destroy(&merge.cond_filled);
+    pthread_cond_destroy(&merge.cond_request);
+    pthread_mutex_destroy(&merge.mutex);
+    free(merge.buf_mem);
+    free(merge.queue);
+    free(merge.tree);
+    free(merge.runs);
 }
 
 
@@ -1010,6 +1811,7 @@ sortRandom(
     size_t buffer_chunk_recs;       /* how to grow from current to max buf */
     size_t num_chunks;              /* how quickly to grow buffer */
     size_t record_count = 0;        /* Number of records read */
+    size_t count;                   /* Number of records in one read */
     int rv;
 
     /* Determine the maximum number of records that will fit into the
@@ -1072,9 +1874,10 @@ sortRandom(
     record_count = 0;
     cur_node = record_buffer;
     while (input_stream != NULL) {
-        /* read record */
-        rv = fillRecordAndKey(input_stream, cur_node);
-        if (rv == 0) {
+        /* read records until the buffer is full */
+        count = fillRecordsAndKeys(input_stream, cur_node,
+                                   buffer_recs - record_count);
+        if (count == 0) {
             /* close current and open next */
             skStreamDestroy(&input_stream);
             rv = appNextInput(&input_stream);
@@ -1087,8 +1890,8 @@ sortRandom(
             continue;
         }
 
-        ++record_count;
-        cur_node += node_size;
+        record_count += count;
+        cur_node += count * node_size;
 
         if (record_count == buffer_recs) {
             /* Filled the current buffer */
@@ -1127,7 +1930,7 @@ sortRandom(
             if (record_count == buffer_max_recs) {
                 /* Sort */
                 TRACEMSG(("Sorting %" SK_PRIuZ " records...", record_count));
-                skQSort(record_buffer, record_count, node_size, &rwrecCompare);
+                sortBuffer(record_buffer, record_count);
                 TRACEMSG(("Sorting %" SK_PRIuZ " records...done",
                           record_count));
 
@@ -1145,7 +1948,7 @@ sortRandom(
     /* Sort (and maybe store) last batch of records */
     if (record_count > 0) {
         TRACEMSG(("Sorting %" SK_PRIuZ " records...", record_count));
-        skQSort(record_buffer, record_count, node_size, &rwrecCompare);
+        sortBuffer(record_buffer, record_count);
         TRACEMSG(("Sorting %" SK_PRIuZ " records...done", record_count));
 
         if (temp_file_idx >= 0) {
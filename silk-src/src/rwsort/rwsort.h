@@ -75,11 +75,26 @@ RCSIDENTVAR(rcsID_RWSORT_H, "$SiLK: rwsort.h ef14e54179be 2020-04-14 21:57:45Z m
  */
 #define MIN_IN_CORE_RECORDS     1000
 
+/*
+ *    The maximum number of records to read from an input stream at
+ *    one time when the records must be copied into the nodes.
+ */
+#define SORT_READ_RECS  256
+
 /*
  *    Maximum number of files to attempt to merge-sort at once.
  */
 #define MAX_MERGE_FILES         1024
 
+/*
+ *    The smallest and largest read-ahead buffer, in bytes, for each
+ *    temporary file being merged.  Each file gets two buffers; the
+ *    size within this range depends on --sort-buffer-size and the
+ *    number of files being merged at once.
+ */
+#define MERGE_BUFFER_MIN        ((size_t)0x10000)
+#define MERGE_BUFFER_MAX        ((size_t)0x200000)
+
 /*
  *    Maximum number of fields that can come from plugins.  Allow four
  *    per plug-in.
@@ -154,6 +169,16 @@ extern int presorted_input;
 /* maximum amount of RAM to attempt to allocate */
 extern size_t sort_buffer_size;
 
+/* number of threads to use when sorting the buffer */
+extern uint32_t thread_count;
+
+/* whether to sort the buffer with a radix sort on a normalized key */
+extern int radix_sort;
+
+/* width of the normalized key that follows the rwRec in each node,
+ * or 0 when the nodes are compared field by field */
+extern size_t norm_key_width;
+
 /* FUNCTIONS */
 
 void
@@ -167,6 +192,9 @@ appSetup(
 int
 appNextInput(
     skstream_t        **stream);
+size_t
+normKeyFieldWidth(
+    uint32_t            field_id);
 
 #ifdef __cplusplus
 }
@@ -96,7 +96,9 @@ typedef enum {
     OPT_OUTPUT_PATH,
     OPT_PLUGIN,
     OPT_PRESORTED_INPUT,
-    OPT_SORT_BUFFER_SIZE
+    OPT_SORT_BUFFER_SIZE,
+    OPT_THREADS,
+    OPT_RADIX_SORT
 } appOptionsEnum;
 
 static struct option appOptions[] = {
@@ -108,6 +110,8 @@ static struct option appOptions[] = {
     {"plugin",              REQUIRED_ARG, 0, OPT_PLUGIN},
     {"presorted-input",     NO_ARG,       0, OPT_PRESORTED_INPUT},
     {"sort-buffer-size",    REQUIRED_ARG, 0, OPT_SORT_BUFFER_SIZE},
+    {"threads",             REQUIRED_ARG, 0, OPT_THREADS},
+    {"radix-sort",          NO_ARG,       0, OPT_RADIX_SORT},
     {0,0,0,0}               /* sentinel entry */
 };
 
@@ -123,6 +127,9 @@ static const char *appHelp[] = {
     ("Assume input has been presorted using\n"
      "\trwsort invoked with the exact same --fields value. Def. No"),
     NULL, /* generated dynamically */
+    "Sort the in-memory buffer using this number of threads. Def. 1",
+    ("Sort the in-memory buffer with a radix sort on a key\n"
+     "\tbuilt from the --fields. Def. No"),
     (char *)NULL
 };
 
@@ -374,6 +381,12 @@ appSetup(
         skAppUsage();           /* never returns */
     }
 
+    /* the comparison function calls into the plug-ins; sort with a
+     * single thread unless they all support threading */
+    if ((thread_count > 1) && !skPluginIsThreadSafe()) {
+        thread_count = 1;
+    }
+
     /* verify that the temp directory is valid */
     if (skTempFileInitialize(&tmpctx, temp_directory, NULL, &skAppPrintErr)) {
         appExit(EXIT_FAILURE);
@@ -508,6 +521,17 @@ appOptionsHandler(
         }
         sort_buffer_size = tmp64;
         break;
+
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
+
+      case OPT_RADIX_SORT:
+        radix_sort = 1;
+        break;
     }
 
     return 0;                     /* OK */
@@ -557,7 +581,10 @@ parseFields(
 {
     sk_stringmap_iter_t *sm_iter = NULL;
     sk_stringmap_entry_t *sm_entry;
+    key_field_t *kf;
     char *errmsg;
+    size_t key_width;
+    size_t width;
     uint32_t i;
     int have_icmp_type_code;
     int rv = -1;
@@ -691,6 +718,42 @@ parseFields(
         }
     }
 
+    /* for --radix-sort, when every field can be written as octets
+     * that sort correctly with memcmp(), use a normalized key that
+     * follows the rwRec; the binary values from the plug-ins become
+     * part of that key.  This is not possible when a plug-in provides
+     * its own function to compare binary values. */
+    key_width = 0;
+    kf = key_fields;
+    for (i = 0; i < num_fields && radix_sort; ++i) {
+        width = normKeyFieldWidth(sort_fields[i]);
+        if (0 == width) {
+            if (skPluginFieldFnMask(kf->kf_field_handle)
+                & SKPLUGIN_FN_COMPARE)
+            {
+                key_width = 0;
+                break;
+            }
+            width = kf->kf_width;
+            ++kf;
+        }
+        key_width += width;
+    }
+    if (key_width > 0 && sizeof(rwRec) + key_width <= MAX_NODE_SIZE) {
+        node_size = sizeof(rwRec);
+        kf = key_fields;
+        for (i = 0; i < num_fields; ++i) {
+            width = normKeyFieldWidth(sort_fields[i]);
+            if (0 == width) {
+                kf->kf_offset = node_size;
+                width = kf->kf_width;
+                ++kf;
+            }
+            node_size += width;
+        }
+        norm_key_width = key_width;
+    }
+
 #ifdef SK_HAVE_ALIGNED_ACCESS_REQUIRED
     /* records must be aligned */
     node_size = (1 + ((node_size - 1) / sizeof(uint64_t))) * sizeof(uint64_t);
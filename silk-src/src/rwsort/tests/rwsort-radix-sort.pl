@@ -0,0 +1,15 @@
+#! /usr/bin/perl -w
+# MD5: 967258f1a1a4275e7abcc7ad6b9cc8b1
+# TEST: ./rwsort --fields=dip,stime --radix-sort --reverse ../../tests/data.rwf | ../rwcut/rwcut --fields=dip,stime --ipv6-policy=ignore
+
+use strict;
+use SiLKTests;
+
+my $rwsort = check_silk_app('rwsort');
+my $rwcut = check_silk_app('rwcut');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwsort --fields=dip,stime --radix-sort --reverse $file{data} | $rwcut --fields=dip,stime --ipv6-policy=ignore";
+my $md5 = "967258f1a1a4275e7abcc7ad6b9cc8b1";
+
+check_md5_output($md5, $cmd);
@@ -0,0 +1,15 @@
+#! /usr/bin/perl -w
+# MD5: 6a40e2730898fdcf65c39099d35b4c79
+# TEST: ./rwsort --fields=proto,dport,sip --threads=4 ../../tests/data.rwf | ../rwcut/rwcut --fields=proto,dport,sip --ipv6-policy=ignore
+
+use strict;
+use SiLKTests;
+
+my $rwsort = check_silk_app('rwsort');
+my $rwcut = check_silk_app('rwcut');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwsort --fields=proto,dport,sip --threads=4 $file{data} | $rwcut --fields=proto,dport,sip --ipv6-policy=ignore";
+my $md5 = "6a40e2730898fdcf65c39099d35b4c79";
+
+check_md5_output($md5, $cmd);
@@ -142,6 +142,7 @@ RCSIDENT("$SiLK: rwstats.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
 #include <silk/skheap.h>
 #include "rwstats.h"
+#include "skheavyhitters.h"
 
 
 /* TYPEDEFS AND DEFINES */
@@ -223,6 +224,9 @@ static size_t heap_offset_distinct = 0;
 /* the total byte length of a node in the heap */
 static size_t heap_octets_node = 0;
 
+/* the summary used to count the bins when --approximate is given */
+static sk_heavyhitters_t *heavy = NULL;
+
 
 /* FUNCTION DEFINITIONS */
 
@@ -261,8 +265,10 @@ topnPrintHeader(
     }
 
     /* Get a count of unique flows */
-    fprintf(output.of_fp, ("INPUT: %" PRIu64 " Record%s for %" PRIu64 " Bin%s"),
+    fprintf(output.of_fp, ("INPUT: %" PRIu64 " Record%s for %s%" PRIu64
+                           " Bin%s"),
             record_count, PLURAL(record_count),
+            ((heavy && !skHeavyHittersIsExact(heavy)) ? "more than " : ""),
             limit.entries, PLURAL(limit.entries));
     if (value_total) {
         fprintf(output.of_fp, (" and %" PRIu64 " Total %s"),
@@ -273,6 +279,15 @@ topnPrintHeader(
     switch (limit.type) {
       case RWSTATS_COUNT:
         assert(limit.value[RWSTATS_COUNT].u64 > 0);
+        if (heavy) {
+            fprintf(output.of_fp,
+                    ("OUTPUT: %s %" PRIu64 " Bin%s by %s"
+                     " (approximate; maximum error %" PRIu64 ")\n"),
+                    direction_name, limit.value[RWSTATS_COUNT].u64,
+                    PLURAL(limit.value[RWSTATS_COUNT].u64), limit.title,
+                    skHeavyHittersGetMaxError(heavy));
+            break;
+        }
         /* FALLTHROUGH */
       case RWSTATS_ALL:
         fprintf(output.of_fp, ("OUTPUT: %s %" PRIu64 " Bin%s by %s\n"),
@@ -317,6 +332,15 @@ topnPrintHeader(
     /* print key titles */
     rwAsciiPrintTitles(ascii_str);
 
+    if (heavy) {
+        if (app_flags.no_columns) {
+            fprintf(output.of_fp, "%c%s", delimiter, "Max-Error");
+        } else {
+            fprintf(output.of_fp, "%c%*.*s",
+                    delimiter, width[WIDTH_VAL], width[WIDTH_VAL],
+                    "Max-Error");
+        }
+    }
     if (!app_flags.no_percents) {
         snprintf(buf, sizeof(buf), "%%%s", limit.title);
         buf[sizeof(buf)-1] = '\0';
@@ -329,6 +353,8 @@ topnPrintHeader(
                     delimiter, width[WIDTH_PCT], width[WIDTH_PCT], buf,
                     delimiter, width[WIDTH_PCT], width[WIDTH_PCT], "cumul_%");
         }
+    }
+    if (heavy || !app_flags.no_percents) {
         fprintf(output.of_fp, "%s\n", final_delim);
     }
 }
@@ -566,6 +592,23 @@ rwstatsComparePluginAny(
     return ((RWSTATS_DIR_TOP == direction) ? -cmp : cmp);
 }
 
+static int
+rwstatsCompareApproxAny(
+    const skheapnode_t  node1,
+    const skheapnode_t  node2)
+{
+    uint8_t sketch1[HASHLIB_MAX_VALUE_WIDTH];
+    uint8_t sketch2[HASHLIB_MAX_VALUE_WIDTH];
+    int cmp;
+
+    skFieldListExtractFromBuffer(value_fields, HEAP_PTR_VALUE(node1),
+                                 limit.fl_entry, sketch1);
+    skFieldListExtractFromBuffer(value_fields, HEAP_PTR_VALUE(node2),
+                                 limit.fl_entry, sketch2);
+    cmp = skFieldListEntryCompareBuffers(sketch1, sketch2, limit.fl_entry);
+    return ((RWSTATS_DIR_TOP == direction) ? -cmp : cmp);
+}
+
 static int
 rwstatsCompareDistinctsAny(
     const skheapnode_t  node1,
@@ -691,7 +734,9 @@ statsRandom(
     sk_unique_iterator_t *iter;
     uint8_t *outbuf[3] = {NULL, NULL, NULL};
     skstream_t *stream;
-    rwRec rwrec;
+    rwRec rwrec[STATSUNIQ_READ_RECS];
+    size_t rec_count;
+    size_t i;
     int rv = 0;
     size_t len;
     union count_un {
@@ -704,11 +749,14 @@ statsRandom(
 
     /* read SiLK Flow records and insert into the skunique data structure */
     while (0 == (rv = appNextInput(&stream))) {
-        while (SKSTREAM_OK == (rv = readRecord(stream, &rwrec))) {
-            if (0 != skUniqueAddRecord(uniq, &rwrec)) {
-                return -1;
+        do {
+            rv = readRecords(stream, rwrec, STATSUNIQ_READ_RECS, &rec_count);
+            for (i = 0; i < rec_count; ++i) {
+                if (0 != skUniqueAddRecord(uniq, &rwrec[i])) {
+                    return -1;
+                }
             }
-        }
+        } while (SKSTREAM_OK == rv);
         if (rv != SKSTREAM_ERR_EOF) {
             /* corrupt record in file */
             skStreamPrintLastErr(stream, rv, &skAppPrintErr);
@@ -926,6 +974,10 @@ statsRandom(
               default:
                 skFieldListExtractFromBuffer(value_fields, outbuf[1],
                                              limit.fl_entry, count.ar);
+                if (SK_FIELD_APPROX_DISTINCT == limit.fl_id) {
+                    count.u64 = skFieldListEntryGetApproxDistinct(
+                        limit.fl_entry, count.ar);
+                }
                 if (!VALUE_MEETS_THRESHOLD(count.u64)) {
                     continue;
                 }
@@ -1174,6 +1226,10 @@ presortedEntryCallback(
           default:
             skFieldListExtractFromBuffer(value_fields, value,
                                          limit.fl_entry, count.ar);
+            if (SK_FIELD_APPROX_DISTINCT == limit.fl_id) {
+                count.u64 = skFieldListEntryGetApproxDistinct(
+                    limit.fl_entry, count.ar);
+            }
             if (!VALUE_MEETS_THRESHOLD(count.u64)) {
                 return 0;
             }
@@ -1260,6 +1316,11 @@ topnMain(
             cmp_fn = &rwstatsComparePluginAny;
             break;
 
+          case DIR_AND_TYPE(RWSTATS_DIR_TOP, SK_FIELD_APPROX_DISTINCT):
+          case DIR_AND_TYPE(RWSTATS_DIR_BOTTOM, SK_FIELD_APPROX_DISTINCT):
+            cmp_fn = &rwstatsCompareApproxAny;
+            break;
+
           default:
             skAbortBadCase(DIR_AND_TYPE(direction, limit.fl_id));
         }
@@ -1314,6 +1375,111 @@ topnMain(
 }
 
 
+/*
+ *  approxMain();
+ *
+ *    Function used when the user requests an approximate top-N.
+ *    Rather than binning every key, count the keys with a
+ *    fixed-size Space-Saving summary, then print the N bins with the
+ *    largest counts and the maximum amount by which each count may
+ *    exceed the bin's true value.
+ */
+static void
+approxMain(
+    void)
+{
+    uint8_t keybuf[HASHLIB_MAX_KEY_WIDTH];
+    uint8_t *outbuf[3] = {NULL, NULL, NULL};
+    const uint8_t *key;
+    skstream_t *stream;
+    rwRec rwrec[STATSUNIQ_READ_RECS];
+    size_t rec_count;
+    size_t i;
+    uint64_t count;
+    uint64_t error;
+    uint64_t weight;
+    double cumul_pct = 0.0;
+    double percent;
+    uint32_t idx;
+    int rv;
+
+    assert(skFieldListGetBufferSize(value_fields) == sizeof(uint64_t));
+
+    if (skHeavyHittersCreate(&heavy, skFieldListGetBufferSize(key_fields),
+                             approx_counters))
+    {
+        skAppPrintErr(("Unable to create summary of %" PRIu32
+                       " %" PRIu32 "-byte counters"),
+                      approx_counters,
+                      (uint32_t)skFieldListGetBufferSize(key_fields));
+        appExit(EXIT_FAILURE);
+    }
+
+    /* read SiLK Flow records and add each to the summary */
+    while (0 == (rv = appNextInput(&stream))) {
+        do {
+            rv = readRecords(stream, rwrec, STATSUNIQ_READ_RECS, &rec_count);
+            for (i = 0; i < rec_count; ++i) {
+                switch (limit.fl_id) {
+                  case SK_FIELD_SUM_BYTES:
+                    weight = rwRecGetBytes(&rwrec[i]);
+                    break;
+                  case SK_FIELD_SUM_PACKETS:
+                    weight = rwRecGetPkts(&rwrec[i]);
+                    break;
+                  default:
+                    weight = 1;
+                    break;
+                }
+                skFieldListRecToBinary(key_fields, &rwrec[i], keybuf);
+                skHeavyHittersAdd(heavy, keybuf, weight);
+            }
+        } while (SKSTREAM_OK == rv);
+        if (rv != SKSTREAM_ERR_EOF) {
+            /* corrupt record in file */
+            skStreamPrintLastErr(stream, rv, &skAppPrintErr);
+            skStreamDestroy(&stream);
+            skHeavyHittersDestroy(&heavy);
+            appExit(EXIT_FAILURE);
+        }
+        skStreamDestroy(&stream);
+    }
+    if (rv == -1) {
+        /* error opening file */
+        skHeavyHittersDestroy(&heavy);
+        appExit(EXIT_FAILURE);
+    }
+
+    limit.entries = skHeavyHittersGetCount(heavy);
+    skHeavyHittersSort(heavy);
+
+    /* print the headings and column titles */
+    topnPrintHeader();
+
+    for (idx = 0;
+         (idx < limit.value[RWSTATS_COUNT].u64
+          && 0 == skHeavyHittersGetEntry(heavy, idx, &key, &count, &error));
+         ++idx)
+    {
+        outbuf[0] = (uint8_t*)key;
+        outbuf[1] = (uint8_t*)&count;
+        writeAsciiRecord(outbuf);
+        fprintf(output.of_fp, "%c%*" PRIu64,
+                delimiter, width[WIDTH_VAL], error);
+        if (!app_flags.no_percents) {
+            percent = 100.0 * (double)count / value_total;
+            cumul_pct += percent;
+            fprintf(output.of_fp, ("%c%*.6f%c%*.6f"),
+                    delimiter, width[WIDTH_PCT], percent, delimiter,
+                    width[WIDTH_PCT], cumul_pct);
+        }
+        fprintf(output.of_fp, "%s\n", final_delim);
+    }
+
+    skHeavyHittersDestroy(&heavy);
+}
+
+
 int main(int argc, char **argv)
 {
     int rv = 0;
@@ -1323,6 +1489,8 @@ int main(int argc, char **argv)
 
     if (proto_stats) {
         rv = protoStatsMain();
+    } else if (app_flags.approximate) {
+        approxMain();
     } else {
         topnMain();
     }
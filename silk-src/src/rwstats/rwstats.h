@@ -103,6 +103,7 @@ typedef struct app_flags_st {
     unsigned integer_sensors    :1;
     unsigned integer_tcp_flags  :1;
     unsigned check_limits       :1;      /* Whether output must meet limits */
+    unsigned approximate        :1;      /* stats: Use bounded memory */
 } app_flags_t;
 
 /* names for the columns */
@@ -112,6 +113,9 @@ enum width_type {
 
 #define RWSTATS_COLUMN_WIDTH_COUNT 4
 
+/* number of records to read from an input stream at one time */
+#define STATSUNIQ_READ_RECS 256
+
 /* used to handle legacy switches */
 typedef struct rwstats_legacy_st {
     const char *fields;
@@ -170,6 +174,9 @@ extern uint64_t value_total;
 extern uint32_t cidr_sip;
 extern uint32_t cidr_dip;
 
+/* Number of counters to use when --approximate is given */
+extern uint32_t approx_counters;
+
 
 /* FUNCTION DECLARATIONS */
 
@@ -191,6 +198,12 @@ readRecord(
     skstream_t         *stream,
     rwRec              *rwrec);
 int
+readRecords(
+    skstream_t         *stream,
+    rwRec              *rwrecs,
+    size_t              count,
+    size_t             *records_read);
+int
 appNextInput(
     skstream_t        **stream);
 void
@@ -38,6 +38,21 @@ RCSIDENT("$SiLK: rwstatssetup.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 /* suffix for distinct fields */
 #define DISTINCT_SUFFIX  "-Distinct"
 
+/* suffix for approximate distinct fields */
+#define APPROX_SUFFIX  "-Approx-Distinct"
+
+/* text width of an approximate distinct field */
+#define APPROX_TEXT_WIDTH  10
+
+/* when --approximate is given without an argument, use this many
+ * counters for each bin the user requested, but no fewer than
+ * APPROX_COUNTERS_MIN */
+#define APPROX_COUNTERS_PER_BIN  100
+#define APPROX_COUNTERS_MIN      1000
+
+/* the largest argument accepted by --approximate */
+#define APPROX_COUNTERS_MAX      (1 << 26)
+
 /* default bin size to use when the --bin-time switch is provided
  * without an argument */
 #define DEFAULT_BIN_TIME    60
@@ -75,7 +90,7 @@ RCSIDENT("$SiLK: rwstatssetup.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
 /* type of field being defined */
 typedef enum field_type_en {
-    FIELD_TYPE_KEY, FIELD_TYPE_VALUE, FIELD_TYPE_DISTINCT
+    FIELD_TYPE_KEY, FIELD_TYPE_VALUE, FIELD_TYPE_DISTINCT, FIELD_TYPE_APPROX
 } field_type_t;
 
 /* builtin_field_t is a struct to hold information about built-in
@@ -161,6 +176,10 @@ uint64_t value_total = 0;
 uint32_t cidr_sip = 0;
 uint32_t cidr_dip = 0;
 
+/* number of counters to use when --approximate is given; 0 to compute
+ * it from the --count */
+uint32_t approx_counters = 0;
+
 int width[RWSTATS_COLUMN_WIDTH_COUNT] = {
     15, /* WIDTH_KEY:   key */
     20, /* WIDTH_VAL:   count */
@@ -205,6 +224,10 @@ static builtin_field_t builtin_values[] = {
     {"Distinct",       10, SK_FIELD_CALLER,
      STATSUNIQ_PROGRAM_BOTH,   1, 0,
      "You must append a colon and a key field to count the number of"
+     " distinct values seen for that field in the group"},
+    {"Approx-Distinct", 10, SK_FIELD_APPROX_DISTINCT,
+     STATSUNIQ_PROGRAM_BOTH,   0, 0,
+     "You must append a colon and a key field to estimate the number of"
      " distinct values seen for that field in the group"}
 };
 
@@ -278,6 +301,16 @@ static sk_ipv6policy_t ipv6_policy = SK_IPV6POLICY_MIX;
 /* temporary directory */
 static const char *temp_directory = NULL;
 
+/* number of threads to use when binning records */
+static uint32_t thread_count = 1;
+
+/* number of partitions to write when the bins do not fit in memory;
+ * 0 to write sorted temporary files */
+static uint32_t spill_partitions = 0;
+
+/* precision of the sketch used by approx-distinct value fields */
+static uint32_t approx_precision = SK_APPROX_DISTINCT_DEFAULT_PRECISION;
+
 /* how to print IP addresses */
 static uint32_t ip_format = SKIPADDR_CANONICAL;
 
@@ -348,6 +381,10 @@ typedef enum {
     OPT_PRESORTED_INPUT,
     OPT_SORT_OUTPUT,
     OPT_NO_PERCENTS,
+    OPT_THREADS,
+    OPT_SPILL_PARTITIONS,
+    OPT_APPROX_PRECISION,
+    OPT_APPROXIMATE,
     OPT_BIN_TIME,
     OPT_INTEGER_SENSORS,
     OPT_INTEGER_TCP_FLAGS,
@@ -430,6 +467,25 @@ static statsuniq_option_t appOptions[] = {
     {STATSUNIQ_PROGRAM_STATS,
      {"no-percents",         NO_ARG,       0, OPT_NO_PERCENTS},
      ("Do not print the percentage columns. Def. Print percents")},
+    {STATSUNIQ_PROGRAM_BOTH,
+     {"threads",             REQUIRED_ARG, 0, OPT_THREADS},
+     ("Bin the records using this number of threads. Not used\n"
+      "\twith --presorted-input. Def. 1")},
+    {STATSUNIQ_PROGRAM_BOTH,
+     {"spill-partitions",    REQUIRED_ARG, 0, OPT_SPILL_PARTITIONS},
+     ("When the bins do not fit in memory, write them to this\n"
+      "\tmany temporary files by a hash of the key and process each\n"
+      "\tfile separately. Range 2-256. Def. Sort and merge the files")},
+    {STATSUNIQ_PROGRAM_BOTH,
+     {"approx-precision",    REQUIRED_ARG, 0, OPT_APPROX_PRECISION},
+     ("Use 2^N registers to estimate each Approx-Distinct\n"
+      "\tvalue; larger values are more accurate. Range 4-8. Def. 8")},
+    {STATSUNIQ_PROGRAM_STATS,
+     {"approximate",         OPTIONAL_ARG, 0, OPT_APPROXIMATE},
+     ("Find the top N bins in bounded memory using this many\n"
+      "\tcounters; the counts may be too large by the reported error.\n"
+      "\tRequires --count and a Records, Bytes, or Packets value.\n"
+      "\tDef. No. With no argument, use 100 counters per bin, min 1000")},
 
     {STATSUNIQ_PROGRAM_BOTH,
      {"bin-time",            OPTIONAL_ARG, 0, OPT_BIN_TIME},
@@ -535,6 +591,7 @@ isFieldDuplicate(
     const sk_fieldlist_t   *flist,
     sk_fieldid_t            fid,
     const void             *fcontext);
+static int  checkApproximate(void);
 static int  prepareFileForRead(skstream_t *stream);
 
 
@@ -906,7 +963,9 @@ appSetup(
     rwAsciiSetIPv6Policy(ascii_str, ipv6_policy);
     rwAsciiSetIPFormatFlags(ascii_str, ip_format);
     /* set time format after parsing --fields */
-    if (app_flags.no_percents || STATSUNIQ_PROGRAM_UNIQ == this_program) {
+    if ((app_flags.no_percents && !app_flags.approximate)
+        || STATSUNIQ_PROGRAM_UNIQ == this_program)
+    {
         if (app_flags.no_final_delimiter) {
             rwAsciiSetNoFinalDelimiter(ascii_str);
         }
@@ -985,6 +1044,15 @@ appSetup(
     }
     rwAsciiSetTimestampFlags(ascii_str, timestamp_format);
 
+    /* when computing an approximate top-N, the records are counted
+     * by rwstats.c and no uniq object is needed */
+    if (app_flags.approximate) {
+        if (checkApproximate()) {
+            appExit(EXIT_FAILURE);
+        }
+        goto OPEN_OUTPUT;
+    }
+
     /* create and initialize the uniq object */
     if (app_flags.presorted_input) {
         /* cannot use the --percentage limit when using
@@ -1038,6 +1106,15 @@ appSetup(
 
         skUniqueSetTempDirectory(uniq, temp_directory);
 
+        /* the key and value fields may call into the plug-ins; bin
+         * with a single thread unless they all support threading */
+        if ((thread_count > 1) && skPluginIsThreadSafe()) {
+            skUniqueSetThreads(uniq, thread_count);
+        }
+        if (spill_partitions) {
+            skUniqueSetSpillPartitions(uniq, spill_partitions);
+        }
+
         rv = skUniqueSetFields(uniq, key_fields, distinct_fields, value_fields);
         if (0 == rv && limit.distinct) {
             rv = skUniqueEnableTotalDistinct(uniq);
@@ -1337,6 +1414,41 @@ appOptionsHandler(
         app_flags.no_percents = 1;
         break;
 
+      case OPT_THREADS:
+        rv = skStringParseUint32(&thread_count, opt_arg, 1, 0);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
+
+      case OPT_SPILL_PARTITIONS:
+        rv = skStringParseUint32(&spill_partitions, opt_arg,
+                                 2, SK_UNIQUE_MAX_PARTITIONS);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
+
+      case OPT_APPROX_PRECISION:
+        rv = skStringParseUint32(&approx_precision, opt_arg,
+                                 SK_APPROX_DISTINCT_MIN_PRECISION,
+                                 SK_APPROX_DISTINCT_MAX_PRECISION);
+        if (rv) {
+            goto PARSE_ERROR;
+        }
+        break;
+
+      case OPT_APPROXIMATE:
+        if (opt_arg) {
+            rv = skStringParseUint32(&approx_counters, opt_arg,
+                                     1, APPROX_COUNTERS_MAX);
+            if (rv) {
+                goto PARSE_ERROR;
+            }
+        }
+        app_flags.approximate = 1;
+        break;
+
       case OPT_SORT_OUTPUT:
         app_flags.sort_output = 1;
         break;
@@ -1600,6 +1712,13 @@ value_to_ascii(
         sktimestamp_r(text_buf, (sktime_t)val64, timestamp_format);
         break;
 
+      case SK_FIELD_APPROX_DISTINCT:
+        skFieldListExtractFromBuffer(value_fields, ((uint8_t**)v_outbuf)[1],
+                                     fl_entry, bin_buf);
+        val64 = skFieldListEntryGetApproxDistinct(fl_entry, bin_buf);
+        snprintf(text_buf, text_buf_size, ("%" PRIu64), val64);
+        break;
+
       case SK_FIELD_CALLER:
         /* get the binary value from the field-list */
         skFieldListExtractFromBuffer(value_fields, ((uint8_t**)v_outbuf)[1],
@@ -1663,6 +1782,34 @@ builtin_distinct_get_title(
     text_buf[text_buf_size-1] = '\0';
 }
 
+/*
+ *  approx_get_title(buf, bufsize, field_entry);
+ *
+ *    Invoked by rwAsciiPrintTitles() to get the title for an
+ *    approximate distinct field.  The context of 'field_entry' is the
+ *    string-map entry for the key field being counted.
+ *
+ *    Fill 'buf' with the title for the column represented by the
+ *    field list entry 'field_entry'.  This function should write no
+ *    more than 'bufsize' characters to 'buf'.
+ */
+static void
+approx_get_title(
+    char               *text_buf,
+    size_t              text_buf_size,
+    void               *v_fl_entry)
+{
+    sk_fieldentry_t *fl_entry = (sk_fieldentry_t*)v_fl_entry;
+    const sk_stringmap_entry_t *sm_entry;
+
+    sm_entry = ((const sk_stringmap_entry_t*)
+                skFieldListEntryGetContext(fl_entry));
+    rwAsciiGetFieldName(text_buf, text_buf_size,
+                        (rwrec_printable_fields_t)sm_entry->id);
+    snprintf(text_buf + strlen(text_buf), text_buf_size - strlen(text_buf),
+             "%s", APPROX_SUFFIX);
+}
+
 /*
  *  distinct_to_ascii(rwrec, buf, bufsize, field_entry, extra);
  *
@@ -2490,7 +2637,9 @@ parseValueFields(
             /* expected field to be built-in but it is not */
             skAppPrintErr("Invalid id %u", sm_entry->id);
             skAbort();
-        } else if (0 == bf->bf_is_distinct) {
+        } else if (0 == bf->bf_is_distinct
+                   && SK_FIELD_APPROX_DISTINCT != bf->bf_id)
+        {
             /* this is a built-in values field; must have no attribute */
             if (sm_attr[0]) {
                 skAppPrintErr("Invalid %s: Extra text after field name ':%s'",
@@ -2499,7 +2648,9 @@ parseValueFields(
             }
             threshold_value.field_type = FIELD_TYPE_VALUE;
         } else {
-            if (SK_FIELD_CALLER != bf->bf_id) {
+            if (SK_FIELD_CALLER != bf->bf_id
+                && SK_FIELD_APPROX_DISTINCT != bf->bf_id)
+            {
                 /* one of the old sip-distinct,dip-distinct fields;
                  * must have no attribute */
                 if (sm_attr[0]) {
@@ -2513,11 +2664,11 @@ parseValueFields(
                 snprintf(buf, sizeof(buf), "%cip", bf->bf_title[0]);
                 sm_attr = buf;
             } else {
-                /* got a distinct:KEY field */
+                /* got a distinct:KEY or approx-distinct:KEY field */
                 if (!sm_attr[0]) {
                     skAppPrintErr(
-                        "Invalid %s: Must provide a field name for disinct'",
-                        appOptionName(OPT_VALUES));
+                        "Invalid %s: Must provide a field name for %s",
+                        appOptionName(OPT_VALUES), bf->bf_title);
                     goto END;
                 }
             }
@@ -2535,7 +2686,9 @@ parseValueFields(
                 }
                 goto END;
             }
-            threshold_value.field_type = FIELD_TYPE_DISTINCT;
+            threshold_value.field_type
+                = ((SK_FIELD_APPROX_DISTINCT == bf->bf_id)
+                   ? FIELD_TYPE_APPROX : FIELD_TYPE_DISTINCT);
         }
 
         threshold_value.sm_entry = sm_entry;
@@ -2783,6 +2936,70 @@ parseValueFieldsAndThresholds(
                     goto END;
                 }
             }
+        } else if (FIELD_TYPE_APPROX == tv->field_type) {
+            if (tv->sm_entry->userdata) {
+                skAppPrintErr(("Invalid %s: May not estimate distinct"
+                               " values of plug-in field '%s'"),
+                              appOptionName(OPT_VALUES), tv->sm_entry->name);
+                goto END;
+            }
+            if (tv->sm_entry->id == RWREC_PRINTABLE_FIELD_COUNT) {
+                skAppPrintErr("Invalid %s: May not count distinct '%s' entries",
+                              appOptionName(OPT_VALUES), tv->sm_entry->name);
+                goto END;
+            }
+            if (isFieldDuplicate(value_fields, SK_FIELD_APPROX_DISTINCT,
+                                 tv->sm_entry))
+            {
+                skAppPrintErr("Invalid %s: Duplicate approx-distinct '%s'",
+                              appOptionName(OPT_VALUES), tv->sm_entry->name);
+                goto END;
+            }
+            sm_entry_id = tv->sm_entry->id;
+#if SK_ENABLE_IPV6
+            if (ipv6_policy >= SK_IPV6POLICY_MIX) {
+                /* make certain field can hold an IPv6 address */
+                switch (sm_entry_id) {
+                  case SK_FIELD_SIPv4:
+                    sm_entry_id = SK_FIELD_SIPv6;
+                    break;
+                  case SK_FIELD_DIPv4:
+                    sm_entry_id = SK_FIELD_DIPv6;
+                    break;
+                  case SK_FIELD_NHIPv4:
+                    sm_entry_id = SK_FIELD_NHIPv6;
+                    break;
+                }
+            }
+#endif  /* #if SK_ENABLE_IPV6 */
+            fl_entry = skFieldListAddApproxDistinct(
+                value_fields, sm_entry_id, (uint8_t)approx_precision,
+                tv->sm_entry);
+            if (NULL == fl_entry) {
+                skAppPrintErr(
+                    "Error adding approx-distinct field '%s' to field list",
+                    tv->sm_entry->name);
+                goto END;
+            }
+            if (skFieldListGetBufferSize(value_fields)
+                > HASHLIB_MAX_VALUE_WIDTH)
+            {
+                skAppPrintErr(("Invalid %s: Values require more than %d"
+                               " octets; reduce the --%s"),
+                              appOptionName(OPT_VALUES),
+                              HASHLIB_MAX_VALUE_WIDTH,
+                              appOptionName(OPT_APPROX_PRECISION));
+                goto END;
+            }
+            if (rwAsciiAppendCallbackFieldExtra(
+                    ascii_str, &approx_get_title, &value_to_ascii,
+                    fl_entry, APPROX_TEXT_WIDTH))
+            {
+                skAppPrintErr(
+                    "Error adding approx-distinct field '%s' to stream",
+                    tv->sm_entry->name);
+                goto END;
+            }
         } else {
             assert(FIELD_TYPE_DISTINCT == tv->field_type);
             if (tv->sm_entry->userdata) {
@@ -2855,7 +3072,9 @@ parseValueFieldsAndThresholds(
             uniq_limit_t uniq_limit;
             uniq_limit.minimum = tv->minimum;
             uniq_limit.maximum = tv->maximum;
-            if (FIELD_TYPE_VALUE == tv->field_type) {
+            if (FIELD_TYPE_VALUE == tv->field_type
+                || FIELD_TYPE_APPROX == tv->field_type)
+            {
                 skVectorAppendValue(value_limits, &uniq_limit);
             } else {
                 assert(FIELD_TYPE_DISTINCT == tv->field_type);
@@ -2873,6 +3092,16 @@ parseValueFieldsAndThresholds(
             if (limit.distinct) {
                 builtin_distinct_get_title(limit.title, sizeof(limit.title),
                                            fl_entry);
+            } else if (FIELD_TYPE_APPROX == tv->field_type) {
+                limit.bf_value = NULL;
+                approx_get_title(limit.title, sizeof(limit.title), fl_entry);
+                /* there is no total to compute a percentage of */
+                if (RWSTATS_PERCENTAGE == limit.type) {
+                    skAppPrintErr(("The --%s limit is not supported when"
+                                   " the primary value is %s"),
+                                  appOptionName(OPT_PERCENTAGE), limit.title);
+                    goto END;
+                }
             } else {
                 builtin_value_get_title(limit.title, sizeof(limit.title),
                                         fl_entry);
@@ -2990,7 +3219,7 @@ parseThreshold(
     }
     assert(sm_entry->id < num_builtin_values);
     bf = &builtin_values[sm_entry->id];
-    if (0 == bf->bf_is_distinct) {
+    if (0 == bf->bf_is_distinct && SK_FIELD_APPROX_DISTINCT != bf->bf_id) {
         /* this is a built-in values field; must have no attribute */
         if (sm_attr[0]) {
             skAppPrintErr("Invalid %s: Extra text after field name ':%s'",
@@ -2999,7 +3228,9 @@ parseThreshold(
         }
         threshold_value->field_type = FIELD_TYPE_VALUE;
     } else {
-        if (SK_FIELD_CALLER != bf->bf_id) {
+        if (SK_FIELD_CALLER != bf->bf_id
+            && SK_FIELD_APPROX_DISTINCT != bf->bf_id)
+        {
             /* one of the old sip-distinct,dip-distinct fields; must
              * have no attribute */
             if (sm_attr[0]) {
@@ -3010,11 +3241,10 @@ parseThreshold(
             /* copy the "sip" or "dip" prefix into sm_attr */
             snprintf(sm_attr, sizeof(sm_attr), "%cip", bf->bf_title[0]);
         } else {
-            /* got a distinct:KEY field */
+            /* got a distinct:KEY or approx-distinct:KEY field */
             if (!sm_attr[0]) {
-                skAppPrintErr(("Invalid %s:"
-                               " Must provide a field name for disinct'"),
-                              appOptionName(OPT_THRESHOLD));
+                skAppPrintErr("Invalid %s: Must provide a field name for %s",
+                              appOptionName(OPT_THRESHOLD), bf->bf_title);
                 goto END;
             }
         }
@@ -3032,7 +3262,9 @@ parseThreshold(
             }
             goto END;
         }
-        threshold_value->field_type = FIELD_TYPE_DISTINCT;
+        threshold_value->field_type
+            = ((SK_FIELD_APPROX_DISTINCT == bf->bf_id)
+               ? FIELD_TYPE_APPROX : FIELD_TYPE_DISTINCT);
     }
 
     threshold_value->sm_entry = sm_entry;
@@ -3201,9 +3433,10 @@ appAddPlugin(
  *  is_duplicate = isFieldDuplicate(flist, fid, fcontext);
  *
  *    Return 1 if the field-id 'fid' appears in the field-list
- *    'flist'.  If 'fid' is SK_FIELD_CALLER, return 1 when a field in
- *    'flist' has the id SK_FIELD_CALLER and its context object points
- *    to 'fcontext'.  Return 0 otherwise.
+ *    'flist'.  If 'fid' is SK_FIELD_CALLER or
+ *    SK_FIELD_APPROX_DISTINCT, return 1 when a field in 'flist' has
+ *    the id 'fid' and its context object points to 'fcontext'.
+ *    Return 0 otherwise.
  *
  *    In this function, IPv4 and IPv6 fields are considered
  *    equivalent; that is, you cannot have both SK_FIELD_SIPv4 and
@@ -3260,6 +3493,7 @@ isFieldDuplicate(
         break;
 
       case SK_FIELD_CALLER:
+      case SK_FIELD_APPROX_DISTINCT:
         while ((fl_entry = skFieldListIteratorNext(&fl_iter)) != NULL) {
             if ((skFieldListEntryGetId(fl_entry) == (uint32_t)fid)
                 && (skFieldListEntryGetContext(fl_entry) == fcontext))
@@ -3281,6 +3515,77 @@ isFieldDuplicate(
 }
 
 
+/*
+ *  ok = checkApproximate();
+ *
+ *    Verify that the limit and the --values are supported by the
+ *    --approximate switch, and compute the number of counters to use
+ *    when the user did not provide one.  Return 0 if the settings
+ *    are valid; otherwise print an error and return -1.
+ */
+static int
+checkApproximate(
+    void)
+{
+    uint64_t counters;
+
+    if (app_flags.presorted_input) {
+        skAppPrintErr("May not use --%s with --%s",
+                      appOptionName(OPT_APPROXIMATE),
+                      appOptionName(OPT_PRESORTED_INPUT));
+        return -1;
+    }
+    if (RWSTATS_COUNT != limit.type || RWSTATS_DIR_TOP != direction) {
+        skAppPrintErr(("The --%s switch requires a non-zero --%s"
+                       " and a top-N list"),
+                      appOptionName(OPT_APPROXIMATE),
+                      appOptionName(OPT_COUNT));
+        return -1;
+    }
+    if (limit.distinct
+        || skFieldListGetFieldCount(value_fields) != 1
+        || skFieldListGetFieldCount(distinct_fields) != 0)
+    {
+        skAppPrintErr(("The --%s switch requires a single value field"
+                       " of Records, Bytes, or Packets"),
+                      appOptionName(OPT_APPROXIMATE));
+        return -1;
+    }
+    switch (limit.fl_id) {
+      case SK_FIELD_RECORDS:
+      case SK_FIELD_SUM_BYTES:
+      case SK_FIELD_SUM_PACKETS:
+        break;
+      default:
+        skAppPrintErr(("The --%s switch requires a single value field"
+                       " of Records, Bytes, or Packets"),
+                      appOptionName(OPT_APPROXIMATE));
+        return -1;
+    }
+
+    if (0 == approx_counters) {
+        counters = APPROX_COUNTERS_PER_BIN * limit.value[RWSTATS_COUNT].u64;
+        if (counters < APPROX_COUNTERS_MIN) {
+            counters = APPROX_COUNTERS_MIN;
+        } else if (counters > APPROX_COUNTERS_MAX
+                   || limit.value[RWSTATS_COUNT].u64 > APPROX_COUNTERS_MAX)
+        {
+            counters = APPROX_COUNTERS_MAX;
+        }
+        approx_counters = (uint32_t)counters;
+    }
+    if (limit.value[RWSTATS_COUNT].u64 > approx_counters) {
+        skAppPrintErr(("The --%s may not be larger than the number of"
+                       " counters used by --%s (%" PRIu32 ")"),
+                      appOptionName(OPT_COUNT),
+                      appOptionName(OPT_APPROXIMATE), approx_counters);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /*
  *    If requested, print the name of the stream to the standard
  *    error.  Enable copying of the stream's content to the
@@ -3354,12 +3659,50 @@ adjustTimeFields(
 }
 
 
+/*
+ *  prepareRecord(rwrec);
+ *
+ *    Update the global counters for 'rwrec', a record that was just
+ *    read.  Modify the times on the record if the user has requested
+ *    time binning.  Modify the IPs if the user has specified CIDR
+ *    blocks.
+ */
+static void
+prepareRecord(
+    rwRec              *rwrec)
+{
+    ++record_count;
+    switch (limit.fl_id) {
+      case SK_FIELD_RECORDS:
+        ++value_total;
+        break;
+      case SK_FIELD_SUM_BYTES:
+        value_total += rwRecGetBytes(rwrec);
+        break;
+      case SK_FIELD_SUM_PACKETS:
+        value_total += rwRecGetPkts(rwrec);
+        break;
+      default:
+        break;
+    }
+
+    if (cidr_sip) {
+        rwRecSetSIPv4(rwrec, rwRecGetSIPv4(rwrec) & cidr_sip);
+    }
+    if (cidr_dip) {
+        rwRecSetDIPv4(rwrec, rwRecGetDIPv4(rwrec) & cidr_dip);
+    }
+    if (bin_time > 1) {
+        adjustTimeFields(rwrec);
+    }
+}
+
+
 /*
  *  status = readRecord(stream, rwrec);
  *
- *    Fill 'rwrec' with a SiLK Flow record read from 'stream'.  Modify
- *    the times on the record if the user has requested time binning.
- *    Modify the IPs if the user has specified CIDR blocks.
+ *    Fill 'rwrec' with a SiLK Flow record read from 'stream' and
+ *    prepare it as described in prepareRecord().
  *
  *    Return the status of reading the record.
  */
@@ -3372,32 +3715,36 @@ readRecord(
 
     rv = skStreamReadRecord(stream, rwrec);
     if (SKSTREAM_OK == rv) {
-        ++record_count;
-        switch (limit.fl_id) {
-          case SK_FIELD_RECORDS:
-            ++value_total;
-            break;
-          case SK_FIELD_SUM_BYTES:
-            value_total += rwRecGetBytes(rwrec);
-            break;
-          case SK_FIELD_SUM_PACKETS:
-            value_total += rwRecGetPkts(rwrec);
-            break;
-          default:
-            break;
-        }
-
-        if (cidr_sip) {
-            rwRecSetSIPv4(rwrec, rwRecGetSIPv4(rwrec) & cidr_sip);
-        }
-        if (cidr_dip) {
-            rwRecSetDIPv4(rwrec, rwRecGetDIPv4(rwrec) & cidr_dip);
-        }
-        if (bin_time > 1) {
-            adjustTimeFields(rwrec);
-        }
+        prepareRecord(rwrec);
     }
+    return rv;
+}
+
 
+/*
+ *  status = readRecords(stream, rwrecs, count, &records_read);
+ *
+ *    Fill the 'rwrecs' array with up to 'count' SiLK Flow records read
+ *    from 'stream', set 'records_read' to the number of records read,
+ *    and prepare each record as described in prepareRecord().
+ *
+ *    Return the status of reading the records.  The records that
+ *    were read are valid even when the status is not SKSTREAM_OK.
+ */
+int
+readRecords(
+    skstream_t         *stream,
+    rwRec              *rwrecs,
+    size_t              count,
+    size_t             *records_read)
+{
+    size_t i;
+    int rv;
+
+    rv = skStreamReadRecords(stream, rwrecs, count, records_read);
+    for (i = 0; i < *records_read; ++i) {
+        prepareRecord(&rwrecs[i]);
+    }
     return rv;
 }
 
@@ -3734,6 +4081,15 @@ checkLimitsWriteRecord(
         if (0 == tv->minimum && 0 == tv->maximum) {
             continue;
         }
+        if (SK_FIELD_APPROX_DISTINCT == skFieldListEntryGetId(field)) {
+            skFieldListExtractFromBuffer(value_fields, outbuf[1],
+                                         field, value.ar);
+            value.u64 = skFieldListEntryGetApproxDistinct(field, value.ar);
+            if (value.u64 < tv->minimum || value.u64 > tv->maximum) {
+                return;
+            }
+            continue;
+        }
         len = skFieldListEntryGetBinOctets(field);
         switch (len) {
           case 1:
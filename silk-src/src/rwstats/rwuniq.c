@@ -122,15 +122,20 @@ uniqRandom(
     sk_unique_iterator_t *iter;
     uint8_t *outbuf[3];
     skstream_t *stream;
-    rwRec rwrec;
+    rwRec rwrec[STATSUNIQ_READ_RECS];
+    size_t count;
+    size_t i;
     int rv = 0;
 
     while (0 == (rv = appNextInput(&stream))) {
-        while (SKSTREAM_OK == (rv = readRecord(stream, &rwrec))) {
-            if (0 != skUniqueAddRecord(uniq, &rwrec)) {
-                appExit(EXIT_FAILURE);
+        do {
+            rv = readRecords(stream, rwrec, STATSUNIQ_READ_RECS, &count);
+            for (i = 0; i < count; ++i) {
+                if (0 != skUniqueAddRecord(uniq, &rwrec[i])) {
+                    appExit(EXIT_FAILURE);
+                }
             }
-        }
+        } while (SKSTREAM_OK == rv);
         if (rv != SKSTREAM_ERR_EOF) {
             skStreamPrintLastErr(stream, rv, &skAppPrintErr);
             skStreamDestroy(&stream);
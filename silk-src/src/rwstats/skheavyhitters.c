@@ -0,0 +1,470 @@
+/*
+** Copyright (C) 2020 by Carnegie Mellon University.
+**
+** @OPENSOURCE_LICENSE_START@
+** See license information in ../../LICENSE.txt
+** @OPENSOURCE_LICENSE_END@
+*/
+
+/*
+**  skheavyhitters.c
+**
+**    Space-Saving summary used by rwstats --approximate.  See
+**    skheavyhitters.h for a description of the algorithm.
+**
+**    The counters live in a single array.  A min-heap of counter
+**    indexes keeps the smallest counter at its root so it can be
+**    taken over in constant time, and an open-addressed hash table
+**    with linear probing maps each key to its counter.  Removing a
+**    key from the table shifts the following entries of its probe
+**    sequence back, so the table never holds tombstones.
+*/
+
+#include <silk/silk.h>
+
+RCSIDENT("$SiLK: skheavyhitters.c $");
+
+#include <silk/utils.h>
+#include "skheavyhitters.h"
+
+
+/* LOCAL DEFINES AND TYPEDEFS */
+
+/* marks an empty slot in the hash table */
+#define HH_EMPTY  UINT32_MAX
+
+/* the header of each counter; the key follows it */
+typedef struct hh_counter_st {
+    /* the estimated total for the key; must be first for sorting */
+    uint64_t    count;
+    /* the maximum amount by which 'count' overestimates the total */
+    uint64_t    error;
+    /* the hash of the key */
+    uint32_t    hash;
+    /* the position of this counter in the heap */
+    uint32_t    heap_pos;
+    /* the slot in the hash table that references this counter */
+    uint32_t    slot;
+} hh_counter_t;
+
+/* typedef struct sk_heavyhitters_st sk_heavyhitters_t; */
+struct sk_heavyhitters_st {
+    /* the counters, each 'stride' octets long */
+    uint8_t        *counters;
+    /* min-heap of indexes into 'counters', ordered by count */
+    uint32_t       *heap;
+    /* hash table of indexes into 'counters' */
+    uint32_t       *table;
+    size_t          key_octets;
+    size_t          stride;
+    uint32_t        table_mask;
+    uint32_t        capacity;
+    uint32_t        used;
+    /* whether a counter has been taken over by another key */
+    unsigned        evicted :1;
+    /* whether the counters have been sorted */
+    unsigned        sorted  :1;
+};
+
+/* return the counter at index 'cp_idx' */
+#define COUNTER_PTR(cp_hh, cp_idx)                                      \
+    ((hh_counter_t*)((cp_hh)->counters + (size_t)(cp_idx) * (cp_hh)->stride))
+
+/* return the key of the counter 'ck_counter' */
+#define COUNTER_KEY(ck_counter)                         \
+    ((uint8_t*)(ck_counter) + sizeof(hh_counter_t))
+
+
+/* FUNCTION DEFINITIONS */
+
+/*
+ *  hash = hhHash(hh, key);
+ *
+ *    Return a 32-bit hash of 'key': FNV-1a followed by a finalizer
+ *    that spreads the bits across the word.
+ */
+static uint32_t
+hhHash(
+    const sk_heavyhitters_t    *hh,
+    const uint8_t              *key)
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    size_t i;
+
+    for (i = 0; i < hh->key_octets; ++i) {
+        h = (h ^ key[i]) * UINT64_C(0x100000001b3);
+    }
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (uint32_t)h;
+}
+
+
+/*
+ *  hhHeapSwap(hh, pos_a, pos_b);
+ *
+ *    Swap the counters at heap positions 'pos_a' and 'pos_b'.
+ */
+static void
+hhHeapSwap(
+    sk_heavyhitters_t  *hh,
+    uint32_t            pos_a,
+    uint32_t            pos_b)
+{
+    uint32_t tmp = hh->heap[pos_a];
+
+    hh->heap[pos_a] = hh->heap[pos_b];
+    hh->heap[pos_b] = tmp;
+    COUNTER_PTR(hh, hh->heap[pos_a])->heap_pos = pos_a;
+    COUNTER_PTR(hh, hh->heap[pos_b])->heap_pos = pos_b;
+}
+
+
+/*
+ *  hhHeapSiftDown(hh, pos);
+ *
+ *    Move the counter at heap position 'pos' toward the leaves until
+ *    neither child has a smaller count.  Called after a count
+ *    increases.
+ */
+static void
+hhHeapSiftDown(
+    sk_heavyhitters_t  *hh,
+    uint32_t            pos)
+{
+    uint32_t child;
+    uint32_t smallest;
+
+    for (;;) {
+        smallest = pos;
+        child = 2 * pos + 1;
+        if (child < hh->used
+            && (COUNTER_PTR(hh, hh->heap[child])->count
+                < COUNTER_PTR(hh, hh->heap[smallest])->count))
+        {
+            smallest = child;
+        }
+        ++child;
+        if (child < hh->used
+            && (COUNTER_PTR(hh, hh->heap[child])->count
+                < COUNTER_PTR(hh, hh->heap[smallest])->count))
+        {
+            smallest = child;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        hhHeapSwap(hh, pos, smallest);
+        pos = smallest;
+    }
+}
+
+
+/*
+ *  hhHeapSiftUp(hh, pos);
+ *
+ *    Move the counter at heap position 'pos' toward the root until
+ *    its parent does not have a larger count.  Called when a counter
+ *    is appended to the heap.
+ */
+static void
+hhHeapSiftUp(
+    sk_heavyhitters_t  *hh,
+    uint32_t            pos)
+{
+    uint32_t parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (COUNTER_PTR(hh, hh->heap[parent])->count
+            <= COUNTER_PTR(hh, hh->heap[pos])->count)
+        {
+            return;
+        }
+        hhHeapSwap(hh, pos, parent);
+        pos = parent;
+    }
+}
+
+
+/*
+ *  hhTableInsert(hh, idx);
+ *
+ *    Add the counter at index 'idx' to the hash table.  The key must
+ *    not already be present.
+ */
+static void
+hhTableInsert(
+    sk_heavyhitters_t  *hh,
+    uint32_t            idx)
+{
+    hh_counter_t *c = COUNTER_PTR(hh, idx);
+    uint32_t slot = c->hash & hh->table_mask;
+
+    while (hh->table[slot] != HH_EMPTY) {
+        slot = (slot + 1) & hh->table_mask;
+    }
+    hh->table[slot] = idx;
+    c->slot = slot;
+}
+
+
+/*
+ *  hhTableRemove(hh, idx);
+ *
+ *    Remove the counter at index 'idx' from the hash table and move
+ *    any entries that follow it in the same probe sequence back so
+ *    that every entry remains reachable from its home slot.
+ */
+static void
+hhTableRemove(
+    sk_heavyhitters_t  *hh,
+    uint32_t            idx)
+{
+    hh_counter_t *c;
+    uint32_t hole = COUNTER_PTR(hh, idx)->slot;
+    uint32_t slot = hole;
+    uint32_t home;
+
+    for (;;) {
+        slot = (slot + 1) & hh->table_mask;
+        if (HH_EMPTY == hh->table[slot]) {
+            break;
+        }
+        c = COUNTER_PTR(hh, hh->table[slot]);
+        home = c->hash & hh->table_mask;
+        /* move the entry into the hole unless its home slot lies
+         * cyclically in (hole, slot] */
+        if (((slot - home) & hh->table_mask)
+            >= ((slot - hole) & hh->table_mask))
+        {
+            hh->table[hole] = hh->table[slot];
+            c->slot = hole;
+            hole = slot;
+        }
+    }
+    hh->table[hole] = HH_EMPTY;
+}
+
+
+/*
+ *  cmp = hhCompareCounters(a, b, hh);
+ *
+ *    Comparison function for skQSort_r() that orders counters by
+ *    decreasing count and then by key.
+ */
+static int
+hhCompareCounters(
+    const void         *a,
+    const void         *b,
+    void               *v_hh)
+{
+    const hh_counter_t *ca = (const hh_counter_t*)a;
+    const hh_counter_t *cb = (const hh_counter_t*)b;
+
+    if (ca->count != cb->count) {
+        return ((ca->count > cb->count) ? -1 : 1);
+    }
+    return memcmp(COUNTER_KEY(ca), COUNTER_KEY(cb),
+                  ((sk_heavyhitters_t*)v_hh)->key_octets);
+}
+
+
+int
+skHeavyHittersCreate(
+    sk_heavyhitters_t **hh_out,
+    size_t              key_octets,
+    uint32_t            capacity)
+{
+    sk_heavyhitters_t *hh;
+    uint64_t table_size;
+
+    assert(hh_out);
+    if (0 == key_octets || 0 == capacity || capacity > (UINT32_MAX >> 2)) {
+        return -1;
+    }
+
+    hh = (sk_heavyhitters_t*)calloc(1, sizeof(sk_heavyhitters_t));
+    if (NULL == hh) {
+        return -1;
+    }
+    hh->key_octets = key_octets;
+    hh->capacity = capacity;
+
+    /* round the stride up so each counter header is aligned */
+    hh->stride = ((sizeof(hh_counter_t) + key_octets + sizeof(uint64_t) - 1)
+                  & ~(sizeof(uint64_t) - 1));
+
+    /* keep the hash table no more than half full */
+    table_size = 2;
+    while (table_size < 2 * (uint64_t)capacity) {
+        table_size <<= 1;
+    }
+    hh->table_mask = (uint32_t)(table_size - 1);
+
+    hh->counters = (uint8_t*)malloc((size_t)capacity * hh->stride);
+    hh->heap = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    hh->table = (uint32_t*)malloc(table_size * sizeof(uint32_t));
+    if (NULL == hh->counters || NULL == hh->heap || NULL == hh->table) {
+        skHeavyHittersDestroy(&hh);
+        return -1;
+    }
+    memset(hh->table, 0xFF, table_size * sizeof(uint32_t));
+
+    *hh_out = hh;
+    return 0;
+}
+
+
+void
+skHeavyHittersDestroy(
+    sk_heavyhitters_t **hh)
+{
+    if (NULL == hh || NULL == *hh) {
+        return;
+    }
+    free((*hh)->counters);
+    free((*hh)->heap);
+    free((*hh)->table);
+    free(*hh);
+    *hh = NULL;
+}
+
+
+void
+skHeavyHittersAdd(
+    sk_heavyhitters_t  *hh,
+    const uint8_t      *key,
+    uint64_t            weight)
+{
+    hh_counter_t *c;
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t idx;
+
+    assert(hh);
+    assert(!hh->sorted);
+
+    hash = hhHash(hh, key);
+
+    /* look for the key */
+    for (slot = hash & hh->table_mask;
+         hh->table[slot] != HH_EMPTY;
+         slot = (slot + 1) & hh->table_mask)
+    {
+        c = COUNTER_PTR(hh, hh->table[slot]);
+        if (c->hash == hash
+            && 0 == memcmp(COUNTER_KEY(c), key, hh->key_octets))
+        {
+            c->count += weight;
+            hhHeapSiftDown(hh, c->heap_pos);
+            return;
+        }
+    }
+
+    if (hh->used < hh->capacity) {
+        /* use a new counter */
+        idx = hh->used;
+        c = COUNTER_PTR(hh, idx);
+        c->count = weight;
+        c->error = 0;
+        c->hash = hash;
+        memcpy(COUNTER_KEY(c), key, hh->key_octets);
+        hh->table[slot] = idx;
+        c->slot = slot;
+        c->heap_pos = hh->used;
+        hh->heap[hh->used] = idx;
+        ++hh->used;
+        hhHeapSiftUp(hh, c->heap_pos);
+        return;
+    }
+
+    /* take over the counter with the smallest count */
+    idx = hh->heap[0];
+    c = COUNTER_PTR(hh, idx);
+    hhTableRemove(hh, idx);
+    c->error = c->count;
+    c->count += weight;
+    c->hash = hash;
+    memcpy(COUNTER_KEY(c), key, hh->key_octets);
+    hhTableInsert(hh, idx);
+    hhHeapSiftDown(hh, 0);
+    hh->evicted = 1;
+}
+
+
+uint32_t
+skHeavyHittersGetCount(
+    const sk_heavyhitters_t    *hh)
+{
+    assert(hh);
+    return hh->used;
+}
+
+
+int
+skHeavyHittersIsExact(
+    const sk_heavyhitters_t    *hh)
+{
+    assert(hh);
+    return !hh->evicted;
+}
+
+
+uint64_t
+skHeavyHittersGetMaxError(
+    const sk_heavyhitters_t    *hh)
+{
+    assert(hh);
+    if (!hh->evicted) {
+        return 0;
+    }
+    if (hh->sorted) {
+        /* the heap is no longer valid; the smallest count is last */
+        return COUNTER_PTR(hh, hh->used - 1)->count;
+    }
+    return COUNTER_PTR(hh, hh->heap[0])->count;
+}
+
+
+void
+skHeavyHittersSort(
+    sk_heavyhitters_t  *hh)
+{
+    assert(hh);
+    skQSort_r(hh->counters, hh->used, hh->stride, &hhCompareCounters,
+              (void*)hh);
+    hh->sorted = 1;
+}
+
+
+int
+skHeavyHittersGetEntry(
+    const sk_heavyhitters_t    *hh,
+    uint32_t                    idx,
+    const uint8_t             **key,
+    uint64_t                   *count,
+    uint64_t                   *error)
+{
+    const hh_counter_t *c;
+
+    assert(hh);
+    if (idx >= hh->used) {
+        return -1;
+    }
+    c = COUNTER_PTR(hh, idx);
+    *key = COUNTER_KEY(c);
+    *count = c->count;
+    *error = c->error;
+    return 0;
+}
+
+
+/*
+** Local Variables:
+** mode:c
+** indent-tabs-mode:nil
+** c-basic-offset:4
+** End:
+*/
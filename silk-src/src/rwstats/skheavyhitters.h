@@ -0,0 +1,155 @@
+/*
+** Copyright (C) 2020 by Carnegie Mellon University.
+**
+** @OPENSOURCE_LICENSE_START@
+** See license information in ../../LICENSE.txt
+** @OPENSOURCE_LICENSE_END@
+*/
+
+/*
+**  skheavyhitters.h
+**
+**    A fixed-size summary used by rwstats to find the keys with the
+**    largest counts in a stream of (key, weight) pairs without
+**    storing every key.
+**
+**    The summary implements the Space-Saving algorithm: it holds at
+**    most 'capacity' counters.  When a key that is not in the summary
+**    arrives and the summary is full, the key takes over the counter
+**    with the smallest count, inheriting that count as its error.
+**    Each count is an overestimate of the key's true total by no more
+**    than the error recorded with it, and no key that is missing from
+**    the summary has a total larger than the smallest count.  Any key
+**    whose total exceeds 1/capacity of the sum of all weights is
+**    guaranteed to be in the summary.
+**
+*/
+#ifndef _SKHEAVYHITTERS_H
+#define _SKHEAVYHITTERS_H 1
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <silk/silk.h>
+
+RCSIDENTVAR(rcsID_SKHEAVYHITTERS_H, "$SiLK: skheavyhitters.h $");
+
+#include <silk/silk_types.h>
+
+
+/*
+ *    The summary object.
+ */
+typedef struct sk_heavyhitters_st sk_heavyhitters_t;
+
+
+/*
+ *  ok = skHeavyHittersCreate(&hh, key_octets, capacity);
+ *
+ *    Create a summary that holds at most 'capacity' counters for keys
+ *    that are 'key_octets' octets long and store it at the location
+ *    specified by 'hh'.  All memory is allocated here.  Return 0 on
+ *    success, or -1 if memory cannot be allocated or an argument is
+ *    invalid.
+ */
+int
+skHeavyHittersCreate(
+    sk_heavyhitters_t **hh,
+    size_t              key_octets,
+    uint32_t            capacity);
+
+/*
+ *  skHeavyHittersDestroy(&hh);
+ *
+ *    Destroy the summary at location 'hh' and set the pointer to
+ *    NULL.  Do nothing if 'hh' or the object it references is NULL.
+ */
+void
+skHeavyHittersDestroy(
+    sk_heavyhitters_t **hh);
+
+/*
+ *  skHeavyHittersAdd(hh, key, weight);
+ *
+ *    Add 'weight' to the count for 'key', which must be the number of
+ *    octets specified when 'hh' was created.  The function may not
+ *    be called after skHeavyHittersSort().
+ */
+void
+skHeavyHittersAdd(
+    sk_heavyhitters_t  *hh,
+    const uint8_t      *key,
+    uint64_t            weight);
+
+/*
+ *  count = skHeavyHittersGetCount(hh);
+ *
+ *    Return the number of counters in use.
+ */
+uint32_t
+skHeavyHittersGetCount(
+    const sk_heavyhitters_t    *hh);
+
+/*
+ *  is_exact = skHeavyHittersIsExact(hh);
+ *
+ *    Return 1 if no counter has ever been taken over by another key,
+ *    meaning every count is exact and every key seen is present.
+ *    Return 0 otherwise.
+ */
+int
+skHeavyHittersIsExact(
+    const sk_heavyhitters_t    *hh);
+
+/*
+ *  max_error = skHeavyHittersGetMaxError(hh);
+ *
+ *    Return the smallest count in the summary when a counter has been
+ *    taken over, or 0 when the summary is exact.  No count in the
+ *    summary overestimates its key by more than this value, and no
+ *    key missing from the summary has a total larger than it.
+ */
+uint64_t
+skHeavyHittersGetMaxError(
+    const sk_heavyhitters_t    *hh);
+
+/*
+ *  skHeavyHittersSort(hh);
+ *
+ *    Sort the counters from the largest count to the smallest,
+ *    breaking ties by the octets of the key.  Once the counters are
+ *    sorted, no more weights may be added.
+ */
+void
+skHeavyHittersSort(
+    sk_heavyhitters_t  *hh);
+
+/*
+ *  ok = skHeavyHittersGetEntry(hh, idx, &key, &count, &error);
+ *
+ *    Set 'key', 'count', and 'error' to the key, the estimated count,
+ *    and the maximum overestimate of the counter at position 'idx'.
+ *    Positions are in sorted order after a call to
+ *    skHeavyHittersSort().  Return 0 on success or -1 if 'idx' is not
+ *    less than the number of counters in use.
+ */
+int
+skHeavyHittersGetEntry(
+    const sk_heavyhitters_t    *hh,
+    uint32_t                    idx,
+    const uint8_t             **key,
+    uint64_t                   *count,
+    uint64_t                   *error);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* _SKHEAVYHITTERS_H */
+
+/*
+** Local Variables:
+** mode:c
+** indent-tabs-mode:nil
+** c-basic-offset:4
+** End:
+*/
@@ -49,6 +49,14 @@ RCSIDENT("$SiLK: skunique.c ef14e54179be 2020-04-14 21:57:45Z mthomas $");
 
 #define MAX_MERGE_FILES 1024
 
+/* number of records the caller collects for a partition before
+ * handing them to the partition's thread */
+#define UNIQUE_PART_BATCH  2048
+
+/* number of times a spill partition may be partitioned again when
+ * its bins do not fit in memory */
+#define UNIQUE_SPILL_MAX_LEVEL  8
+
 #define COMP_FUNC_CAST(cfc_func)                                \
     (int (*)(const void*, const void*, void*))(cfc_func)
 
@@ -247,6 +255,12 @@ struct sk_fieldentry_st {
     uint8_t                        *initial_value;
 
     sk_fieldlist_t                 *parent_list;
+
+    /* for an SK_FIELD_APPROX_DISTINCT field, a field list holding the
+     * field whose distinct values are counted, and the number of
+     * index bits in the sketch */
+    sk_fieldlist_t                 *approx_source;
+    uint8_t                         approx_precision;
 };
 
 
@@ -258,6 +272,192 @@ struct sk_fieldlist_st {
 };
 
 
+/*
+ *    An SK_FIELD_APPROX_DISTINCT field is a HyperLogLog sketch of
+ *    2^precision registers, each holding a six-bit value, packed
+ *    least-significant bit first.
+ */
+#define APPROX_REG_BITS  6
+#define APPROX_REG_MASK  0x3F
+
+/* the number of octets required by a sketch of precision 'ao_p' */
+#define APPROX_OCTETS(ao_p)                             \
+    ((size_t)((APPROX_REG_BITS << (ao_p)) >> 3))
+
+
+/*
+ *  value = approxGetRegister(sketch, idx);
+ *
+ *    Return the value of register 'idx' in 'sketch'.
+ */
+static uint8_t
+approxGetRegister(
+    const uint8_t      *sketch,
+    size_t              idx)
+{
+    size_t bit = idx * APPROX_REG_BITS;
+    const uint8_t *cp = sketch + (bit >> 3);
+    unsigned int v;
+
+    bit &= 0x7;
+    v = *cp;
+    if (bit + APPROX_REG_BITS > 8) {
+        v |= (unsigned int)cp[1] << 8;
+    }
+    return (uint8_t)((v >> bit) & APPROX_REG_MASK);
+}
+
+/*
+ *  approxSetRegister(sketch, idx, value);
+ *
+ *    Set register 'idx' in 'sketch' to 'value'.
+ */
+static void
+approxSetRegister(
+    uint8_t            *sketch,
+    size_t              idx,
+    uint8_t             value)
+{
+    size_t bit = idx * APPROX_REG_BITS;
+    uint8_t *cp = sketch + (bit >> 3);
+    unsigned int v;
+    unsigned int mask;
+
+    bit &= 0x7;
+    mask = APPROX_REG_MASK << bit;
+    v = (unsigned int)(value & APPROX_REG_MASK) << bit;
+    cp[0] = (uint8_t)((cp[0] & ~mask) | (v & 0xFF));
+    if (bit + APPROX_REG_BITS > 8) {
+        cp[1] = (uint8_t)((cp[1] & ~(mask >> 8)) | (v >> 8));
+    }
+}
+
+/*
+ *  approxAddRec(field, rwrec, sketch);
+ *
+ *    Hash the value of the approximate distinct 'field''s source
+ *    field in 'rwrec' and add it to 'sketch'.  The top 'precision'
+ *    bits of the hash choose the register; the register keeps the
+ *    largest position of the first 1 bit seen in the remaining bits.
+ */
+static void
+approxAddRec(
+    const sk_fieldentry_t  *field,
+    const rwRec            *rwrec,
+    uint8_t                *sketch)
+{
+    uint8_t bin[HASHLIB_MAX_KEY_WIDTH];
+    const size_t len = field->approx_source->total_octets;
+    const unsigned int p = field->approx_precision;
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    uint64_t rest;
+    uint8_t rank;
+    size_t idx;
+    size_t i;
+
+    skFieldListRecToBinary(field->approx_source, rwrec, bin);
+
+    /* FNV-1a, then the MurmurHash3 finalizer to spread the bits */
+    for (i = 0; i < len; ++i) {
+        h = (h ^ bin[i]) * UINT64_C(0x100000001b3);
+    }
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+
+    idx = (size_t)(h >> (64 - p));
+    rest = h << p;
+    if (0 == rest) {
+        rank = (uint8_t)(64 - p + 1);
+    } else {
+        for (rank = 1; 0 == (rest & UINT64_C(0x8000000000000000)); ++rank) {
+            rest <<= 1;
+        }
+    }
+    if (rank > approxGetRegister(sketch, idx)) {
+        approxSetRegister(sketch, idx, rank);
+    }
+}
+
+/*
+ *  approxMerge(field, sketch1, sketch2);
+ *
+ *    Merge 'sketch2' into 'sketch1' by keeping the larger value of
+ *    each register.
+ */
+static void
+approxMerge(
+    const sk_fieldentry_t  *field,
+    uint8_t                *sketch1,
+    const uint8_t          *sketch2)
+{
+    const size_t m = (size_t)1 << field->approx_precision;
+    uint8_t v;
+    size_t i;
+
+    for (i = 0; i < m; ++i) {
+        v = approxGetRegister(sketch2, i);
+        if (v > approxGetRegister(sketch1, i)) {
+            approxSetRegister(sketch1, i, v);
+        }
+    }
+}
+
+/*
+ *  count = approxEstimate(field, sketch);
+ *
+ *    Return the estimated number of distinct values added to
+ *    'sketch'.  Use linear counting when the raw HyperLogLog estimate
+ *    is small and some registers are still empty.
+ */
+static uint64_t
+approxEstimate(
+    const sk_fieldentry_t  *field,
+    const uint8_t          *sketch)
+{
+    const size_t m = (size_t)1 << field->approx_precision;
+    double alpha;
+    double sum = 0.0;
+    double estimate;
+    size_t zeros = 0;
+    uint8_t v;
+    size_t i;
+
+    for (i = 0; i < m; ++i) {
+        v = approxGetRegister(sketch, i);
+        if (0 == v) {
+            ++zeros;
+        }
+        sum += 1.0 / (double)(UINT64_C(1) << v);
+    }
+    if (m == zeros) {
+        return 0;
+    }
+
+    switch (m) {
+      case 16:
+        alpha = 0.673;
+        break;
+      case 32:
+        alpha = 0.697;
+        break;
+      case 64:
+        alpha = 0.709;
+        break;
+      default:
+        alpha = 0.7213 / (1.0 + 1.079 / (double)m);
+        break;
+    }
+    estimate = alpha * (double)m * (double)m / sum;
+    if (estimate <= 2.5 * (double)m && zeros > 0) {
+        estimate = (double)m * log((double)m / (double)zeros);
+    }
+    return (uint64_t)(estimate + 0.5);
+}
+
+
 /*  compare arbitrary buffers of size len */
 int
 skFieldCompareMemcmp(
@@ -396,6 +596,7 @@ skFieldListDestroy(
         if (field->initial_value) {
             free(field->initial_value);
         }
+        skFieldListDestroy(&field->approx_source);
     }
 
     free(fl);
@@ -552,6 +753,64 @@ skFieldListAddKnownField(
 }
 
 
+/*  add an approximate distinct count of 'source_id' to a field list */
+sk_fieldentry_t *
+skFieldListAddApproxDistinct(
+    sk_fieldlist_t     *field_list,
+    int                 source_id,
+    uint8_t             precision,
+    void               *ctx)
+{
+    sk_fieldentry_t *field = NULL;
+    sk_fieldlist_t *source = NULL;
+
+    if (NULL == field_list) {
+        return NULL;
+    }
+    if (FIELDLIST_MAX_NUM_FIELDS == field_list->num_fields) {
+        return NULL;
+    }
+    if (precision < SK_APPROX_DISTINCT_MIN_PRECISION
+        || precision > SK_APPROX_DISTINCT_MAX_PRECISION)
+    {
+        skAppPrintErr("Invalid approximate distinct precision %u",
+                      precision);
+        return NULL;
+    }
+    if (SK_FIELD_CALLER == source_id
+        || SK_FIELD_APPROX_DISTINCT == source_id)
+    {
+        skAppPrintErr("Field %d may not be approximately counted",
+                      source_id);
+        return NULL;
+    }
+
+    if (skFieldListCreate(&source)) {
+        return NULL;
+    }
+    if (NULL == skFieldListAddKnownField(source, source_id, NULL)) {
+        skFieldListDestroy(&source);
+        return NULL;
+    }
+
+    field = &field_list->fields[field_list->num_fields];
+    ++field_list->num_fields;
+
+    memset(field, 0, sizeof(sk_fieldentry_t));
+    field->offset = field_list->total_octets;
+    field->octets = APPROX_OCTETS(precision);
+    field->parent_list = field_list;
+    field->id = SK_FIELD_APPROX_DISTINCT;
+    field->context = ctx;
+    field->approx_source = source;
+    field->approx_precision = precision;
+
+    field_list->total_octets += field->octets;
+
+    return field;
+}
+
+
 /*  return context for a field */
 void *
 skFieldListEntryGetContext(
@@ -582,6 +841,18 @@ skFieldListEntryGetBinOctets(
 }
 
 
+/*  return the estimated count held by an approximate distinct field */
+uint64_t
+skFieldListEntryGetApproxDistinct(
+    const sk_fieldentry_t  *field,
+    const uint8_t          *field_buffer)
+{
+    assert(field);
+    assert(SK_FIELD_APPROX_DISTINCT == field->id);
+    return approxEstimate(field, field_buffer);
+}
+
+
 /*  return (binary) size of all fields in 'field_list' */
 size_t
 skFieldListGetBufferSize(
@@ -862,6 +1133,10 @@ skFieldListAddRecToBuffer(
                                     rwRecGetEndSeconds(rwrec));
                 break;
 
+              case SK_FIELD_APPROX_DISTINCT:
+                approxAddRec(f, rwrec, FIELD_PTR(summed, f));
+                break;
+
               case SK_FIELD_CALLER:
                 break;
 
@@ -954,6 +1229,11 @@ skFieldListMergeBuffers(
                                    FIELD_PTR(all_fields_buffer2, f));
                 break;
 
+              case SK_FIELD_APPROX_DISTINCT:
+                approxMerge(f, FIELD_PTR(all_fields_buffer1, f),
+                            FIELD_PTR(all_fields_buffer2, f));
+                break;
+
               default:
                 break;
             }
@@ -1043,6 +1323,12 @@ skFieldListCompareBuffers(
                              FIELD_PTR(all_fields_buffer2, f));
                 break;
 
+              case SK_FIELD_APPROX_DISTINCT:
+                rv = COMPARE(
+                    approxEstimate(f, FIELD_PTR(all_fields_buffer1, f)),
+                    approxEstimate(f, FIELD_PTR(all_fields_buffer2, f)));
+                break;
+
               default:
                 rv = memcmp(FIELD_PTR(all_fields_buffer1, f),
                             FIELD_PTR(all_fields_buffer2, f),
@@ -1125,6 +1411,11 @@ skFieldListEntryCompareBuffers(
             CMP_INT_PTRS(rv, uint64_t, field_buffer1, field_buffer2);
             break;
 
+          case SK_FIELD_APPROX_DISTINCT:
+            rv = COMPARE(approxEstimate(field_entry, field_buffer1),
+                         approxEstimate(field_entry, field_buffer2));
+            break;
+
           default:
             rv = memcmp(field_buffer1, field_buffer2, field_entry->octets);
             break;
@@ -1821,6 +2112,7 @@ static struct allowed_fieldid_st {
     {SK_FIELD_MAX_ENDTIME,          VALUE_ONLY},
     {SK_FIELD_MIN_STARTTIME_MSEC,   VALUE_ONLY},
     {SK_FIELD_MAX_ENDTIME_MSEC,     VALUE_ONLY},
+    {SK_FIELD_APPROX_DISTINCT,      VALUE_ONLY},
 
     {SK_FIELD_CALLER,               KEY_VALUE_DISTINCT}
 };
@@ -2285,63 +2577,37 @@ uniqDistinctShortListToHashSet(
 
 
 /*
- *  status = uniqDistinctIncrement(uniq_fields, distincts, key);
+ *  status = uniqDistinctIncrementOne(dist, value);
  *
- *    Increment the distinct counters given 'key'.  Return 0 on
- *    success or -1 on memory allocation failure.
+ *    Increment the distinct counter 'dist' given the value at
+ *    'value', which is 'dv_octets' octets long.  Return 0 on success
+ *    or -1 on memory allocation failure.
  */
 static int
-uniqDistinctIncrement(
-    const sk_uniq_field_info_t *field_info,
-    distinct_value_t           *distincts,
-    const uint8_t              *key)
+uniqDistinctIncrementOne(
+    distinct_value_t   *dist,
+    const uint8_t      *value)
 {
-    distinct_value_t *dist;
-    uint8_t i;
     int rv;
 
-    for (i = 0; i < field_info->distinct_num_fields; ++i) {
-        dist = &distincts[i];
-        switch (dist->dv_type) {
-          case DISTINCT_BITMAP:
-            skBitmapSetBit(dist->dv_v.dv_bitmap,
-                           *(uint8_t*)DISTINCT_PTR(key, distincts, i));
-            dist->dv_count = skBitmapGetHighCount(dist->dv_v.dv_bitmap);
+    switch (dist->dv_type) {
+      case DISTINCT_BITMAP:
+        skBitmapSetBit(dist->dv_v.dv_bitmap, *value);
+        dist->dv_count = skBitmapGetHighCount(dist->dv_v.dv_bitmap);
+        break;
+      case DISTINCT_SHORTLIST:
+        rv = skShortListInsert(dist->dv_v.dv_shortlist, (void*)value);
+        switch (rv) {
+          case SK_SHORT_LIST_OK:
+            ++dist->dv_count;
             break;
-          case DISTINCT_SHORTLIST:
-            rv = skShortListInsert(dist->dv_v.dv_shortlist,
-                                   (void*)DISTINCT_PTR(key,distincts,i));
-            switch (rv) {
-              case SK_SHORT_LIST_OK:
-                ++dist->dv_count;
-                break;
-              case SK_SHORT_LIST_OK_DUPLICATE:
-                break;
-              case SK_SHORT_LIST_ERR_FULL:
-                if (uniqDistinctShortListToHashSet(dist)) {
-                    return -1;
-                }
-                rv = hashset_insert(dist->dv_v.dv_hashset,
-                                    DISTINCT_PTR(key,distincts,i));
-                switch (rv) {
-                  case OK:
-                    ++dist->dv_count;
-                    break;
-                  case OK_DUPLICATE:
-                    break;
-                  default:
-                    TRACEMSG(("%s:%d: Error inserting value into hashset",
-                              __FILE__, __LINE__));
-                    return -1;
-                }
-                break;
-              default:
-                skAbortBadCase(rv);
-            }
+          case SK_SHORT_LIST_OK_DUPLICATE:
             break;
-          case DISTINCT_HASHSET:
-            rv = hashset_insert(dist->dv_v.dv_hashset,
-                                DISTINCT_PTR(key, distincts, i));
+          case SK_SHORT_LIST_ERR_FULL:
+            if (uniqDistinctShortListToHashSet(dist)) {
+                return -1;
+            }
+            rv = hashset_insert(dist->dv_v.dv_hashset, value);
             switch (rv) {
               case OK:
                 ++dist->dv_count;
@@ -2354,6 +2620,49 @@ uniqDistinctIncrement(
                 return -1;
             }
             break;
+          default:
+            skAbortBadCase(rv);
+        }
+        break;
+      case DISTINCT_HASHSET:
+        rv = hashset_insert(dist->dv_v.dv_hashset, value);
+        switch (rv) {
+          case OK:
+            ++dist->dv_count;
+            break;
+          case OK_DUPLICATE:
+            break;
+          default:
+            TRACEMSG(("%s:%d: Error inserting value into hashset",
+                      __FILE__, __LINE__));
+            return -1;
+        }
+        break;
+    }
+
+    return 0;
+}
+
+
+/*
+ *  status = uniqDistinctIncrement(uniq_fields, distincts, key);
+ *
+ *    Increment the distinct counters given 'key'.  Return 0 on
+ *    success or -1 on memory allocation failure.
+ */
+static int
+uniqDistinctIncrement(
+    const sk_uniq_field_info_t *field_info,
+    distinct_value_t           *distincts,
+    const uint8_t              *key)
+{
+    uint8_t i;
+
+    for (i = 0; i < field_info->distinct_num_fields; ++i) {
+        if (uniqDistinctIncrementOne(&distincts[i],
+                                     DISTINCT_PTR(key, distincts, i)))
+        {
+            return -1;
         }
     }
 
@@ -3595,6 +3904,70 @@ uniqTempWriteTriple(
 
 /* **************************************************************** */
 
+/*
+ *    When the caller requests more than one thread, the records are
+ *    partitioned by a hash of their key across several sk_unique_t
+ *    objects, each of which is filled by its own thread.  A key
+ *    appears in exactly one partition, so the partitions never need
+ *    to be merged: the iterator visits each partition in turn or,
+ *    for sorted output, interleaves the partitions' sorted bins.
+ *
+ *    The caller's thread collects a batch of records for each
+ *    partition and hands the batch to the partition's thread once the
+ *    batch is full.
+ */
+typedef struct uniq_part_st {
+    /* the unique object holding the bins for this partition */
+    sk_unique_t            *uniq;
+
+    /* the batch being filled by the caller and the batch being
+     * processed by the partition's thread */
+    rwRec                  *fill;
+    rwRec                  *work;
+    size_t                  fill_count;
+    size_t                  work_count;
+
+    pthread_t               thread;
+    pthread_mutex_t         mutex;
+    pthread_cond_t          cond;
+
+    /* non-zero once adding a record or preparing for output fails */
+    int                     status;
+
+    /* whether the thread was started; when it was not, the caller's
+     * thread processes the batches itself */
+    unsigned                running  :1;
+
+    /* whether the caller has no more records for the thread */
+    unsigned                stopping :1;
+} uniq_part_t;
+
+
+/*
+ *    When the caller requests partitioned spilling, each time the
+ *    hash table fills its bins are written unsorted to one of several
+ *    partition files chosen by a hash of the key.  Every bin for a
+ *    key is written to the same partition, so once input is complete
+ *    each partition is read into a new hash table on its own and its
+ *    bins are returned in hash-table order.  When the bins of one
+ *    partition do not fit in memory, they are partitioned again
+ *    using a different hash seed.
+ */
+typedef struct uniq_spill_st {
+    /* number of bins written to the partition */
+    uint64_t                bins;
+    /* index of the temporary file holding the key, value, and
+     * distinct counts of the bins */
+    int                     temp_idx;
+    /* index of the temporary file holding the distinct values, or -1
+     * when there are no distinct fields */
+    int                     dist_idx;
+    /* the number of times the partition's keys have been
+     * partitioned; used to seed the hash */
+    uint32_t                level;
+} uniq_spill_t;
+
+
 /* structure for binning records */
 
 /* typedef struct sk_unique_st sk_unique_t; */
@@ -3625,6 +3998,30 @@ struct sk_unique_st {
      * across all bins */
     total_distinct_t        total_dist;
 
+    /* when using threads, the partitions that hold the bins; the
+     * hash table and temporary files on this object are unused */
+    uniq_part_t            *parts;
+    uint32_t                part_count;
+
+    /* the number of threads requested by the caller */
+    uint32_t                thread_count;
+
+    /* when spilling by partition, the partitions that have been
+     * written and the number of them */
+    uniq_spill_t           *spill;
+    size_t                  spill_count;
+
+    /* when spilling by partition, the streams being written for the
+     * 'spill_partitions' partitions that start at index 'spill_open'
+     * in 'spill'; the streams for the distinct values follow those
+     * for the bins.  NULL when no partitions are open. */
+    skstream_t            **spill_fp;
+    size_t                  spill_open;
+
+    /* the number of partition files to write each time spilling
+     * begins, or 0 to write sorted temporary files */
+    uint32_t                spill_partitions;
+
     /* when creating the hash table, the estimated number of entries
      * for the table */
     uint64_t                ht_estimated;
@@ -3889,33 +4286,700 @@ uniqueDumpHashToTemp(
 }
 
 
-/*  create a new unique object */
-int
-skUniqueCreate(
-    sk_unique_t       **uniq)
+/*
+ *  index = uniqSpillIndex(uniq, key, level);
+ *
+ *    Return the partition that holds the bin for the key fields in
+ *    'key' when the bins at 'level' are partitioned.  Uses a 64-bit
+ *    FNV-1a hash seeded by 'level' with a final mix, so that the
+ *    partitions are independent of each other, of the thread
+ *    partitions chosen by uniqPartIndex(), and of the hash used by
+ *    hashlib.
+ */
+static uint32_t
+uniqSpillIndex(
+    const sk_unique_t  *uniq,
+    const uint8_t      *key,
+    uint32_t            level)
 {
-    sk_unique_t *u;
-    const char *env_value;
-    uint32_t debug_lvl;
+    uint64_t h;
+    size_t i;
 
-    u = (sk_unique_t*)calloc(1, sizeof(sk_unique_t));
-    if (NULL == u) {
-        *uniq = NULL;
-        return -1;
+    h = UINT64_C(14695981039346656037)
+        ^ ((uint64_t)(level + 1) * UINT64_C(0x9e3779b97f4a7c15));
+    for (i = 0; i < uniq->fi.key_octets; ++i) {
+        h = (h ^ key[i]) * UINT64_C(1099511628211);
     }
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (uint32_t)(((h >> 32) * uniq->spill_partitions) >> 32);
+}
 
-    u->ht_estimated = HASH_INITIAL_SIZE;
-    u->temp_idx = -1;
-    u->max_temp_idx = -1;
 
-    env_value = getenv(SKUNIQUE_DEBUG_ENVAR);
-    if (env_value && 0 == skStringParseUint32(&debug_lvl, env_value, 1, 0)) {
-        u->print_debug = 1;
-    }
+/*
+ *  uniqSpillOpen(uniq, level);
+ *
+ *    Append 'spill_partitions' partitions at 'level' to the 'spill'
+ *    array on 'uniq' and create the temporary files that hold them.
+ *    Exit the application on failure.
+ */
+static void
+uniqSpillOpen(
+    sk_unique_t        *uniq,
+    uint32_t            level)
+{
+    const uint32_t count = uniq->spill_partitions;
+    uniq_spill_t *spill;
+    uint32_t i;
 
-    *uniq = u;
-    return 0;
-}
+    assert(NULL == uniq->spill_fp);
+    assert(count > 1);
+
+    spill = (uniq_spill_t*)realloc(
+        uniq->spill, (uniq->spill_count + count) * sizeof(uniq_spill_t));
+    if (NULL == spill) {
+        skAppPrintOutOfMemory("unique spill partitions");
+        exit(EXIT_FAILURE);
+    }
+    uniq->spill = spill;
+    uniq->spill_fp = (skstream_t**)calloc(2 * count, sizeof(skstream_t*));
+    if (NULL == uniq->spill_fp) {
+        skAppPrintOutOfMemory("unique spill streams");
+        exit(EXIT_FAILURE);
+    }
+    uniq->spill_open = uniq->spill_count;
+
+    for (i = 0, spill += uniq->spill_open; i < count; ++i, ++spill) {
+        spill->bins = 0;
+        spill->level = level;
+        spill->dist_idx = -1;
+        uniq->spill_fp[i] = uniqTempCreate(uniq->tmpctx, &spill->temp_idx);
+        if (uniq->fi.distinct_num_fields) {
+            uniq->spill_fp[count + i]
+                = uniqTempCreate(uniq->tmpctx, &spill->dist_idx);
+        }
+        ++uniq->spill_count;
+    }
+
+    uniqDebug(uniq, "Opened %" PRIu32 " spill partitions at level %" PRIu32,
+              count, level);
+}
+
+
+/*
+ *  uniqSpillClose(uniq);
+ *
+ *    Close the streams for the partitions that are open on 'uniq'.
+ */
+static void
+uniqSpillClose(
+    sk_unique_t        *uniq)
+{
+    uint32_t i;
+
+    if (NULL == uniq->spill_fp) {
+        return;
+    }
+    for (i = 0; i < 2 * uniq->spill_partitions; ++i) {
+        uniqTempClose(uniq->spill_fp[i]);
+    }
+    free(uniq->spill_fp);
+    uniq->spill_fp = NULL;
+}
+
+
+/*
+ *  uniqSpillTable(uniq, level);
+ *
+ *    Write the entries in the current hash table on 'uniq' to the
+ *    open partitions, opening partitions at 'level' when none are
+ *    open, and destroy the hash table.  The key of each entry is
+ *    hashed using the level of the open partitions.  Unlike
+ *    uniqueDumpHashToTemp(), the entries are not sorted.  Exit the
+ *    application on failure.
+ */
+static void
+uniqSpillTable(
+    sk_unique_t        *uniq,
+    uint32_t            level)
+{
+    distinct_value_t *distincts = NULL;
+    uint8_t *hash_key;
+    uint8_t *hash_val;
+    uint64_t entry_count;
+    HASH_ITER ithash;
+    uint32_t idx;
+
+    if (NULL == uniq->spill_fp) {
+        uniqSpillOpen(uniq, level);
+    }
+    level = uniq->spill[uniq->spill_open].level;
+
+    /* use the table's current entry count to set the initial entry
+     * for when the table is re-created */
+    entry_count = hashlib_count_entries(uniq->ht);
+    if (uniq->ht_estimated < (entry_count >> 1)) {
+        uniq->ht_estimated = entry_count >> 1;
+    }
+
+    uniqDebug(uniq, "Writing %" PRIu64 " bins to spill partitions %" SK_PRIuZ
+              "-%" SK_PRIuZ "...", entry_count, uniq->spill_open,
+              uniq->spill_open + uniq->spill_partitions - 1);
+
+    ithash = hashlib_create_iterator(uniq->ht);
+    while (hashlib_iterate(uniq->ht, &ithash, &hash_key, &hash_val)
+           != ERR_NOMOREENTRIES)
+    {
+        idx = uniqSpillIndex(uniq, hash_key, level);
+        if (uniq->fi.distinct_num_fields) {
+            memcpy(&distincts, hash_val + uniq->fi.value_octets,
+                   sizeof(void*));
+        }
+        uniqTempWriteTriple(&uniq->fi, uniq->spill_fp[idx],
+                            uniq->spill_fp[uniq->spill_partitions + idx],
+                            hash_key, hash_val, distincts);
+        ++uniq->spill[uniq->spill_open + idx].bins;
+    }
+    uniqueDestroyHashTable(uniq);
+}
+
+
+/*
+ *  status = uniqSpillMakeRoom(uniq, level);
+ *
+ *    Handle a memory error while reading a spill partition at 'level'
+ *    into the hash table on 'uniq': write the table to partitions at
+ *    the next level and create a new table.  Return 0 on success.
+ *    Return -1 when the table holds no more than the current bin, when
+ *    the maximum level is reached, or when the table cannot be
+ *    created.
+ */
+static int
+uniqSpillMakeRoom(
+    sk_unique_t        *uniq,
+    uint32_t            level)
+{
+    if (hashlib_count_entries(uniq->ht) <= 1
+        || level + 1 >= UNIQUE_SPILL_MAX_LEVEL)
+    {
+        skAppPrintErr("Out of memory while reading the bins of"
+                      " a spill partition");
+        return -1;
+    }
+    uniqSpillTable(uniq, level + 1);
+    return uniqueCreateHashTable(uniq);
+}
+
+
+/*
+ *  status = uniqSpillLoad(uniq, spill_idx);
+ *
+ *    Read the bins of the partition at position 'spill_idx' in the
+ *    'spill' array of 'uniq' into a new hash table, merging the bins
+ *    that share a key, and remove the partition's temporary files.
+ *    When the bins do not fit in memory, they are written to new
+ *    partitions that are appended to 'spill' and the hash table on
+ *    'uniq' is NULL on return.  Return 0 on success or -1 on failure.
+ */
+static int
+uniqSpillLoad(
+    sk_unique_t        *uniq,
+    size_t              spill_idx)
+{
+    const sk_uniq_field_info_t *fi = &uniq->fi;
+    uint64_t dist_count[FIELDLIST_MAX_NUM_FIELDS];
+    uint8_t key[HASHLIB_MAX_KEY_WIDTH];
+    uint8_t value[HASHLIB_MAX_VALUE_WIDTH];
+    uint8_t dist_buf[HASHLIB_MAX_KEY_WIDTH];
+    distinct_value_t *distincts = NULL;
+    skstream_t *fp = NULL;
+    skstream_t *dist_fp = NULL;
+    uniq_spill_t spill;
+    uint8_t *hash_val;
+    uint64_t j;
+    uint16_t i;
+    int ins;
+    int rv = -1;
+
+    /* copy the entry since uniqSpillOpen() may move the array */
+    spill = uniq->spill[spill_idx];
+    assert(NULL == uniq->ht);
+    assert(NULL == uniq->spill_fp);
+
+    uniqDebug(uniq, "Reading %" PRIu64 " bins from spill partition %" SK_PRIuZ,
+              spill.bins, spill_idx);
+
+    if (uniqueCreateHashTable(uniq)) {
+        return -1;
+    }
+    if (0 == spill.bins) {
+        goto END;
+    }
+    fp = uniqTempReopen(uniq->tmpctx, spill.temp_idx);
+    if (NULL == fp) {
+        skAppPrintSyserror("Unable to open temporary file '%s'",
+                           skTempFileGetName(uniq->tmpctx, spill.temp_idx));
+        goto END;
+    }
+    if (fi->distinct_num_fields) {
+        dist_fp = uniqTempReopen(uniq->tmpctx, spill.dist_idx);
+        if (NULL == dist_fp) {
+            skAppPrintSyserror("Unable to open temporary file '%s'",
+                               skTempFileGetName(uniq->tmpctx,
+                                                 spill.dist_idx));
+            goto END;
+        }
+    }
+
+    while (uniqTempRead(fp, key, fi->key_octets)) {
+        if (fi->value_octets
+            && !uniqTempRead(fp, value, fi->value_octets))
+        {
+            goto READ_ERROR;
+        }
+        for (i = 0; i < fi->distinct_num_fields; ++i) {
+            if (!uniqTempRead(fp, &dist_count[i], sizeof(uint64_t))) {
+                goto READ_ERROR;
+            }
+        }
+
+        /* find or create the bin; a new bin gets its distinct
+         * counters before it is considered complete */
+        for (;;) {
+            ins = hashlib_insert(uniq->ht, key, &hash_val);
+            switch (ins) {
+              case OK:
+                skFieldListInitializeBuffer(fi->value_fields, hash_val);
+                if (0 == fi->distinct_num_fields) {
+                    break;
+                }
+                if (uniqDistinctAlloc(fi, &distincts)) {
+                    if (uniqSpillMakeRoom(uniq, spill.level)) {
+                        goto END;
+                    }
+                    continue;
+                }
+                memcpy(hash_val + fi->value_octets, &distincts,
+                       sizeof(void*));
+                break;
+              case OK_DUPLICATE:
+                if (fi->distinct_num_fields) {
+                    memcpy(&distincts, hash_val + fi->value_octets,
+                           sizeof(void*));
+                }
+                break;
+              case ERR_OUTOFMEMORY:
+              case ERR_NOMOREBLOCKS:
+                if (uniqSpillMakeRoom(uniq, spill.level)) {
+                    goto END;
+                }
+                continue;
+              default:
+                skAppPrintErr(("Unexpected return code '%d'"
+                               " from hash table insert"), ins);
+                goto END;
+            }
+            break;
+        }
+
+        /* add the distinct values.  When memory runs out, the bin is
+         * written out with the values added so far and the remaining
+         * values go to a new bin for the key; the two bins are
+         * merged when the next level is read. */
+        for (i = 0; i < fi->distinct_num_fields; ++i) {
+            for (j = 0; j < dist_count[i]; ++j) {
+                if (!uniqTempRead(dist_fp, dist_buf, distincts[i].dv_octets)) {
+                    goto READ_ERROR;
+                }
+                while (uniqDistinctIncrementOne(&distincts[i], dist_buf)) {
+                    if (uniqSpillMakeRoom(uniq, spill.level)) {
+                        goto END;
+                    }
+                    if (OK != hashlib_insert(uniq->ht, key, &hash_val)) {
+                        skAppPrintErr("Unable to insert into new hash table");
+                        goto END;
+                    }
+                    skFieldListInitializeBuffer(fi->value_fields, hash_val);
+                    if (uniqDistinctAlloc(fi, &distincts)) {
+                        skAppPrintErr("Unable to allocate distinct counters"
+                                      " in new hash table");
+                        goto END;
+                    }
+                    memcpy(hash_val + fi->value_octets, &distincts,
+                           sizeof(void*));
+                }
+            }
+        }
+
+        /* merge the value once the bin is complete */
+        if (fi->value_octets) {
+            skFieldListMergeBuffers(fi->value_fields, hash_val, value);
+        }
+    }
+
+    if (uniq->spill_fp) {
+        /* the partition was written to a new level */
+        uniqSpillTable(uniq, spill.level + 1);
+        uniqSpillClose(uniq);
+    }
+    rv = 0;
+    goto END;
+
+  READ_ERROR:
+    skAppPrintErr("Error reading from temporary file '%s'",
+                  skTempFileGetName(uniq->tmpctx, spill.temp_idx));
+  END:
+    uniqTempClose(fp);
+    uniqTempClose(dist_fp);
+    skTempFileRemove(uniq->tmpctx, spill.temp_idx);
+    if (fi->distinct_num_fields) {
+        skTempFileRemove(uniq->tmpctx, spill.dist_idx);
+    }
+    if (rv) {
+        uniqSpillClose(uniq);
+        uniqueDestroyHashTable(uniq);
+    }
+    return rv;
+}
+
+
+/*
+ *  index = uniqPartIndex(uniq, key);
+ *
+ *    Return the partition on 'uniq' that holds the bin for the key
+ *    fields in 'key'.  Uses the FNV-1a hash, which differs from the
+ *    hash used by hashlib so that each partition's table still sees
+ *    well-distributed keys.
+ */
+static uint32_t
+uniqPartIndex(
+    const sk_unique_t  *uniq,
+    const uint8_t      *key)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < uniq->fi.key_octets; ++i) {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    return (uint32_t)(((uint64_t)h * uniq->part_count) >> 32);
+}
+
+
+/*
+ *  uniqPartProcessBatch(part);
+ *
+ *    Add the records in the 'work' batch of 'part' to the partition's
+ *    unique object.  Set the 'status' member of 'part' on error.
+ */
+static void
+uniqPartProcessBatch(
+    uniq_part_t        *part)
+{
+    size_t i;
+
+    for (i = 0; i < part->work_count && 0 == part->status; ++i) {
+        if (skUniqueAddRecord(part->uniq, &part->work[i])) {
+            part->status = -1;
+        }
+    }
+}
+
+
+/*
+ *  uniqPartWorker(part);
+ *
+ *    THREAD ENTRY POINT.
+ *
+ *    Process the batches of records that the caller hands to 'part'
+ *    until the caller sets the 'stopping' member, then prepare the
+ *    partition's unique object for output so that the partitions are
+ *    sorted and written to disk in parallel.
+ */
+static void *
+uniqPartWorker(
+    void               *v_part)
+{
+    uniq_part_t *part = (uniq_part_t*)v_part;
+    int rv;
+
+    pthread_mutex_lock(&part->mutex);
+    for (;;) {
+        while (0 == part->work_count && !part->stopping) {
+            pthread_cond_wait(&part->cond, &part->mutex);
+        }
+        if (0 == part->work_count) {
+            break;
+        }
+        pthread_mutex_unlock(&part->mutex);
+
+        uniqPartProcessBatch(part);
+
+        pthread_mutex_lock(&part->mutex);
+        part->work_count = 0;
+        pthread_cond_broadcast(&part->cond);
+    }
+    rv = part->status;
+    pthread_mutex_unlock(&part->mutex);
+
+    if (0 == rv && skUniquePrepareForOutput(part->uniq)) {
+        part->status = -1;
+    }
+    return NULL;
+}
+
+
+/*
+ *  status = uniqPartHandoff(part);
+ *
+ *    Give the records in the 'fill' batch of 'part' to the
+ *    partition's thread, waiting for the thread to finish its current
+ *    batch.  When the thread is not running, process the batch in the
+ *    caller's thread.  Return 0 on success or -1 if adding records to
+ *    the partition has failed.
+ */
+static int
+uniqPartHandoff(
+    uniq_part_t        *part)
+{
+    rwRec *tmp;
+    int rv;
+
+    if (!part->running) {
+        tmp = part->work;
+        part->work = part->fill;
+        part->fill = tmp;
+        part->work_count = part->fill_count;
+        part->fill_count = 0;
+        uniqPartProcessBatch(part);
+        part->work_count = 0;
+        return part->status;
+    }
+
+    pthread_mutex_lock(&part->mutex);
+    while (part->work_count) {
+        pthread_cond_wait(&part->cond, &part->mutex);
+    }
+    rv = part->status;
+    if (0 == rv) {
+        tmp = part->work;
+        part->work = part->fill;
+        part->fill = tmp;
+        part->work_count = part->fill_count;
+        part->fill_count = 0;
+        pthread_cond_broadcast(&part->cond);
+    } else {
+        /* the partition has failed; discard the batch */
+        part->fill_count = 0;
+    }
+    pthread_mutex_unlock(&part->mutex);
+    return rv;
+}
+
+
+/*
+ *  uniqPartsStop(uniq, abandon);
+ *
+ *    Tell the thread for each partition on 'uniq' that no more
+ *    records are coming and wait for the threads to exit.  When
+ *    'abandon' is non-zero, the threads exit without preparing their
+ *    partitions for output.
+ */
+static void
+uniqPartsStop(
+    sk_unique_t        *uniq,
+    int                 abandon)
+{
+    uniq_part_t *part;
+    uint32_t i;
+
+    for (i = 0, part = uniq->parts; i < uniq->part_count; ++i, ++part) {
+        if (!part->running) {
+            continue;
+        }
+        pthread_mutex_lock(&part->mutex);
+        if (abandon && 0 == part->status) {
+            part->status = -1;
+        }
+        part->stopping = 1;
+        pthread_cond_broadcast(&part->cond);
+        pthread_mutex_unlock(&part->mutex);
+    }
+    for (i = 0, part = uniq->parts; i < uniq->part_count; ++i, ++part) {
+        if (part->running) {
+            pthread_join(part->thread, NULL);
+            part->running = 0;
+        }
+    }
+}
+
+
+/*
+ *  uniqPartsDestroy(uniq);
+ *
+ *    Stop the partitions' threads and destroy the partitions on
+ *    'uniq'.
+ */
+static void
+uniqPartsDestroy(
+    sk_unique_t        *uniq)
+{
+    uniq_part_t *part;
+    uint32_t i;
+
+    if (NULL == uniq->parts) {
+        return;
+    }
+    uniqPartsStop(uniq, 1);
+
+    for (i = 0, part = uniq->parts; i < uniq->part_count; ++i, ++part) {
+        skUniqueDestroy(&part->uniq);
+        /* 'fill' and 'work' share one allocation */
+        free((part->fill < part->work) ? part->fill : part->work);
+        pthread_mutex_destroy(&part->mutex);
+        pthread_cond_destroy(&part->cond);
+    }
+    free(uniq->parts);
+    uniq->parts = NULL;
+    uniq->part_count = 0;
+}
+
+
+/*
+ *  status = uniqPartsCreate(uniq);
+ *
+ *    Create a partition for each thread requested on 'uniq', give
+ *    each partition the fields and settings of 'uniq', and start the
+ *    partitions' threads.  If a thread cannot be started, the
+ *    caller's thread fills that partition.  Return 0 on success or
+ *    -1 on failure.
+ */
+static int
+uniqPartsCreate(
+    sk_unique_t        *uniq)
+{
+    uniq_part_t *part;
+    uint32_t i;
+
+    uniq->parts = (uniq_part_t*)calloc(uniq->thread_count,
+                                       sizeof(uniq_part_t));
+    if (NULL == uniq->parts) {
+        skAppPrintOutOfMemory("unique partitions");
+        return -1;
+    }
+
+    for (i = 0; i < uniq->thread_count; ++i) {
+        part = &uniq->parts[i];
+        part->fill = (rwRec*)malloc(2 * UNIQUE_PART_BATCH * sizeof(rwRec));
+        if (NULL == part->fill) {
+            skAppPrintOutOfMemory("unique partition buffer");
+            goto ERROR;
+        }
+        part->work = part->fill + UNIQUE_PART_BATCH;
+        pthread_mutex_init(&part->mutex, NULL);
+        pthread_cond_init(&part->cond, NULL);
+        ++uniq->part_count;
+
+        if (skUniqueCreate(&part->uniq)) {
+            skAppPrintOutOfMemory("unique partition");
+            goto ERROR;
+        }
+        part->uniq->print_debug = uniq->print_debug;
+        part->uniq->sort_output = uniq->sort_output;
+        part->uniq->ht_estimated = uniq->ht_estimated / uniq->thread_count;
+        part->uniq->spill_partitions = uniq->spill_partitions;
+        skUniqueSetTempDirectory(part->uniq, uniq->temp_dir);
+        if (skUniqueSetFields(part->uniq, uniq->fi.key_fields,
+                              uniq->fi.distinct_fields,
+                              uniq->fi.value_fields)
+            || skUniquePrepareForInput(part->uniq))
+        {
+            goto ERROR;
+        }
+    }
+
+    for (i = 0, part = uniq->parts; i < uniq->part_count; ++i, ++part) {
+        if (pthread_create(&part->thread, NULL, uniqPartWorker, part)) {
+            uniqDebug(uniq, "Unable to start thread for partition %" PRIu32
+                      "; using the main thread", i);
+        } else {
+            part->running = 1;
+        }
+    }
+
+    uniqDebug(uniq, "Partitioned bins across %" PRIu32 " threads",
+              uniq->part_count);
+    return 0;
+
+  ERROR:
+    uniqPartsDestroy(uniq);
+    return -1;
+}
+
+
+/*
+ *  status = uniqPartsPrepareForOutput(uniq);
+ *
+ *    Hand the final batch of records to each partition on 'uniq',
+ *    wait for the partitions' threads to prepare their unique objects
+ *    for output, and prepare any partition that has no thread.
+ *    Return 0 on success or -1 on failure.
+ */
+static int
+uniqPartsPrepareForOutput(
+    sk_unique_t        *uniq)
+{
+    uniq_part_t *part;
+    uint32_t i;
+    int rv = 0;
+
+    for (i = 0, part = uniq->parts; i < uniq->part_count; ++i, ++part) {
+        if (part->fill_count) {
+            uniqPartHandoff(part);
+        }
+    }
+    uniqPartsStop(uniq, 0);
+
+    for (i = 0, part = uniq->parts; i < uniq->part_count; ++i, ++part) {
+        if (0 == part->status && skUniquePrepareForOutput(part->uniq)) {
+            part->status = -1;
+        }
+        if (part->status) {
+            rv = -1;
+        }
+    }
+    return rv;
+}
+
+
+/*  create a new unique object */
+int
+skUniqueCreate(
+    sk_unique_t       **uniq)
+{
+    sk_unique_t *u;
+    const char *env_value;
+    uint32_t debug_lvl;
+
+    u = (sk_unique_t*)calloc(1, sizeof(sk_unique_t));
+    if (NULL == u) {
+        *uniq = NULL;
+        return -1;
+    }
+
+    u->ht_estimated = HASH_INITIAL_SIZE;
+    u->temp_idx = -1;
+    u->max_temp_idx = -1;
+
+    env_value = getenv(SKUNIQUE_DEBUG_ENVAR);
+    if (env_value && 0 == skStringParseUint32(&debug_lvl, env_value, 1, 0)) {
+        u->print_debug = 1;
+    }
+
+    *uniq = u;
+    return 0;
+}
 
 
 /*  destroy a unique object; cleans up any temporary files; etc. */
@@ -3940,6 +5004,9 @@ skUniqueDestroy(
         uniqTempClose(u->dist_fp);
         u->dist_fp = NULL;
     }
+    uniqSpillClose(u);
+    free(u->spill);
+    uniqPartsDestroy(u);
     uniqTotalDistinctDestroy(&u->total_dist);
     skTempFileTeardown(&u->tmpctx);
     u->temp_idx = -1;
@@ -3967,6 +5034,45 @@ skUniqueSetSortedOutput(
 }
 
 
+/*  specify the number of threads 'uniq' should use */
+int
+skUniqueSetThreads(
+    sk_unique_t        *uniq,
+    uint32_t            thread_count)
+{
+    assert(uniq);
+
+    if (uniq->ready_for_input) {
+        skAppPrintErr("May not call skUniqueSetThreads"
+                      " after calling skUniquePrepareForInput");
+        return -1;
+    }
+    uniq->thread_count = thread_count;
+    return 0;
+}
+
+
+/*  specify how 'uniq' writes its bins when the hash table fills */
+int
+skUniqueSetSpillPartitions(
+    sk_unique_t        *uniq,
+    uint32_t            partition_count)
+{
+    assert(uniq);
+
+    if (uniq->ready_for_input) {
+        skAppPrintErr("May not call skUniqueSetSpillPartitions"
+                      " after calling skUniquePrepareForInput");
+        return -1;
+    }
+    if (1 == partition_count || partition_count > SK_UNIQUE_MAX_PARTITIONS) {
+        return -1;
+    }
+    uniq->spill_partitions = partition_count;
+    return 0;
+}
+
+
 /*  specify the temporary directory. */
 void
 skUniqueSetTempDirectory(
@@ -4078,6 +5184,22 @@ skUniquePrepareForInput(
              (uniq->fi.value_octets
               + (uniq->fi.distinct_num_fields ? sizeof(void*) : 0)));
 
+    /* sorted output requires sorting and merging the bins */
+    if (uniq->sort_output && uniq->spill_partitions) {
+        uniqDebug(uniq, "Using sorted temporary files for sorted output");
+        uniq->spill_partitions = 0;
+    }
+
+    /* when using threads, the partitions hold the hash tables and
+     * temporary files */
+    if (uniq->thread_count > 1) {
+        if (uniqPartsCreate(uniq)) {
+            return -1;
+        }
+        uniq->ready_for_input = 1;
+        return 0;
+    }
+
     /* create the hash table */
     if (uniqueCreateHashTable(uniq)) {
         return -1;
@@ -4090,11 +5212,15 @@ skUniquePrepareForInput(
         return -1;
     }
 
-    /* open an intermediate file */
-    uniq->temp_fp = uniqTempCreate(uniq->tmpctx, &uniq->max_temp_idx);
-    uniq->temp_idx = uniq->max_temp_idx;
-    if (uniq->fi.distinct_num_fields) {
-        uniq->dist_fp = uniqTempCreate(uniq->tmpctx, &uniq->max_temp_idx);
+    /* open an intermediate file unless spilling to partitions,
+     * which are created when the table first fills */
+    if (0 == uniq->spill_partitions) {
+        uniq->temp_fp = uniqTempCreate(uniq->tmpctx, &uniq->max_temp_idx);
+        uniq->temp_idx = uniq->max_temp_idx;
+        if (uniq->fi.distinct_num_fields) {
+            uniq->dist_fp = uniqTempCreate(uniq->tmpctx,
+                                           &uniq->max_temp_idx);
+        }
     }
 
     uniq->ready_for_input = 1;
@@ -4112,10 +5238,11 @@ skUniqueAddRecord(
     uint8_t field_buf[HASHLIB_MAX_KEY_WIDTH];
     uint8_t *hash_val;
     uint32_t memory_error = 0;
+    uniq_part_t *part;
     int rv;
 
     assert(uniq);
-    assert(uniq->ht);
+    assert(uniq->ht || uniq->parts);
     assert(rwrec);
     assert(uniq->ready_for_input);
 
@@ -4123,6 +5250,17 @@ skUniqueAddRecord(
         return -1;
     }
 
+    if (uniq->parts) {
+        /* add the record to the batch for its key's partition */
+        skFieldListRecToBinary(uniq->fi.key_fields, rwrec, field_buf);
+        part = &uniq->parts[uniqPartIndex(uniq, field_buf)];
+        RWREC_COPY(&part->fill[part->fill_count], rwrec);
+        if (++part->fill_count < UNIQUE_PART_BATCH) {
+            return 0;
+        }
+        return uniqPartHandoff(part);
+    }
+
     for (;;) {
         skFieldListRecToBinary(uniq->fi.key_fields, rwrec, field_buf);
 
@@ -4208,7 +5346,11 @@ skUniqueAddRecord(
          */
 
         /* out of memory */
-        uniqueDumpHashToTemp(uniq);
+        if (uniq->spill_partitions) {
+            uniqSpillTable(uniq, 0);
+        } else {
+            uniqueDumpHashToTemp(uniq);
+        }
 
         /* re-create the hash table */
         if (uniqueCreateHashTable(uniq)) {
@@ -4234,7 +5376,17 @@ skUniquePrepareForOutput(
         return -1;
     }
 
-    if (uniq->temp_idx > 0) {
+    if (uniq->parts) {
+        /* each partition dumps or sorts its own entries */
+        if (uniqPartsPrepareForOutput(uniq)) {
+            return -1;
+        }
+    } else if (uniq->spill_fp) {
+        /* write the final hash entries to the partitions, which the
+         * iterator reads one at a time */
+        uniqSpillTable(uniq, 0);
+        uniqSpillClose(uniq);
+    } else if (uniq->temp_idx > 0) {
         /* dump the current/final hash entries to a file */
         uniqueDumpHashToTemp(uniq);
     } else if (uniq->sort_output) {
@@ -4450,6 +5602,133 @@ uniqIterDistinctCreate(
 }
 
 
+/****************************************************************
+ * Iterator for handling spill partitions
+ ***************************************************************/
+
+/*
+ *    An iterator that reads each spill partition into the hash table
+ *    in turn and returns its bins.  Since reading a partition removes
+ *    its temporary files, the bins may only be visited once.
+ */
+
+typedef struct uniqiter_spill_st {
+    sk_uniqiter_next_fn_t   next_fn;
+    sk_uniqiter_free_fn_t   free_fn;
+    sk_unique_t            *uniq;
+    HASH_ITER               ithash;
+    /* position in the 'spill' array of the next partition to read */
+    size_t                  next_spill;
+    uint8_t                 returned_buf[HASH_MAX_NODE_BYTES];
+} uniqiter_spill_t;
+
+
+/*
+ *  status = uniqIterSpillNext(iter, &key, &distinct, &value);
+ *
+ *    Implementation for skUniqueIteratorNext().
+ */
+static int
+uniqIterSpillNext(
+    sk_unique_iterator_t   *v_iter,
+    uint8_t               **key_fields_buffer,
+    uint8_t               **distinct_fields_buffer,
+    uint8_t               **value_fields_buffer)
+{
+    uniqiter_spill_t *iter = (uniqiter_spill_t*)v_iter;
+    sk_unique_t *uniq = iter->uniq;
+    distinct_value_t *distincts;
+
+    for (;;) {
+        if (uniq->ht) {
+            if (hashlib_iterate(uniq->ht, &iter->ithash,
+                                key_fields_buffer, value_fields_buffer)
+                != ERR_NOMOREENTRIES)
+            {
+                if (uniq->fi.distinct_num_fields) {
+                    memcpy(&distincts,
+                           *value_fields_buffer + uniq->fi.value_octets,
+                           sizeof(void*));
+                    uniqDistinctSetOutputBuf(&uniq->fi, distincts,
+                                             iter->returned_buf);
+                    *distinct_fields_buffer = iter->returned_buf;
+                }
+                return SK_ITERATOR_OK;
+            }
+            uniqueDestroyHashTable(uniq);
+        }
+
+        /* read the next partition; the spill array grows when a
+         * partition is partitioned again */
+        if (iter->next_spill >= uniq->spill_count) {
+            return SK_ITERATOR_NO_MORE_ENTRIES;
+        }
+        if (uniqSpillLoad(uniq, iter->next_spill)) {
+            iter->next_spill = uniq->spill_count;
+            return SK_ITERATOR_NO_MORE_ENTRIES;
+        }
+        ++iter->next_spill;
+        if (uniq->ht) {
+            iter->ithash = hashlib_create_iterator(uniq->ht);
+        }
+    }
+}
+
+
+/*
+ *  uniqIterSpillDestroy(&iter);
+ *
+ *    Implementation for skUniqueIteratorDestroy().
+ */
+static void
+uniqIterSpillDestroy(
+    sk_unique_iterator_t  **v_iter)
+{
+    uniqiter_spill_t *iter;
+
+    if (v_iter && *v_iter) {
+        iter = *(uniqiter_spill_t**)v_iter;
+        memset(iter, 0, sizeof(uniqiter_spill_t));
+        free(iter);
+        *v_iter = NULL;
+    }
+}
+
+
+/*
+ *  status = uniqIterSpillCreate(uniq, &iter);
+ *
+ *    Helper function for skUniqueIteratorCreate().
+ */
+static int
+uniqIterSpillCreate(
+    sk_unique_t            *uniq,
+    sk_unique_iterator_t  **new_iter)
+{
+    uniqiter_spill_t *iter;
+
+    assert(uniq);
+    assert(NULL == uniq->ht);
+
+    iter = (uniqiter_spill_t*)calloc(1, sizeof(uniqiter_spill_t));
+    if (NULL == iter) {
+        skAppPrintOutOfMemory("unique iterator");
+        return -1;
+    }
+
+    iter->uniq = uniq;
+    iter->next_fn = uniqIterSpillNext;
+    iter->free_fn = uniqIterSpillDestroy;
+
+    uniqDebug(uniq, "Created spill iterator; num partitions = %" SK_PRIuZ,
+              uniq->spill_count);
+
+    *new_iter = (sk_unique_iterator_t*)iter;
+    return 0;
+}
+
+
+
 /****************************************************************
  * Iterator for handling temporary files without distinct values
  ***************************************************************/
@@ -5804,6 +7083,235 @@ uniqIterTempDistOpenAll(
 
 
 
+/****************************************************************
+ * Iterator for handling partitioned bins
+ ***************************************************************/
+
+/*
+ *    An iterator over the partitions of a unique object that uses
+ *    threads.  The iterator holds an iterator for every partition.
+ *    For unsorted output, it visits each partition in turn.  For
+ *    sorted output, it holds the current bin of every partition and
+ *    returns the bin having the smallest key.  Since a key appears in
+ *    only one partition, the bins never need to be merged.
+ */
+
+typedef struct uniqiter_part_entry_st {
+    uint8_t                *key;
+    uint8_t                *distinct;
+    uint8_t                *value;
+} uniqiter_part_entry_t;
+
+typedef struct uniqiter_parts_st {
+    sk_uniqiter_next_fn_t   next_fn;
+    sk_uniqiter_free_fn_t   free_fn;
+    sk_unique_t            *uniq;
+    /* an iterator for every partition */
+    sk_unique_iterator_t  **part_iter;
+    /* for sorted output, the current bin of every partition; the key
+     * is NULL once the partition has no more bins */
+    uniqiter_part_entry_t  *entry;
+    /* for unsorted output, the partition being visited; for sorted
+     * output, the partition whose bin was returned most recently */
+    uint32_t                pos;
+} uniqiter_parts_t;
+
+
+/*
+ *  uniqIterPartsAdvance(iter, idx);
+ *
+ *    Fill the entry for partition 'idx' on 'iter' with the
+ *    partition's next bin, or set the entry's key to NULL when the
+ *    partition has no more bins.
+ */
+static void
+uniqIterPartsAdvance(
+    uniqiter_parts_t   *iter,
+    uint32_t            idx)
+{
+    uniqiter_part_entry_t *e = &iter->entry[idx];
+
+    if (skUniqueIteratorNext(iter->part_iter[idx], &e->key, &e->distinct,
+                             &e->value)
+        != SK_ITERATOR_OK)
+    {
+        e->key = NULL;
+    }
+}
+
+
+/*
+ *  status = uniqIterPartsNext(iter, &key, &distinct, &value);
+ *
+ *    Implementation for skUniqueIteratorNext() when the output is
+ *    not sorted.
+ */
+static int
+uniqIterPartsNext(
+    sk_unique_iterator_t   *v_iter,
+    uint8_t               **key_fields_buffer,
+    uint8_t               **distinct_fields_buffer,
+    uint8_t               **value_fields_buffer)
+{
+    uniqiter_parts_t *iter = (uniqiter_parts_t*)v_iter;
+
+    while (iter->pos < iter->uniq->part_count) {
+        if (skUniqueIteratorNext(iter->part_iter[iter->pos],
+                                 key_fields_buffer, distinct_fields_buffer,
+                                 value_fields_buffer)
+            == SK_ITERATOR_OK)
+        {
+            return SK_ITERATOR_OK;
+        }
+        ++iter->pos;
+    }
+    return SK_ITERATOR_NO_MORE_ENTRIES;
+}
+
+
+/*
+ *  status = uniqIterPartsSortedNext(iter, &key, &distinct, &value);
+ *
+ *    Implementation for skUniqueIteratorNext() when the output is
+ *    sorted.
+ */
+static int
+uniqIterPartsSortedNext(
+    sk_unique_iterator_t   *v_iter,
+    uint8_t               **key_fields_buffer,
+    uint8_t               **distinct_fields_buffer,
+    uint8_t               **value_fields_buffer)
+{
+    uniqiter_parts_t *iter = (uniqiter_parts_t*)v_iter;
+    const uint32_t count = iter->uniq->part_count;
+    uint32_t best;
+    uint32_t i;
+
+    /* the buffers of the bin returned previously remain valid until
+     * now, so only advance its partition now */
+    if (iter->pos < count) {
+        uniqIterPartsAdvance(iter, iter->pos);
+    }
+
+    best = count;
+    for (i = 0; i < count; ++i) {
+        if (iter->entry[i].key
+            && (best == count
+                || (skFieldListCompareBuffers(
+                        iter->entry[i].key, iter->entry[best].key,
+                        iter->uniq->fi.key_fields) < 0)))
+        {
+            best = i;
+        }
+    }
+    if (best == count) {
+        iter->pos = count;
+        return SK_ITERATOR_NO_MORE_ENTRIES;
+    }
+
+    iter->pos = best;
+    *key_fields_buffer = iter->entry[best].key;
+    *distinct_fields_buffer = iter->entry[best].distinct;
+    *value_fields_buffer = iter->entry[best].value;
+    return SK_ITERATOR_OK;
+}
+
+
+/*
+ *  uniqIterPartsDestroy(&iter);
+ *
+ *    Implementation for skUniqueIteratorDestroy().
+ */
+static void
+uniqIterPartsDestroy(
+    sk_unique_iterator_t  **v_iter)
+{
+    uniqiter_parts_t *iter;
+    uint32_t i;
+
+    if (v_iter && *v_iter) {
+        iter = *(uniqiter_parts_t**)v_iter;
+        if (iter->part_iter) {
+            for (i = 0; i < iter->uniq->part_count; ++i) {
+                skUniqueIteratorDestroy(&iter->part_iter[i]);
+            }
+            free(iter->part_iter);
+        }
+        free(iter->entry);
+        memset(iter, 0, sizeof(uniqiter_parts_t));
+        free(iter);
+        *v_iter = NULL;
+    }
+}
+
+
+/*
+ *  status = uniqIterPartsCreate(uniq, &iter);
+ *
+ *    Helper function for skUniqueIteratorCreate().
+ */
+static int
+uniqIterPartsCreate(
+    sk_unique_t            *uniq,
+    sk_unique_iterator_t  **new_iter)
+{
+    uniqiter_parts_t *iter;
+    uint32_t i;
+
+    assert(uniq);
+    assert(uniq->parts);
+
+    iter = (uniqiter_parts_t*)calloc(1, sizeof(uniqiter_parts_t));
+    if (NULL == iter) {
+        skAppPrintOutOfMemory("unique iterator");
+        return -1;
+    }
+    iter->uniq = uniq;
+    iter->free_fn = uniqIterPartsDestroy;
+
+    iter->part_iter = ((sk_unique_iterator_t**)
+                       calloc(uniq->part_count, sizeof(void*)));
+    if (NULL == iter->part_iter) {
+        skAppPrintOutOfMemory("unique iterator");
+        goto ERROR;
+    }
+    for (i = 0; i < uniq->part_count; ++i) {
+        if (skUniqueIteratorCreate(uniq->parts[i].uniq, &iter->part_iter[i])) {
+            goto ERROR;
+        }
+    }
+
+    if (!uniq->sort_output) {
+        iter->next_fn = uniqIterPartsNext;
+        iter->pos = 0;
+    } else {
+        iter->next_fn = uniqIterPartsSortedNext;
+        iter->entry = ((uniqiter_part_entry_t*)
+                       calloc(uniq->part_count,
+                              sizeof(uniqiter_part_entry_t)));
+        if (NULL == iter->entry) {
+            skAppPrintOutOfMemory("unique iterator");
+            goto ERROR;
+        }
+        for (i = 0; i < uniq->part_count; ++i) {
+            uniqIterPartsAdvance(iter, i);
+        }
+        iter->pos = uniq->part_count;
+    }
+
+    uniqDebug(uniq, "Created partition iterator; num partitions = %" PRIu32,
+              uniq->part_count);
+
+    *new_iter = (sk_unique_iterator_t*)iter;
+    return 0;
+
+  ERROR:
+    uniqIterPartsDestroy((sk_unique_iterator_t**)&iter);
+    return -1;
+}
+
+
+
 /****************************************************************
  * Public Interface for Iterating over the bins
  ***************************************************************/
@@ -5822,6 +7330,12 @@ skUniqueIteratorCreate(
                       " before calling skUniquePrepareForOutput");
         return -1;
     }
+    if (uniq->parts) {
+        return uniqIterPartsCreate(uniq, new_iter);
+    }
+    if (uniq->spill_count) {
+        return uniqIterSpillCreate(uniq, new_iter);
+    }
     if (uniq->temp_idx > 0) {
         if (uniq->fi.distinct_num_fields) {
             return uniqIterTempDistCreate(uniq, new_iter);
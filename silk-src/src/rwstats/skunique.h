@@ -176,6 +176,42 @@ skFieldListAddKnownField(
     int                 field_id,
     void               *ctx);
 
+/*
+ *    The minimum, maximum, and default precision of an
+ *    SK_FIELD_APPROX_DISTINCT field.  A field of precision P uses 2^P
+ *    six-bit registers, and its standard error is about
+ *    1.04/sqrt(2^P).  The maximum is bounded by
+ *    HASHLIB_MAX_VALUE_WIDTH.
+ */
+#define SK_APPROX_DISTINCT_MIN_PRECISION        4
+#define SK_APPROX_DISTINCT_MAX_PRECISION        8
+#define SK_APPROX_DISTINCT_DEFAULT_PRECISION    8
+
+/*
+ *  entry = skFieldListAddApproxDistinct(fl, source_id, precision, ctx);
+ *
+ *    Add an SK_FIELD_APPROX_DISTINCT aggregate value field to
+ *    'field_list'.  The field holds a HyperLogLog sketch that
+ *    estimates the number of distinct values of the known field
+ *    'source_id' (an sk_fieldid_t that is allowed as a distinct
+ *    field) seen in a bin.  The sketch has a fixed size determined by
+ *    'precision', which must be between
+ *    SK_APPROX_DISTINCT_MIN_PRECISION and
+ *    SK_APPROX_DISTINCT_MAX_PRECISION inclusive.  Two sketches are
+ *    merged by taking the maximum of each register, so the field may
+ *    be merged across temporary files and threads like any other
+ *    value.  'ctx' is a user-defined context.  Returns a handle to
+ *    the new field, or NULL on error.
+ *
+ *    Use skFieldListEntryGetApproxDistinct() to get the estimate.
+ */
+sk_fieldentry_t *
+skFieldListAddApproxDistinct(
+    sk_fieldlist_t     *field_list,
+    int                 source_id,
+    uint8_t             precision,
+    void               *ctx);
+
 /*
  *  count = skFieldListGetFieldCount(field_list);
  *
@@ -309,6 +345,19 @@ size_t
 skFieldListEntryGetBinOctets(
     const sk_fieldentry_t  *field);
 
+/*
+ *  count = skFieldListEntryGetApproxDistinct(field, field_buffer);
+ *
+ *    Return the estimated number of distinct values held by the
+ *    sketch in 'field_buffer', where 'field' is an
+ *    SK_FIELD_APPROX_DISTINCT field and 'field_buffer' points at the
+ *    start of the bytes for 'field'.
+ */
+uint64_t
+skFieldListEntryGetApproxDistinct(
+    const sk_fieldentry_t  *field,
+    const uint8_t          *field_buffer);
+
 /*
  *  skFieldListExtractFromBuffer(field_list,all_fields_buf,field,one_field_buf);
  *
@@ -523,6 +572,7 @@ typedef enum sk_fieldid_en {
 
     SK_FIELD_MIN_STARTTIME_MSEC,/* 36 */
     SK_FIELD_MAX_ENDTIME_MSEC,
+    SK_FIELD_APPROX_DISTINCT,
     SK_FIELD_CALLER
 } sk_fieldid_t;
 
@@ -566,6 +616,8 @@ typedef enum sk_fieldid_en {
  *      skUniqueSetFields(u, key, distinct, value);
  *      skUniqueSetTempDirectory(u);  //optional
  *      skUniqueSetSortedOutput(u);   //optional
+ *      skUniqueSetThreads(u, n);     //optional
+ *      skUniqueSetSpillPartitions(u, n);  //optional
  *      skUniquePrepareForInput(u);
  *      foreach (input_file) {
  *          skStreamOpenSilkFlow(stream, input_file[i]);
@@ -638,6 +690,58 @@ skUniqueSetTempDirectory(
     sk_unique_t        *uniq,
     const char         *temp_dir);
 
+/*
+ *  ok = skUniqueSetThreads(uniq, thread_count);
+ *
+ *    Specify that the unique object 'uniq' should bin records using
+ *    'thread_count' threads.  When 'thread_count' is greater than 1,
+ *    records are partitioned by a hash of their key fields, and each
+ *    partition has its own hash table and temporary files which are
+ *    filled by a separate thread.  The callbacks on the field lists
+ *    must be safe to call from multiple threads.  This function must
+ *    be called before calling skUniquePrepareForInput(); otherwise,
+ *    the function returns -1.
+ *
+ *    When using threads and unsorted output, the order of the bins
+ *    differs from that when using a single thread.
+ */
+int
+skUniqueSetThreads(
+    sk_unique_t        *uniq,
+    uint32_t            thread_count);
+
+/*
+ *  ok = skUniqueSetSpillPartitions(uniq, partition_count);
+ *
+ *    Specify how the unique object 'uniq' writes its bins to disk
+ *    when the hash table fills.  By default, or when
+ *    'partition_count' is 0, the table is sorted and written to a
+ *    temporary file, and the temporary files are merged when the bins
+ *    are read.  When 'partition_count' is 2 or more, each bin is
+ *    instead written unsorted to one of 'partition_count' temporary
+ *    files chosen by a hash of its key, and the iterator aggregates
+ *    each file separately in a new hash table.  A file whose bins do
+ *    not fit in memory is partitioned again.  This function must be
+ *    called before calling skUniquePrepareForInput(); otherwise, the
+ *    function returns -1.  The function also returns -1 when
+ *    'partition_count' is 1 or greater than SK_UNIQUE_MAX_PARTITIONS.
+ *
+ *    Partitioned spilling is not used when sorted output has been
+ *    requested, since the bins must then be sorted and merged.  When
+ *    spilling occurs, the order of the bins differs from that of a
+ *    run that does not spill.
+ */
+int
+skUniqueSetSpillPartitions(
+    sk_unique_t        *uniq,
+    uint32_t            partition_count);
+
+/*
+ *    The maximum partition count that may be passed to
+ *    skUniqueSetSpillPartitions().
+ */
+#define SK_UNIQUE_MAX_PARTITIONS  256
+
 /*
  *  ok = skUniqueSetFields(uniq, keys, distincts, values);
  *
@@ -0,0 +1,14 @@
+#! /usr/bin/perl -w
+# MD5: 65a1d2bc1eee21f9c6169cd35ab07dd0
+# TEST: ./rwstats --fields=dport --values=approx-distinct:sport,distinct:sport --threshold=1000 ../../tests/data.rwf
+
+use strict;
+use SiLKTests;
+
+my $rwstats = check_silk_app('rwstats');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwstats --fields=dport --values=approx-distinct:sport,distinct:sport --threshold=1000 $file{data}";
+my $md5 = "65a1d2bc1eee21f9c6169cd35ab07dd0";
+
+check_md5_output($md5, $cmd);
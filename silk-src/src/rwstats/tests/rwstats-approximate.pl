@@ -0,0 +1,14 @@
+#! /usr/bin/perl -w
+# MD5: 1542388d1299455360283a931885af41
+# TEST: ./rwstats --fields=sip --values=records --count=10 --approximate=1000 --ipv6-policy=ignore ../../tests/data.rwf
+
+use strict;
+use SiLKTests;
+
+my $rwstats = check_silk_app('rwstats');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwstats --fields=sip --values=records --count=10 --approximate=1000 --ipv6-policy=ignore $file{data}";
+my $md5 = "1542388d1299455360283a931885af41";
+
+check_md5_output($md5, $cmd);
@@ -0,0 +1,16 @@
+#! /usr/bin/perl -w
+# MD5: 499a406fbbe7dc73a8daa4c4e29ca858
+# TEST: ./rwstats --fields=dip --values=packets --count=20 --spill-partitions=4 --ipv6-policy=ignore ../../tests/data.rwf
+
+use strict;
+use SiLKTests;
+
+my $rwstats = check_silk_app('rwstats');
+my %file;
+$file{data} = get_data_or_exit77('data');
+$ENV{SILK_HASH_MAXMEM} = '2m';
+push @SiLKTests::DUMP_ENVVARS, 'SILK_HASH_MAXMEM';
+my $cmd = "$rwstats --fields=dip --values=packets --count=20 --spill-partitions=4 --ipv6-policy=ignore $file{data}";
+my $md5 = "499a406fbbe7dc73a8daa4c4e29ca858";
+
+check_md5_output($md5, $cmd);
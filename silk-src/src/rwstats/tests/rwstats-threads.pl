@@ -0,0 +1,14 @@
+#! /usr/bin/perl -w
+# MD5: 8e747b7016b22347edc525401f47b42a
+# TEST: ./rwstats --fields=sip --values=bytes --count=20 --threads=4 --ipv6-policy=ignore ../../tests/data.rwf
+
+use strict;
+use SiLKTests;
+
+my $rwstats = check_silk_app('rwstats');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwstats --fields=sip --values=bytes --count=20 --threads=4 --ipv6-policy=ignore $file{data}";
+my $md5 = "8e747b7016b22347edc525401f47b42a";
+
+check_md5_output($md5, $cmd);
@@ -0,0 +1,14 @@
+#! /usr/bin/perl -w
+# MD5: 2cfcbd78165e4e1baa4f480a01ddfc84
+# TEST: ./rwuniq --fields=dport --values=approx-distinct:sport,records --approx-precision=6 --sort-output ../../tests/data.rwf
+
+use strict;
+use SiLKTests;
+
+my $rwuniq = check_silk_app('rwuniq');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwuniq --fields=dport --values=approx-distinct:sport,records --approx-precision=6 --sort-output $file{data}";
+my $md5 = "2cfcbd78165e4e1baa4f480a01ddfc84";
+
+check_md5_output($md5, $cmd);
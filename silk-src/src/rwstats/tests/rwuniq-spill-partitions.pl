@@ -0,0 +1,16 @@
+#! /usr/bin/perl -w
+# MD5: 790a0cc85d4803ad12493e63118eaa97
+# TEST: ./rwuniq --fields=sip,dport --values=bytes,distinct:dip --spill-partitions=8 --no-title --ipv6-policy=ignore ../../tests/data.rwf | sort
+
+use strict;
+use SiLKTests;
+
+my $rwuniq = check_silk_app('rwuniq');
+my %file;
+$file{data} = get_data_or_exit77('data');
+$ENV{SILK_HASH_MAXMEM} = '2m';
+push @SiLKTests::DUMP_ENVVARS, 'SILK_HASH_MAXMEM';
+my $cmd = "$rwuniq --fields=sip,dport --values=bytes,distinct:dip --spill-partitions=8 --no-title --ipv6-policy=ignore $file{data} | sort";
+my $md5 = "790a0cc85d4803ad12493e63118eaa97";
+
+check_md5_output($md5, $cmd);
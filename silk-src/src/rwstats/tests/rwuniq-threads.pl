@@ -0,0 +1,14 @@
+#! /usr/bin/perl -w
+# MD5: c33d31f2c122ac454d70c21faca0eca6
+# TEST: ./rwuniq --fields=sip,dport --values=bytes,distinct:dip --sort-output --threads=3 --ipv6-policy=ignore ../../tests/data.rwf
+
+use strict;
+use SiLKTests;
+
+my $rwuniq = check_silk_app('rwuniq');
+my %file;
+$file{data} = get_data_or_exit77('data');
+my $cmd = "$rwuniq --fields=sip,dport --values=bytes,distinct:dip --sort-output --threads=3 --ipv6-policy=ignore $file{data}";
+my $md5 = "c33d31f2c122ac454d70c21faca0eca6";
+
+check_md5_output($md5, $cmd);